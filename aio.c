@@ -0,0 +1,347 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "aio.h"
+
+///////////////////////////////////
+//
+//
+// Ring
+//
+//
+///////////////////////////////////
+
+static int uring_setup(u32 entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, u32 opcode, const void *arg, u32 nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void ring_destroy(AioRing *ring) {
+  if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+  if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+  if (ring->fd >= 0) close(ring->fd);
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+static bool ring_create(AioRing *ring) {
+  memset(ring, 0, sizeof(*ring));
+
+  struct io_uring_params params = {0};
+  ring->fd = uring_setup(AIO_RING_ENTRIES, &params);
+  if (ring->fd < 0) {
+    ring->fd = -1;
+    return false;
+  }
+
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+  ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    ring->sq_ring_size = ring->cq_ring_size = CORE_MAX(ring->sq_ring_size, ring->cq_ring_size);
+  }
+
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+      IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED) {
+    ring->sq_ring = NULL;
+    ring_destroy(ring);
+    return false;
+  }
+
+  if (single_mmap) {
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+        IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED) {
+      ring->cq_ring = NULL;
+      ring_destroy(ring);
+      return false;
+    }
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+      IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    ring_destroy(ring);
+    return false;
+  }
+
+  u8 *sq = ring->sq_ring;
+  u8 *cq = ring->cq_ring;
+  ring->sq_head = (u32 *)(sq + params.sq_off.head);
+  ring->sq_tail = (u32 *)(sq + params.sq_off.tail);
+  ring->sq_mask = *(u32 *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (u32 *)(sq + params.sq_off.array);
+  ring->cq_head = (u32 *)(cq + params.cq_off.head);
+  ring->cq_tail = (u32 *)(cq + params.cq_off.tail);
+  ring->cq_mask = *(u32 *)(cq + params.cq_off.ring_mask);
+  ring->cqes = cq + params.cq_off.cqes;
+
+  return true;
+}
+
+///////////////////////////////////
+//
+//
+// File
+//
+//
+///////////////////////////////////
+
+static u8 *buffer(AsyncFile *file, u32 idx) {
+  return file->buffers + (u64)idx * AIO_BUFFER_SIZE;
+}
+
+static void fail(AsyncFile *file, int error) {
+  if (!file->failed) {
+    file->failed = true;
+    file->error = error;
+  }
+}
+
+static bool pwrite_all(int fd, const u8 *data, u64 size, u64 offset) {
+  while (size > 0) {
+    ssize_t n = pwrite(fd, data, size, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+static void complete(AsyncFile *file, u32 idx, i32 res) {
+  file->in_flight[idx] = false;
+  file->in_flight_count--;
+
+  if (res < 0) {
+    fail(file, -res);
+  } else if ((u32)res < file->lens[idx] && !file->failed) {
+    // short writes are rare enough to finish in place
+    if (!pwrite_all(file->fd, buffer(file, idx) + res, file->lens[idx] - res, file->offsets[idx] + res)) {
+      fail(file, errno);
+    }
+  }
+  file->lens[idx] = 0;
+}
+
+static void reap(AsyncFile *file) {
+  AioRing *ring = &file->ring;
+  u32 head = *ring->cq_head;
+  u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+  while (head != tail) {
+    struct io_uring_cqe *cqe = (struct io_uring_cqe *)ring->cqes + (head & ring->cq_mask);
+    complete(file, (u32)cqe->user_data, cqe->res);
+    head++;
+  }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Takes back the writes the kernel hasn't picked up from the submission queue,
+// they'll never complete.
+static void drop_unsubmitted(AsyncFile *file) {
+  AioRing *ring = &file->ring;
+  u32 head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  u32 tail = *ring->sq_tail;
+
+  for (u32 i = head; i != tail; i++) {
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)ring->sqes + ring->sq_array[i & ring->sq_mask];
+    u32 idx = (u32)sqe->user_data;
+    file->in_flight[idx] = false;
+    file->in_flight_count--;
+    file->lens[idx] = 0;
+  }
+
+  __atomic_store_n(ring->sq_tail, head, __ATOMIC_RELEASE);
+  ring->to_submit = 0;
+}
+
+// Submits what's queued, waiting for `wait_for` writes to complete.
+static void enter(AsyncFile *file, u32 wait_for) {
+  AioRing *ring = &file->ring;
+
+  while (ring->to_submit > 0 || wait_for > 0) {
+    u32 flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int submitted = uring_enter(ring->fd, ring->to_submit, wait_for, flags);
+    if (submitted < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+        reap(file);
+        continue;
+      }
+      // nothing queued will complete, the writes are lost
+      fail(file, errno);
+      drop_unsubmitted(file);
+      break;
+    }
+    ring->to_submit -= CORE_MIN((u32)submitted, ring->to_submit);
+
+    u32 before = file->in_flight_count;
+    reap(file);
+    u32 reaped = before - file->in_flight_count;
+    wait_for -= CORE_MIN(reaped, wait_for);
+  }
+  reap(file);
+}
+
+static void queue(AsyncFile *file, u32 idx) {
+  AioRing *ring = &file->ring;
+  u32 tail = *ring->sq_tail;
+  u32 slot = tail & ring->sq_mask;
+
+  struct io_uring_sqe *sqe = (struct io_uring_sqe *)ring->sqes + slot;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = file->backend == AIO_BACKEND_URING_FIXED ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->fd = file->fd;
+  sqe->addr = (u64)(uptr)buffer(file, idx);
+  sqe->len = file->lens[idx];
+  sqe->off = file->offsets[idx];
+  sqe->buf_index = (u16)idx;
+  sqe->user_data = idx;
+
+  ring->sq_array[slot] = slot;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->to_submit++;
+
+  file->in_flight[idx] = true;
+  file->in_flight_count++;
+}
+
+// Writes out the buffer being filled and moves on to a free one.
+static void flush_current(AsyncFile *file) {
+  u32 idx = file->current;
+  if (file->lens[idx] == 0) return;
+
+  if (file->backend == AIO_BACKEND_PWRITE) {
+    if (!file->failed && !pwrite_all(file->fd, buffer(file, idx), file->lens[idx], file->offsets[idx])) {
+      fail(file, errno);
+    }
+    file->lens[idx] = 0;
+    return;
+  }
+
+  queue(file, idx);
+  // the ring has an entry per buffer, so it's never full while one is free
+  enter(file, file->in_flight_count == AIO_BUFFER_COUNT ? 1 : 0);
+
+  for (u32 i = 1; i <= AIO_BUFFER_COUNT; i++) {
+    u32 next = (idx + i) % AIO_BUFFER_COUNT;
+    if (!file->in_flight[next]) {
+      file->current = next;
+      break;
+    }
+  }
+}
+
+bool aio_open(AsyncFile *file, const char *path) {
+  memset(file, 0, sizeof(*file));
+  file->ring.fd = -1;
+
+  file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (file->fd < 0) {
+    printf("[ERROR]: could not create \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  // page aligned, as registered buffers are pinned page by page
+  file->buffers = mmap(NULL, (u64)AIO_BUFFER_COUNT * AIO_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (file->buffers == MAP_FAILED) {
+    printf("[FATAL] Failed to allocate memory for output buffers\n");
+    exit(1);
+  }
+
+  const char *disabled = getenv("C2048_NO_IO_URING");
+  file->backend = AIO_BACKEND_PWRITE;
+  if (!(disabled && *disabled) && ring_create(&file->ring)) {
+    file->backend = AIO_BACKEND_URING;
+
+    struct iovec iovs[AIO_BUFFER_COUNT];
+    for (u32 i = 0; i < AIO_BUFFER_COUNT; i++) {
+      iovs[i] = (struct iovec){.iov_base = buffer(file, i), .iov_len = AIO_BUFFER_SIZE};
+    }
+    if (uring_register(file->ring.fd, IORING_REGISTER_BUFFERS, iovs, AIO_BUFFER_COUNT) == 0) {
+      file->backend = AIO_BACKEND_URING_FIXED;
+    }
+  }
+
+  return true;
+}
+
+bool aio_write(AsyncFile *file, const void *data, u64 size) {
+  const u8 *p = data;
+  while (size > 0 && !file->failed) {
+    u32 idx = file->current;
+    if (file->lens[idx] == 0) {
+      file->offsets[idx] = file->offset;
+    }
+
+    u32 n = (u32)CORE_MIN(size, (u64)(AIO_BUFFER_SIZE - file->lens[idx]));
+    memcpy(buffer(file, idx) + file->lens[idx], p, n);
+    file->lens[idx] += n;
+    file->offset += n;
+    p += n;
+    size -= n;
+
+    if (file->lens[idx] == AIO_BUFFER_SIZE) {
+      flush_current(file);
+    }
+  }
+
+  return !file->failed;
+}
+
+bool aio_close(AsyncFile *file) {
+  flush_current(file);
+  if (file->backend != AIO_BACKEND_PWRITE) {
+    enter(file, file->in_flight_count);
+    ring_destroy(&file->ring);
+  }
+
+  if (close(file->fd) != 0) {
+    fail(file, errno);
+  }
+  munmap(file->buffers, (u64)AIO_BUFFER_COUNT * AIO_BUFFER_SIZE);
+
+  bool ok = !file->failed;
+  if (!ok) {
+    printf("[ERROR]: write failed: %s\n", strerror(file->error));
+  }
+  memset(file, 0, sizeof(*file));
+  file->fd = -1;
+
+  return ok;
+}
+
+const char *aio_backend_name(AioBackend backend) {
+  switch (backend) {
+    case AIO_BACKEND_PWRITE:
+      return "pwrite";
+    case AIO_BACKEND_URING:
+      return "io_uring";
+    case AIO_BACKEND_URING_FIXED:
+      return "io_uring, registered buffers";
+  }
+  return "?";
+}
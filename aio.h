@@ -0,0 +1,83 @@
+#pragma once
+
+#include "core.h"
+
+// Append-only output file written asynchronously with io_uring, for the
+// writers of high-volume self-play output (datasets, game record files).
+//
+// Writes are copied into one of AIO_BUFFER_COUNT buffers of AIO_BUFFER_SIZE
+// bytes, registered with the ring once when the file is opened. A full buffer
+// is queued as a write at its offset in the file and the caller goes on
+// filling the next one; the kernel is only entered once per buffer, to submit
+// what's queued and reap what's done, and only waited on when every buffer is
+// in flight. So a caller making many small writes costs a syscall per
+// AIO_BUFFER_SIZE bytes and never waits for the disk while a buffer is free.
+//
+// The ring is driven with the raw syscalls. Where io_uring isn't available
+// (old kernels, seccomp filters) or C2048_NO_IO_URING is set, full buffers
+// are written with pwrite() instead, and where the buffers can't be
+// registered (RLIMIT_MEMLOCK) they're written with plain, unregistered
+// io_uring writes.
+//
+// Not thread safe, one writer at a time.
+
+#define AIO_BUFFER_COUNT 8
+#define AIO_BUFFER_SIZE (512 << 10)
+#define AIO_RING_ENTRIES AIO_BUFFER_COUNT
+
+typedef enum AioBackend {
+  AIO_BACKEND_PWRITE,
+  AIO_BACKEND_URING,
+  // io_uring with the buffers registered, writes skip mapping them per call
+  AIO_BACKEND_URING_FIXED,
+} AioBackend;
+
+typedef struct AioRing {
+  int fd;
+  void *sq_ring;
+  u64 sq_ring_size;
+  void *cq_ring;
+  u64 cq_ring_size;
+  void *sqes;
+  u64 sqes_size;
+
+  u32 *sq_head;
+  u32 *sq_tail;
+  u32 sq_mask;
+  u32 *sq_array;
+  u32 *cq_head;
+  u32 *cq_tail;
+  u32 cq_mask;
+  void *cqes;
+  // queued since the last io_uring_enter()
+  u32 to_submit;
+} AioRing;
+
+typedef struct AsyncFile {
+  int fd;
+  AioBackend backend;
+  AioRing ring;
+
+  u8 *buffers;
+  // per buffer: where it goes in the file and how much of it is filled
+  u64 offsets[AIO_BUFFER_COUNT];
+  u32 lens[AIO_BUFFER_COUNT];
+  bool in_flight[AIO_BUFFER_COUNT];
+  u32 in_flight_count;
+  // buffer being filled
+  u32 current;
+  // end of the data handed to aio_write()
+  u64 offset;
+  // set on the first failed write, later writes are dropped
+  bool failed;
+  int error;
+} AsyncFile;
+
+// Creates (truncates) the file at `path`.
+bool aio_open(AsyncFile *file, const char *path);
+// Appends `size` bytes. False once a write has failed.
+bool aio_write(AsyncFile *file, const void *data, u64 size);
+// Writes what's buffered, waits for every write and closes the file. False if
+// any write failed.
+bool aio_close(AsyncFile *file);
+const char *aio_backend_name(AioBackend backend);
@@ -0,0 +1,305 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "record.h"
+#include "search.h"
+#include "timer.h"
+
+// Annotates every position of a game record file with the move the
+// expectimax search prefers and how much expected value the move actually
+// played gave up. Games are read a batch at a time, the positions of a batch
+// are searched in parallel against one shared transposition table (persisted
+// with -t) and written back in game order, so memory stays bounded whatever
+// the size of the corpus.
+//
+// Output, one line per position:
+//
+//   <seed> <ply> <board> <played> <best> <value played> <value best> <loss>
+//
+// where values are in the units of the search's evaluation and the loss is
+// their difference.
+
+#define ANNOTATE_DEFAULT_BATCH_GAMES 64
+// positions a thread takes at a time, neighbours share most of their subtrees
+#define ANNOTATE_GRAIN 8
+
+typedef struct Annotation {
+  Board board;
+  u64 seed;
+  u32 ply;
+  MoveDir played;
+  MoveDir best;
+  f32 value_played;
+  f32 value_best;
+} Annotation;
+
+typedef struct Annotator {
+  u32 depth;
+  u32 thread_count;
+  f32 blunder_ratio;
+  TransTable tt;
+
+  Annotation *positions;
+  u32 position_count;
+  u32 position_cap;
+  u32 next_position;
+
+  pthread_mutex_t stats_lock;
+  SearchStats stats;
+} Annotator;
+
+Annotator annotator = {0};
+
+void add_position(Annotation annotation) {
+  if (annotator.position_count >= annotator.position_cap) {
+    annotator.position_cap = annotator.position_cap ? annotator.position_cap * 2 : 4096;
+    Annotation *temp = realloc(annotator.positions, annotator.position_cap * sizeof(Annotation));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for positions\n");
+      exit(1);
+    }
+    annotator.positions = temp;
+  }
+
+  annotator.positions[annotator.position_count++] = annotation;
+}
+
+// Adds every position of the game where a move was played. False if the
+// record isn't a legal game.
+bool add_game(const GameRecord *record) {
+  Rng rng;
+  rng_seed(&rng, record->seed);
+  Board b = board_new_game(&rng);
+
+  for (u32 i = 0; i < record->move_count; i++) {
+    MoveDir dir = record_get_move(record, i);
+    Board moved = board_move(b, dir, NULL);
+    if (moved == b) return false;
+
+    add_position((Annotation){.board = b, .seed = record->seed, .ply = i, .played = dir});
+    b = board_spawn_random_tile(moved, &rng);
+  }
+
+  return true;
+}
+
+void *annotate_thread(void *arg) {
+  CORE_UNUSED(arg);
+
+  Search search;
+  search_init(&search, &annotator.tt, annotator.depth);
+
+  for (;;) {
+    u32 first = __atomic_fetch_add(&annotator.next_position, ANNOTATE_GRAIN, __ATOMIC_RELAXED);
+    if (first >= annotator.position_count) break;
+
+    u32 last = CORE_MIN(first + ANNOTATE_GRAIN, annotator.position_count);
+    for (u32 i = first; i < last; i++) {
+      Annotation *pos = &annotator.positions[i];
+      f32 values[MOVE_DIR_COUNT];
+      pos->best = search_best_move(&search, pos->board, values);
+      pos->value_best = values[pos->best];
+      pos->value_played = values[pos->played];
+    }
+  }
+
+  pthread_mutex_lock(&annotator.stats_lock);
+  annotator.stats.nodes += search.stats.nodes;
+  annotator.stats.tt_probes += search.stats.tt_probes;
+  annotator.stats.tt_hits += search.stats.tt_hits;
+  pthread_mutex_unlock(&annotator.stats_lock);
+
+  return NULL;
+}
+
+void annotate_batch(void) {
+  annotator.next_position = 0;
+
+  pthread_t *threads = malloc(annotator.thread_count * sizeof(pthread_t));
+  for (u32 i = 0; i < annotator.thread_count; i++) {
+    pthread_create(&threads[i], NULL, annotate_thread, NULL);
+  }
+  for (u32 i = 0; i < annotator.thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+typedef struct Totals {
+  u64 games;
+  u64 positions;
+  u64 best_played;
+  u64 blunders;
+  f64 loss_sum;
+} Totals;
+
+bool write_batch(FILE *out, Totals *totals) {
+  for (u32 i = 0; i < annotator.position_count; i++) {
+    Annotation *pos = &annotator.positions[i];
+    f32 loss = pos->value_best - pos->value_played;
+    char hex[BOARD_HEX_LEN + 1];
+    board_to_hex(pos->board, hex);
+
+    if (fprintf(out, "%llu %u %s %c %c %.1f %.1f %.1f\n", (unsigned long long)pos->seed, pos->ply, hex,
+        move_dir_to_char(pos->played), move_dir_to_char(pos->best), pos->value_played, pos->value_best, loss) < 0) {
+      return false;
+    }
+
+    totals->positions++;
+    totals->loss_sum += loss;
+    totals->best_played += pos->played == pos->best;
+    totals->blunders += loss > annotator.blunder_ratio * fabsf(pos->value_best);
+  }
+
+  return true;
+}
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] <records>\n"
+      "\n"
+      "Annotates every position of a game record file (\"-\" reads stdin).\n"
+      "\n"
+      "options:\n"
+      "  -o <file>   annotated output (default stdout)\n"
+      "  -d <depth>  search depth in chance nodes (default: from the board)\n"
+      "  -t <file>   persistent transposition table, created if missing\n"
+      "  -m <MB>     size of a new transposition table (default %d)\n"
+      "  -j <count>  worker threads (default: number of cores)\n"
+      "  -g <count>  games read per batch (default %d)\n"
+      "  -b <ratio>  count moves losing more than this share of the best value as\n"
+      "              blunders (default 0.05)\n", prog, TT_DEFAULT_SIZE_MB, ANNOTATE_DEFAULT_BATCH_GAMES);
+}
+
+int main(int argc, char *argv[]) {
+  const char *out_path = NULL;
+  const char *tt_path = NULL;
+  u64 tt_size_mb = TT_DEFAULT_SIZE_MB;
+  u32 batch_games = ANNOTATE_DEFAULT_BATCH_GAMES;
+  annotator.thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+  annotator.blunder_ratio = 0.05f;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:d:t:m:j:g:b:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        out_path = optarg;
+        break;
+      case 'd':
+        annotator.depth = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        tt_path = optarg;
+        break;
+      case 'm':
+        tt_size_mb = CORE_MAX(1, strtoull(optarg, NULL, 10));
+        break;
+      case 'j':
+        annotator.thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'g':
+        batch_games = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'b':
+        annotator.blunder_ratio = strtof(optarg, NULL);
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind + 1 != argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  board_init_tables();
+  search_init_tables();
+  start_internal_timer();
+
+  RecordFileReader reader;
+  if (!record_file_open(&reader, argv[optind])) return 1;
+
+  FILE *out = out_path ? fopen(out_path, "w") : stdout;
+  if (!out) {
+    printf("[ERROR]: could not create \"%s\"\n", out_path);
+    return 1;
+  }
+
+  bool tt_ok = tt_path ? tt_open_file(&annotator.tt, tt_path, tt_size_mb, SEARCH_EVAL_VERSION)
+    : tt_create(&annotator.tt, tt_size_mb);
+  if (!tt_ok) return 1;
+  pthread_mutex_init(&annotator.stats_lock, NULL);
+
+  GameRecord record;
+  record_init(&record, 0);
+  Totals totals = {0};
+  u64 invalid_games = 0;
+  bool ok = true;
+  bool more = true;
+
+  while (more && ok) {
+    annotator.position_count = 0;
+    for (u32 g = 0; g < batch_games; g++) {
+      if (!record_file_next(&reader, &record)) {
+        more = false;
+        break;
+      }
+
+      // positions of an illegal game are dropped along with the game
+      u32 count_before = annotator.position_count;
+      if (!add_game(&record)) {
+        annotator.position_count = count_before;
+        invalid_games++;
+        continue;
+      }
+      totals.games++;
+    }
+
+    annotate_batch();
+    ok = write_batch(out, &totals);
+    fprintf(stderr, "\r%llu games, %llu positions, %.1fs", (unsigned long long)totals.games,
+        (unsigned long long)totals.positions, get_time());
+  }
+  fprintf(stderr, "\n");
+
+  if (reader.error) {
+    printf("[WARN] %s: stopped on a truncated record\n", argv[optind]);
+  }
+  if (invalid_games) {
+    printf("[WARN] skipped %llu games with illegal moves\n", (unsigned long long)invalid_games);
+  }
+  if (out != stdout && fclose(out) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    printf("[ERROR]: failed to write the annotations\n");
+  }
+
+  f64 div = totals.positions ? (f64)totals.positions : 1;
+  fprintf(stderr, "best move played %.1f%%, average loss %.2f, %llu blunders\n",
+      100.0 * (f64)totals.best_played / div, totals.loss_sum / div, (unsigned long long)totals.blunders);
+  fprintf(stderr, "%llu nodes, transposition table hits %.1f%% of %llu probes\n",
+      (unsigned long long)annotator.stats.nodes,
+      annotator.stats.tt_probes ? 100.0 * (f64)annotator.stats.tt_hits / (f64)annotator.stats.tt_probes : 0.0,
+      (unsigned long long)annotator.stats.tt_probes);
+
+  record_free(&record);
+  record_file_close(&reader);
+  tt_destroy(&annotator.tt);
+  free(annotator.positions);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,396 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.h"
+
+static bool pread_all(int fd, void *buf, u64 size, u64 offset) {
+  u8 *p = buf;
+  while (size > 0) {
+    ssize_t n = pread(fd, p, size, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+static bool pwrite_all(int fd, const void *buf, u64 size, u64 offset) {
+  const u8 *p = buf;
+  while (size > 0) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+static void add_entry(Archive *archive, ArchiveEntry entry) {
+  if (archive->entry_count >= archive->entry_cap) {
+    archive->entry_cap = archive->entry_cap ? archive->entry_cap * 2 : 1024;
+    ArchiveEntry *temp = realloc(archive->entries, archive->entry_cap * sizeof(ArchiveEntry));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for the archive index\n");
+      exit(1);
+    }
+    archive->entries = temp;
+  }
+
+  archive->entries[archive->entry_count++] = entry;
+}
+
+static int compare_entries(const void *a, const void *b) {
+  const ArchiveEntry *ea = a;
+  const ArchiveEntry *eb = b;
+  if (ea->id != eb->id) return (ea->id > eb->id) - (ea->id < eb->id);
+  return (ea->offset > eb->offset) - (ea->offset < eb->offset);
+}
+
+// Sorts the index and keeps only the last copy of a game added twice.
+static void sort_entries(Archive *archive) {
+  if (archive->sorted == archive->entry_count) return;
+
+  qsort(archive->entries, archive->entry_count, sizeof(ArchiveEntry), compare_entries);
+  u64 len = 0;
+  for (u64 i = 0; i < archive->entry_count; i++) {
+    if (len > 0 && archive->entries[len - 1].id == archive->entries[i].id) {
+      len--;
+    }
+    archive->entries[len++] = archive->entries[i];
+  }
+  archive->entry_count = len;
+  archive->sorted = len;
+}
+
+static bool read_index(Archive *archive, u64 file_size) {
+  if (file_size < ARCHIVE_HEADER_SIZE + ARCHIVE_TRAILER_SIZE) return false;
+
+  u8 trailer[ARCHIVE_TRAILER_SIZE];
+  if (!pread_all(archive->fd, trailer, sizeof(trailer), file_size - ARCHIVE_TRAILER_SIZE)) return false;
+
+  u64 index_offset;
+  u64 count;
+  u32 checksum;
+  memcpy(&index_offset, trailer, 8);
+  memcpy(&count, trailer + 8, 8);
+  memcpy(&checksum, trailer + 16, 4);
+  if (memcmp(trailer + 20, ARCHIVE_MAGIC, 4) != 0 || index_offset < ARCHIVE_HEADER_SIZE ||
+      count > file_size / ARCHIVE_INDEX_ENTRY_SIZE ||
+      index_offset + count * ARCHIVE_INDEX_ENTRY_SIZE + ARCHIVE_TRAILER_SIZE != file_size) {
+    return false;
+  }
+
+  u64 size = count * ARCHIVE_INDEX_ENTRY_SIZE;
+  u8 *index = malloc(CORE_MAX(1, size));
+  if (!index) {
+    printf("[FATAL] Failed to allocate memory for the archive index\n");
+    exit(1);
+  }
+  if (!pread_all(archive->fd, index, size, index_offset) ||
+      core_fnv_hash32(index, size, CORE_FNV_HASH32_INIT) != checksum) {
+    free(index);
+    return false;
+  }
+
+  for (u64 i = 0; i < count; i++) {
+    ArchiveEntry entry;
+    const u8 *p = index + i * ARCHIVE_INDEX_ENTRY_SIZE;
+    memcpy(&entry.id, p, 8);
+    memcpy(&entry.offset, p + 8, 8);
+    memcpy(&entry.size, p + 16, 4);
+    memcpy(&entry.segment, p + 20, 4);
+    add_entry(archive, entry);
+    archive->segment_count = CORE_MAX(archive->segment_count, entry.segment + 1);
+  }
+  free(index);
+
+  archive->sorted = archive->entry_count;
+  archive->data_end = index_offset;
+  return true;
+}
+
+// Rebuilds the index from the segments, for an archive without one.
+static void scan_segments(Archive *archive, u64 file_size) {
+  u64 offset = ARCHIVE_HEADER_SIZE;
+  u8 *data = NULL;
+
+  while (offset + ARCHIVE_SEGMENT_HEADER_SIZE <= file_size) {
+    u8 header[ARCHIVE_SEGMENT_HEADER_SIZE];
+    u32 game_count;
+    u32 size;
+    u32 checksum;
+    if (!pread_all(archive->fd, header, sizeof(header), offset)) break;
+    memcpy(&game_count, header + 4, 4);
+    memcpy(&size, header + 8, 4);
+    memcpy(&checksum, header + 12, 4);
+    if (memcmp(header, ARCHIVE_SEGMENT_MAGIC, 4) != 0 || size > ARCHIVE_SEGMENT_SIZE ||
+        offset + ARCHIVE_SEGMENT_HEADER_SIZE + size > file_size) {
+      break;
+    }
+
+    if (!data) data = malloc(ARCHIVE_SEGMENT_SIZE);
+    u64 data_offset = offset + ARCHIVE_SEGMENT_HEADER_SIZE;
+    if (!pread_all(archive->fd, data, size, data_offset)) break;
+    if (core_fnv_hash32(data, size, CORE_FNV_HASH32_INIT) != checksum) {
+      // its games are lost, the segments after it are still found
+      printf("[WARN] archive \"%s\": segment %u fails its checksum, its games are left out\n", archive->path,
+          archive->segment_count);
+      archive->segment_count++;
+      offset = data_offset + size;
+      continue;
+    }
+
+    u64 first = archive->entry_count;
+    u32 pos = 0;
+    bool valid = true;
+    for (u32 i = 0; i < game_count && valid; i++) {
+      ArchiveEntry entry = {.segment = archive->segment_count};
+      valid = pos + ARCHIVE_GAME_HEADER_SIZE <= size;
+      if (valid) {
+        memcpy(&entry.id, data + pos, 8);
+        memcpy(&entry.size, data + pos + 8, 4);
+        entry.offset = data_offset + pos + ARCHIVE_GAME_HEADER_SIZE;
+        pos += ARCHIVE_GAME_HEADER_SIZE;
+        valid = entry.size <= size - pos;
+        pos += entry.size;
+      }
+      if (valid) {
+        add_entry(archive, entry);
+      }
+    }
+    if (!valid || pos != size) {
+      archive->entry_count = first;
+      break;
+    }
+
+    archive->segment_count++;
+    offset = data_offset + size;
+  }
+
+  free(data);
+  archive->data_end = offset;
+  archive->sorted = 0;
+  sort_entries(archive);
+}
+
+bool archive_open(Archive *archive, const char *path, bool writable) {
+  memset(archive, 0, sizeof(*archive));
+  archive->path = path;
+  archive->writable = writable;
+
+  archive->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  struct stat st;
+  if (archive->fd < 0 || fstat(archive->fd, &st) != 0) {
+    printf("[ERROR]: could not open archive \"%s\": %s\n", path, strerror(errno));
+    if (archive->fd >= 0) close(archive->fd);
+    return false;
+  }
+
+  u8 header[ARCHIVE_HEADER_SIZE];
+  u32 version = ARCHIVE_VERSION;
+  if (st.st_size == 0 && writable) {
+    memcpy(header, ARCHIVE_MAGIC, 4);
+    memcpy(header + 4, &version, 4);
+    if (!pwrite_all(archive->fd, header, sizeof(header), 0)) {
+      printf("[ERROR]: could not write archive \"%s\": %s\n", path, strerror(errno));
+      close(archive->fd);
+      return false;
+    }
+    archive->data_end = ARCHIVE_HEADER_SIZE;
+  } else {
+    if (!pread_all(archive->fd, header, sizeof(header), 0) || memcmp(header, ARCHIVE_MAGIC, 4) != 0 ||
+        memcmp(header + 4, &version, 4) != 0) {
+      printf("[ERROR]: \"%s\" is not a version %d replay archive\n", path, ARCHIVE_VERSION);
+      close(archive->fd);
+      return false;
+    }
+
+    if (!read_index(archive, st.st_size)) {
+      printf("[WARN] archive \"%s\" has no valid index, rebuilding it from its segments\n", path);
+      archive->entry_count = 0;
+      archive->segment_count = 0;
+      scan_segments(archive, st.st_size);
+      if (archive->data_end < (u64)st.st_size && !writable) {
+        printf("[WARN] archive \"%s\" ends with %llu bytes that aren't a valid segment\n", path,
+            (unsigned long long)(st.st_size - archive->data_end));
+      }
+    }
+  }
+
+  if (writable) {
+    archive->segment = malloc(ARCHIVE_SEGMENT_SIZE);
+    if (!archive->segment) {
+      printf("[FATAL] Failed to allocate memory for an archive segment\n");
+      exit(1);
+    }
+  }
+
+  return true;
+}
+
+const ArchiveEntry *archive_find(const Archive *archive, u64 id) {
+  u64 lo = 0;
+  u64 hi = archive->sorted;
+  while (lo < hi) {
+    u64 mid = lo + (hi - lo) / 2;
+    if (archive->entries[mid].id < id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo < archive->sorted && archive->entries[lo].id == id ? &archive->entries[lo] : NULL;
+}
+
+bool archive_read(const Archive *archive, const ArchiveEntry *entry, u8 *out) {
+  if (!pread_all(archive->fd, out, entry->size, entry->offset)) {
+    printf("[ERROR]: could not read game %016llx of archive \"%s\"\n", (unsigned long long)entry->id, archive->path);
+    return false;
+  }
+  return true;
+}
+
+static void flush_segment(Archive *archive) {
+  if (archive->segment_games == 0) return;
+
+  u8 header[ARCHIVE_SEGMENT_HEADER_SIZE];
+  u32 checksum = core_fnv_hash32(archive->segment, archive->segment_len, CORE_FNV_HASH32_INIT);
+  memcpy(header, ARCHIVE_SEGMENT_MAGIC, 4);
+  memcpy(header + 4, &archive->segment_games, 4);
+  memcpy(header + 8, &archive->segment_len, 4);
+  memcpy(header + 12, &checksum, 4);
+
+  if (pwrite_all(archive->fd, header, sizeof(header), archive->data_end) &&
+      pwrite_all(archive->fd, archive->segment, archive->segment_len, archive->data_end + sizeof(header))) {
+    archive->data_end += sizeof(header) + archive->segment_len;
+    archive->segment_count++;
+  } else {
+    // its games were the last ones added, the index forgets them
+    printf("[ERROR]: could not write archive \"%s\": %s\n", archive->path, strerror(errno));
+    archive->entry_count -= archive->segment_games;
+    archive->failed = true;
+  }
+
+  archive->segment_len = 0;
+  archive->segment_games = 0;
+}
+
+void archive_add(Archive *archive, u64 id, const u8 *data, u32 size) {
+  if (archive->failed) return;
+  if (size > ARCHIVE_SEGMENT_SIZE - ARCHIVE_GAME_HEADER_SIZE) {
+    printf("[ERROR]: game %016llx is too large for an archive segment\n", (unsigned long long)id);
+    archive->failed = true;
+    return;
+  }
+  if (archive->segment_len + ARCHIVE_GAME_HEADER_SIZE + size > ARCHIVE_SEGMENT_SIZE) {
+    flush_segment(archive);
+  }
+
+  u8 *p = archive->segment + archive->segment_len;
+  memcpy(p, &id, 8);
+  memcpy(p + 8, &size, 4);
+  memcpy(p + ARCHIVE_GAME_HEADER_SIZE, data, size);
+
+  u64 offset = archive->data_end + ARCHIVE_SEGMENT_HEADER_SIZE + archive->segment_len + ARCHIVE_GAME_HEADER_SIZE;
+  add_entry(archive, (ArchiveEntry){.id = id, .offset = offset, .size = size, .segment = archive->segment_count});
+  archive->segment_len += ARCHIVE_GAME_HEADER_SIZE + size;
+  archive->segment_games++;
+}
+
+u32 archive_verify(const Archive *archive) {
+  u32 bad = 0;
+  u8 *data = malloc(ARCHIVE_SEGMENT_SIZE);
+  u64 offset = ARCHIVE_HEADER_SIZE;
+
+  for (u32 i = 0; offset < archive->data_end; i++) {
+    u8 header[ARCHIVE_SEGMENT_HEADER_SIZE];
+    u32 size = 0;
+    u32 checksum;
+    bool ok = pread_all(archive->fd, header, sizeof(header), offset) && memcmp(header, ARCHIVE_SEGMENT_MAGIC, 4) == 0;
+    if (ok) {
+      memcpy(&size, header + 8, 4);
+      memcpy(&checksum, header + 12, 4);
+      ok = size <= ARCHIVE_SEGMENT_SIZE && offset + sizeof(header) + size <= archive->data_end;
+    }
+    if (!ok) {
+      // the segments after it can't be found
+      printf("[ERROR]: %s: segment %u at offset %llu has a corrupt header\n", archive->path, i,
+          (unsigned long long)offset);
+      bad++;
+      break;
+    }
+
+    if (!pread_all(archive->fd, data, size, offset + sizeof(header)) ||
+        core_fnv_hash32(data, size, CORE_FNV_HASH32_INIT) != checksum) {
+      printf("[ERROR]: %s: segment %u at offset %llu fails its checksum\n", archive->path, i,
+          (unsigned long long)offset);
+      bad++;
+    }
+    offset += sizeof(header) + size;
+  }
+
+  free(data);
+  return bad;
+}
+
+static bool write_index(Archive *archive) {
+  u64 size = archive->entry_count * ARCHIVE_INDEX_ENTRY_SIZE;
+  u8 *index = malloc(size + ARCHIVE_TRAILER_SIZE);
+  if (!index) {
+    printf("[FATAL] Failed to allocate memory for the archive index\n");
+    exit(1);
+  }
+
+  for (u64 i = 0; i < archive->entry_count; i++) {
+    const ArchiveEntry *entry = &archive->entries[i];
+    u8 *p = index + i * ARCHIVE_INDEX_ENTRY_SIZE;
+    memcpy(p, &entry->id, 8);
+    memcpy(p + 8, &entry->offset, 8);
+    memcpy(p + 16, &entry->size, 4);
+    memcpy(p + 20, &entry->segment, 4);
+  }
+
+  u8 *trailer = index + size;
+  u32 checksum = core_fnv_hash32(index, size, CORE_FNV_HASH32_INIT);
+  memcpy(trailer, &archive->data_end, 8);
+  memcpy(trailer + 8, &archive->entry_count, 8);
+  memcpy(trailer + 16, &checksum, 4);
+  memcpy(trailer + 20, ARCHIVE_MAGIC, 4);
+
+  bool ok = pwrite_all(archive->fd, index, size + ARCHIVE_TRAILER_SIZE, archive->data_end) &&
+    ftruncate(archive->fd, archive->data_end + size + ARCHIVE_TRAILER_SIZE) == 0 && fsync(archive->fd) == 0;
+  free(index);
+  return ok;
+}
+
+bool archive_close(Archive *archive) {
+  bool ok = true;
+  if (archive->writable) {
+    flush_segment(archive);
+    sort_entries(archive);
+    // the index still points at the games that made it in
+    if (!write_index(archive) && !archive->failed) {
+      printf("[ERROR]: could not write the index of archive \"%s\": %s\n", archive->path, strerror(errno));
+      archive->failed = true;
+    }
+    ok = !archive->failed;
+  }
+
+  close(archive->fd);
+  free(archive->entries);
+  free(archive->segment);
+  memset(archive, 0, sizeof(*archive));
+  archive->fd = -1;
+
+  return ok;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "core.h"
+
+// Archive of many replays (replay.h) in one file, by game id (the seed).
+//
+// Games are appended in segments, each with a checksum of its data, and the
+// archive ends with an index of every game sorted by id. Opening reads the
+// trailer and the index only, and a game is read with a single pread() at the
+// offset the index gives. Adding games writes new segments over the old
+// index and a new index after them, so the data itself is never rewritten.
+// File layout, little endian:
+//
+//   header   "C2RA" u32 version
+//   segment  "C2SG" u32 game_count u32 data_size u32 fnv32 of the data, then
+//            per game: u64 id u32 size, the replay
+//   index    entry_count * (u64 id u64 offset u32 size u32 segment), sorted
+//            by id, `offset` being that of the replay in the file
+//   trailer  u64 index_offset u64 entry_count u32 fnv32 of the index "C2RA"
+//
+// An archive whose writer died before the index was written is opened by
+// walking the segments up to the first truncated one, and its index is
+// rebuilt from those that pass their checksum.
+
+#define ARCHIVE_MAGIC "C2RA"
+#define ARCHIVE_SEGMENT_MAGIC "C2SG"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 8
+#define ARCHIVE_SEGMENT_HEADER_SIZE 16
+#define ARCHIVE_GAME_HEADER_SIZE 12
+#define ARCHIVE_INDEX_ENTRY_SIZE 24
+#define ARCHIVE_TRAILER_SIZE 24
+// data of a segment, written in one go once full
+#define ARCHIVE_SEGMENT_SIZE (4 << 20)
+
+typedef struct ArchiveEntry {
+  u64 id;
+  u64 offset;
+  u32 size;
+  u32 segment;
+} ArchiveEntry;
+
+typedef struct Archive {
+  const char *path;
+  int fd;
+  bool writable;
+  // sorted by id, unsorted past `sorted` while games are being added
+  ArchiveEntry *entries;
+  u64 entry_count;
+  u64 entry_cap;
+  u64 sorted;
+  // end of the last segment, where the next one goes
+  u64 data_end;
+  u32 segment_count;
+
+  // segment being filled by archive_add()
+  u8 *segment;
+  u32 segment_len;
+  u32 segment_games;
+  bool failed;
+} Archive;
+
+// Opens the archive at `path`. With `writable` it's created when it doesn't
+// exist and games can be added.
+bool archive_open(Archive *archive, const char *path, bool writable);
+// The game with `id`, NULL if there's none.
+const ArchiveEntry *archive_find(const Archive *archive, u64 id);
+// Reads the replay of `entry` into `out`, which holds entry->size bytes.
+bool archive_read(const Archive *archive, const ArchiveEntry *entry, u8 *out);
+// Adds a replay. A game already in the archive under `id` is replaced, its
+// old copy stays in its segment. Nothing is added after a write failed.
+void archive_add(Archive *archive, u64 id, const u8 *data, u32 size);
+// Reads every segment and checks its checksum. The number of bad segments, a
+// corrupt segment header stops the walk.
+u32 archive_verify(const Archive *archive);
+// Writes the last segment and the index and syncs them. False if any game
+// added since it was opened couldn't be written.
+bool archive_close(Archive *archive);
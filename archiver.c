@@ -0,0 +1,287 @@
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "replay.h"
+
+// Packs replay files into an archive (archive.h) and gets them back out.
+//
+// Adding takes replay files and directories of them. Every finished replay
+// is added under its seed, unfinished ones (games still being played) are
+// left alone. With -r the files are deleted once the archive holding them is
+// synced.
+
+typedef enum ArchiverMode {
+  ARCHIVER_ADD,
+  ARCHIVER_LIST,
+  ARCHIVER_EXTRACT,
+  ARCHIVER_CHECK,
+} ArchiverMode;
+
+typedef struct Archiver {
+  Archive archive;
+  bool remove_files;
+  // read into, grown to the largest replay
+  u8 *buf;
+  u64 buf_cap;
+
+  // added files, deleted with -r
+  char **added;
+  u64 added_count;
+  u64 added_cap;
+  u64 skipped;
+} Archiver;
+
+Archiver archiver = {0};
+
+// Reads the whole file at `path` into archiver.buf. Returns its size, or
+// U64_MAX when it can't be read.
+u64 read_file(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  struct stat st;
+  if (!fp || fstat(fileno(fp), &st) != 0) {
+    printf("[WARN] skipped \"%s\": %s\n", path, strerror(errno));
+    if (fp) fclose(fp);
+    return U64_MAX;
+  }
+
+  u64 size = st.st_size;
+  if (size > archiver.buf_cap) {
+    archiver.buf_cap = CORE_MAX(size, archiver.buf_cap * 2);
+    u8 *temp = realloc(archiver.buf, archiver.buf_cap);
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for a replay\n");
+      exit(1);
+    }
+    archiver.buf = temp;
+  }
+
+  bool ok = size == 0 || fread(archiver.buf, size, 1, fp) == 1;
+  fclose(fp);
+  if (!ok) {
+    printf("[WARN] skipped \"%s\": could not read it\n", path);
+    return U64_MAX;
+  }
+  return size;
+}
+
+void add_replay(const char *path) {
+  u64 size = read_file(path);
+  if (size == U64_MAX) {
+    archiver.skipped++;
+    return;
+  }
+
+  ReplayHeader header;
+  if (size < REPLAY_HEADER_SIZE || !replay_decode_header(archiver.buf, &header)) {
+    printf("[WARN] skipped \"%s\": not a replay\n", path);
+    archiver.skipped++;
+    return;
+  }
+  if (header.move_count == REPLAY_UNFINISHED) {
+    printf("[WARN] skipped \"%s\": the game isn't finished\n", path);
+    archiver.skipped++;
+    return;
+  }
+
+  archive_add(&archiver.archive, header.seed, archiver.buf, (u32)size);
+
+  if (archiver.remove_files) {
+    if (archiver.added_count >= archiver.added_cap) {
+      archiver.added_cap = archiver.added_cap ? archiver.added_cap * 2 : 1024;
+      char **temp = realloc(archiver.added, archiver.added_cap * sizeof(char *));
+      if (!temp) {
+        printf("[FATAL] Failed to reallocate memory for file names\n");
+        exit(1);
+      }
+      archiver.added = temp;
+    }
+    archiver.added[archiver.added_count++] = strdup(path);
+  }
+}
+
+void add_path(const char *path) {
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+      printf("[WARN] skipped \"%s\": %s\n", path, strerror(errno));
+      return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+      size_t len = strlen(ent->d_name);
+      if (len < 5 || strcmp(ent->d_name + len - 5, ".c2rp") != 0) continue;
+
+      char file[4096];
+      snprintf(file, sizeof(file), "%s/%s", path, ent->d_name);
+      add_replay(file);
+    }
+    closedir(dir);
+  } else {
+    add_replay(path);
+  }
+}
+
+bool add_replays(char **paths, u32 count) {
+  u64 before = archiver.archive.entry_count;
+  for (u32 i = 0; i < count; i++) {
+    add_path(paths[i]);
+  }
+
+  u64 added = archiver.archive.entry_count - before;
+  bool ok = archive_close(&archiver.archive);
+  if (ok) {
+    for (u64 i = 0; i < archiver.added_count; i++) {
+      unlink(archiver.added[i]);
+    }
+  }
+  for (u64 i = 0; i < archiver.added_count; i++) {
+    free(archiver.added[i]);
+  }
+  free(archiver.added);
+
+  fprintf(stderr, "%llu replays added, %llu skipped%s\n", (unsigned long long)added,
+      (unsigned long long)archiver.skipped, ok && archiver.remove_files ? ", files removed" : "");
+  return ok;
+}
+
+void list_games(void) {
+  const Archive *archive = &archiver.archive;
+  printf("%-16s %10s %10s %8s\n", "# id", "moves", "score", "bytes");
+
+  u8 header_bytes[REPLAY_HEADER_SIZE];
+  for (u64 i = 0; i < archive->entry_count; i++) {
+    const ArchiveEntry *entry = &archive->entries[i];
+    ReplayHeader header;
+    ArchiveEntry head = *entry;
+    head.size = CORE_MIN(entry->size, REPLAY_HEADER_SIZE);
+    if (head.size == REPLAY_HEADER_SIZE && archive_read(archive, &head, header_bytes) &&
+        replay_decode_header(header_bytes, &header)) {
+      printf("%016llx %10u %10u %8u\n", (unsigned long long)entry->id, header.move_count, header.score, entry->size);
+    } else {
+      printf("%016llx %10s %10s %8u\n", (unsigned long long)entry->id, "?", "?", entry->size);
+    }
+  }
+}
+
+bool extract_game(u64 id, const char *output_path) {
+  const ArchiveEntry *entry = archive_find(&archiver.archive, id);
+  if (!entry) {
+    printf("[ERROR]: archive \"%s\" has no game %016llx\n", archiver.archive.path, (unsigned long long)id);
+    return false;
+  }
+
+  u8 *data = malloc(CORE_MAX(1, entry->size));
+  bool ok = archive_read(&archiver.archive, entry, data);
+
+  FILE *fp = stdout;
+  if (ok && output_path) {
+    fp = fopen(output_path, "wb");
+    if (!fp) {
+      printf("[ERROR]: could not create \"%s\": %s\n", output_path, strerror(errno));
+      ok = false;
+    }
+  }
+  if (ok) {
+    ok = fwrite(data, entry->size, 1, fp) == 1;
+    ok = (fp == stdout ? fflush(fp) : fclose(fp)) == 0 && ok;
+    if (!ok) {
+      fprintf(stderr, "[ERROR]: could not write game %016llx\n", (unsigned long long)id);
+    }
+  }
+
+  free(data);
+  return ok;
+}
+
+void print_usage(const char *prog) {
+  printf("usage: %s [-r] <archive> <replay file or directory>...\n"
+      "       %s -l <archive>\n"
+      "       %s -x <id> [-o <file>] <archive>\n"
+      "       %s -c <archive>\n"
+      "\n"
+      "Adds finished replays to an archive by seed, or lists, extracts or checks\n"
+      "the games of one.\n"
+      "\n"
+      "options:\n"
+      "  -r          delete the replay files once they're archived\n"
+      "  -l          list every game: id, moves, score and size\n"
+      "  -x <id>     write the replay of game <id> (hex) to stdout, or -o\n"
+      "  -o <file>   where -x writes the replay\n"
+      "  -c          check the checksum of every segment\n", prog, prog, prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+  ArchiverMode mode = ARCHIVER_ADD;
+  u64 extract_id = 0;
+  const char *output_path = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "rlx:o:ch")) != -1) {
+    switch (opt) {
+      case 'r':
+        archiver.remove_files = true;
+        break;
+      case 'l':
+        mode = ARCHIVER_LIST;
+        break;
+      case 'x':
+        mode = ARCHIVER_EXTRACT;
+        extract_id = strtoull(optarg, NULL, 16);
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'c':
+        mode = ARCHIVER_CHECK;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  bool adding = mode == ARCHIVER_ADD;
+  if (optind >= argc || (adding && optind + 1 >= argc) || (!adding && optind + 1 != argc)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (!archive_open(&archiver.archive, argv[optind], adding)) {
+    return 1;
+  }
+
+  bool ok = true;
+  u32 bad_segments;
+  switch (mode) {
+    case ARCHIVER_ADD:
+      ok = add_replays(argv + optind + 1, (u32)(argc - optind - 1));
+      break;
+    case ARCHIVER_LIST:
+      list_games();
+      break;
+    case ARCHIVER_EXTRACT:
+      ok = extract_game(extract_id, output_path);
+      break;
+    case ARCHIVER_CHECK:
+      bad_segments = archive_verify(&archiver.archive);
+      fprintf(stderr, "%llu games, %u bad segments\n", (unsigned long long)archiver.archive.entry_count,
+          bad_segments);
+      ok = bad_segments == 0;
+      break;
+  }
+
+  if (!adding) {
+    archive_close(&archiver.archive);
+  }
+  free(archiver.buf);
+
+  return ok ? 0 : 1;
+}
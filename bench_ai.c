@@ -0,0 +1,478 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mcts.h"
+#include "ntuple.h"
+#include "player.h"
+#include "search.h"
+#include "timer.h"
+
+// Plays every built-in AI on the same frozen list of seeds and reports its
+// strength and speed, as a table and optionally as JSON for tracking
+// regressions between builds.
+//
+// Every AI is deterministic given the seed of a game: the random and Monte
+// Carlo players draw from an Rng seeded by it, and expectimax searches start
+// every game with an empty transposition table. The results therefore only
+// change when the engine or an AI does, the timings aside.
+
+// the seed list is generated from this, never change it or old results stop
+// being comparable
+#define BENCH_SEED_SET 0x2048BE4C5EED0001ULL
+#define BENCH_RESULTS_VERSION 1
+#define BENCH_TT_SIZE_MB 16
+
+typedef enum BenchAiKind {
+  BENCH_AI_RANDOM,
+  BENCH_AI_GREEDY,
+  BENCH_AI_EXPECTIMAX,
+  BENCH_AI_MCTS,
+  BENCH_AI_NTUPLE,
+} BenchAiKind;
+
+typedef struct GameResult {
+  u32 score;
+  u32 moves;
+  u8 max_exponent;
+} GameResult;
+
+typedef struct LatencyList {
+  u32 *data;
+  u64 size;
+  u64 capacity;
+} LatencyList;
+
+typedef struct BenchAi {
+  char name[32];
+  BenchAiKind kind;
+  u32 depth;
+  // Monte Carlo playouts follow the policy model (-m)
+  bool policy_playouts;
+
+  GameResult *results;
+  // nanoseconds spent choosing each move, over every game
+  LatencyList latencies;
+  pthread_mutex_t lock;
+  u32 next_game;
+} BenchAi;
+
+typedef struct Bench {
+  u64 *seeds;
+  u32 seed_count;
+  u32 thread_count;
+  u32 mcts_playouts;
+  NTupleNet *ntuple;
+  PolicyModel *policy;
+  BenchAi *ais;
+  u32 ai_count;
+} Bench;
+
+Bench bench = {0};
+
+static u64 now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+void add_latency(LatencyList *list, u32 ns) {
+  if (list->size >= list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 4096;
+    u32 *temp = realloc(list->data, list->capacity * sizeof(u32));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for move latencies\n");
+      exit(1);
+    }
+    list->data = temp;
+  }
+
+  list->data[list->size++] = ns;
+}
+
+///////////////////////////////////
+//
+//
+// Games
+//
+//
+///////////////////////////////////
+
+// What one thread needs to play games with an AI.
+typedef struct AiState {
+  Player player;
+  Search search;
+  TransTable tt;
+  Mcts mcts;
+} AiState;
+
+MoveDir choose_move(BenchAi *ai, AiState *state, Board b) {
+  switch (ai->kind) {
+    case BENCH_AI_RANDOM:
+    case BENCH_AI_GREEDY:
+      return player_choose_move(&state->player, b);
+    case BENCH_AI_EXPECTIMAX:
+      return search_best_move(&state->search, b, NULL);
+    case BENCH_AI_MCTS:
+      return mcts_choose_move(&state->mcts, b);
+    case BENCH_AI_NTUPLE:
+      return ntuple_choose_move(bench.ntuple, b);
+  }
+
+  return player_choose_move(&state->player, b);
+}
+
+void play_game(BenchAi *ai, AiState *state, u32 game_idx, LatencyList *latencies) {
+  u64 seed = bench.seeds[game_idx];
+  player_init(&state->player, ai->kind == BENCH_AI_RANDOM ? PLAYER_RANDOM : PLAYER_GREEDY, seed);
+  mcts_init(&state->mcts, seed);
+  state->mcts.playouts = bench.mcts_playouts;
+  state->mcts.policy = ai->policy_playouts ? bench.policy : NULL;
+  if (ai->kind == BENCH_AI_EXPECTIMAX) {
+    tt_clear(&state->tt);
+  }
+
+  Rng rng;
+  rng_seed(&rng, seed);
+  Board b = board_new_game(&rng);
+  GameResult result = {0};
+
+  while (!board_is_game_over(b)) {
+    u64 start = now_ns();
+    MoveDir dir = choose_move(ai, state, b);
+    add_latency(latencies, (u32)CORE_MIN(now_ns() - start, U32_MAX));
+
+    b = board_move(b, dir, &result.score);
+    b = board_spawn_random_tile(b, &rng);
+    result.moves++;
+  }
+
+  result.max_exponent = board_max_exponent(b);
+  ai->results[game_idx] = result;
+  player_deinit(&state->player);
+}
+
+void *bench_thread(void *arg) {
+  BenchAi *ai = arg;
+
+  AiState state = {0};
+  if (ai->kind == BENCH_AI_EXPECTIMAX) {
+    // a thread without a table would leave its games zeroed in the results
+    if (!tt_create(&state.tt, BENCH_TT_SIZE_MB)) {
+      printf("[FATAL] Failed to allocate the transposition table of %s\n", ai->name);
+      exit(1);
+    }
+    search_init(&state.search, &state.tt, ai->depth);
+  }
+
+  LatencyList latencies = {0};
+  for (;;) {
+    u32 game_idx = __atomic_fetch_add(&ai->next_game, 1, __ATOMIC_RELAXED);
+    if (game_idx >= bench.seed_count) break;
+
+    latencies.size = 0;
+    play_game(ai, &state, game_idx, &latencies);
+
+    pthread_mutex_lock(&ai->lock);
+    for (u64 i = 0; i < latencies.size; i++) {
+      add_latency(&ai->latencies, latencies.data[i]);
+    }
+    pthread_mutex_unlock(&ai->lock);
+  }
+
+  free(latencies.data);
+  if (ai->kind == BENCH_AI_EXPECTIMAX) {
+    tt_destroy(&state.tt);
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////
+//
+//
+// Reporting
+//
+//
+///////////////////////////////////
+
+typedef struct Summary {
+  u32 games;
+  f64 avg_score;
+  u32 max_score;
+  f64 rate_2048;
+  f64 rate_4096;
+  f64 rate_8192;
+  u64 moves;
+  f64 moves_per_sec;
+  f64 p50_us;
+  f64 p99_us;
+} Summary;
+
+int compare_u32(const void *a, const void *b) {
+  u32 x = *(const u32 *)a;
+  u32 y = *(const u32 *)b;
+  return (x > y) - (x < y);
+}
+
+f64 percentile_us(const LatencyList *sorted, f64 p) {
+  if (sorted->size == 0) return 0;
+  u64 idx = (u64)(p * (f64)(sorted->size - 1) + 0.5);
+  return sorted->data[idx] / 1000.0;
+}
+
+Summary summarize(BenchAi *ai) {
+  Summary s = {.games = bench.seed_count};
+  u64 score_sum = 0;
+  u32 reached[3] = {0};
+
+  for (u32 i = 0; i < bench.seed_count; i++) {
+    GameResult *r = &ai->results[i];
+    score_sum += r->score;
+    s.max_score = CORE_MAX(s.max_score, r->score);
+    s.moves += r->moves;
+    for (u32 t = 0; t < 3; t++) {
+      reached[t] += r->max_exponent >= 11 + t;
+    }
+  }
+
+  f64 div = bench.seed_count ? bench.seed_count : 1;
+  s.avg_score = (f64)score_sum / div;
+  s.rate_2048 = reached[0] / div;
+  s.rate_4096 = reached[1] / div;
+  s.rate_8192 = reached[2] / div;
+
+  // throughput of a single thread: moves over the time spent choosing them
+  u64 think_ns = 0;
+  for (u64 i = 0; i < ai->latencies.size; i++) {
+    think_ns += ai->latencies.data[i];
+  }
+  s.moves_per_sec = think_ns ? (f64)ai->latencies.size * 1e9 / (f64)think_ns : 0;
+
+  qsort(ai->latencies.data, ai->latencies.size, sizeof(u32), compare_u32);
+  s.p50_us = percentile_us(&ai->latencies, 0.50);
+  s.p99_us = percentile_us(&ai->latencies, 0.99);
+
+  return s;
+}
+
+void print_table(const Summary *summaries) {
+  printf("\n%-16s %6s %10s %10s %7s %7s %7s %10s %12s %10s %10s\n", "ai", "games", "avg score", "max score",
+      "2048%", "4096%", "8192%", "moves", "moves/s", "p50 us", "p99 us");
+
+  for (u32 a = 0; a < bench.ai_count; a++) {
+    const Summary *s = &summaries[a];
+    printf("%-16s %6u %10.1f %10u %6.1f%% %6.1f%% %6.1f%% %10llu %12.0f %10.2f %10.2f\n", bench.ais[a].name,
+        s->games, s->avg_score, s->max_score, s->rate_2048 * 100, s->rate_4096 * 100, s->rate_8192 * 100,
+        (unsigned long long)s->moves, s->moves_per_sec, s->p50_us, s->p99_us);
+  }
+}
+
+bool write_json(const char *path, const Summary *summaries) {
+  FILE *fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (!fp) {
+    printf("[ERROR]: could not create \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"version\": %d,\n", BENCH_RESULTS_VERSION);
+  fprintf(fp, "  \"seed_set\": \"%016llx\",\n", (unsigned long long)BENCH_SEED_SET);
+  fprintf(fp, "  \"games\": %u,\n", bench.seed_count);
+  fprintf(fp, "  \"ais\": [\n");
+  for (u32 a = 0; a < bench.ai_count; a++) {
+    const Summary *s = &summaries[a];
+    fprintf(fp, "    {\"name\": \"%s\", \"games\": %u, \"avg_score\": %.1f, \"max_score\": %u, "
+        "\"rate_2048\": %.4f, \"rate_4096\": %.4f, \"rate_8192\": %.4f, \"moves\": %llu, "
+        "\"moves_per_sec\": %.1f, \"latency_p50_us\": %.3f, \"latency_p99_us\": %.3f}%s\n",
+        bench.ais[a].name, s->games, s->avg_score, s->max_score, s->rate_2048, s->rate_4096, s->rate_8192,
+        (unsigned long long)s->moves, s->moves_per_sec, s->p50_us, s->p99_us, a + 1 < bench.ai_count ? "," : "");
+  }
+  fprintf(fp, "  ]\n}\n");
+
+  if (fp == stdout) return true;
+  if (fclose(fp) != 0) {
+    printf("[ERROR]: failed to write \"%s\"\n", path);
+    return false;
+  }
+  return true;
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+// "random", "greedy", "expectimax:<depth>", "mcts" or "ntuple"
+bool parse_ai(const char *spec, BenchAi *ai) {
+  memset(ai, 0, sizeof(*ai));
+  snprintf(ai->name, sizeof(ai->name), "%s", spec);
+
+  if (strcmp(spec, "random") == 0) {
+    ai->kind = BENCH_AI_RANDOM;
+  } else if (strcmp(spec, "greedy") == 0) {
+    ai->kind = BENCH_AI_GREEDY;
+  } else if (strncmp(spec, "expectimax:", 11) == 0) {
+    ai->kind = BENCH_AI_EXPECTIMAX;
+    ai->depth = (u32)strtoul(spec + 11, NULL, 10);
+    if (ai->depth == 0) {
+      printf("[ERROR]: \"%s\" needs a depth of at least 1\n", spec);
+      return false;
+    }
+  } else if (strcmp(spec, "mcts") == 0) {
+    ai->kind = BENCH_AI_MCTS;
+  } else if (strcmp(spec, "mcts:policy") == 0) {
+    ai->kind = BENCH_AI_MCTS;
+    ai->policy_playouts = true;
+  } else if (strcmp(spec, "ntuple") == 0) {
+    ai->kind = BENCH_AI_NTUPLE;
+  } else {
+    printf("[ERROR]: unknown AI \"%s\"\n", spec);
+    return false;
+  }
+
+  return true;
+}
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] [ai]...\n"
+      "\n"
+      "An AI is random, greedy, expectimax:<depth>, mcts, mcts:policy or ntuple.\n"
+      "By default random, greedy, expectimax:1, expectimax:2, expectimax:3 and\n"
+      "mcts are played, and ntuple too when -N is given. mcts:policy plays out\n"
+      "with the policy model of -m and orders the root moves by it.\n"
+      "\n"
+      "options:\n"
+      "  -n <count>  games per AI, the first seeds of the frozen list (default 20)\n"
+      "  -N <file>   n-tuple network weights (see c2048-ntuple-train)\n"
+      "  -m <file>   policy model (see c2048-policy-bench)\n"
+      "  -p <count>  Monte Carlo playouts per move (default %d)\n"
+      "  -j <count>  threads playing games (default 1, more inflate the latencies)\n"
+      "  -o <file>   write the results as JSON, - for stdout\n", prog, MCTS_DEFAULT_PLAYOUTS);
+}
+
+int main(int argc, char *argv[]) {
+  const char *json_path = NULL;
+  const char *ntuple_path = NULL;
+  const char *policy_path = NULL;
+  bench.seed_count = 20;
+  bench.thread_count = 1;
+  bench.mcts_playouts = MCTS_DEFAULT_PLAYOUTS;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:N:m:p:j:o:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        bench.seed_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'N':
+        ntuple_path = optarg;
+        break;
+      case 'm':
+        policy_path = optarg;
+        break;
+      case 'p':
+        bench.mcts_playouts = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'j':
+        bench.thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'o':
+        json_path = optarg;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  const char *default_ais[] = {"random", "greedy", "expectimax:1", "expectimax:2", "expectimax:3", "mcts", "ntuple"};
+  u32 ai_count = argc - optind;
+  if (ai_count == 0) {
+    ai_count = CORE_ARRAY_COUNT(default_ais) - (ntuple_path ? 0 : 1);
+  }
+
+  bench.ais = calloc(ai_count, sizeof(BenchAi));
+  for (u32 i = 0; i < ai_count; i++) {
+    const char *spec = optind < argc ? argv[optind + i] : default_ais[i];
+    if (!parse_ai(spec, &bench.ais[i])) return 1;
+    if (bench.ais[i].kind == BENCH_AI_NTUPLE && !ntuple_path) {
+      printf("[ERROR]: the ntuple AI needs weights (-N)\n");
+      return 1;
+    }
+    if (bench.ais[i].policy_playouts && !policy_path) {
+      printf("[ERROR]: the mcts:policy AI needs a policy model (-m)\n");
+      return 1;
+    }
+  }
+  bench.ai_count = ai_count;
+
+  board_init_tables();
+  search_init_tables();
+  start_internal_timer();
+
+  if (ntuple_path) {
+    bench.ntuple = malloc(sizeof(NTupleNet));
+    if (!ntuple_load(bench.ntuple, ntuple_path)) return 1;
+  }
+  if (policy_path) {
+    bench.policy = malloc(sizeof(PolicyModel));
+    if (!policy_load(bench.policy, policy_path)) return 1;
+  }
+
+  Rng seed_rng;
+  rng_seed(&seed_rng, BENCH_SEED_SET);
+  bench.seeds = malloc(bench.seed_count * sizeof(u64));
+  for (u32 i = 0; i < bench.seed_count; i++) {
+    bench.seeds[i] = rng_next(&seed_rng);
+  }
+
+  Summary *summaries = calloc(bench.ai_count, sizeof(Summary));
+  pthread_t *threads = malloc(bench.thread_count * sizeof(pthread_t));
+
+  for (u32 a = 0; a < bench.ai_count; a++) {
+    BenchAi *ai = &bench.ais[a];
+    ai->results = calloc(bench.seed_count, sizeof(GameResult));
+    pthread_mutex_init(&ai->lock, NULL);
+
+    // progress goes to stderr so that `-o -` stays valid JSON
+    fprintf(stderr, "%s...", ai->name);
+    f64 start = get_time();
+
+    for (u32 i = 0; i < bench.thread_count; i++) {
+      pthread_create(&threads[i], NULL, bench_thread, ai);
+    }
+    for (u32 i = 0; i < bench.thread_count; i++) {
+      pthread_join(threads[i], NULL);
+    }
+
+    fprintf(stderr, " %.1fs\n", get_time() - start);
+    summaries[a] = summarize(ai);
+  }
+
+  if (!json_path || strcmp(json_path, "-") != 0) {
+    print_table(summaries);
+  }
+  bool ok = !json_path || write_json(json_path, summaries);
+
+  for (u32 a = 0; a < bench.ai_count; a++) {
+    free(bench.ais[a].results);
+    free(bench.ais[a].latencies.data);
+    pthread_mutex_destroy(&bench.ais[a].lock);
+  }
+  free(bench.ais);
+  free(bench.seeds);
+  free(bench.ntuple);
+  free(bench.policy);
+  free(summaries);
+  free(threads);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+#include <stddef.h>
+
+#include "board.h"
+
+static bool tables_initialized = false;
+static u16 row_left_table[65536];
+static u16 row_right_table[65536];
+static u32 row_score_table[65536];
+
+///////////////////////////////////
+//
+//
+// Tables
+//
+//
+///////////////////////////////////
+
+static u16 reverse_row(u16 row) {
+  return (u16)((row >> 12) | ((row >> 4) & 0x00F0) | ((row << 4) & 0x0F00) | (row << 12));
+}
+
+static u16 slide_row_left(u16 row, u32 *score) {
+  u8 line[4] = {0};
+  u8 count = 0;
+  bool can_merge = false;
+
+  for (u8 i = 0; i < 4; i++) {
+    u8 tile = (row >> (i * 4)) & 0xF;
+    if (tile == 0) {
+      continue;
+    }
+
+    // two max tiles can't merge since the result doesn't fit in a nibble
+    if (can_merge && line[count - 1] == tile && tile < BOARD_MAX_EXPONENT) {
+      line[count - 1]++;
+      *score += 1u << line[count - 1];
+      can_merge = false;
+    } else {
+      line[count++] = tile;
+      can_merge = true;
+    }
+  }
+
+  return (u16)(line[0] | (line[1] << 4) | (line[2] << 8) | (line[3] << 12));
+}
+
+void board_init_tables(void) {
+  if (tables_initialized) return;
+
+  for (u32 row = 0; row < 65536; row++) {
+    u32 score = 0;
+    row_left_table[row] = slide_row_left((u16)row, &score);
+    row_score_table[row] = score;
+  }
+
+  // the right move of a row is the left move of the reversed row
+  for (u32 row = 0; row < 65536; row++) {
+    row_right_table[row] = reverse_row(row_left_table[reverse_row((u16)row)]);
+  }
+
+  tables_initialized = true;
+}
+
+///////////////////////////////////
+//
+//
+// Board
+//
+//
+///////////////////////////////////
+
+Board board_transpose(Board b) {
+  u64 a1 = b & 0xF0F00F0FF0F00F0FULL;
+  u64 a2 = b & 0x0000F0F00000F0F0ULL;
+  u64 a3 = b & 0x0F0F00000F0F0000ULL;
+  u64 a = a1 | (a2 << 12) | (a3 >> 12);
+  u64 b1 = a & 0xFF00FF0000FF00FFULL;
+  u64 b2 = a & 0x00FF00FF00000000ULL;
+  u64 b3 = a & 0x00000000FF00FF00ULL;
+  return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+static Board mirror_rows(Board b) {
+  return ((b & 0x000F000F000F000FULL) << 12) | ((b & 0x00F000F000F000F0ULL) << 4) |
+    ((b & 0x0F000F000F000F00ULL) >> 4) | ((b & 0xF000F000F000F000ULL) >> 12);
+}
+
+static Board mirror_columns(Board b) {
+  return (b << 48) | ((b << 16) & 0x0000FFFF00000000ULL) | ((b >> 16) & 0x00000000FFFF0000ULL) | (b >> 48);
+}
+
+Board board_canonical(Board b) {
+  Board best = b;
+  for (u8 i = 0; i < 2; i++) {
+    Board h = mirror_rows(b);
+    Board v = mirror_columns(b);
+    Board hv = mirror_columns(h);
+    best = CORE_MIN(best, CORE_MIN(CORE_MIN(b, h), CORE_MIN(v, hv)));
+    b = board_transpose(b);
+  }
+  return best;
+}
+
+static Board move_rows(Board b, const u16 *table, u32 *score) {
+  Board res = 0;
+  u32 gained = 0;
+
+  for (u8 i = 0; i < 4; i++) {
+    u16 row = (u16)(b >> (i * 16));
+    res |= (Board)table[row] << (i * 16);
+    gained += row_score_table[row];
+  }
+
+  if (score) {
+    *score += gained;
+  }
+
+  return res;
+}
+
+u8 board_get_tile(Board b, u8 x, u8 y) {
+  return (b >> ((y * 4 + x) * 4)) & 0xF;
+}
+
+Board board_set_tile(Board b, u8 x, u8 y, u8 exponent) {
+  u8 shift = (y * 4 + x) * 4;
+  return (b & ~((Board)0xF << shift)) | ((Board)(exponent & 0xF) << shift);
+}
+
+u8 board_count_empty(Board b) {
+  u8 count = 0;
+  for (u8 i = 0; i < 16; i++) {
+    if (((b >> (i * 4)) & 0xF) == 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+u8 board_max_exponent(Board b) {
+  u8 max = 0;
+  for (u8 i = 0; i < 16; i++) {
+    max = CORE_MAX(max, (u8)((b >> (i * 4)) & 0xF));
+  }
+  return max;
+}
+
+Board board_move(Board b, MoveDir dir, u32 *score) {
+  CORE_DEBUG_ASSERT(tables_initialized, "board_init_tables() must be called before moving");
+
+  switch (dir) {
+    case MOVE_DIR_LEFT:
+      return move_rows(b, row_left_table, score);
+    case MOVE_DIR_RIGHT:
+      return move_rows(b, row_right_table, score);
+    case MOVE_DIR_UP:
+      return board_transpose(move_rows(board_transpose(b), row_left_table, score));
+    case MOVE_DIR_DOWN:
+      return board_transpose(move_rows(board_transpose(b), row_right_table, score));
+  }
+
+  return b;
+}
+
+void board_move_many(const Board *boards, Board *out, u32 *scores, u32 count, MoveDir dir) {
+  CORE_DEBUG_ASSERT(tables_initialized, "board_init_tables() must be called before moving");
+
+  // the direction is resolved once for the whole batch instead of per board
+  const u16 *table = dir == MOVE_DIR_LEFT || dir == MOVE_DIR_UP ? row_left_table : row_right_table;
+  bool vertical = dir == MOVE_DIR_UP || dir == MOVE_DIR_DOWN;
+
+  for (u32 i = 0; i < count; i++) {
+    u32 gained = 0;
+    Board b = vertical ? board_transpose(boards[i]) : boards[i];
+    b = move_rows(b, table, &gained);
+    out[i] = vertical ? board_transpose(b) : b;
+    if (scores) {
+      scores[i] = gained;
+    }
+  }
+}
+
+u8 board_legal_moves(Board b) {
+  u8 mask = 0;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    if (board_move(b, dir, NULL) != b) {
+      mask |= 1 << dir;
+    }
+  }
+  return mask;
+}
+
+bool board_is_game_over(Board b) {
+  return board_legal_moves(b) == 0;
+}
+
+Board board_spawn_random_tile(Board b, Rng *rng) {
+  u8 empty = board_count_empty(b);
+  if (empty == 0) return b;
+
+  u32 target = rng_bounded(rng, empty);
+  u8 exponent = rng_bounded(rng, 10) < 9 ? 1 : 2;
+
+  for (u8 i = 0; i < 16; i++) {
+    if (((b >> (i * 4)) & 0xF) != 0) {
+      continue;
+    }
+
+    if (target == 0) {
+      return b | ((Board)exponent << (i * 4));
+    }
+    target--;
+  }
+
+  return b;
+}
+
+Board board_new_game(Rng *rng) {
+  Board b = 0;
+  for (int i = 0; i < 2; i++) {
+    b = board_spawn_random_tile(b, rng);
+  }
+  return b;
+}
+
+///////////////////////////////////
+//
+//
+// Text conversion
+//
+//
+///////////////////////////////////
+
+char move_dir_to_char(MoveDir dir) {
+  switch (dir) {
+    case MOVE_DIR_UP:
+      return 'u';
+    case MOVE_DIR_DOWN:
+      return 'd';
+    case MOVE_DIR_LEFT:
+      return 'l';
+    case MOVE_DIR_RIGHT:
+      return 'r';
+  }
+
+  return '?';
+}
+
+bool move_dir_from_char(char c, MoveDir *dir) {
+  switch (c) {
+    case 'u':
+    case 'U':
+      *dir = MOVE_DIR_UP;
+      return true;
+    case 'd':
+    case 'D':
+      *dir = MOVE_DIR_DOWN;
+      return true;
+    case 'l':
+    case 'L':
+      *dir = MOVE_DIR_LEFT;
+      return true;
+    case 'r':
+    case 'R':
+      *dir = MOVE_DIR_RIGHT;
+      return true;
+    default:
+      return false;
+  }
+}
+
+void board_to_hex(Board b, char *out) {
+  const char *digits = "0123456789abcdef";
+  for (u8 i = 0; i < 16; i++) {
+    out[i] = digits[(b >> (i * 4)) & 0xF];
+  }
+  out[BOARD_HEX_LEN] = '\0';
+}
+
+bool board_from_hex(const char *hex, Board *out) {
+  Board b = 0;
+  for (u8 i = 0; i < 16; i++) {
+    char c = hex[i];
+    u64 nibble;
+    if (c >= '0' && c <= '9') {
+      nibble = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      nibble = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      nibble = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    b |= nibble << (i * 4);
+  }
+
+  *out = b;
+  return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "core.h"
+#include "rng.h"
+
+typedef enum MoveDir {
+    MOVE_DIR_UP,
+    MOVE_DIR_DOWN,
+    MOVE_DIR_LEFT,
+    MOVE_DIR_RIGHT,
+} MoveDir;
+
+#define MOVE_DIR_COUNT 4
+
+// Headless rules engine.
+//
+// A board is 16 tile exponents packed 4 bits each (0 is an empty tile, 1 is a 2,
+// 2 is a 4, ...). The tile at row `y` and column `x` lives in the nibble at
+// index `y * 4 + x`, so a row is a contiguous u16 with column 0 in the low bits.
+typedef u64 Board;
+
+#define BOARD_MAX_EXPONENT 15
+#define BOARD_HEX_LEN 16
+
+// Must be called once before any other board_* function, and before spawning
+// threads that use them.
+void board_init_tables(void);
+
+u8 board_get_tile(Board b, u8 x, u8 y);
+Board board_set_tile(Board b, u8 x, u8 y, u8 exponent);
+u8 board_count_empty(Board b);
+u8 board_max_exponent(Board b);
+// swaps rows and columns, so column `x` becomes the u16 row `x`
+Board board_transpose(Board b);
+// The smallest of the 8 rotations and reflections of `b`, which all play the
+// same way up to relabeling the moves.
+Board board_canonical(Board b);
+
+// Slides and merges the tiles without spawning a new one. `score` is
+// incremented by the value of every merged tile and may be NULL.
+Board board_move(Board b, MoveDir dir, u32 *score);
+// board_move() over `count` boards in one pass. `scores` may be NULL,
+// otherwise scores[i] is set (not incremented) to the score of out[i].
+void board_move_many(const Board *boards, Board *out, u32 *scores, u32 count, MoveDir dir);
+// bit `1 << dir` is set for every direction that changes the board
+u8 board_legal_moves(Board b);
+bool board_is_game_over(Board b);
+
+// 90% chance of a 2, 10% chance of a 4 on a uniformly picked empty tile
+Board board_spawn_random_tile(Board b, Rng *rng);
+Board board_new_game(Rng *rng);
+
+char move_dir_to_char(MoveDir dir);
+bool move_dir_from_char(char c, MoveDir *dir);
+
+// one hex digit per tile exponent in tile index order. `out` must hold
+// BOARD_HEX_LEN + 1 bytes
+void board_to_hex(Board b, char *out);
+bool board_from_hex(const char *hex, Board *out);
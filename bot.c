@@ -0,0 +1,368 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bot.h"
+
+#define BOT_UNIX_PREFIX "unix:"
+
+static i64 now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (i64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void set_nonblocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void init_conn(BotConn *bot) {
+  memset(bot, 0, sizeof(*bot));
+  bot->read_fd = -1;
+  bot->write_fd = -1;
+}
+
+static bool open_process(BotConn *bot, const char *command) {
+  int to_child[2];
+  int from_child[2];
+
+  if (pipe(to_child) != 0) {
+    return false;
+  }
+  if (pipe(from_child) != 0) {
+    close(to_child[0]);
+    close(to_child[1]);
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(to_child[0]);
+    close(to_child[1]);
+    close(from_child[0]);
+    close(from_child[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    dup2(to_child[0], STDIN_FILENO);
+    dup2(from_child[1], STDOUT_FILENO);
+    close(to_child[0]);
+    close(to_child[1]);
+    close(from_child[0]);
+    close(from_child[1]);
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+
+  close(to_child[0]);
+  close(from_child[1]);
+
+  bot->pid = pid;
+  bot->write_fd = to_child[1];
+  bot->read_fd = from_child[0];
+
+  return true;
+}
+
+static bool open_unix_socket(BotConn *bot, const char *path) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return false;
+  }
+
+  bot->read_fd = fd;
+  bot->write_fd = fd;
+
+  return true;
+}
+
+bool bot_open(BotConn *bot, const char *spec) {
+  init_conn(bot);
+
+  bool opened;
+  if (strncmp(spec, BOT_UNIX_PREFIX, strlen(BOT_UNIX_PREFIX)) == 0) {
+    opened = open_unix_socket(bot, spec + strlen(BOT_UNIX_PREFIX));
+  } else {
+    opened = open_process(bot, spec);
+  }
+
+  if (!opened) {
+    printf("[ERROR]: could not start engine \"%s\": %s\n", spec, strerror(errno));
+    return false;
+  }
+
+  set_nonblocking(bot->read_fd);
+  if (bot->write_fd != bot->read_fd) {
+    set_nonblocking(bot->write_fd);
+  }
+
+  snprintf(bot->name, sizeof(bot->name), "%s", spec);
+
+  return true;
+}
+
+///////////////////////////////////
+//
+//
+// IO
+//
+//
+///////////////////////////////////
+
+static BotResult write_all(BotConn *bot, const char *data, u32 size, i64 deadline) {
+  u32 written = 0;
+
+  while (written < size) {
+    ssize_t res = write(bot->write_fd, data + written, size - written);
+    if (res > 0) {
+      written += (u32)res;
+      continue;
+    }
+
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      return BOT_IO_ERROR;
+    }
+
+    i64 remaining = deadline - now_ms();
+    if (remaining <= 0) {
+      return BOT_TIMEOUT;
+    }
+
+    struct pollfd pfd = { .fd = bot->write_fd, .events = POLLOUT };
+    if (poll(&pfd, 1, (int)remaining) < 0 && errno != EINTR) {
+      return BOT_IO_ERROR;
+    }
+  }
+
+  return BOT_OK;
+}
+
+static void reserve_line(BotConn *bot, u32 size) {
+  if (size <= bot->line_cap) return;
+
+  bot->line_cap = CORE_MAX(size, bot->line_cap * 2);
+  char *temp = realloc(bot->line, bot->line_cap);
+  if (!temp) {
+    printf("[FATAL] Failed to reallocate memory for engine line buffer\n");
+    exit(1);
+  }
+  bot->line = temp;
+}
+
+// Reads a single line into bot->line without the trailing newline. With
+// `wait` false it returns BOT_PENDING rather than wait for more input, what
+// was read so far staying in bot->line for the next call.
+static BotResult read_line(BotConn *bot, u32 *len_out, i64 deadline, bool wait) {
+  for (;;) {
+    while (bot->read_pos < bot->read_len) {
+      char c = bot->read_buf[bot->read_pos++];
+      if (c == '\n') {
+        reserve_line(bot, bot->line_len + 1);
+        bot->line[bot->line_len] = '\0';
+        *len_out = bot->line_len;
+        bot->line_len = 0;
+        return BOT_OK;
+      }
+
+      reserve_line(bot, bot->line_len + 2);
+      bot->line[bot->line_len++] = c;
+    }
+
+    ssize_t res = read(bot->read_fd, bot->read_buf, sizeof(bot->read_buf));
+    if (res > 0) {
+      bot->read_pos = 0;
+      bot->read_len = (u32)res;
+      continue;
+    }
+
+    if (res == 0) {
+      return BOT_IO_ERROR;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return BOT_IO_ERROR;
+    }
+    if (!wait) {
+      return BOT_PENDING;
+    }
+
+    i64 remaining = deadline - now_ms();
+    if (remaining <= 0) {
+      return BOT_TIMEOUT;
+    }
+
+    struct pollfd pfd = { .fd = bot->read_fd, .events = POLLIN };
+    if (poll(&pfd, 1, (int)remaining) < 0 && errno != EINTR) {
+      return BOT_IO_ERROR;
+    }
+  }
+}
+
+///////////////////////////////////
+//
+//
+// Protocol
+//
+//
+///////////////////////////////////
+
+BotResult bot_handshake(BotConn *bot, int timeout_ms) {
+  i64 deadline = now_ms() + timeout_ms;
+
+  char hello[32];
+  int hello_len = snprintf(hello, sizeof(hello), "c2048 %d\n", BOT_PROTOCOL_VERSION);
+
+  BotResult res = write_all(bot, hello, (u32)hello_len, deadline);
+  if (res != BOT_OK) return res;
+
+  u32 len = 0;
+  res = read_line(bot, &len, deadline, true);
+  if (res != BOT_OK) return res;
+
+  if (strncmp(bot->line, "name ", 5) != 0) {
+    return BOT_PROTOCOL_ERROR;
+  }
+
+  snprintf(bot->name, sizeof(bot->name), "%s", bot->line + 5);
+
+  return BOT_OK;
+}
+
+BotResult bot_send_moves(BotConn *bot, const Board *boards, u32 count, int timeout_ms) {
+  i64 deadline = now_ms() + timeout_ms;
+
+  // "move <count>" plus a space and a hex board per board and the newline
+  u32 needed = 32 + count * (BOARD_HEX_LEN + 1);
+  if (needed > bot->request_cap) {
+    bot->request_cap = CORE_MAX(needed, bot->request_cap * 2);
+    char *temp = realloc(bot->request, bot->request_cap);
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for engine request buffer\n");
+      exit(1);
+    }
+    bot->request = temp;
+  }
+
+  u32 len = (u32)sprintf(bot->request, "move %u", count);
+  for (u32 i = 0; i < count; i++) {
+    bot->request[len++] = ' ';
+    board_to_hex(boards[i], bot->request + len);
+    len += BOARD_HEX_LEN;
+  }
+  bot->request[len++] = '\n';
+
+  return write_all(bot, bot->request, len, deadline);
+}
+
+static BotResult parse_moves(BotConn *bot, u32 line_len, u32 count, MoveDir *moves_out) {
+  u32 parsed = 0;
+  for (u32 i = 0; i < line_len; i++) {
+    char c = bot->line[i];
+    if (c == ' ' || c == '\t' || c == '\r') {
+      continue;
+    }
+
+    if (parsed == count || !move_dir_from_char(c, &moves_out[parsed])) {
+      return BOT_PROTOCOL_ERROR;
+    }
+    parsed++;
+  }
+
+  return parsed == count ? BOT_OK : BOT_PROTOCOL_ERROR;
+}
+
+BotResult bot_poll_moves(BotConn *bot, u32 count, MoveDir *moves_out) {
+  u32 line_len = 0;
+  BotResult res = read_line(bot, &line_len, 0, false);
+  if (res != BOT_OK) return res;
+
+  return parse_moves(bot, line_len, count, moves_out);
+}
+
+BotResult bot_request_moves(BotConn *bot, const Board *boards, u32 count, MoveDir *moves_out, int timeout_ms) {
+  i64 deadline = now_ms() + timeout_ms;
+
+  BotResult res = bot_send_moves(bot, boards, count, timeout_ms);
+  if (res != BOT_OK) return res;
+
+  u32 line_len = 0;
+  res = read_line(bot, &line_len, deadline, true);
+  if (res != BOT_OK) return res;
+
+  return parse_moves(bot, line_len, count, moves_out);
+}
+
+void bot_close(BotConn *bot) {
+  if (bot->write_fd >= 0) {
+    // best effort, the engine might already be gone
+    write_all(bot, "quit\n", 5, now_ms() + 100);
+  }
+
+  if (bot->write_fd >= 0 && bot->write_fd != bot->read_fd) {
+    close(bot->write_fd);
+  }
+  if (bot->read_fd >= 0) {
+    close(bot->read_fd);
+  }
+
+  if (bot->pid > 0) {
+    // give the engine a moment to exit on its own before killing it
+    i64 deadline = now_ms() + 500;
+    while (waitpid(bot->pid, NULL, WNOHANG) == 0) {
+      if (now_ms() >= deadline) {
+        kill(bot->pid, SIGKILL);
+        waitpid(bot->pid, NULL, 0);
+        break;
+      }
+      usleep(1000);
+    }
+  }
+
+  free(bot->line);
+  free(bot->request);
+  init_conn(bot);
+}
+
+const char *bot_result_str(BotResult res) {
+  switch (res) {
+    case BOT_OK:
+      return "ok";
+    case BOT_TIMEOUT:
+      return "timeout";
+    case BOT_IO_ERROR:
+      return "io error";
+    case BOT_PROTOCOL_ERROR:
+      return "protocol error";
+    case BOT_PENDING:
+      return "pending";
+  }
+
+  return "unknown";
+}
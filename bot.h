@@ -0,0 +1,65 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include "board.h"
+
+// Protocol spoken with external engines. Every message is a single line
+// terminated by '\n', boards are written with board_to_hex() and moves with
+// move_dir_to_char().
+//
+//   host   -> engine: "c2048 1"                      handshake with the protocol version
+//   engine -> host:   "name <engine name>"
+//   host   -> engine: "move <n> <board> <board> ..."  n boards to play a move on
+//   engine -> host:   "<n move chars>"                e.g. "lurd", one per board in order
+//   host   -> engine: "quit"
+//
+// Requests are batched so a single write and read covers every board the host
+// currently needs a move for, which keeps the per board IPC cost far below the
+// time an engine spends thinking.
+//
+// An engine is either a command that is spawned and spoken to over its
+// stdin/stdout, or a process already listening on a unix socket, which is
+// given as "unix:<path>".
+
+#define BOT_PROTOCOL_VERSION 1
+#define BOT_NAME_MAX 64
+
+typedef enum BotResult {
+  BOT_OK,
+  BOT_TIMEOUT,
+  BOT_IO_ERROR,
+  BOT_PROTOCOL_ERROR,
+  // bot_poll_moves() only, the answer hasn't fully arrived yet
+  BOT_PENDING,
+} BotResult;
+
+typedef struct BotConn {
+  int read_fd;
+  int write_fd;
+  pid_t pid; // 0 when connected over a socket
+  char name[BOT_NAME_MAX];
+
+  char read_buf[4096];
+  u32 read_pos;
+  u32 read_len;
+  // length of the line read so far, kept between polls
+  u32 line_len;
+
+  // reused between requests so batches don't allocate
+  char *line;
+  u32 line_cap;
+  char *request;
+  u32 request_cap;
+} BotConn;
+
+bool bot_open(BotConn *bot, const char *spec);
+BotResult bot_handshake(BotConn *bot, int timeout_ms);
+BotResult bot_request_moves(BotConn *bot, const Board *boards, u32 count, MoveDir *moves_out, int timeout_ms);
+// The two halves of bot_request_moves() for callers that can't block, e.g. a
+// render loop: send the request, then poll once per frame until the answer is
+// in. Timing the engine out is up to the caller.
+BotResult bot_send_moves(BotConn *bot, const Board *boards, u32 count, int timeout_ms);
+BotResult bot_poll_moves(BotConn *bot, u32 count, MoveDir *moves_out);
+void bot_close(BotConn *bot);
+const char *bot_result_str(BotResult res);
@@ -0,0 +1,650 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aio.h"
+#include "distrib.h"
+#include "player.h"
+#include "record.h"
+#include "timer.h"
+
+// Hands out ranges of seeds to workers connected over TCP (see distrib.h),
+// checks the game records they send back by replaying them and aggregates
+// statistics. A job whose worker disconnects or misses its deadline goes back
+// to the queue and is given to the next idle worker.
+
+#define COORDINATOR_MAX_WORKERS 256
+#define COORDINATOR_POLL_MS 200
+
+typedef enum JobState {
+  JOB_PENDING,
+  JOB_ASSIGNED,
+  JOB_DONE,
+} JobState;
+
+typedef struct Job {
+  u64 first_seed;
+  u32 game_count;
+  JobState state;
+  i32 worker;
+  f64 deadline;
+  u32 model_version;
+} Job;
+
+typedef struct Worker {
+  bool active;
+  bool greeted;
+  DistribConn conn;
+  char name[64];
+  i32 job;
+  u32 jobs_done;
+  u64 games_done;
+} Worker;
+
+typedef struct Stats {
+  u64 games;
+  u64 moves;
+  u64 score_sum;
+  u32 best_score;
+  u64 max_tile_counts[BOARD_MAX_EXPONENT + 1];
+} Stats;
+
+// A model file as it was when published, kept while jobs still use it.
+typedef struct ModelVersion {
+  u32 version;
+  u8 *data;
+  u64 size;
+} ModelVersion;
+
+typedef struct Coordinator {
+  Job *jobs;
+  u32 job_count;
+  u32 jobs_done;
+  u32 jobs_requeued;
+  f64 job_timeout;
+  PlayerKind player_kind;
+
+  const char *model_path;
+  // the current version last
+  ModelVersion *models;
+  u32 model_count;
+  u32 model_cap;
+  u32 model_version;
+  struct timespec model_mtime;
+
+  Worker workers[COORDINATOR_MAX_WORKERS];
+  u32 workers_seen;
+  u32 workers_lost;
+
+  bool writing_records;
+  AsyncFile records;
+  RecordCodec records_codec;
+  // a record encoded for the file, grown to the longest game
+  u8 *record_buf;
+  u64 record_buf_cap;
+  Stats stats;
+} Coordinator;
+
+Coordinator coord = {0};
+
+///////////////////////////////////
+//
+//
+// Model
+//
+//
+///////////////////////////////////
+
+ModelVersion *find_model(u32 version) {
+  for (u32 i = 0; i < coord.model_count; i++) {
+    if (coord.models[i].version == version) return &coord.models[i];
+  }
+  return NULL;
+}
+
+// Frees the old versions no assigned job refers to anymore. A worker only asks
+// for the version of the job it holds, so every request can still be served.
+void prune_models(void) {
+  u32 kept = 0;
+  for (u32 i = 0; i < coord.model_count; i++) {
+    ModelVersion *model = &coord.models[i];
+    bool used = i + 1 == coord.model_count;
+    for (u32 j = 0; j < coord.job_count && !used; j++) {
+      used = coord.jobs[j].state == JOB_ASSIGNED && coord.jobs[j].model_version == model->version;
+    }
+
+    if (used) {
+      coord.models[kept++] = *model;
+    } else {
+      free(model->data);
+    }
+  }
+  coord.model_count = kept;
+}
+
+// Picks up a new version of the model file whenever it changes on disk, so a
+// trainer can publish a model while self-play keeps running.
+void refresh_model(void) {
+  if (!coord.model_path) return;
+
+  struct stat st;
+  if (stat(coord.model_path, &st) != 0) return;
+  if (coord.model_version > 0 && st.st_mtim.tv_sec == coord.model_mtime.tv_sec &&
+      st.st_mtim.tv_nsec == coord.model_mtime.tv_nsec) {
+    return;
+  }
+
+  u64 size;
+  u8 *data = policy_read_file(coord.model_path, &size);
+  PolicyModel *check = malloc(sizeof(PolicyModel));
+  bool valid = data && policy_load_memory(check, data, size);
+  free(check);
+  if (!valid) {
+    // most likely caught halfway through being written, keep the old one
+    free(data);
+    return;
+  }
+
+  if (coord.model_count == coord.model_cap) {
+    coord.model_cap = coord.model_cap ? coord.model_cap * 2 : 4;
+    ModelVersion *temp = realloc(coord.models, coord.model_cap * sizeof(ModelVersion));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for model versions\n");
+      exit(1);
+    }
+    coord.models = temp;
+  }
+
+  coord.model_version++;
+  coord.models[coord.model_count++] = (ModelVersion){.version = coord.model_version, .data = data, .size = size};
+  coord.model_mtime = st.st_mtim;
+  prune_models();
+  printf("[INFO] serving model version %u (%llu bytes)\n", coord.model_version, (unsigned long long)size);
+}
+
+///////////////////////////////////
+//
+//
+// Workers
+//
+//
+///////////////////////////////////
+
+void requeue_job(i32 job_idx) {
+  Job *job = &coord.jobs[job_idx];
+  if (job->state != JOB_ASSIGNED) return;
+
+  job->state = JOB_PENDING;
+  job->worker = -1;
+  coord.jobs_requeued++;
+}
+
+void drop_worker(u32 idx, const char *reason) {
+  Worker *worker = &coord.workers[idx];
+  printf("[INFO] lost worker %u (%s): %s\n", idx, worker->greeted ? worker->name : "?", reason);
+
+  if (worker->job >= 0) {
+    requeue_job(worker->job);
+  }
+
+  distrib_conn_close(&worker->conn);
+  worker->active = false;
+  coord.workers_lost++;
+}
+
+void accept_workers(int listen_fd) {
+  for (;;) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+
+    u32 idx = 0;
+    while (idx < COORDINATOR_MAX_WORKERS && coord.workers[idx].active) {
+      idx++;
+    }
+    if (idx == COORDINATOR_MAX_WORKERS) {
+      close(fd);
+      continue;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    Worker *worker = &coord.workers[idx];
+    memset(worker, 0, sizeof(*worker));
+    worker->active = true;
+    worker->job = -1;
+    distrib_conn_init(&worker->conn, fd);
+  }
+}
+
+void assign_job(u32 idx) {
+  Worker *worker = &coord.workers[idx];
+
+  i32 job_idx = -1;
+  for (u32 i = 0; i < coord.job_count; i++) {
+    if (coord.jobs[i].state == JOB_PENDING) {
+      job_idx = i;
+      break;
+    }
+  }
+  if (job_idx < 0) return;
+
+  refresh_model();
+
+  Job *job = &coord.jobs[job_idx];
+  job->state = JOB_ASSIGNED;
+  job->worker = idx;
+  job->deadline = get_time() + coord.job_timeout;
+  job->model_version = coord.model_version;
+  worker->job = job_idx;
+
+  DistribWriter msg = {0};
+  distrib_put_u32(&msg, job_idx);
+  distrib_put_u64(&msg, job->first_seed);
+  distrib_put_u32(&msg, job->game_count);
+  distrib_put_u8(&msg, (u8)coord.player_kind);
+  distrib_put_u32(&msg, job->model_version);
+  distrib_queue(&worker->conn, DISTRIB_MSG_JOB, msg.data, msg.size);
+  distrib_writer_free(&msg);
+}
+
+// Returns false if the result doesn't match the job, which drops the worker.
+bool write_record(const GameRecord *record) {
+  u64 bound = RECORD_FILE_RECORD_BOUND(record->move_count);
+  if (bound > coord.record_buf_cap) {
+    coord.record_buf_cap = CORE_MAX(bound, coord.record_buf_cap * 2);
+    u8 *temp = realloc(coord.record_buf, coord.record_buf_cap);
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for a game record\n");
+      exit(1);
+    }
+    coord.record_buf = temp;
+  }
+
+  u64 size = record_file_encode(coord.records_codec, record, coord.record_buf);
+  return size > 0 && aio_write(&coord.records, coord.record_buf, size);
+}
+
+bool handle_result(u32 idx, DistribReader *reader) {
+  Worker *worker = &coord.workers[idx];
+  u32 job_idx = distrib_get_u32(reader);
+  u32 count = distrib_get_u32(reader);
+  if (!reader->ok || job_idx >= coord.job_count) return false;
+
+  Job *job = &coord.jobs[job_idx];
+  if (job->state == JOB_DONE) {
+    // a requeued job finished by two workers only counts once
+    return true;
+  }
+  if (count != job->game_count) return false;
+
+  Stats stats = {0};
+  GameRecord *records = calloc(count, sizeof(GameRecord));
+  bool valid = true;
+  for (u32 i = 0; i < count && valid; i++) {
+    record_init(&records[i], 0);
+    u64 used = record_decode(&records[i], reader->data + reader->pos, reader->size - reader->pos);
+    valid = used > 0 && distrib_get(reader, (u32)used) != NULL;
+
+    // replaying is what makes a record trustworthy, the seed decides every
+    // spawn so a worker can't make up a game
+    Board final_board;
+    u32 score;
+    valid = valid && records[i].seed == job->first_seed + i && record_replay(&records[i], &final_board, &score) &&
+      score == records[i].score && board_is_game_over(final_board);
+
+    if (valid) {
+      stats.games++;
+      stats.moves += records[i].move_count;
+      stats.score_sum += score;
+      stats.best_score = CORE_MAX(stats.best_score, score);
+      stats.max_tile_counts[board_max_exponent(final_board)]++;
+    }
+  }
+
+  bool written = true;
+  if (valid && coord.writing_records) {
+    for (u32 i = 0; i < count && written; i++) {
+      written = write_record(&records[i]);
+    }
+  }
+
+  for (u32 i = 0; i < count; i++) {
+    record_free(&records[i]);
+  }
+  free(records);
+
+  if (!valid) return false;
+  if (!written) {
+    printf("[ERROR]: failed to write game records, no more are written\n");
+    aio_close(&coord.records);
+    coord.writing_records = false;
+  }
+
+  coord.stats.games += stats.games;
+  coord.stats.moves += stats.moves;
+  coord.stats.score_sum += stats.score_sum;
+  coord.stats.best_score = CORE_MAX(coord.stats.best_score, stats.best_score);
+  for (u32 e = 0; e <= BOARD_MAX_EXPONENT; e++) {
+    coord.stats.max_tile_counts[e] += stats.max_tile_counts[e];
+  }
+
+  // the job may have been requeued to another worker in the meantime
+  if (job->state == JOB_ASSIGNED && job->worker >= 0 && (u32)job->worker != idx) {
+    coord.workers[job->worker].job = -1;
+  }
+  job->state = JOB_DONE;
+  job->worker = -1;
+  coord.jobs_done++;
+  if (worker->job == (i32)job_idx) {
+    worker->job = -1;
+  }
+  worker->jobs_done++;
+  worker->games_done += count;
+
+  return true;
+}
+
+// Returns false if the worker has to be dropped.
+bool handle_message(u32 idx, const DistribMessage *msg) {
+  Worker *worker = &coord.workers[idx];
+  DistribReader reader;
+  distrib_reader_init(&reader, msg);
+
+  if (!worker->greeted) {
+    if (msg->type != DISTRIB_MSG_HELLO) return false;
+
+    u32 version = distrib_get_u32(&reader);
+    u32 name_len = distrib_get_u32(&reader);
+    const u8 *name = distrib_get(&reader, name_len);
+    if (!reader.ok || version != DISTRIB_PROTOCOL_VERSION) return false;
+
+    u32 len = CORE_MIN(name_len, sizeof(worker->name) - 1);
+    memcpy(worker->name, name, len);
+    worker->name[len] = '\0';
+    worker->greeted = true;
+    coord.workers_seen++;
+    printf("[INFO] worker %u connected: %s\n", idx, worker->name);
+    return true;
+  }
+
+  switch (msg->type) {
+    case DISTRIB_MSG_MODEL_REQUEST: {
+      u32 version = distrib_get_u32(&reader);
+      // versions are kept as long as a job uses them, so the version of the
+      // worker's own job is always there
+      ModelVersion *model = reader.ok ? find_model(version) : NULL;
+      if (!model || worker->job < 0 || coord.jobs[worker->job].model_version != version) return false;
+
+      DistribWriter out = {0};
+      distrib_put_u32(&out, version);
+      distrib_put(&out, model->data, (u32)model->size);
+      distrib_queue(&worker->conn, DISTRIB_MSG_MODEL, out.data, out.size);
+      distrib_writer_free(&out);
+      return true;
+    }
+    case DISTRIB_MSG_RESULT:
+      return handle_result(idx, &reader);
+    default:
+      return false;
+  }
+}
+
+void service_worker(u32 idx, short revents) {
+  Worker *worker = &coord.workers[idx];
+
+  if (revents & (POLLIN | POLLHUP | POLLERR)) {
+    bool open = distrib_fill(&worker->conn);
+
+    DistribMessage msg;
+    bool error = false;
+    while (distrib_next_message(&worker->conn, &msg, &error)) {
+      if (!handle_message(idx, &msg)) {
+        drop_worker(idx, "protocol error");
+        return;
+      }
+    }
+
+    if (error) {
+      drop_worker(idx, "malformed message");
+      return;
+    }
+    if (!open) {
+      drop_worker(idx, "disconnected");
+      return;
+    }
+  }
+
+  if (!distrib_flush(&worker->conn)) {
+    drop_worker(idx, "write failed");
+  }
+}
+
+void check_deadlines(void) {
+  f64 now = get_time();
+  for (u32 i = 0; i < COORDINATOR_MAX_WORKERS; i++) {
+    Worker *worker = &coord.workers[i];
+    if (worker->active && worker->job >= 0 && coord.jobs[worker->job].deadline < now) {
+      drop_worker(i, "job timed out");
+    }
+  }
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_stats(f64 elapsed) {
+  Stats *stats = &coord.stats;
+  printf("\n%llu games, %llu moves in %.2fs (%.0f games/s)\n", (unsigned long long)stats->games,
+      (unsigned long long)stats->moves, elapsed, elapsed > 0 ? (f64)stats->games / elapsed : 0);
+  printf("average score %.1f, best score %u\n", stats->games ? (f64)stats->score_sum / (f64)stats->games : 0,
+      stats->best_score);
+
+  u64 at_least = 0;
+  for (i32 e = BOARD_MAX_EXPONENT; e >= 1; e--) {
+    at_least += stats->max_tile_counts[e];
+    if (stats->max_tile_counts[e] == 0) continue;
+    printf("  reached %6u: %6.2f%%\n", 1u << e, 100.0 * (f64)at_least / (f64)stats->games);
+  }
+
+  printf("%u workers, %u lost, %u jobs requeued\n", coord.workers_seen, coord.workers_lost, coord.jobs_requeued);
+}
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options]\n"
+      "\n"
+      "options:\n"
+      "  -l <addr>   address to listen on (default %s)\n"
+      "  -n <count>  number of games (default 1000)\n"
+      "  -s <seed>   seed of the first game (default 1)\n"
+      "  -g <count>  games per job (default 64)\n"
+      "  -p <name>   policy playing the games: random, greedy or policy (default greedy)\n"
+      "  -m <file>   model of the policy player, reloaded whenever it changes\n"
+      "  -t <secs>   requeue a job if its worker hasn't answered in time (default 60)\n"
+      "  -o <file>   write every game record to this file\n"
+      "  -z          entropy code the moves of the written records\n", prog, DISTRIB_DEFAULT_ADDRESS);
+}
+
+int main(int argc, char *argv[]) {
+  const char *address = DISTRIB_DEFAULT_ADDRESS;
+  const char *records_path = NULL;
+  u32 game_count = 1000;
+  u64 first_seed = 1;
+  u32 games_per_job = 64;
+  coord.player_kind = PLAYER_GREEDY;
+  coord.job_timeout = 60;
+  coord.records_codec = RECORD_CODEC_PACKED;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "l:n:s:g:p:m:t:o:zh")) != -1) {
+    switch (opt) {
+      case 'l':
+        address = optarg;
+        break;
+      case 'n':
+        game_count = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        first_seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'g':
+        games_per_job = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'p':
+        if (!player_kind_from_name(optarg, &coord.player_kind)) {
+          printf("[ERROR]: unknown policy \"%s\"\n", optarg);
+          return 1;
+        }
+        break;
+      case 'm':
+        coord.model_path = optarg;
+        break;
+      case 't':
+        coord.job_timeout = strtod(optarg, NULL);
+        break;
+      case 'o':
+        records_path = optarg;
+        break;
+      case 'z':
+        coord.records_codec = RECORD_CODEC_RANS;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (coord.player_kind == PLAYER_POLICY && !coord.model_path) {
+    printf("[ERROR]: the policy player needs a model (-m)\n");
+    return 1;
+  }
+
+  board_init_tables();
+  start_internal_timer();
+
+  refresh_model();
+  if (coord.model_path && coord.model_version == 0) {
+    printf("[ERROR]: could not load the model \"%s\"\n", coord.model_path);
+    return 1;
+  }
+
+  if (records_path) {
+    u8 header[8];
+    u32 version = coord.records_codec;
+    memcpy(header, RECORD_FILE_MAGIC, 4);
+    memcpy(header + 4, &version, 4);
+    if (!aio_open(&coord.records, records_path) || !aio_write(&coord.records, header, sizeof(header))) {
+      return 1;
+    }
+    coord.writing_records = true;
+    printf("[INFO] writing records to \"%s\" with %s\n", records_path, aio_backend_name(coord.records.backend));
+  }
+
+  coord.job_count = CORE_DIV_ROUND_UP(game_count, games_per_job);
+  coord.jobs = calloc(CORE_MAX(1, coord.job_count), sizeof(Job));
+  for (u32 i = 0; i < coord.job_count; i++) {
+    coord.jobs[i] = (Job){
+      .first_seed = first_seed + (u64)i * games_per_job,
+      .game_count = CORE_MIN(games_per_job, game_count - i * games_per_job),
+      .state = JOB_PENDING,
+      .worker = -1,
+    };
+  }
+
+  int listen_fd = distrib_listen(address);
+  if (listen_fd < 0) return 1;
+  fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+  printf("[INFO] listening on %s for %u games in %u jobs\n", address, game_count, coord.job_count);
+
+  f64 start = 0;
+  struct pollfd fds[COORDINATOR_MAX_WORKERS + 1];
+  u32 fd_workers[COORDINATOR_MAX_WORKERS + 1];
+
+  while (coord.jobs_done < coord.job_count) {
+    for (u32 i = 0; i < COORDINATOR_MAX_WORKERS; i++) {
+      Worker *worker = &coord.workers[i];
+      if (worker->active && worker->greeted && worker->job < 0) {
+        if (start == 0) {
+          start = get_time();
+        }
+        assign_job(i);
+      }
+    }
+
+    u32 nfds = 0;
+    fds[nfds++] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+    for (u32 i = 0; i < COORDINATOR_MAX_WORKERS; i++) {
+      Worker *worker = &coord.workers[i];
+      if (!worker->active) continue;
+
+      short events = POLLIN;
+      if (distrib_has_pending_writes(&worker->conn)) {
+        events |= POLLOUT;
+      }
+      fd_workers[nfds] = i;
+      fds[nfds++] = (struct pollfd){.fd = worker->conn.fd, .events = events};
+    }
+
+    if (poll(fds, nfds, COORDINATOR_POLL_MS) < 0 && errno != EINTR) {
+      printf("[ERROR]: poll failed: %s\n", strerror(errno));
+      return 1;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      accept_workers(listen_fd);
+    }
+    for (u32 i = 1; i < nfds; i++) {
+      if (fds[i].revents) {
+        service_worker(fd_workers[i], fds[i].revents);
+      }
+    }
+
+    check_deadlines();
+  }
+
+  f64 elapsed = start > 0 ? get_time() - start : 0;
+
+  // let every worker know it can exit
+  for (u32 i = 0; i < COORDINATOR_MAX_WORKERS; i++) {
+    Worker *worker = &coord.workers[i];
+    if (!worker->active) continue;
+
+    int flags = fcntl(worker->conn.fd, F_GETFL);
+    fcntl(worker->conn.fd, F_SETFL, flags & ~O_NONBLOCK);
+    distrib_send(&worker->conn, DISTRIB_MSG_DONE, NULL, 0);
+    distrib_conn_close(&worker->conn);
+    worker->active = false;
+  }
+  close(listen_fd);
+
+  if (coord.writing_records && !aio_close(&coord.records)) {
+    printf("[ERROR]: failed to write \"%s\"\n", records_path);
+  }
+  free(coord.record_buf);
+
+  print_stats(elapsed);
+
+  printf("%-24s %8s %10s\n", "worker", "jobs", "games");
+  for (u32 i = 0; i < COORDINATOR_MAX_WORKERS; i++) {
+    Worker *worker = &coord.workers[i];
+    if (worker->jobs_done == 0) continue;
+    printf("%-24s %8u %10llu\n", worker->name, worker->jobs_done, (unsigned long long)worker->games_done);
+  }
+
+  free(coord.jobs);
+  for (u32 i = 0; i < coord.model_count; i++) {
+    free(coord.models[i].data);
+  }
+  free(coord.models);
+
+  return 0;
+}
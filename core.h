@@ -25,7 +25,7 @@
 #define CORE_UNUSED(expr) ((void)(expr))
 
 // align must be a power of 2
-#define CORE_INT_ROUND_UP_ALIGN(i, align) (((i) + ((align) - )) & ~((align) - 1))
+#define CORE_INT_ROUND_UP_ALIGN(i, align) (((i) + ((align) - 1)) & ~((align) - 1))
 // align must be a power of 2
 #define CORE_INT_ROUND_DOWN_ALIGN(i, align) ((i) & ~((align) - 1))
 
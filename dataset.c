@@ -0,0 +1,432 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dataset.h"
+
+#define DATASET_MAGIC "C2DS"
+#define DATASET_HEADER_SIZE 16
+#define DATASET_TRAILER_SIZE 16
+#define DATASET_CHUNK_ENTRY_SIZE (8 + DATASET_COLUMN_COUNT * 16)
+
+const u32 column_widths[DATASET_COLUMN_COUNT] = {
+  [DATASET_COLUMN_GAME] = 4,
+  [DATASET_COLUMN_BOARD] = 8,
+  [DATASET_COLUMN_LEGAL_MOVES] = 1,
+  [DATASET_COLUMN_MOVE] = 1,
+  [DATASET_COLUMN_REWARD] = 4,
+  [DATASET_COLUMN_FINAL_SCORE] = 4,
+};
+
+const char *column_names[DATASET_COLUMN_COUNT] = {
+  [DATASET_COLUMN_GAME] = "game",
+  [DATASET_COLUMN_BOARD] = "board",
+  [DATASET_COLUMN_LEGAL_MOVES] = "legal_moves",
+  [DATASET_COLUMN_MOVE] = "move",
+  [DATASET_COLUMN_REWARD] = "reward",
+  [DATASET_COLUMN_FINAL_SCORE] = "final_score",
+};
+
+u32 dataset_column_width(DatasetColumn column) {
+  return column_widths[column];
+}
+
+const char *dataset_column_name(DatasetColumn column) {
+  return column_names[column];
+}
+
+///////////////////////////////////
+//
+//
+// Codec
+//
+//
+///////////////////////////////////
+
+static u64 load_value(const u8 *src, u32 width) {
+  u64 v = 0;
+  memcpy(&v, src, width);
+  return v;
+}
+
+static void store_value(u8 *dst, u64 v, u32 width) {
+  memcpy(dst, &v, width);
+}
+
+// Delta codes the values and scatters their bytes into `width` planes so the
+// mostly zero high bytes end up next to each other.
+static void delta_to_planes(const u8 *values, u32 rows, u32 width, bool use_xor, u8 *planes) {
+  u64 mask = width == 8 ? U64_MAX : ((u64)1 << (width * 8)) - 1;
+  u64 prev = 0;
+
+  for (u32 r = 0; r < rows; r++) {
+    u64 v = load_value(values + (u64)r * width, width);
+    u64 d = use_xor ? v ^ prev : (v - prev) & mask;
+    prev = v;
+
+    for (u32 k = 0; k < width; k++) {
+      planes[(u64)k * rows + r] = (u8)(d >> (k * 8));
+    }
+  }
+}
+
+static void undelta_in_place(u8 *values, u32 rows, u32 width, bool use_xor) {
+  u64 mask = width == 8 ? U64_MAX : ((u64)1 << (width * 8)) - 1;
+  u64 prev = 0;
+
+  for (u32 r = 0; r < rows; r++) {
+    u64 d = load_value(values + (u64)r * width, width);
+    u64 v = use_xor ? d ^ prev : (d + prev) & mask;
+    store_value(values + (u64)r * width, v, width);
+    prev = v;
+  }
+}
+
+// Control byte < 128 is followed by control + 1 literal bytes, otherwise the
+// next byte is repeated control - 126 times.
+static u64 rle_encode(const u8 *in, u64 size, u8 *out) {
+  u64 i = 0;
+  u64 o = 0;
+
+  while (i < size) {
+    u64 run = 1;
+    while (i + run < size && run < 129 && in[i + run] == in[i]) {
+      run++;
+    }
+
+    if (run >= 3) {
+      out[o++] = (u8)(126 + run);
+      out[o++] = in[i];
+      i += run;
+      continue;
+    }
+
+    u64 start = i;
+    u64 len = 0;
+    while (i < size && len < 128) {
+      if (i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2]) {
+        break;
+      }
+      i++;
+      len++;
+    }
+
+    out[o++] = (u8)(len - 1);
+    memcpy(out + o, in + start, len);
+    o += len;
+  }
+
+  return o;
+}
+
+// decodes the planes straight back into row order
+static bool rle_decode_planes(const u8 *in, u64 size, u8 *values, u32 rows, u32 width) {
+  u64 total = (u64)rows * width;
+  u64 i = 0;
+  u64 o = 0;
+
+  while (i < size && o < total) {
+    u8 control = in[i++];
+    u64 len = control < 128 ? (u64)control + 1 : (u64)control - 126;
+    if (o + len > total) return false;
+
+    if (control < 128) {
+      if (i + len > size) return false;
+      for (u64 j = 0; j < len; j++) {
+        u64 pos = o + j;
+        values[(pos % rows) * width + pos / rows] = in[i + j];
+      }
+      i += len;
+    } else {
+      if (i >= size) return false;
+      u8 byte = in[i++];
+      for (u64 j = 0; j < len; j++) {
+        u64 pos = o + j;
+        values[(pos % rows) * width + pos / rows] = byte;
+      }
+    }
+
+    o += len;
+  }
+
+  return o == total;
+}
+
+///////////////////////////////////
+//
+//
+// Writer
+//
+//
+///////////////////////////////////
+
+static bool write_bytes(DatasetWriter *writer, const void *data, u64 size) {
+  if (!aio_write(&writer->out, data, size)) {
+    return false;
+  }
+  writer->offset += size;
+  return true;
+}
+
+static bool write_padding(DatasetWriter *writer) {
+  const u8 zeros[8] = {0};
+  u64 pad = CORE_INT_ROUND_UP_ALIGN(writer->offset, 8) - writer->offset;
+  return write_bytes(writer, zeros, pad);
+}
+
+static void append_directory(DatasetWriter *writer, const void *data, u32 size) {
+  if (writer->directory_size + size > writer->directory_cap) {
+    writer->directory_cap = CORE_MAX(writer->directory_cap * 2, writer->directory_size + size);
+    u8 *temp = realloc(writer->directory, writer->directory_cap);
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for the dataset directory\n");
+      exit(1);
+    }
+    writer->directory = temp;
+  }
+
+  memcpy(writer->directory + writer->directory_size, data, size);
+  writer->directory_size += size;
+}
+
+// The directory entry of the chunk is only added once all of its columns are
+// written, so a failed chunk leaves no trace in it.
+static bool flush_chunk(DatasetWriter *writer) {
+  if (writer->row_count == 0) return true;
+
+  u32 rows = writer->row_count;
+  u8 entry[DATASET_CHUNK_ENTRY_SIZE] = {0};
+  memcpy(entry, &rows, sizeof(rows));
+
+  for (u32 c = 0; c < DATASET_COLUMN_COUNT; c++) {
+    u32 width = column_widths[c];
+    u64 raw_size = (u64)rows * width;
+
+    delta_to_planes(writer->columns[c], rows, width, c == DATASET_COLUMN_BOARD, writer->scratch);
+    u64 encoded_size = rle_encode(writer->scratch, raw_size, writer->encoded);
+
+    // keep whichever is smaller, raw columns have the bonus of being usable in place
+    u32 codec = encoded_size < raw_size ? DATASET_CODEC_DELTA_RLE : DATASET_CODEC_RAW;
+    const u8 *data = codec == DATASET_CODEC_RAW ? writer->columns[c] : writer->encoded;
+    u32 size = (u32)(codec == DATASET_CODEC_RAW ? raw_size : encoded_size);
+
+    if (!write_padding(writer)) return false;
+
+    u64 offset = writer->offset;
+    if (!write_bytes(writer, data, size)) return false;
+
+    u8 *column_entry = entry + 8 + c * 16;
+    memcpy(column_entry, &offset, sizeof(offset));
+    memcpy(column_entry + 8, &size, sizeof(size));
+    memcpy(column_entry + 12, &codec, sizeof(codec));
+  }
+
+  append_directory(writer, entry, sizeof(entry));
+  writer->chunk_count++;
+  writer->row_count = 0;
+
+  return true;
+}
+
+bool dataset_writer_open(DatasetWriter *writer, const char *path, u32 chunk_rows) {
+  memset(writer, 0, sizeof(*writer));
+
+  if (!aio_open(&writer->out, path)) {
+    return false;
+  }
+
+  writer->chunk_rows = chunk_rows ? chunk_rows : DATASET_DEFAULT_CHUNK_ROWS;
+
+  for (u32 c = 0; c < DATASET_COLUMN_COUNT; c++) {
+    writer->columns[c] = malloc((u64)writer->chunk_rows * column_widths[c]);
+    if (!writer->columns[c]) {
+      printf("[FATAL] Failed to allocate memory for dataset columns\n");
+      exit(1);
+    }
+  }
+
+  // worst case of the rle is one control byte per 128 literals
+  u64 max_raw = (u64)writer->chunk_rows * 8;
+  writer->scratch = malloc(max_raw);
+  writer->encoded = malloc(max_raw + max_raw / 128 + 16);
+  if (!writer->scratch || !writer->encoded) {
+    printf("[FATAL] Failed to allocate memory for dataset encoding\n");
+    exit(1);
+  }
+
+  u8 header[DATASET_HEADER_SIZE] = {0};
+  u32 version = DATASET_VERSION;
+  u32 column_count = DATASET_COLUMN_COUNT;
+  memcpy(header, DATASET_MAGIC, 4);
+  memcpy(header + 4, &version, 4);
+  memcpy(header + 8, &column_count, 4);
+
+  return write_bytes(writer, header, sizeof(header));
+}
+
+bool dataset_writer_append(DatasetWriter *writer, const DatasetRow *row) {
+  if (writer->failed) return false;
+
+  u32 r = writer->row_count;
+
+  memcpy(writer->columns[DATASET_COLUMN_GAME] + (u64)r * 4, &row->game, 4);
+  memcpy(writer->columns[DATASET_COLUMN_BOARD] + (u64)r * 8, &row->board, 8);
+  writer->columns[DATASET_COLUMN_LEGAL_MOVES][r] = row->legal_moves;
+  writer->columns[DATASET_COLUMN_MOVE][r] = row->move;
+  memcpy(writer->columns[DATASET_COLUMN_REWARD] + (u64)r * 4, &row->reward, 4);
+  memcpy(writer->columns[DATASET_COLUMN_FINAL_SCORE] + (u64)r * 4, &row->final_score, 4);
+
+  writer->row_count++;
+  if (writer->row_count == writer->chunk_rows) {
+    if (!flush_chunk(writer)) {
+      printf("[ERROR]: failed to write dataset chunk: %s\n", strerror(writer->out.error));
+      writer->failed = true;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool dataset_writer_close(DatasetWriter *writer) {
+  bool ok = !writer->failed && flush_chunk(writer) && write_padding(writer);
+
+  u64 directory_offset = writer->offset;
+  ok = ok && write_bytes(writer, writer->directory, writer->directory_size);
+
+  u8 trailer[DATASET_TRAILER_SIZE];
+  memcpy(trailer, &directory_offset, 8);
+  memcpy(trailer + 8, &writer->chunk_count, 4);
+  memcpy(trailer + 12, DATASET_MAGIC, 4);
+  ok = ok && write_bytes(writer, trailer, sizeof(trailer));
+
+  ok = aio_close(&writer->out) && ok;
+
+  for (u32 c = 0; c < DATASET_COLUMN_COUNT; c++) {
+    free(writer->columns[c]);
+  }
+  free(writer->scratch);
+  free(writer->encoded);
+  free(writer->directory);
+  memset(writer, 0, sizeof(*writer));
+
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// Reader
+//
+//
+///////////////////////////////////
+
+bool dataset_reader_open(DatasetReader *reader, const char *path) {
+  memset(reader, 0, sizeof(*reader));
+  reader->fd = -1;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("[ERROR]: could not open dataset \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (u64)st.st_size < DATASET_HEADER_SIZE + DATASET_TRAILER_SIZE) {
+    printf("[ERROR]: \"%s\" is not a dataset\n", path);
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    printf("[ERROR]: could not map dataset \"%s\": %s\n", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  reader->fd = fd;
+  reader->data = data;
+  reader->size = st.st_size;
+
+  const u8 *trailer = reader->data + reader->size - DATASET_TRAILER_SIZE;
+  u64 directory_offset;
+  u32 version, column_count;
+  memcpy(&version, reader->data + 4, 4);
+  memcpy(&column_count, reader->data + 8, 4);
+  memcpy(&directory_offset, trailer, 8);
+  memcpy(&reader->chunk_count, trailer + 8, 4);
+
+  bool valid = memcmp(reader->data, DATASET_MAGIC, 4) == 0 && memcmp(trailer + 12, DATASET_MAGIC, 4) == 0 &&
+    version == DATASET_VERSION && column_count == DATASET_COLUMN_COUNT &&
+    directory_offset + (u64)reader->chunk_count * DATASET_CHUNK_ENTRY_SIZE <= reader->size - DATASET_TRAILER_SIZE;
+
+  if (!valid) {
+    printf("[ERROR]: \"%s\" is not a valid dataset\n", path);
+    dataset_reader_close(reader);
+    return false;
+  }
+
+  reader->chunks = calloc(reader->chunk_count ? reader->chunk_count : 1, sizeof(DatasetChunkInfo));
+  const u8 *entry = reader->data + directory_offset;
+
+  for (u32 i = 0; i < reader->chunk_count; i++) {
+    DatasetChunkInfo *chunk = &reader->chunks[i];
+    memcpy(&chunk->row_count, entry, 4);
+    entry += 8;
+
+    for (u32 c = 0; c < DATASET_COLUMN_COUNT; c++) {
+      u32 codec;
+      memcpy(&chunk->offsets[c], entry, 8);
+      memcpy(&chunk->sizes[c], entry + 8, 4);
+      memcpy(&codec, entry + 12, 4);
+      chunk->codecs[c] = codec;
+      entry += 16;
+
+      bool raw_size_ok = codec != DATASET_CODEC_RAW || chunk->sizes[c] == (u64)chunk->row_count * column_widths[c];
+      if (chunk->offsets[c] + chunk->sizes[c] > directory_offset || codec > DATASET_CODEC_DELTA_RLE || !raw_size_ok) {
+        printf("[ERROR]: \"%s\" has a corrupt chunk directory\n", path);
+        dataset_reader_close(reader);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+const void *dataset_reader_column(DatasetReader *reader, u32 chunk, DatasetColumn column, void *scratch) {
+  CORE_DEBUG_ASSERT(chunk < reader->chunk_count, "chunk %u out of bounds", chunk);
+
+  DatasetChunkInfo *info = &reader->chunks[chunk];
+  const u8 *data = reader->data + info->offsets[column];
+
+  if (info->codecs[column] == DATASET_CODEC_RAW) {
+    return data;
+  }
+
+  u32 width = column_widths[column];
+  if (!rle_decode_planes(data, info->sizes[column], scratch, info->row_count, width)) {
+    return NULL;
+  }
+  undelta_in_place(scratch, info->row_count, width, column == DATASET_COLUMN_BOARD);
+
+  return scratch;
+}
+
+void dataset_reader_close(DatasetReader *reader) {
+  if (reader->data) {
+    munmap((void *)reader->data, reader->size);
+  }
+  if (reader->fd >= 0) {
+    close(reader->fd);
+  }
+  free(reader->chunks);
+  memset(reader, 0, sizeof(*reader));
+  reader->fd = -1;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "aio.h"
+#include "board.h"
+
+// Columnar self-play dataset.
+//
+// Rows are grouped into chunks and every column of a chunk is stored (and
+// compressed) on its own, so a reader that only needs the moves never touches
+// the bytes of the boards. File layout, all integers little endian:
+//
+//   header     "C2DS" u32 version u32 column_count u32 reserved
+//   chunks     per chunk, the data of every column, each aligned to 8 bytes
+//   directory  per chunk: u32 row_count u32 reserved
+//                         per column: u64 offset u32 stored_size u32 codec
+//   trailer    u64 directory_offset u32 chunk_count "C2DS"
+//
+// A column stored with DATASET_CODEC_RAW is a plain little endian array and
+// can be used straight from the mapping.
+
+#define DATASET_VERSION 1
+#define DATASET_DEFAULT_CHUNK_ROWS 65536
+
+typedef enum DatasetColumn {
+  DATASET_COLUMN_GAME,        // u32, index of the game the row belongs to
+  DATASET_COLUMN_BOARD,       // u64, packed board before the move
+  DATASET_COLUMN_LEGAL_MOVES, // u8, bit `1 << dir` set for every legal move
+  DATASET_COLUMN_MOVE,        // u8, MoveDir that was played
+  DATASET_COLUMN_REWARD,      // u32, score gained by the move
+  DATASET_COLUMN_FINAL_SCORE, // u32, score of the game when it ended
+
+  DATASET_COLUMN_COUNT,
+} DatasetColumn;
+
+typedef enum DatasetCodec {
+  DATASET_CODEC_RAW,
+  // values are delta coded against the previous row (xor for boards), split
+  // into byte planes and run length encoded
+  DATASET_CODEC_DELTA_RLE,
+} DatasetCodec;
+
+typedef struct DatasetRow {
+  u32 game;
+  Board board;
+  u8 legal_moves;
+  u8 move;
+  u32 reward;
+  u32 final_score;
+} DatasetRow;
+
+typedef struct DatasetWriter {
+  AsyncFile out;
+  u64 offset;
+  u32 chunk_rows;
+  u32 row_count;
+  u8 *columns[DATASET_COLUMN_COUNT];
+  u8 *scratch;
+  u8 *encoded;
+
+  u8 *directory;
+  u32 directory_size;
+  u32 directory_cap;
+  u32 chunk_count;
+  // set by the first failed write, appends are dropped from then on
+  bool failed;
+} DatasetWriter;
+
+typedef struct DatasetChunkInfo {
+  u32 row_count;
+  u64 offsets[DATASET_COLUMN_COUNT];
+  u32 sizes[DATASET_COLUMN_COUNT];
+  DatasetCodec codecs[DATASET_COLUMN_COUNT];
+} DatasetChunkInfo;
+
+typedef struct DatasetReader {
+  int fd;
+  const u8 *data;
+  u64 size;
+  u32 chunk_count;
+  DatasetChunkInfo *chunks;
+} DatasetReader;
+
+u32 dataset_column_width(DatasetColumn column);
+const char *dataset_column_name(DatasetColumn column);
+
+bool dataset_writer_open(DatasetWriter *writer, const char *path, u32 chunk_rows);
+// Returns false once a write has failed, the dataset is lost then.
+bool dataset_writer_append(DatasetWriter *writer, const DatasetRow *row);
+bool dataset_writer_close(DatasetWriter *writer);
+
+bool dataset_reader_open(DatasetReader *reader, const char *path);
+// Returns the values of one column of one chunk. Raw columns point straight
+// into the mapping, compressed ones are decoded into `scratch`, which must hold
+// row_count * dataset_column_width(column) bytes.
+const void *dataset_reader_column(DatasetReader *reader, u32 chunk, DatasetColumn column, void *scratch);
+void dataset_reader_close(DatasetReader *reader);
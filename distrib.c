@@ -0,0 +1,306 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "distrib.h"
+
+///////////////////////////////////
+//
+//
+// Sockets
+//
+//
+///////////////////////////////////
+
+bool distrib_parse_address(const char *address, char *host, u32 host_size, u16 *port) {
+  const char *colon = strrchr(address, ':');
+  if (!colon || (u32)(colon - address) >= host_size) return false;
+
+  char *end;
+  unsigned long value = strtoul(colon + 1, &end, 10);
+  if (*end != '\0' || value == 0 || value > 65535) return false;
+
+  memcpy(host, address, colon - address);
+  host[colon - address] = '\0';
+  *port = (u16)value;
+
+  return true;
+}
+
+static bool make_sockaddr(const char *address, struct sockaddr_in *addr) {
+  char host[64];
+  u16 port;
+  if (!distrib_parse_address(address, host, sizeof(host), &port)) {
+    printf("[ERROR]: invalid address \"%s\", expected <ipv4>:<port>\n", address);
+    return false;
+  }
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &addr->sin_addr) != 1) {
+    printf("[ERROR]: invalid IPv4 address \"%s\"\n", host);
+    return false;
+  }
+
+  return true;
+}
+
+int distrib_listen(const char *address) {
+  struct sockaddr_in addr;
+  if (!make_sockaddr(address, &addr)) return -1;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+    printf("[ERROR]: could not listen on %s: %s\n", address, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int distrib_connect(const char *address) {
+  struct sockaddr_in addr;
+  if (!make_sockaddr(address, &addr)) return -1;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  // messages are written whole, don't hold back the tail of one
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  return fd;
+}
+
+///////////////////////////////////
+//
+//
+// Connection
+//
+//
+///////////////////////////////////
+
+static void reserve(u8 **buf, u32 *cap, u32 needed) {
+  if (needed <= *cap) return;
+
+  u32 new_cap = *cap ? *cap : 4096;
+  while (new_cap < needed) {
+    new_cap *= 2;
+  }
+
+  u8 *temp = realloc(*buf, new_cap);
+  if (!temp) {
+    printf("[FATAL] Failed to reallocate memory for a connection buffer\n");
+    exit(1);
+  }
+  *buf = temp;
+  *cap = new_cap;
+}
+
+void distrib_conn_init(DistribConn *conn, int fd) {
+  memset(conn, 0, sizeof(*conn));
+  conn->fd = fd;
+}
+
+void distrib_conn_close(DistribConn *conn) {
+  if (conn->fd >= 0) {
+    close(conn->fd);
+  }
+  free(conn->read_buf);
+  free(conn->write_buf);
+  memset(conn, 0, sizeof(*conn));
+  conn->fd = -1;
+}
+
+void distrib_queue(DistribConn *conn, u8 type, const void *payload, u32 size) {
+  // drop what was already written before growing
+  if (conn->write_pos == conn->write_len) {
+    conn->write_pos = conn->write_len = 0;
+  }
+
+  reserve(&conn->write_buf, &conn->write_cap, conn->write_len + DISTRIB_HEADER_SIZE + size);
+  u8 *out = conn->write_buf + conn->write_len;
+  memcpy(out, &size, 4);
+  out[4] = type;
+  if (size) {
+    memcpy(out + DISTRIB_HEADER_SIZE, payload, size);
+  }
+  conn->write_len += DISTRIB_HEADER_SIZE + size;
+}
+
+bool distrib_has_pending_writes(DistribConn *conn) {
+  return conn->write_pos < conn->write_len;
+}
+
+bool distrib_flush(DistribConn *conn) {
+  while (conn->write_pos < conn->write_len) {
+    ssize_t n = send(conn->fd, conn->write_buf + conn->write_pos, conn->write_len - conn->write_pos, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    conn->write_pos += n;
+  }
+
+  conn->write_pos = conn->write_len = 0;
+  return true;
+}
+
+bool distrib_fill(DistribConn *conn) {
+  // messages already handed out are dropped here, which is why their
+  // payloads only live until the next fill
+  if (conn->read_pos > 0) {
+    memmove(conn->read_buf, conn->read_buf + conn->read_pos, conn->read_len - conn->read_pos);
+    conn->read_len -= conn->read_pos;
+    conn->read_pos = 0;
+  }
+
+  reserve(&conn->read_buf, &conn->read_cap, conn->read_len + 65536);
+
+  for (;;) {
+    ssize_t n = recv(conn->fd, conn->read_buf + conn->read_len, conn->read_cap - conn->read_len, 0);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (n == 0) return false;
+
+    conn->read_len += n;
+    return true;
+  }
+}
+
+bool distrib_next_message(DistribConn *conn, DistribMessage *msg, bool *error) {
+  u32 available = conn->read_len - conn->read_pos;
+  if (available < DISTRIB_HEADER_SIZE) return false;
+
+  const u8 *start = conn->read_buf + conn->read_pos;
+  u32 size;
+  memcpy(&size, start, 4);
+  if (size > DISTRIB_MAX_PAYLOAD) {
+    *error = true;
+    return false;
+  }
+
+  if (available - DISTRIB_HEADER_SIZE < size) {
+    // big payloads need more room than a single fill makes
+    reserve(&conn->read_buf, &conn->read_cap, conn->read_pos + DISTRIB_HEADER_SIZE + size);
+    return false;
+  }
+
+  msg->type = start[4];
+  msg->payload = start + DISTRIB_HEADER_SIZE;
+  msg->size = size;
+  conn->read_pos += DISTRIB_HEADER_SIZE + size;
+
+  return true;
+}
+
+bool distrib_send(DistribConn *conn, u8 type, const void *payload, u32 size) {
+  distrib_queue(conn, type, payload, size);
+  return distrib_flush(conn) && !distrib_has_pending_writes(conn);
+}
+
+bool distrib_receive(DistribConn *conn, DistribMessage *msg) {
+  bool error = false;
+  while (!distrib_next_message(conn, msg, &error)) {
+    if (error || !distrib_fill(conn)) return false;
+  }
+  return true;
+}
+
+///////////////////////////////////
+//
+//
+// Payloads
+//
+//
+///////////////////////////////////
+
+u8 *distrib_reserve(DistribWriter *writer, u32 size) {
+  reserve(&writer->data, &writer->cap, writer->size + size);
+  u8 *out = writer->data + writer->size;
+  writer->size += size;
+  return out;
+}
+
+void distrib_put(DistribWriter *writer, const void *data, u32 size) {
+  if (size) {
+    memcpy(distrib_reserve(writer, size), data, size);
+  }
+}
+
+void distrib_put_u8(DistribWriter *writer, u8 v) {
+  distrib_put(writer, &v, 1);
+}
+
+void distrib_put_u32(DistribWriter *writer, u32 v) {
+  distrib_put(writer, &v, 4);
+}
+
+void distrib_put_u64(DistribWriter *writer, u64 v) {
+  distrib_put(writer, &v, 8);
+}
+
+void distrib_writer_free(DistribWriter *writer) {
+  free(writer->data);
+  memset(writer, 0, sizeof(*writer));
+}
+
+void distrib_reader_init(DistribReader *reader, const DistribMessage *msg) {
+  reader->data = msg->payload;
+  reader->size = msg->size;
+  reader->pos = 0;
+  reader->ok = true;
+}
+
+const u8 *distrib_get(DistribReader *reader, u32 size) {
+  if (!reader->ok || reader->size - reader->pos < size) {
+    reader->ok = false;
+    return NULL;
+  }
+
+  const u8 *data = reader->data + reader->pos;
+  reader->pos += size;
+  return data;
+}
+
+u8 distrib_get_u8(DistribReader *reader) {
+  const u8 *data = distrib_get(reader, 1);
+  return data ? data[0] : 0;
+}
+
+u32 distrib_get_u32(DistribReader *reader) {
+  u32 v = 0;
+  const u8 *data = distrib_get(reader, 4);
+  if (data) {
+    memcpy(&v, data, 4);
+  }
+  return v;
+}
+
+u64 distrib_get_u64(DistribReader *reader) {
+  u64 v = 0;
+  const u8 *data = distrib_get(reader, 8);
+  if (data) {
+    memcpy(&v, data, 8);
+  }
+  return v;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "core.h"
+
+// Protocol between the self-play coordinator and its workers.
+//
+// Every message is a u32 payload size, a u8 type and the payload, integers
+// little endian:
+//
+//   worker -> coordinator  HELLO          u32 protocol version, u32 name length, name
+//   coordinator -> worker  JOB            u32 job id, u64 first seed, u32 game count,
+//                                         u8 PlayerKind, u32 model version (0: none)
+//   worker -> coordinator  MODEL_REQUEST  u32 model version
+//   coordinator -> worker  MODEL          u32 model version, the bytes of the model file
+//   worker -> coordinator  RESULT         u32 job id, u32 record count, encoded
+//                                         GameRecords (see record.h) in seed order
+//   coordinator -> worker  DONE           no more jobs, the worker exits
+//
+// A worker holds at most one job at a time and asks for a model only when a
+// job needs a version it doesn't have yet.
+
+#define DISTRIB_PROTOCOL_VERSION 1
+#define DISTRIB_DEFAULT_ADDRESS "127.0.0.1:20480"
+#define DISTRIB_HEADER_SIZE 5
+#define DISTRIB_MAX_PAYLOAD (256u << 20)
+
+typedef enum DistribMessageType {
+  DISTRIB_MSG_HELLO = 1,
+  DISTRIB_MSG_JOB,
+  DISTRIB_MSG_MODEL_REQUEST,
+  DISTRIB_MSG_MODEL,
+  DISTRIB_MSG_RESULT,
+  DISTRIB_MSG_DONE,
+} DistribMessageType;
+
+typedef struct DistribMessage {
+  u8 type;
+  const u8 *payload;
+  u32 size;
+} DistribMessage;
+
+// Buffered connection, usable both with blocking and non-blocking sockets.
+typedef struct DistribConn {
+  int fd;
+  u8 *read_buf;
+  u32 read_pos;
+  u32 read_len;
+  u32 read_cap;
+  u8 *write_buf;
+  u32 write_pos;
+  u32 write_len;
+  u32 write_cap;
+} DistribConn;
+
+// Growable payload being built.
+typedef struct DistribWriter {
+  u8 *data;
+  u32 size;
+  u32 cap;
+} DistribWriter;
+
+// Cursor over a received payload, `ok` turns false on the first read past the end.
+typedef struct DistribReader {
+  const u8 *data;
+  u32 size;
+  u32 pos;
+  bool ok;
+} DistribReader;
+
+// "host:port" with a numeric IPv4 host
+bool distrib_parse_address(const char *address, char *host, u32 host_size, u16 *port);
+int distrib_listen(const char *address);
+int distrib_connect(const char *address);
+
+void distrib_conn_init(DistribConn *conn, int fd);
+void distrib_conn_close(DistribConn *conn);
+void distrib_queue(DistribConn *conn, u8 type, const void *payload, u32 size);
+bool distrib_has_pending_writes(DistribConn *conn);
+// Writes as much of the queue as the socket takes. False on error.
+bool distrib_flush(DistribConn *conn);
+// Reads what the socket has. False on error or when the peer closed.
+bool distrib_fill(DistribConn *conn);
+// Pops the next complete message, its payload stays valid until the next
+// call to distrib_next_message() or distrib_fill(). Sets `error` on a
+// malformed stream.
+bool distrib_next_message(DistribConn *conn, DistribMessage *msg, bool *error);
+
+// Blocking helpers for clients.
+bool distrib_send(DistribConn *conn, u8 type, const void *payload, u32 size);
+bool distrib_receive(DistribConn *conn, DistribMessage *msg);
+
+void distrib_put(DistribWriter *writer, const void *data, u32 size);
+void distrib_put_u8(DistribWriter *writer, u8 v);
+void distrib_put_u32(DistribWriter *writer, u32 v);
+void distrib_put_u64(DistribWriter *writer, u64 v);
+// Makes room for `size` more bytes and returns where they go.
+u8 *distrib_reserve(DistribWriter *writer, u32 size);
+void distrib_writer_free(DistribWriter *writer);
+
+void distrib_reader_init(DistribReader *reader, const DistribMessage *msg);
+const u8 *distrib_get(DistribReader *reader, u32 size);
+u8 distrib_get_u8(DistribReader *reader);
+u32 distrib_get_u32(DistribReader *reader);
+u64 distrib_get_u64(DistribReader *reader);
@@ -1,7 +1,10 @@
 #include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "game.h"
 #include "timer.h"
@@ -10,6 +13,13 @@
 #define TILE_ANIM_SPEED 2.5f
 #define TILE_SPAWN_SPEED 8.0f
 #define GAMEOVER_ANIM_SPEED 175.f
+#define BOT_HANDSHAKE_TIMEOUT_MS 5000
+#define BOT_MOVE_TIMEOUT_MS 5000
+#define REPLAY_VIEWER_DEFAULT_SPEED 4.0f
+#define REPLAY_VIEWER_MIN_SPEED 0.25f
+#define REPLAY_VIEWER_MAX_SPEED 1024.0f
+// up to this speed every move slides like in a game, above it the board jumps
+#define REPLAY_VIEWER_ANIMATED_SPEED 4.0f
 
 Game game = {0};
 
@@ -58,6 +68,21 @@ Color get_tile_color(u16 value) {
   }
 }
 
+Board game_get_board(void) {
+  Board b = 0;
+
+  for (u8 y = 0; y < 4; y++) {
+    for (u8 x = 0; x < 4; x++) {
+      u16 value = game.board[y][x].value;
+      if (value > 0) {
+        b = board_set_tile(b, x, y, (u8)__builtin_ctz(value));
+      }
+    }
+  }
+
+  return b;
+}
+
 u8 get_tile_font_size(u16 value) {
   switch (value) {
     case 2:
@@ -89,51 +114,122 @@ u8 get_tile_font_size(u16 value) {
 //
 ///////////////////////////////////
 
-u16 get_spawned_tile_value(void) {
-  // 90% chance of spawning a 2, 10% chance of spawning a 4
-  if (rand() % 10 < 9) {
-    return 2;
-  } else {
-    return 4;
-  }
-}
-
 void spawn_new_tile_with_value(u8 x, u8 y, u16 value) {
   game.board[x][y].value = value;
   game.board[x][y].new_value = value;
 }
 
-void spawn_new_tile(u8 x, u8 y) {
-  const u16 val = get_spawned_tile_value();
+void set_board(Board b) {
+  for (u8 y = 0; y < 4; y++) {
+    for (u8 x = 0; x < 4; x++) {
+      u8 exponent = board_get_tile(b, x, y);
+      u16 value = exponent ? (u16)(1 << exponent) : 0;
+      game.board[y][x].value = value;
+      game.board[y][x].new_value = value;
+    }
+  }
+}
 
-  game.board[x][y].value = val;
-  game.board[x][y].new_value = val;
+// appends the game as it is now to the journal, when autosaving
+void autosave(void) {
+  if (game.autosaving) {
+    journal_append(&game.journal, &game.autosave);
+  }
 }
 
-Vec2 get_random_available_tile_coords(void) {
-  u8 available_tiles_count = 0;
-  u8 available_tiles[16];
+// Every spawn is drawn by the rules engine from the game's seeded Rng, so the
+// seed and the moves are enough to replay the game.
+void start_new_game(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  game.seed = ((u64)ts.tv_sec << 32) ^ (u64)ts.tv_nsec ^ ((u64)getpid() << 48);
+  rng_seed(&game.rng, game.seed);
+  Board b = board_new_game(&game.rng);
+  set_board(b);
+
+  game.autosave = (JournalEntry){.seed = game.seed, .board = b, .rng = game.rng};
+  autosave();
+  if (game.spectating) {
+    spectate_keyframe(&game.spectator, game.seed, b, 0, 0);
+  }
+  game.started_at = get_time();
 
-  for (int i = 0; i < 4; i++) {
-    for (int j = 0; j <= 3; j++) {
-      if (game.board[i][j].new_value == 0 && !game.board[i][j].merged) {
-        available_tiles[available_tiles_count] = i * 4 + j;
-        available_tiles_count++;
-      }
-    }
+  if (game.replay_dir) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%016llx.c2rp", game.replay_dir, (unsigned long long)game.seed);
+    game.recording = replay_writer_open(&game.replay, path, game.seed);
+  }
+}
+
+void resume_game(const JournalEntry *saved) {
+  game.seed = saved->seed;
+  game.rng = saved->rng;
+  game.score = saved->score;
+  set_board(saved->board);
+  game.autosave = *saved;
+  game.started_at = get_time();
+  if (game.spectating) {
+    spectate_keyframe(&game.spectator, saved->seed, saved->board, saved->score, saved->move_count);
   }
 
-  u8 rand_idx = rand() % available_tiles_count;
+  printf("[INFO] Resumed game %016llx at move %u\n", (unsigned long long)saved->seed, saved->move_count);
+  if (game.replay_dir) {
+    printf("[INFO] Its start wasn't recorded, recording starts with the next game\n");
+  }
+}
 
-  u8 x = available_tiles[rand_idx] / 4;
-  u8 y = available_tiles[rand_idx] % 4;
+// The puzzle's own generator state makes the spawns its solution was found
+// with. Puzzles aren't autosaved, recorded or scored.
+void start_puzzle(u32 index) {
+  PuzzleMode *mode = &game.puzzles;
+  mode->index = index % mode->pack.puzzle_count;
+  mode->puzzle = &mode->pack.puzzles[mode->index];
+  mode->moves_made = 0;
+  mode->on_line = true;
+  mode->solved = false;
+  mode->failed = false;
 
-  return (Vec2){x, y};
+  game.score = 0;
+  game.seed = mode->puzzle->rng_state;
+  game.rng = (Rng){mode->puzzle->rng_state};
+  set_board(mode->puzzle->board);
+  game.autosave = (JournalEntry){.seed = game.seed, .board = mode->puzzle->board, .rng = game.rng};
+  if (game.spectating) {
+    spectate_keyframe(&game.spectator, game.seed, mode->puzzle->board, 0, 0);
+  }
 }
 
-void spawn_random_tile(void) {
-  Vec2 coords = get_random_available_tile_coords();
-  spawn_new_tile(coords.x, coords.y);
+void puzzle_moved(MoveDir dir, Board moved) {
+  PuzzleMode *mode = &game.puzzles;
+  mode->on_line = mode->on_line && dir == puzzle_move(mode->puzzle, mode->moves_made);
+  mode->moves_made++;
+
+  if (board_max_exponent(moved) >= mode->puzzle->target_exponent) {
+    mode->solved = true;
+  } else if (mode->moves_made >= mode->puzzle->move_count) {
+    mode->failed = true;
+  }
+}
+
+void save_finished_game(void) {
+  if (!game.tracking_scores || game.viewer.active || game.puzzles.active) return;
+
+  ScoreEntry entry = {
+    .seed = game.seed,
+    .finished_at = (u64)time(NULL),
+    .score = game.score,
+    .moves = game.autosave.move_count,
+    .duration_ms = (u32)((get_time() - game.started_at) * 1000.0),
+    .max_exponent = board_max_exponent(game_get_board()),
+  };
+  scores_add(&game.scores, &entry);
+}
+
+void finish_replay(void) {
+  if (!game.recording) return;
+
+  replay_writer_close(&game.replay, game.score);
+  game.recording = false;
 }
 
 void move_right(void) {
@@ -181,8 +277,6 @@ void move_right(void) {
         }
         src->new_value = 0;
         game.animating = true;
-        game.spawning_tile_coords = get_random_available_tile_coords();
-        game.spawning_tile_value = get_spawned_tile_value();
       }
     }
   }
@@ -233,8 +327,6 @@ void move_left(void) {
         }
         src->new_value = 0;
         game.animating = true;
-        game.spawning_tile_coords = get_random_available_tile_coords();
-        game.spawning_tile_value = get_spawned_tile_value();
       }
     }
   }
@@ -282,8 +374,6 @@ void move_down(void) {
         }
         src->new_value = 0;
         game.animating = true;
-        game.spawning_tile_coords = get_random_available_tile_coords();
-        game.spawning_tile_value = get_spawned_tile_value();
       }
     }
   }
@@ -331,13 +421,58 @@ void move_up(void) {
         }
         src->new_value = 0;
         game.animating = true;
-        game.spawning_tile_coords = get_random_available_tile_coords();
-        game.spawning_tile_value = get_spawned_tile_value();
       }
     }
   }
 }
 
+void game_move(MoveDir dir) {
+  Board b = game_get_board();
+  if (!(board_legal_moves(b) & (1 << dir))) return;
+  u32 score_before = game.score;
+
+  switch (dir) {
+    case MOVE_DIR_UP:
+      move_up();
+      break;
+    case MOVE_DIR_DOWN:
+      move_down();
+      break;
+    case MOVE_DIR_LEFT:
+      move_left();
+      break;
+    case MOVE_DIR_RIGHT:
+      move_right();
+      break;
+  }
+
+  // the tile spawned once the slide animation is over
+  Board moved = board_move(b, dir, NULL);
+  Board spawned = board_spawn_random_tile(moved, &game.rng);
+  u8 idx = (u8)(__builtin_ctzll(spawned ^ moved) / 4);
+  game.spawning_tile_coords = (Vec2){idx / 4, idx % 4};
+  game.spawning_tile_value = (u16)(1 << board_get_tile(spawned, idx % 4, idx / 4));
+
+  if (game.recording) {
+    replay_writer_add_move(&game.replay, dir);
+  }
+
+  journal_entry_push_history(&game.autosave, b, score_before);
+  game.autosave.board = spawned;
+  game.autosave.rng = game.rng;
+  game.autosave.score = game.score;
+  game.autosave.move_count++;
+  autosave();
+
+  if (game.spectating) {
+    spectate_move(&game.spectator, dir, spawned, game.score);
+  }
+
+  if (game.puzzles.active) {
+    puzzle_moved(dir, moved);
+  }
+}
+
 bool gameover(void) {
   if (game.has_lost) return false;
 
@@ -361,36 +496,45 @@ bool gameover(void) {
   return true;
 }
 
-void reset_game(void) {
-  game.score = 0;
+void stop_animations(void) {
   game.animating = false;
   game.spawning_new_tile = false;
-  game.quit_dialog = false;
-  game.help_dialog = false;
-  game.settings_dialog = false;
+  game.spawning_tile_scale = 0.0f;
   game.has_lost = false;
   game.game_over_bg_opacity = 0;
   game.game_over_opacity = 0;
 
   for (int y = 0; y < 4; y++) {
     for (int x = 0; x < 4; x++) {
-      game.board[y][x].value = 0;
-      game.board[y][x].new_value = 0;
       game.board[y][x].merged = false;
       game.board[y][x].tiles_to_move = 0;
       game.board[y][x].anim_x_offset_relative = 0;
       game.board[y][x].anim_y_offset_relative = 0;
     }
   }
+}
 
-  for (int i = 0; i < 2; i++) {
-    spawn_random_tile();
+void reset_game(void) {
+  game.score = 0;
+  game.quit_dialog = false;
+  game.help_dialog = false;
+  game.settings_dialog = false;
+  game.scores_dialog = false;
+
+  finish_replay();
+  stop_animations();
+
+  if (game.puzzles.active) {
+    start_puzzle(game.puzzles.index);
+  } else {
+    start_new_game();
   }
 }
 
 void game_attempt_quit(void) {
   game.help_dialog = false;
   game.settings_dialog = false;
+  game.scores_dialog = false;
   game.quit_dialog = true;
 }
 
@@ -414,7 +558,7 @@ void reset_palette(void) {
 }
 
 void game_init(void) {
-  srand(time(NULL));
+  board_init_tables();
 
   game.icon_textures[HELP_ICON] = load_texture("assets/icons/help.png");
   game.icon_textures[SETTINGS_ICON] = load_texture("assets/icons/settings.png");
@@ -422,8 +566,24 @@ void game_init(void) {
 
   reset_palette();
 
-  for (int i = 0; i < 2; i++) {
-    spawn_random_tile();
+  // the viewer already shows the start of its replay
+  if (game.viewer.active) return;
+
+  if (game.puzzles.active) {
+    start_puzzle(game.puzzles.index);
+    return;
+  }
+
+  // a lost game isn't resumed
+  JournalEntry saved;
+  if (game.autosave_path && journal_load(game.autosave_path, &saved) && board_legal_moves(saved.board)) {
+    resume_game(&saved);
+  } else {
+    start_new_game();
+  }
+
+  if (game.autosave_path) {
+    game.autosaving = journal_open(&game.journal, game.autosave_path, &game.autosave);
   }
 }
 
@@ -689,6 +849,109 @@ void draw_settings_dialog(void) {
   }
 }
 
+void draw_scores_dialog(void) {
+  UIConstraints dialog_con = default_constraints;
+  set_width_constraint(&dialog_con, 1.f, UI_CONSTRAINT_RELATIVE);
+  set_height_constraint(&dialog_con, 1.f, UI_CONSTRAINT_RELATIVE);
+  set_x_constraint(&dialog_con, 0, UI_CONSTRAINT_FIXED);
+  set_y_constraint(&dialog_con, 0, UI_CONSTRAINT_FIXED);
+  UiStyle style = {
+    .bg_color = ColorRGBA(0, 0, 0, 200),
+    .align = ALIGN_CENTER,
+  };
+  draw_quad(&dialog_con, style);
+
+  UIConstraints content_card_con = default_constraints;
+  set_parent_constraint(&content_card_con, &dialog_con);
+  set_width_constraint(&content_card_con, 0.55f, UI_CONSTRAINT_RELATIVE);
+  set_height_constraint(&content_card_con, 0.6f, UI_CONSTRAINT_RELATIVE);
+  style = (UiStyle){
+    .bg_color = ColorRGBA(135, 124, 124, 255),
+    .border_radius = 8,
+    .align = ALIGN_CENTER,
+  };
+  draw_quad(&content_card_con, style);
+
+  UIConstraints text_con = default_constraints;
+  set_parent_constraint(&text_con, &content_card_con);
+  set_width_constraint(&text_con, 1, UI_CONSTRAINT_RELATIVE_PIXELS);
+  set_x_constraint(&text_con, 0, UI_CONSTRAINT_FIXED);
+  set_y_constraint(&text_con, 40, UI_CONSTRAINT_RELATIVE_PIXELS);
+  draw_text("Scores", 64.f, text_con, COLOR_YELLOW, ALIGN_TOP_CENTER);
+
+  // stats
+  ScoreStore *scores = &game.scores;
+  f64 games = scores->count ? (f64)scores->count : 1;
+  char stats[512];
+  snprintf(stats, sizeof(stats),
+      "Games: %u\n"
+      "Best: %u\n"
+      "Average: %.0f\n"
+      "Median: %u\n"
+      "Top 10%%: %u\n"
+      "Average moves: %.0f\n"
+      "Reached 1024: %.1f%%\n"
+      "Reached 2048: %.1f%%\n"
+      "Reached 4096: %.1f%%",
+      scores->count, scores_percentile(scores, 1.0), (f64)scores->score_sum / games, scores_percentile(scores, 0.5),
+      scores_percentile(scores, 0.9), (f64)scores->move_sum / games, 100.0 * scores_reach_rate(scores, 10),
+      100.0 * scores_reach_rate(scores, 11), 100.0 * scores_reach_rate(scores, 12));
+
+  const u8 font_size = 30;
+  set_x_constraint(&text_con, 30, UI_CONSTRAINT_RELATIVE_PIXELS);
+  set_y_constraint(&text_con, 150, UI_CONSTRAINT_RELATIVE_PIXELS);
+  draw_text("Stats", 40.f, text_con, COLOR_WHITE, ALIGN_TOP_LEFT);
+  set_y_constraint(&text_con, 210, UI_CONSTRAINT_RELATIVE_PIXELS);
+  draw_text(stats, font_size, text_con, COLOR_WHITE, ALIGN_TOP_LEFT);
+
+  // leaderboard, a column per field so they line up
+  ScoreEntry top[10];
+  u32 top_count = scores_top(scores, 10, top);
+  char ranks[128] = "";
+  char points[160] = "";
+  char tiles[160] = "";
+  char dates[256] = "";
+  for (u32 i = 0; i < top_count; i++) {
+    time_t finished_at = (time_t)top[i].finished_at;
+    char date[16];
+    strftime(date, sizeof(date), "%Y-%m-%d", localtime(&finished_at));
+    snprintf(ranks + strlen(ranks), sizeof(ranks) - strlen(ranks), "%u.\n", i + 1);
+    snprintf(points + strlen(points), sizeof(points) - strlen(points), "%u\n", top[i].score);
+    snprintf(tiles + strlen(tiles), sizeof(tiles) - strlen(tiles), "%u\n", 1u << top[i].max_exponent);
+    snprintf(dates + strlen(dates), sizeof(dates) - strlen(dates), "%s\n", date);
+  }
+
+  const f32 columns[] = {0.45f, 0.52f, 0.66f, 0.78f};
+  set_x_constraint(&text_con, columns[0], UI_CONSTRAINT_RELATIVE);
+  set_y_constraint(&text_con, 150, UI_CONSTRAINT_RELATIVE_PIXELS);
+  draw_text("Leaderboard", 40.f, text_con, COLOR_WHITE, ALIGN_TOP_LEFT);
+  set_y_constraint(&text_con, 210, UI_CONSTRAINT_RELATIVE_PIXELS);
+  if (top_count == 0) {
+    draw_text("No finished games yet", font_size, text_con, COLOR_WHITE, ALIGN_TOP_LEFT);
+  }
+  const char *column_texts[] = {ranks, points, tiles, dates};
+  for (u32 i = 0; i < 4 && top_count > 0; i++) {
+    set_x_constraint(&text_con, columns[i], UI_CONSTRAINT_RELATIVE);
+    draw_text(column_texts[i], font_size, text_con, COLOR_WHITE, ALIGN_TOP_LEFT);
+  }
+
+  UIConstraints btn_con = default_constraints;
+  set_parent_constraint(&btn_con, &content_card_con);
+  set_width_constraint(&btn_con, 56, UI_CONSTRAINT_RELATIVE_PIXELS);
+  set_height_constraint(&btn_con, 1, UI_CONSTRAINT_ASPECT_RATIO);
+  set_y_constraint(&btn_con, -24, UI_CONSTRAINT_RELATIVE_PIXELS);
+  set_x_constraint(&btn_con, 24, UI_CONSTRAINT_RELATIVE_PIXELS);
+  style = (UiStyle){
+    .bg_color = mult_color(COLOR_WHITE, 0.8f),
+    .fg_color = ColorRGBA(232, 28, 36, 255),
+    .border_radius = btn_con.height * 0.2f,
+    .align = ALIGN_TOP_RIGHT,
+  };
+  if (draw_icon_button(&btn_con, game.icon_textures[CLOSE_ICON], style, BUTTON_STATE_ACTIVE)) {
+    game.scores_dialog = false;
+  }
+}
+
 void draw_game_over(void) {
   UIConstraints dialog_con = default_constraints;
   set_width_constraint(&dialog_con, 1.f, UI_CONSTRAINT_RELATIVE);
@@ -737,7 +1000,7 @@ void draw_game_over(void) {
 }
 
 void draw_ui(void) {
-  ButtonState bg_btns_state = game.quit_dialog || game.help_dialog || game.settings_dialog || game.has_lost
+  ButtonState bg_btns_state = game.quit_dialog || game.help_dialog || game.settings_dialog || game.scores_dialog || game.has_lost
     ? BUTTON_STATE_INACTIVE
     : BUTTON_STATE_ACTIVE;
   const int icon_btn_width = 80;
@@ -775,10 +1038,21 @@ void draw_ui(void) {
     .border_radius = btn_con.height * 0.25f,
     .align = ALIGN_BOTTOM_CENTER,
   };
-  if (draw_button(&btn_con, "New Game", style, bg_btns_state)) {
+  if (draw_button(&btn_con, game.puzzles.active ? "Restart" : "New Game", style, bg_btns_state)) {
     reset_game();
   }
 
+  if (game.tracking_scores) {
+    set_x_constraint(&btn_con, icon_btn_offset, UI_CONSTRAINT_RELATIVE_PIXELS);
+    set_y_constraint(&btn_con, icon_btn_offset, UI_CONSTRAINT_RELATIVE_PIXELS);
+    set_width_constraint(&btn_con, 160, UI_CONSTRAINT_RELATIVE_PIXELS);
+    set_height_constraint(&btn_con, icon_btn_width, UI_CONSTRAINT_RELATIVE_PIXELS);
+    style.align = ALIGN_TOP_LEFT;
+    if (draw_button(&btn_con, "Scores", style, bg_btns_state)) {
+      game.scores_dialog = true;
+    }
+  }
+
   if (game.settings_dialog) {
     draw_settings_dialog();
   }
@@ -787,6 +1061,10 @@ void draw_ui(void) {
     draw_help_dialog();
   }
 
+  if (game.scores_dialog) {
+    draw_scores_dialog();
+  }
+
   if (game.has_lost) {
     draw_game_over();
   }
@@ -1012,6 +1290,11 @@ void update_positions(f64 delta_t) {
   if (gameover()) {
     game.has_lost = true;
     game.animating = true;
+    finish_replay();
+    save_finished_game();
+    if (game.spectating) {
+      spectate_game_over(&game.spectator);
+    }
   }
 
   if (game.spawning_new_tile) {
@@ -1034,6 +1317,334 @@ void update_positions(f64 delta_t) {
 }
 
 
+///////////////////////////////////
+//
+//
+// Replay viewer
+//
+//
+///////////////////////////////////
+
+
+// Shows the game after `move` moves of the replay, from its nearest keyframe.
+void viewer_seek(u32 move) {
+  ReplayViewer *viewer = &game.viewer;
+  viewer->move = CORE_MIN(move, viewer->replay.record.move_count);
+
+  Board b;
+  replay_seek(&viewer->replay, viewer->move, &b, &game.rng, &game.score);
+  stop_animations();
+  set_board(b);
+}
+
+// Plays the next move with the game's animation, game.rng is where the
+// replay's is so the same tile spawns.
+void viewer_step(void) {
+  ReplayViewer *viewer = &game.viewer;
+  if (viewer->move >= viewer->replay.record.move_count) return;
+
+  if (game.animating) {
+    viewer_seek(viewer->move + 1);
+    return;
+  }
+
+  game_move(record_get_move(&viewer->replay.record, viewer->move));
+  viewer->move++;
+}
+
+void update_viewer(f64 delta_t) {
+  ReplayViewer *viewer = &game.viewer;
+  u32 move_count = viewer->replay.record.move_count;
+
+  update_positions(delta_t);
+
+  if (viewer->paused || viewer->move >= move_count) {
+    viewer->pending = 0;
+    return;
+  }
+  if (viewer->speed <= REPLAY_VIEWER_ANIMATED_SPEED && game.animating) return;
+
+  viewer->pending += delta_t * viewer->speed;
+  if (viewer->pending < 1.0) return;
+
+  u32 steps = (u32)viewer->pending;
+  viewer->pending -= steps;
+  if (steps == 1 && viewer->speed <= REPLAY_VIEWER_ANIMATED_SPEED) {
+    viewer_step();
+  } else {
+    viewer_seek(viewer->move + steps);
+  }
+
+  if (viewer->move >= move_count) {
+    viewer->paused = true;
+  }
+}
+
+void handle_viewer_key(ZephrKeycode code) {
+  ReplayViewer *viewer = &game.viewer;
+  u32 move_count = viewer->replay.record.move_count;
+
+  switch (code) {
+    case ZEPHR_KEYCODE_SPACE:
+      // playing from the end starts over
+      if (viewer->paused && viewer->move >= move_count) {
+        viewer_seek(0);
+      }
+      viewer->paused = !viewer->paused;
+      break;
+    case ZEPHR_KEYCODE_RIGHT:
+      viewer->paused = true;
+      viewer_step();
+      break;
+    case ZEPHR_KEYCODE_LEFT:
+      viewer->paused = true;
+      if (viewer->move > 0) {
+        viewer_seek(viewer->move - 1);
+      }
+      break;
+    case ZEPHR_KEYCODE_UP:
+      viewer->speed = CORE_MIN(viewer->speed * 2, REPLAY_VIEWER_MAX_SPEED);
+      break;
+    case ZEPHR_KEYCODE_DOWN:
+      viewer->speed = CORE_MAX(viewer->speed / 2, REPLAY_VIEWER_MIN_SPEED);
+      break;
+    case ZEPHR_KEYCODE_HOME:
+      viewer_seek(0);
+      break;
+    case ZEPHR_KEYCODE_END:
+      viewer_seek(move_count);
+      break;
+    default:
+      break;
+  }
+}
+
+void draw_viewer_ui(void) {
+  ReplayViewer *viewer = &game.viewer;
+  u32 move_count = viewer->replay.record.move_count;
+  ButtonState state = game.quit_dialog ? BUTTON_STATE_INACTIVE : BUTTON_STATE_ACTIVE;
+
+  UIConstraints slider_con = default_constraints;
+  set_y_constraint(&slider_con, -0.12f, UI_CONSTRAINT_RELATIVE);
+  set_width_constraint(&slider_con, 0.5f, UI_CONSTRAINT_RELATIVE);
+  set_height_constraint(&slider_con, 12, UI_CONSTRAINT_RELATIVE_PIXELS);
+  UiStyle style = {
+    .bg_color = game.palette.board_bg_color,
+    .fg_color = ColorRGBA(201, 146, 126, 255),
+    .border_radius = slider_con.height * 0.5f,
+    .align = ALIGN_BOTTOM_CENTER,
+  };
+  f32 at = move_count ? (f32)viewer->move / (f32)move_count : 0;
+  f32 scrubbed = draw_slider(&slider_con, at, style, state);
+  if (scrubbed != at) {
+    viewer_seek((u32)roundf(scrubbed * (f32)move_count));
+  }
+
+  char status[96];
+  snprintf(status, sizeof(status), "Move %u / %u   %g moves/s%s", viewer->move, move_count, viewer->speed,
+      viewer->paused ? "   paused" : "");
+
+  UIConstraints text_con = default_constraints;
+  set_y_constraint(&text_con, -0.05f, UI_CONSTRAINT_RELATIVE);
+  set_width_constraint(&text_con, 1, UI_CONSTRAINT_RELATIVE_PIXELS);
+  draw_text(status, 32, text_con, COLOR_BLACK, ALIGN_BOTTOM_CENTER);
+
+  if (game.quit_dialog) {
+    draw_quit_dialog();
+  }
+}
+
+// A game of an archive, given as "<archive>.c2ra:<game id in hex>".
+bool open_archived_replay(const char *spec, const char *separator) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%.*s", (int)(separator - spec), spec);
+  char *end;
+  u64 id = strtoull(separator + 1, &end, 16);
+  if (*end != '\0') {
+    printf("[ERROR]: \"%s\" isn't a game id\n", separator + 1);
+    return false;
+  }
+
+  Archive archive;
+  if (!archive_open(&archive, path, false)) {
+    return false;
+  }
+
+  const ArchiveEntry *entry = archive_find(&archive, id);
+  u8 *data = entry ? malloc(CORE_MAX(1, entry->size)) : NULL;
+  bool ok = entry && archive_read(&archive, entry, data) && replay_open_memory(&game.viewer.replay, data, entry->size, spec);
+  if (!entry) {
+    printf("[ERROR]: archive \"%s\" has no game %016llx\n", path, (unsigned long long)id);
+  }
+
+  free(data);
+  archive_close(&archive);
+  return ok;
+}
+
+bool game_open_replay(const char *path) {
+  const char *separator = strrchr(path, ':');
+  bool archived = separator && separator - path >= 5 && strncmp(separator - 5, ".c2ra", 5) == 0;
+  if (archived ? !open_archived_replay(path, separator) : !replay_open(&game.viewer.replay, path)) {
+    return false;
+  }
+
+  game.viewer.active = true;
+  game.viewer.speed = REPLAY_VIEWER_DEFAULT_SPEED;
+  viewer_seek(0);
+
+  printf("[INFO] Replaying game %016llx, %u moves, score %u\n", (unsigned long long)game.viewer.replay.header.seed,
+      game.viewer.replay.record.move_count, game.viewer.replay.record.score);
+
+  return true;
+}
+
+bool game_export_video(VideoWriter *video, u32 fps, f32 speed) {
+  game_init();
+
+  ReplayViewer *viewer = &game.viewer;
+  viewer->paused = false;
+  viewer->speed = speed;
+  u32 move_count = viewer->replay.record.move_count;
+
+  f64 frame_time = 1.0 / fps;
+  // the last position stays on screen for a second
+  u32 end_frames = fps;
+  u64 frame = 0;
+  bool ok = true;
+
+  while (ok && end_frames > 0) {
+    update_viewer(frame_time);
+    draw_bg();
+    draw_board();
+
+    const u8 *pixels = zephr_read_frame();
+    if (pixels) {
+      ok = video_write_frame(video, pixels);
+    }
+
+    if (viewer->move >= move_count) {
+      end_frames--;
+    }
+    if (++frame % fps == 0) {
+      fprintf(stderr, "\rmove %u / %u, %llu frames, %.1fs", viewer->move, move_count,
+          (unsigned long long)video->frames, get_time());
+    }
+  }
+
+  for (const u8 *pixels; ok && (pixels = zephr_flush_frame());) {
+    ok = video_write_frame(video, pixels);
+  }
+  fprintf(stderr, "\rmove %u / %u, %llu frames, %.1fs\n", viewer->move, move_count,
+      (unsigned long long)video->frames, get_time());
+
+  replay_close(&viewer->replay);
+  if (!ok) {
+    printf("[ERROR]: failed to write the video\n");
+  }
+
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// Puzzles
+//
+//
+///////////////////////////////////
+
+
+bool puzzle_over(void) {
+  return game.puzzles.active && (game.puzzles.solved || game.puzzles.failed);
+}
+
+void handle_puzzle_key(ZephrKeycode code) {
+  PuzzleMode *mode = &game.puzzles;
+  u32 count = mode->pack.puzzle_count;
+
+  switch (code) {
+    case ZEPHR_KEYCODE_R:
+      reset_game();
+      break;
+    case ZEPHR_KEYCODE_N:
+      mode->index = (mode->index + 1) % count;
+      reset_game();
+      break;
+    case ZEPHR_KEYCODE_P:
+      mode->index = (mode->index + count - 1) % count;
+      reset_game();
+      break;
+    case ZEPHR_KEYCODE_H:
+      // the solution only holds from its own line
+      if (mode->on_line && !puzzle_over() && !game.animating && !game.has_lost) {
+        game_move(puzzle_move(mode->puzzle, mode->moves_made));
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void draw_puzzle_ui(void) {
+  PuzzleMode *mode = &game.puzzles;
+  const Puzzle *puzzle = mode->puzzle;
+
+  char title[96];
+  snprintf(title, sizeof(title), "Puzzle %u / %u: make %u in %u moves", mode->index + 1, mode->pack.puzzle_count,
+      1u << puzzle->target_exponent, puzzle->move_count);
+
+  char status[96];
+  if (mode->solved) {
+    snprintf(status, sizeof(status), "Solved in %u moves!   N: next puzzle", mode->moves_made);
+  } else if (mode->failed || game.has_lost) {
+    snprintf(status, sizeof(status), "Out of moves   R: retry   N: next puzzle");
+  } else {
+    u32 left = puzzle->move_count - mode->moves_made;
+    snprintf(status, sizeof(status), "%u move%s left%s   R: restart   N / P: next / previous", left,
+        left == 1 ? "" : "s", mode->on_line ? "   H: hint" : "");
+  }
+
+  UIConstraints text_con = default_constraints;
+  set_y_constraint(&text_con, 24, UI_CONSTRAINT_RELATIVE_PIXELS);
+  set_width_constraint(&text_con, 1, UI_CONSTRAINT_RELATIVE_PIXELS);
+  draw_text(title, 40, text_con, COLOR_BLACK, ALIGN_TOP_CENTER);
+
+  set_y_constraint(&text_con, 76, UI_CONSTRAINT_RELATIVE_PIXELS);
+  Color status_color = mode->solved ? ColorRGBA(40, 130, 60, 255) : COLOR_BLACK;
+  draw_text(status, 28, text_con, status_color, ALIGN_TOP_CENTER);
+}
+
+bool game_open_puzzles(const char *spec) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s", spec);
+  u32 number = 1;
+  char *separator = strrchr(path, ':');
+  if (separator) {
+    char *end;
+    number = (u32)strtoul(separator + 1, &end, 10);
+    if (*end != '\0' || number == 0) {
+      printf("[ERROR]: \"%s\" isn't a puzzle number\n", separator + 1);
+      return false;
+    }
+    *separator = '\0';
+  }
+
+  PuzzleMode *mode = &game.puzzles;
+  if (!puzzle_pack_open(&mode->pack, path)) return false;
+  if (mode->pack.puzzle_count == 0) {
+    printf("[ERROR]: puzzle pack \"%s\" is empty\n", path);
+    puzzle_pack_close(&mode->pack);
+    return false;
+  }
+
+  mode->active = true;
+  mode->index = (number - 1) % mode->pack.puzzle_count;
+  printf("[INFO] Playing %u puzzles from \"%s\"\n", mode->pack.puzzle_count, path);
+
+  return true;
+}
+
 ///////////////////////////////////
 //
 //
@@ -1044,7 +1655,8 @@ void update_positions(f64 delta_t) {
 
 
 void handle_keyboard_input(ZephrEvent e) {
-  bool can_move = !game.quit_dialog && !game.help_dialog && !game.settings_dialog && !game.animating;
+  bool can_move = !game.quit_dialog && !game.help_dialog && !game.settings_dialog && !game.scores_dialog && !game.animating &&
+    !puzzle_over();
 
   if (e.key.mods & ZEPHR_KEY_MOD_CTRL && e.key.code == ZEPHR_KEYCODE_Q) {
     game_attempt_quit();
@@ -1052,21 +1664,123 @@ void handle_keyboard_input(ZephrEvent e) {
     game.quit_dialog = false;
     game.help_dialog = false;
     game.settings_dialog = false;
+    game.scores_dialog = false;
   } else if (e.key.code == ZEPHR_KEYCODE_F11) {
     zephr_toggle_fullscreen();
+  } else if (game.viewer.active) {
+    if (!game.quit_dialog)
+      handle_viewer_key(e.key.code);
   } else if (e.key.code == ZEPHR_KEYCODE_UP) {
     if (can_move)
-      move_up();
+      game_move(MOVE_DIR_UP);
   } else if (e.key.code == ZEPHR_KEYCODE_DOWN) {
     if (can_move)
-      move_down();
+      game_move(MOVE_DIR_DOWN);
   } else if (e.key.code == ZEPHR_KEYCODE_LEFT) {
     if (can_move)
-      move_left();
+      game_move(MOVE_DIR_LEFT);
   } else if (e.key.code == ZEPHR_KEYCODE_RIGHT) {
     if (can_move)
-      move_right();
+      game_move(MOVE_DIR_RIGHT);
+  } else if (game.puzzles.active) {
+    if (!game.quit_dialog)
+      handle_puzzle_key(e.key.code);
+  }
+}
+
+bool game_attach_bot(const char *spec) {
+  // an engine dying mid request must not take the game down with it
+  signal(SIGPIPE, SIG_IGN);
+
+  if (!bot_open(&game.bot, spec)) {
+    return false;
+  }
+
+  BotResult res = bot_handshake(&game.bot, BOT_HANDSHAKE_TIMEOUT_MS);
+  if (res != BOT_OK) {
+    printf("[ERROR]: engine \"%s\" failed the handshake: %s\n", spec, bot_result_str(res));
+    bot_close(&game.bot);
+    return false;
   }
+
+  printf("[INFO] Engine \"%s\" is playing\n", game.bot.name);
+  game.has_bot = true;
+
+  return true;
+}
+
+void game_record_replays(const char *dir) {
+  game.replay_dir = dir;
+}
+
+void game_autosave(const char *path) {
+  game.autosave_path = path;
+}
+
+bool game_spectate(const char *path) {
+  game.spectating = spectate_open(&game.spectator, path);
+  return game.spectating;
+}
+
+bool game_track_scores(const char *path) {
+  game.tracking_scores = scores_open(&game.scores, path);
+  return game.tracking_scores;
+}
+
+void game_detach_bot(void) {
+  bot_close(&game.bot);
+  game.has_bot = false;
+  game.bot_waiting = false;
+}
+
+// Asks the engine for a move and polls for the answer on the frames after, so
+// a slow engine never holds up the window.
+void play_bot_move(void) {
+  bool can_move = !game.quit_dialog && !game.help_dialog && !game.settings_dialog && !game.scores_dialog && !game.animating &&
+    !game.has_lost && !puzzle_over();
+  Board b = game_get_board();
+
+  if (!game.bot_waiting) {
+    if (!can_move) return;
+
+    BotResult res = bot_send_moves(&game.bot, &b, 1, BOT_MOVE_TIMEOUT_MS);
+    if (res != BOT_OK) {
+      printf("[ERROR]: engine \"%s\" stopped playing: %s\n", game.bot.name, bot_result_str(res));
+      game_detach_bot();
+      return;
+    }
+
+    game.bot_waiting = true;
+    game.bot_board = b;
+    game.bot_deadline = get_time() + BOT_MOVE_TIMEOUT_MS / 1000.0;
+  }
+
+  MoveDir dir;
+  BotResult res = bot_poll_moves(&game.bot, 1, &dir);
+  if (res == BOT_PENDING) {
+    if (get_time() < game.bot_deadline) return;
+    res = BOT_TIMEOUT;
+  }
+  game.bot_waiting = false;
+
+  if (res != BOT_OK) {
+    printf("[ERROR]: engine \"%s\" stopped playing: %s\n", game.bot.name, bot_result_str(res));
+    game_detach_bot();
+    return;
+  }
+
+  // the board changed or a dialog opened while the engine was thinking, the
+  // move is asked for again once the game can take it
+  if (!can_move || b != game.bot_board) return;
+
+  // an illegal move would leave the board untouched and ask the engine again forever
+  if (!(board_legal_moves(b) & (1 << dir))) {
+    printf("[ERROR]: engine \"%s\" played an illegal move '%c'\n", game.bot.name, move_dir_to_char(dir));
+    game_detach_bot();
+    return;
+  }
+
+  game_move(dir);
 }
 
 void game_loop(void) {
@@ -1098,12 +1812,57 @@ void game_loop(void) {
     f64 delta_t = now - last_frame;
     last_frame = now;
 
-    update_positions(delta_t);
+    if (game.viewer.active) {
+      update_viewer(delta_t);
+    } else {
+      if (game.has_bot) {
+        play_bot_move();
+      }
+
+      update_positions(delta_t);
+    }
+
+    if (game.spectating) {
+      spectate_poll(&game.spectator);
+    }
 
     draw_bg();
     draw_board();
-    draw_ui();
+    if (game.viewer.active) {
+      draw_viewer_ui();
+    } else {
+      draw_ui();
+      if (game.puzzles.active) {
+        draw_puzzle_ui();
+      }
+    }
 
     zephr_swap_buffers();
   }
+
+  if (game.has_bot) {
+    game_detach_bot();
+  }
+
+  finish_replay();
+
+  if (game.autosaving) {
+    journal_close(&game.journal);
+  }
+
+  if (game.spectating) {
+    spectate_close(&game.spectator);
+  }
+
+  if (game.tracking_scores) {
+    scores_close(&game.scores);
+  }
+
+  if (game.viewer.active) {
+    replay_close(&game.viewer.replay);
+  }
+
+  if (game.puzzles.active) {
+    puzzle_pack_close(&game.puzzles.pack);
+  }
 }
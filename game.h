@@ -1,14 +1,16 @@
 #pragma once
 
+#include "archive.h"
+#include "board.h"
+#include "bot.h"
 #include "core.h"
+#include "journal.h"
+#include "puzzle.h"
+#include "replay.h"
+#include "scores.h"
+#include "spectate.h"
 #include "ui.h"
-
-typedef enum MoveDir {
-    MOVE_DIR_UP,
-    MOVE_DIR_DOWN,
-    MOVE_DIR_LEFT,
-    MOVE_DIR_RIGHT,
-} MoveDir;
+#include "video.h"
 
 typedef enum IconTexture {
     HELP_ICON,
@@ -34,6 +36,31 @@ typedef struct Tile {
     u8 tiles_to_move;
 } Tile;
 
+typedef struct ReplayViewer {
+    bool active;
+    Replay replay;
+    // moves of the replay shown so far
+    u32 move;
+    bool paused;
+    // moves per second
+    f32 speed;
+    // part of the next move already waited for
+    f64 pending;
+} ReplayViewer;
+
+typedef struct PuzzleMode {
+    bool active;
+    PuzzlePack pack;
+    u32 index;
+    const Puzzle *puzzle;
+    u32 moves_made;
+    // every move so far was the solution's, so hints can go on
+    bool on_line;
+    bool solved;
+    // out of moves without the target
+    bool failed;
+} PuzzleMode;
+
 typedef struct Game {
     Tile board[4][4];
     u32 score;
@@ -50,10 +77,62 @@ typedef struct Game {
     bool quit_dialog;
     bool help_dialog;
     bool settings_dialog;
+    bool scores_dialog;
 
     TextureId icon_textures[ICON_TEXTURE_COUNT];
     ColorPalette palette;
+
+    bool has_bot;
+    BotConn bot;
+    // a move was asked for `bot_board` and the answer is awaited until
+    // `bot_deadline`, polled once per frame
+    bool bot_waiting;
+    Board bot_board;
+    f64 bot_deadline;
+
+    u64 seed;
+    Rng rng;
+    // NULL unless games are recorded
+    const char *replay_dir;
+    bool recording;
+    ReplayWriter replay;
+
+    // NULL unless the game is autosaved
+    const char *autosave_path;
+    bool autosaving;
+    Journal journal;
+    // the game as it's journaled, updated on every move
+    JournalEntry autosave;
+
+    bool tracking_scores;
+    ScoreStore scores;
+    // time the game started, or was resumed at
+    f64 started_at;
+
+    bool spectating;
+    Spectator spectator;
+
+    ReplayViewer viewer;
+    PuzzleMode puzzles;
 } Game;
 
 void draw_board(void);
+bool game_attach_bot(const char *spec);
+// Records every game from now on to a replay file in `dir`.
+void game_record_replays(const char *dir);
+// Journals the game to `path` as it's played and resumes it from there.
+void game_autosave(const char *path);
+// Adds every finished game to the score store at `path`.
+bool game_track_scores(const char *path);
+// Streams the game to spectators connecting to the unix socket at `path`.
+bool game_spectate(const char *path);
+// Plays back a replay file, or a game of an archive (archive.h) given as
+// "<archive>.c2ra:<game id>", instead of a game. False if it can't be loaded.
+bool game_open_replay(const char *path);
+// Renders the opened replay to `video` at `fps` frames per second, `speed`
+// moves per second, as fast as it can with an offscreen context.
+bool game_export_video(VideoWriter *video, u32 fps, f32 speed);
+// Plays the puzzles of a pack (puzzle.h) instead of games, starting with
+// puzzle <n> (from 1) when given as "<pack>:<n>".
+bool game_open_puzzles(const char *spec);
 void game_loop(void);
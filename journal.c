@@ -0,0 +1,264 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+static void encode_entry(const JournalEntry *entry, u8 *out) {
+  u8 *p = out;
+  memcpy(p, &entry->seed, 8);
+  memcpy(p + 8, &entry->board, 8);
+  memcpy(p + 16, &entry->rng.state, 8);
+  memcpy(p + 24, &entry->score, 4);
+  memcpy(p + 28, &entry->move_count, 4);
+  memcpy(p + 32, &entry->history_len, 4);
+  p += 36;
+  for (u32 i = 0; i < JOURNAL_HISTORY_LEN; i++, p += 12) {
+    memcpy(p, &entry->history[i], 8);
+    memcpy(p + 8, &entry->history_scores[i], 4);
+  }
+
+  u32 checksum = core_fnv_hash32(out, JOURNAL_ENTRY_SIZE - 4, CORE_FNV_HASH32_INIT);
+  memcpy(p, &checksum, 4);
+}
+
+// False if the entry is torn or corrupted.
+static bool decode_entry(const u8 *data, JournalEntry *entry) {
+  u32 checksum;
+  memcpy(&checksum, data + JOURNAL_ENTRY_SIZE - 4, 4);
+  if (checksum != core_fnv_hash32(data, JOURNAL_ENTRY_SIZE - 4, CORE_FNV_HASH32_INIT)) return false;
+
+  const u8 *p = data;
+  memcpy(&entry->seed, p, 8);
+  memcpy(&entry->board, p + 8, 8);
+  memcpy(&entry->rng.state, p + 16, 8);
+  memcpy(&entry->score, p + 24, 4);
+  memcpy(&entry->move_count, p + 28, 4);
+  memcpy(&entry->history_len, p + 32, 4);
+  p += 36;
+  for (u32 i = 0; i < JOURNAL_HISTORY_LEN; i++, p += 12) {
+    memcpy(&entry->history[i], p, 8);
+    memcpy(&entry->history_scores[i], p + 8, 4);
+  }
+
+  return entry->history_len <= JOURNAL_HISTORY_LEN;
+}
+
+void journal_entry_push_history(JournalEntry *entry, Board board, u32 score) {
+  memmove(entry->history + 1, entry->history, (JOURNAL_HISTORY_LEN - 1) * sizeof(Board));
+  memmove(entry->history_scores + 1, entry->history_scores, (JOURNAL_HISTORY_LEN - 1) * sizeof(u32));
+  entry->history[0] = board;
+  entry->history_scores[0] = score;
+  entry->history_len = CORE_MIN(entry->history_len + 1, JOURNAL_HISTORY_LEN);
+}
+
+bool journal_load(const char *path, JournalEntry *entry) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  u8 header[JOURNAL_HEADER_SIZE];
+  u32 version = 0;
+  bool valid = fstat(fd, &st) == 0 && pread(fd, header, sizeof(header), 0) == sizeof(header);
+  if (valid) {
+    memcpy(&version, header + 4, 4);
+    valid = memcmp(header, JOURNAL_MAGIC, 4) == 0 && version == JOURNAL_VERSION;
+  }
+
+  // the newest entry that was written whole
+  bool found = false;
+  u64 count = valid ? ((u64)st.st_size - JOURNAL_HEADER_SIZE) / JOURNAL_ENTRY_SIZE : 0;
+  for (u64 i = count; i > 0 && !found; i--) {
+    u8 bytes[JOURNAL_ENTRY_SIZE];
+    off_t offset = (off_t)(JOURNAL_HEADER_SIZE + (i - 1) * JOURNAL_ENTRY_SIZE);
+    found = pread(fd, bytes, sizeof(bytes), offset) == sizeof(bytes) && decode_entry(bytes, entry);
+  }
+  close(fd);
+
+  if (!valid) {
+    printf("[WARN] \"%s\" is not an autosave journal, it will be replaced\n", path);
+  }
+
+  return found;
+}
+
+///////////////////////////////////
+//
+//
+// Writer
+//
+//
+///////////////////////////////////
+
+static bool write_all(int fd, const u8 *data, u64 size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    size -= (u64)written;
+  }
+
+  return true;
+}
+
+// Replaces the journal by one holding only `latest`, atomically so a crash
+// leaves either journal whole.
+static bool rewrite(Journal *journal, const JournalEntry *latest) {
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", journal->path);
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+
+  u8 bytes[JOURNAL_HEADER_SIZE + JOURNAL_ENTRY_SIZE];
+  u32 version = JOURNAL_VERSION;
+  memcpy(bytes, JOURNAL_MAGIC, 4);
+  memcpy(bytes + 4, &version, 4);
+  if (latest) {
+    encode_entry(latest, bytes + JOURNAL_HEADER_SIZE);
+  }
+
+  u64 size = JOURNAL_HEADER_SIZE + (latest ? JOURNAL_ENTRY_SIZE : 0);
+  if (!write_all(fd, bytes, size) || fsync(fd) != 0 || rename(tmp_path, journal->path) != 0) {
+    close(fd);
+    unlink(tmp_path);
+    return false;
+  }
+
+  // the descriptor now points at the journal, at its end
+  if (journal->fd >= 0) {
+    close(journal->fd);
+  }
+  journal->fd = fd;
+  journal->entries_in_file = latest ? 1 : 0;
+
+  return true;
+}
+
+static f64 ms_between(struct timespec from, struct timespec to) {
+  return (f64)(to.tv_sec - from.tv_sec) * 1000.0 + (f64)(to.tv_nsec - from.tv_nsec) / 1e6;
+}
+
+static void fail(Journal *journal) {
+  if (!journal->failed) {
+    printf("[ERROR]: autosave to \"%s\" failed, the game isn't saved anymore: %s\n", journal->path, strerror(errno));
+  }
+  journal->failed = true;
+}
+
+static void *writer_thread(void *arg) {
+  Journal *journal = arg;
+  u8 bytes[JOURNAL_QUEUE_LEN * JOURNAL_ENTRY_SIZE];
+  JournalEntry last;
+  // written but not synced yet
+  bool dirty = false;
+  struct timespec last_sync;
+  clock_gettime(CLOCK_REALTIME, &last_sync);
+
+  pthread_mutex_lock(&journal->lock);
+  for (;;) {
+    while (journal->queue_len == 0 && !journal->stopping) {
+      if (!dirty) {
+        pthread_cond_wait(&journal->cond, &journal->lock);
+        continue;
+      }
+
+      struct timespec deadline = last_sync;
+      deadline.tv_nsec += JOURNAL_SYNC_INTERVAL_MS * 1000000L;
+      deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+      deadline.tv_nsec %= 1000000000L;
+      if (pthread_cond_timedwait(&journal->cond, &journal->lock, &deadline) == ETIMEDOUT) break;
+    }
+
+    u32 count = journal->queue_len;
+    for (u32 i = 0; i < count; i++) {
+      last = journal->queue[(journal->queue_head + i) % JOURNAL_QUEUE_LEN];
+      encode_entry(&last, bytes + i * JOURNAL_ENTRY_SIZE);
+    }
+    journal->queue_head = (journal->queue_head + count) % JOURNAL_QUEUE_LEN;
+    journal->queue_len = 0;
+    bool stopping = journal->stopping;
+    pthread_mutex_unlock(&journal->lock);
+
+    if (count > 0 && !journal->failed) {
+      if (journal->entries_in_file + count > JOURNAL_COMPACT_ENTRIES) {
+        // synced by the rewrite
+        if (!rewrite(journal, &last)) fail(journal);
+        dirty = false;
+        clock_gettime(CLOCK_REALTIME, &last_sync);
+      } else if (write_all(journal->fd, bytes, (u64)count * JOURNAL_ENTRY_SIZE)) {
+        journal->entries_in_file += count;
+        dirty = true;
+      } else {
+        fail(journal);
+      }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (dirty && !journal->failed && (stopping || ms_between(last_sync, now) >= JOURNAL_SYNC_INTERVAL_MS)) {
+      if (fdatasync(journal->fd) != 0) fail(journal);
+      dirty = false;
+      last_sync = now;
+    }
+
+    pthread_mutex_lock(&journal->lock);
+    if (stopping && journal->queue_len == 0) break;
+  }
+  pthread_mutex_unlock(&journal->lock);
+
+  return NULL;
+}
+
+bool journal_open(Journal *journal, const char *path, const JournalEntry *latest) {
+  memset(journal, 0, sizeof(*journal));
+  journal->path = path;
+  journal->fd = -1;
+
+  if (!rewrite(journal, latest)) {
+    printf("[ERROR]: could not create the autosave journal \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  pthread_mutex_init(&journal->lock, NULL);
+  pthread_cond_init(&journal->cond, NULL);
+  if (pthread_create(&journal->thread, NULL, writer_thread, journal) != 0) {
+    printf("[ERROR]: could not start the autosave writer\n");
+    close(journal->fd);
+    return false;
+  }
+
+  return true;
+}
+
+void journal_append(Journal *journal, const JournalEntry *entry) {
+  pthread_mutex_lock(&journal->lock);
+  if (journal->queue_len == JOURNAL_QUEUE_LEN) {
+    journal->queue_head = (journal->queue_head + 1) % JOURNAL_QUEUE_LEN;
+    journal->queue_len--;
+  }
+  journal->queue[(journal->queue_head + journal->queue_len) % JOURNAL_QUEUE_LEN] = *entry;
+  journal->queue_len++;
+  pthread_cond_signal(&journal->cond);
+  pthread_mutex_unlock(&journal->lock);
+}
+
+void journal_close(Journal *journal) {
+  pthread_mutex_lock(&journal->lock);
+  journal->stopping = true;
+  pthread_cond_signal(&journal->cond);
+  pthread_mutex_unlock(&journal->lock);
+
+  pthread_join(journal->thread, NULL);
+  pthread_mutex_destroy(&journal->lock);
+  pthread_cond_destroy(&journal->cond);
+  close(journal->fd);
+  journal->fd = -1;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "board.h"
+
+// Autosave journal of the game being played.
+//
+// Every move appends a snapshot of the whole game to the journal, so resuming
+// only needs the last snapshot that made it to disk. Snapshots have a fixed
+// size and a checksum, a write torn by a crash is told apart and ignored.
+// File layout, little endian:
+//
+//   header  "C2JN" u32 version
+//   entry   u64 seed u64 board u64 rng_state u32 score u32 move_count
+//           u32 history_len, JOURNAL_HISTORY_LEN x (u64 board u32 score),
+//           u32 fnv32 of the entry before it
+//
+// Appending never touches the disk on the caller's thread: entries are queued
+// for a writer thread, which writes whatever is queued in one go and fsyncs
+// at most every JOURNAL_SYNC_INTERVAL_MS. The journal is rewritten down to its
+// last entry when opened and every JOURNAL_COMPACT_ENTRIES entries.
+
+#define JOURNAL_MAGIC "C2JN"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 8
+#define JOURNAL_HISTORY_LEN 8
+#define JOURNAL_ENTRY_SIZE (36 + JOURNAL_HISTORY_LEN * 12 + 4)
+// entries waiting for the writer, past it the oldest are dropped as only the
+// latest matters to resume
+#define JOURNAL_QUEUE_LEN 64
+#define JOURNAL_SYNC_INTERVAL_MS 250
+#define JOURNAL_COMPACT_ENTRIES 4096
+
+typedef struct JournalEntry {
+  u64 seed;
+  Board board;
+  Rng rng;
+  u32 score;
+  u32 move_count;
+  // positions before the last moves, newest first
+  u32 history_len;
+  Board history[JOURNAL_HISTORY_LEN];
+  u32 history_scores[JOURNAL_HISTORY_LEN];
+} JournalEntry;
+
+typedef struct Journal {
+  const char *path;
+  int fd;
+  u32 entries_in_file;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  JournalEntry queue[JOURNAL_QUEUE_LEN];
+  u32 queue_head;
+  u32 queue_len;
+  bool stopping;
+  // set by the writer on the first error, it stops writing
+  bool failed;
+} Journal;
+
+// Remembers `board` and `score` as the position before the entry's next move.
+void journal_entry_push_history(JournalEntry *entry, Board board, u32 score);
+
+// The last complete entry of the journal at `path`. False if there is none.
+bool journal_load(const char *path, JournalEntry *entry);
+// Starts a journal holding only `latest` (may be NULL) and its writer thread.
+bool journal_open(Journal *journal, const char *path, const JournalEntry *latest);
+void journal_append(Journal *journal, const JournalEntry *entry);
+// Writes and syncs what's queued and stops the writer.
+void journal_close(Journal *journal);
@@ -1,4 +1,8 @@
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "game.h"
 #include "zephr.h"
@@ -8,13 +12,162 @@ const char *font_path = "assets/fonts/Rubik/Rubik-VariableFont_wght.ttf";
 const char *game_icon_path = "assets/icon-128x128.png";
 const char *title = "C2048";
 
+// $XDG_STATE_HOME/c2048/<name>, or under ~/.local/state without it. Creates
+// the directory.
+bool default_state_path(const char *name, char *path, size_t size) {
+  const char *state_home = getenv("XDG_STATE_HOME");
+  const char *home = getenv("HOME");
+  char dir[4096];
+
+  if (state_home && *state_home) {
+    snprintf(dir, sizeof(dir), "%s/c2048", state_home);
+  } else if (home && *home) {
+    snprintf(dir, sizeof(dir), "%s/.local/state/c2048", home);
+  } else {
+    return false;
+  }
+
+  for (char *p = dir + 1; *p; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      mkdir(dir, 0755);
+      *p = '/';
+    }
+  }
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    printf("[WARN] could not create \"%s\", games won't be saved: %s\n", dir, strerror(errno));
+    return false;
+  }
+
+  snprintf(path, size, "%s/%s", dir, name);
+  return true;
+}
+
 int main(int argc, char *argv[]) {
-  CORE_UNUSED(argc);
-  CORE_UNUSED(argv);
+  const char *bot_spec = NULL;
+  const char *replay_dir = NULL;
+  const char *replay_path = NULL;
+  const char *autosave_path = NULL;
+  const char *scores_path = NULL;
+  const char *export_path = NULL;
+  const char *spectate_path = NULL;
+  const char *puzzles_spec = NULL;
+  u32 export_fps = 60;
+  f32 export_speed = 4;
+  bool autosave = true;
+  char default_autosave_path[4096];
+  char default_scores_path[4096];
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--bot") == 0 && i + 1 < argc) {
+      bot_spec = argv[++i];
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      replay_dir = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (strcmp(argv[i], "--autosave") == 0 && i + 1 < argc) {
+      autosave_path = argv[++i];
+    } else if (strcmp(argv[i], "--no-autosave") == 0) {
+      autosave = false;
+    } else if (strcmp(argv[i], "--scores") == 0 && i + 1 < argc) {
+      scores_path = argv[++i];
+    } else if (strcmp(argv[i], "--spectate") == 0 && i + 1 < argc) {
+      spectate_path = argv[++i];
+    } else if (strcmp(argv[i], "--puzzles") == 0 && i + 1 < argc) {
+      puzzles_spec = argv[++i];
+    } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+      export_path = argv[++i];
+    } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+      export_fps = CORE_MAX(1, (u32)strtoul(argv[++i], NULL, 10));
+    } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+      export_speed = CORE_MAX(0.25f, strtof(argv[++i], NULL));
+    } else {
+      printf("usage: %s [--bot <engine command | unix:path>] [--record <replay directory>] [--replay <replay file | archive.c2ra:id>]\n"
+          "       [--autosave <journal> | --no-autosave] [--scores <score store>] [--spectate <socket path>]\n"
+          "       [--puzzles <puzzle pack>[:<n>]]\n"
+          "       [--replay <replay file> --export <video.y4m | video.rgba | -> [--fps <n>] [--speed <moves/s>]]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  Size window_size = {1200, 800};
+
+  if (replay_path && (bot_spec || replay_dir || spectate_path)) {
+    printf("[ERROR]: --replay plays a recorded game, it can't be combined with --bot, --record or --spectate\n");
+    return 1;
+  }
+  if (puzzles_spec && (replay_path || replay_dir)) {
+    printf("[ERROR]: --puzzles can't be combined with --replay or --record\n");
+    return 1;
+  }
+
+  board_init_tables();
+
+  // rendered without a window, nothing else of the game runs
+  if (export_path) {
+    if (!replay_path) {
+      printf("[ERROR]: --export renders a replay, it needs --replay\n");
+      return 1;
+    }
 
-  zephr_init(font_path, game_icon_path, title, (Size){1200, 800}, true);
+    zephr_init_offscreen(font_path, window_size);
+    VideoWriter video;
+    bool ok = video_open(&video, export_path, window_size.width, window_size.height, export_fps) &&
+      game_open_replay(replay_path) && game_export_video(&video, export_fps, export_speed);
+    ok = video_close(&video) && ok;
+    zephr_deinit();
+
+    return ok ? 0 : 1;
+  }
+
+  zephr_init(font_path, game_icon_path, title, window_size, true);
   /* zephr_toggle_fullscreen(); */
 
+  if (spectate_path && !game_spectate(spectate_path)) {
+    zephr_deinit();
+    return 1;
+  }
+
+  if (bot_spec && !game_attach_bot(bot_spec)) {
+    zephr_deinit();
+    return 1;
+  }
+
+  if (replay_dir) {
+    game_record_replays(replay_dir);
+  }
+
+  if (replay_path && !game_open_replay(replay_path)) {
+    zephr_deinit();
+    return 1;
+  }
+
+  if (puzzles_spec && !game_open_puzzles(puzzles_spec)) {
+    zephr_deinit();
+    return 1;
+  }
+
+  // a replay being watched or a puzzle isn't a game to save
+  bool playing_games = !replay_path && !puzzles_spec;
+  if (autosave && playing_games) {
+    if (!autosave_path && default_state_path("autosave.c2j", default_autosave_path, sizeof(default_autosave_path))) {
+      autosave_path = default_autosave_path;
+    }
+    if (autosave_path) {
+      game_autosave(autosave_path);
+    }
+  }
+
+  if (playing_games) {
+    if (!scores_path && default_state_path("scores.c2s", default_scores_path, sizeof(default_scores_path))) {
+      scores_path = default_scores_path;
+    }
+    // the game goes on without its leaderboard
+    if (scores_path) {
+      game_track_scores(scores_path);
+    }
+  }
+
   game_loop();
 
   zephr_deinit();
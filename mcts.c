@@ -0,0 +1,96 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "mcts.h"
+
+void mcts_init(Mcts *mcts, u64 seed) {
+  mcts->playouts = MCTS_DEFAULT_PLAYOUTS;
+  mcts->playout_depth = MCTS_DEFAULT_PLAYOUT_DEPTH;
+  mcts->exploration = 0.5f;
+  rng_seed_independent(&mcts->rng, seed);
+  mcts->policy = NULL;
+}
+
+static MoveDir random_legal_move(Rng *rng, u8 legal) {
+  u32 pick = rng_bounded(rng, (u32)__builtin_popcount(legal));
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    if (legal & (1 << dir)) {
+      if (pick == 0) return dir;
+      pick--;
+    }
+  }
+  return MOVE_DIR_LEFT;
+}
+
+// points made from the afterstate `b` on, the root move's own points excluded
+static u32 playout(Mcts *mcts, Board b) {
+  u32 score = 0;
+  b = board_spawn_random_tile(b, &mcts->rng);
+
+  for (u32 i = 0; i < mcts->playout_depth; i++) {
+    u8 legal = board_legal_moves(b);
+    if (!legal) break;
+
+    MoveDir dir = mcts->policy ? policy_choose_move(mcts->policy, b) : random_legal_move(&mcts->rng, legal);
+    b = board_move(b, dir, &score);
+    b = board_spawn_random_tile(b, &mcts->rng);
+  }
+
+  return score;
+}
+
+MoveDir mcts_choose_move(Mcts *mcts, Board b) {
+  Board after[MOVE_DIR_COUNT];
+  u32 reward[MOVE_DIR_COUNT] = {0};
+  u32 visits[MOVE_DIR_COUNT] = {0};
+  f64 totals[MOVE_DIR_COUNT] = {0};
+  MoveDir moves[MOVE_DIR_COUNT];
+  u8 move_count = 0;
+
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    after[dir] = board_move(b, dir, &reward[dir]);
+    if (after[dir] != b && !mcts->policy) {
+      moves[move_count++] = dir;
+    }
+  }
+  if (mcts->policy) {
+    move_count = policy_order_moves(mcts->policy, b, moves);
+  }
+  if (move_count == 1) return moves[0];
+
+  f64 best_total = 1;
+  for (u32 n = 0; n < mcts->playouts; n++) {
+    MoveDir pick = moves[0];
+    if (n < move_count) {
+      pick = moves[n];
+    } else {
+      // UCB1 on values scaled to [0, 1] by the best playout so far
+      f64 best_ucb = -1;
+      f64 log_n = log((f64)n);
+      for (u8 i = 0; i < move_count; i++) {
+        MoveDir dir = moves[i];
+        f64 mean = totals[dir] / visits[dir] / best_total;
+        f64 ucb = mean + mcts->exploration * sqrt(log_n / visits[dir]);
+        if (ucb > best_ucb) {
+          best_ucb = ucb;
+          pick = dir;
+        }
+      }
+    }
+
+    u32 value = reward[pick] + playout(mcts, after[pick]);
+    totals[pick] += value;
+    visits[pick]++;
+    best_total = CORE_MAX(best_total, (f64)value);
+  }
+
+  MoveDir best = moves[0];
+  for (u8 i = 1; i < move_count; i++) {
+    MoveDir dir = moves[i];
+    if (visits[dir] > visits[best] || (visits[dir] == visits[best] && totals[dir] > totals[best])) {
+      best = dir;
+    }
+  }
+
+  return best;
+}
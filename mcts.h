@@ -0,0 +1,32 @@
+#pragma once
+
+#include "board.h"
+#include "policy.h"
+
+// Monte Carlo search over the moves of the current board.
+//
+// Every playout picks a root move with UCB1, then plays random moves from the
+// position it leads to until the game ends or `playout_depth` moves were made.
+// A playout is scored by the points it made, scaled by the best score seen so
+// far at this root, and the most played move is chosen. Spawns during playouts
+// come from the search's own Rng, never from the game's.
+//
+// With a policy model, playouts follow the policy's move instead of a random
+// one, and the root moves are tried in the policy's order, which also settles
+// ties between them in its favor.
+
+#define MCTS_DEFAULT_PLAYOUTS 400
+#define MCTS_DEFAULT_PLAYOUT_DEPTH 40
+
+typedef struct Mcts {
+  u32 playouts;
+  u32 playout_depth;
+  f32 exploration;
+  Rng rng;
+  // NULL for random playouts
+  const PolicyModel *policy;
+} Mcts;
+
+void mcts_init(Mcts *mcts, u64 seed);
+// `b` must have at least one legal move
+MoveDir mcts_choose_move(Mcts *mcts, Board b);
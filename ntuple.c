@@ -0,0 +1,201 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ntuple.h"
+
+#define NTUPLE_MAGIC "C2NT"
+#define NTUPLE_SYMMETRY_COUNT 8
+
+// tile indices of each tuple, `y * 4 + x`
+static const u8 tuple_cells[NTUPLE_TUPLE_COUNT][NTUPLE_TUPLE_LEN] = {
+  {0, 1, 2, 3},
+  {4, 5, 6, 7},
+  {0, 1, 4, 5},
+  {1, 2, 5, 6},
+  {5, 6, 9, 10},
+};
+
+void ntuple_init(NTupleNet *net) {
+  memset(net, 0, sizeof(*net));
+}
+
+bool ntuple_load(NTupleNet *net, const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    printf("[ERROR]: could not open n-tuple weights \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  char magic[4];
+  u32 header[3];
+  bool ok = fread(magic, 4, 1, fp) == 1 && memcmp(magic, NTUPLE_MAGIC, 4) == 0 &&
+    fread(header, sizeof(header), 1, fp) == 1 && header[0] == NTUPLE_VERSION && header[1] == NTUPLE_TUPLE_COUNT &&
+    fread(net->weights, sizeof(net->weights), 1, fp) == 1;
+  fclose(fp);
+
+  if (!ok) {
+    printf("[ERROR]: \"%s\" is not a version %d n-tuple weights file\n", path, NTUPLE_VERSION);
+    return false;
+  }
+  net->games_trained = header[2];
+
+  return true;
+}
+
+bool ntuple_save(const NTupleNet *net, const char *path) {
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    printf("[ERROR]: could not create \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  u32 header[3] = {NTUPLE_VERSION, NTUPLE_TUPLE_COUNT, net->games_trained};
+  bool ok = fwrite(NTUPLE_MAGIC, 4, 1, fp) == 1 && fwrite(header, sizeof(header), 1, fp) == 1 &&
+    fwrite(net->weights, sizeof(net->weights), 1, fp) == 1;
+  ok = fclose(fp) == 0 && ok;
+
+  if (!ok) {
+    printf("[ERROR]: failed to write \"%s\"\n", path);
+  }
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// Evaluation
+//
+//
+///////////////////////////////////
+
+// reverses the columns of every row
+static Board mirror(Board b) {
+  return ((b & 0x000F000F000F000FULL) << 12) | ((b & 0x00F000F000F000F0ULL) << 4) |
+    ((b & 0x0F000F000F000F00ULL) >> 4) | ((b & 0xF000F000F000F000ULL) >> 12);
+}
+
+// reverses the order of the rows
+static Board flip(Board b) {
+  return (b << 48) | ((b & 0xFFFF0000ULL) << 16) | ((b >> 16) & 0xFFFF0000ULL) | (b >> 48);
+}
+
+static void symmetries(Board b, Board *out) {
+  Board t = board_transpose(b);
+  Board f = flip(b);
+  Board ft = board_transpose(f);
+
+  out[0] = b;
+  out[1] = mirror(b);
+  out[2] = t;
+  out[3] = mirror(t);
+  out[4] = f;
+  out[5] = mirror(f);
+  out[6] = ft;
+  out[7] = mirror(ft);
+}
+
+static u32 tuple_index(Board b, u32 tuple) {
+  const u8 *cells = tuple_cells[tuple];
+  return (u32)((b >> (cells[0] * 4)) & 0xF) | (u32)((b >> (cells[1] * 4)) & 0xF) << 4 |
+    (u32)((b >> (cells[2] * 4)) & 0xF) << 8 | (u32)((b >> (cells[3] * 4)) & 0xF) << 12;
+}
+
+f32 ntuple_evaluate(const NTupleNet *net, Board b) {
+  Board boards[NTUPLE_SYMMETRY_COUNT];
+  symmetries(b, boards);
+
+  f32 value = 0;
+  for (u32 s = 0; s < NTUPLE_SYMMETRY_COUNT; s++) {
+    for (u32 t = 0; t < NTUPLE_TUPLE_COUNT; t++) {
+      value += net->weights[t][tuple_index(boards[s], t)];
+    }
+  }
+  return value;
+}
+
+static void update(NTupleNet *net, Board b, f32 delta) {
+  Board boards[NTUPLE_SYMMETRY_COUNT];
+  symmetries(b, boards);
+
+  for (u32 s = 0; s < NTUPLE_SYMMETRY_COUNT; s++) {
+    for (u32 t = 0; t < NTUPLE_TUPLE_COUNT; t++) {
+      net->weights[t][tuple_index(boards[s], t)] += delta;
+    }
+  }
+}
+
+static MoveDir best_afterstate(const NTupleNet *net, Board b, Board *after, u32 *reward, f32 *value) {
+  MoveDir best = MOVE_DIR_LEFT;
+  f32 best_value = -INFINITY;
+
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    u32 score = 0;
+    Board moved = board_move(b, dir, &score);
+    if (moved == b) continue;
+
+    f32 v = (f32)score + ntuple_evaluate(net, moved);
+    if (v > best_value) {
+      best_value = v;
+      best = dir;
+      *after = moved;
+      *reward = score;
+    }
+  }
+
+  *value = best_value;
+  return best;
+}
+
+MoveDir ntuple_choose_move(const NTupleNet *net, Board b) {
+  Board after;
+  u32 reward;
+  f32 value;
+  return best_afterstate(net, b, &after, &reward, &value);
+}
+
+///////////////////////////////////
+//
+//
+// Training
+//
+//
+///////////////////////////////////
+
+u32 ntuple_train_game(NTupleNet *net, Rng *rng, f32 learning_rate, Board *final_board) {
+  Board b = board_new_game(rng);
+  Board prev_after = 0;
+  bool has_prev = false;
+  u32 score = 0;
+
+  while (!board_is_game_over(b)) {
+    Board after;
+    u32 reward;
+    f32 value;
+    best_afterstate(net, b, &after, &reward, &value);
+
+    // the previous afterstate is worth what was gained from it plus the
+    // value of the next one
+    if (has_prev) {
+      update(net, prev_after, learning_rate * (value - ntuple_evaluate(net, prev_after)));
+    }
+
+    prev_after = after;
+    has_prev = true;
+    score += reward;
+    b = board_spawn_random_tile(after, rng);
+  }
+
+  // nothing follows the last afterstate
+  if (has_prev) {
+    update(net, prev_after, learning_rate * -ntuple_evaluate(net, prev_after));
+  }
+
+  net->games_trained++;
+  if (final_board) {
+    *final_board = b;
+  }
+
+  return score;
+}
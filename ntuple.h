@@ -0,0 +1,45 @@
+#pragma once
+
+#include "board.h"
+
+// N-tuple network value function.
+//
+// The value of a board is the sum, over every tuple and each of the 8
+// symmetries of the board, of a weight looked up by the exponents of the
+// tuple's 4 tiles. Symmetric positions share their weights, so 5 tuples cover
+// 40 placements: 2 rows (edge and middle) and 3 squares (corner, edge and
+// center).
+//
+// It values afterstates, the board right after a move and before the spawn,
+// and is trained with TD(0) on self-played games: a move is worth its merge
+// score plus the value of its afterstate.
+//
+// Weights file, little endian:
+//
+//   header   "C2NT" u32 version u32 tuple count u32 games trained
+//   weights  f32[tuple count][NTUPLE_TUPLE_SIZE]
+
+#define NTUPLE_VERSION 1
+#define NTUPLE_TUPLE_COUNT 5
+#define NTUPLE_TUPLE_LEN 4
+#define NTUPLE_TUPLE_SIZE (1u << (NTUPLE_TUPLE_LEN * 4))
+#define NTUPLE_DEFAULT_LEARNING_RATE 0.0025f
+
+typedef struct NTupleNet {
+  f32 weights[NTUPLE_TUPLE_COUNT][NTUPLE_TUPLE_SIZE];
+  u32 games_trained;
+} NTupleNet;
+
+// All weights zero.
+void ntuple_init(NTupleNet *net);
+bool ntuple_load(NTupleNet *net, const char *path);
+bool ntuple_save(const NTupleNet *net, const char *path);
+
+f32 ntuple_evaluate(const NTupleNet *net, Board b);
+// Legal move with the best merge score plus afterstate value, `b` must have a
+// legal move.
+MoveDir ntuple_choose_move(const NTupleNet *net, Board b);
+
+// Plays one game greedily with the current weights, updating them after every
+// move. Returns the final score. Not thread safe on a shared `net`.
+u32 ntuple_train_game(NTupleNet *net, Rng *rng, f32 learning_rate, Board *final_board);
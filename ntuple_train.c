@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ntuple.h"
+#include "timer.h"
+
+// Trains the weights of an n-tuple network by TD(0) self-play (see ntuple.h)
+// and saves them regularly, so a long run can be stopped at any time.
+
+#define REPORT_INTERVAL 1000
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] -o <file>\n"
+      "\n"
+      "options:\n"
+      "  -o <file>   weights to write\n"
+      "  -i <file>   keep training these weights instead of starting from zero\n"
+      "  -n <count>  games to play (default 100000)\n"
+      "  -s <seed>   seed of the first game (default 1)\n"
+      "  -a <rate>   learning rate (default %g)\n", prog, NTUPLE_DEFAULT_LEARNING_RATE);
+}
+
+int main(int argc, char *argv[]) {
+  const char *out_path = NULL;
+  const char *in_path = NULL;
+  u32 game_count = 100000;
+  u64 seed = 1;
+  f32 learning_rate = NTUPLE_DEFAULT_LEARNING_RATE;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:i:n:s:a:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        out_path = optarg;
+        break;
+      case 'i':
+        in_path = optarg;
+        break;
+      case 'n':
+        game_count = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'a':
+        learning_rate = strtof(optarg, NULL);
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!out_path) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  board_init_tables();
+  start_internal_timer();
+
+  NTupleNet *net = malloc(sizeof(NTupleNet));
+  ntuple_init(net);
+  if (in_path && !ntuple_load(net, in_path)) return 1;
+
+  Rng rng;
+  rng_seed(&rng, seed);
+
+  u64 score_sum = 0;
+  u32 reached_2048 = 0;
+  u32 best_score = 0;
+  f64 start = get_time();
+
+  for (u32 i = 1; i <= game_count; i++) {
+    Board final_board;
+    u32 score = ntuple_train_game(net, &rng, learning_rate, &final_board);
+    score_sum += score;
+    best_score = CORE_MAX(best_score, score);
+    reached_2048 += board_max_exponent(final_board) >= 11;
+
+    if (i % REPORT_INTERVAL == 0 || i == game_count) {
+      u32 games = (i - 1) % REPORT_INTERVAL + 1;
+      printf("%8u games  avg score %8.1f  best %6u  2048 %5.1f%%  %.1fs\n", net->games_trained,
+          (f64)score_sum / games, best_score, 100.0 * reached_2048 / games, get_time() - start);
+      fflush(stdout);
+      score_sum = 0;
+      reached_2048 = 0;
+      best_score = 0;
+
+      if (!ntuple_save(net, out_path)) return 1;
+    }
+  }
+
+  free(net);
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "planner.h"
+#include "timer.h"
+
+// Plans the shortest game reaching a tile from a seed and replays the plan
+// through the rules engine to check it.
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options]\n"
+      "\n"
+      "options:\n"
+      "  -s <seed>   seed of the game (default 1)\n"
+      "  -t <tile>   tile to reach (default 2048)\n"
+      "  -w <width>  beam width (default %d)\n"
+      "  -j <count>  threads expanding the beam (default: number of cores)\n"
+      "  -m <moves>  give up after this many moves (default %d)\n"
+      "  -q          don't print the moves\n", prog, PLANNER_DEFAULT_BEAM_WIDTH, PLANNER_DEFAULT_MAX_MOVES);
+}
+
+int main(int argc, char *argv[]) {
+  u64 seed = 1;
+  u32 target_tile = 2048;
+  u32 beam_width = PLANNER_DEFAULT_BEAM_WIDTH;
+  u32 thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+  u32 max_moves = PLANNER_DEFAULT_MAX_MOVES;
+  bool quiet = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:w:j:m:qh")) != -1) {
+    switch (opt) {
+      case 's':
+        seed = strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        target_tile = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        beam_width = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'j':
+        thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'm':
+        max_moves = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!CORE_IS_POWER_OF_TWO(target_tile) || target_tile < 2 || target_tile > (1u << BOARD_MAX_EXPONENT)) {
+    printf("[ERROR]: the target must be a tile value between 2 and %u\n", 1u << BOARD_MAX_EXPONENT);
+    return 1;
+  }
+  u8 target_exponent = (u8)__builtin_ctz(target_tile);
+
+  board_init_tables();
+  start_internal_timer();
+
+  Planner planner;
+  if (!planner_create(&planner, beam_width, thread_count)) return 1;
+  planner.max_moves = max_moves;
+
+  Rng rng;
+  rng_seed(&rng, seed);
+  Board start = board_new_game(&rng);
+
+  f64 plan_start = get_time();
+  PlanResult result;
+  planner_plan(&planner, start, rng, target_exponent, &result);
+  f64 plan_time = get_time() - plan_start;
+
+  planner_destroy(&planner);
+
+  // replay the plan from the seed, the same way the game would play it
+  Board b = start;
+  u32 score = 0;
+  for (u32 i = 0; i < result.move_count; i++) {
+    Board moved = board_move(b, result.moves[i], &score);
+    if (moved == b) {
+      printf("[ERROR]: move %u of the plan is illegal\n", i + 1);
+      return 1;
+    }
+    b = board_spawn_random_tile(moved, &rng);
+  }
+  if (b != result.final_board || score != result.score) {
+    printf("[ERROR]: replaying the plan doesn't end on the planned board\n");
+    return 1;
+  }
+
+  if (result.reached) {
+    printf("reached %u in %u moves (score %u) in %.3fs\n", target_tile, result.move_count, result.score, plan_time);
+  } else {
+    printf("could not reach %u, best line lasts %u moves (score %u) in %.3fs\n", target_tile, result.move_count,
+        result.score, plan_time);
+  }
+
+  if (!quiet) {
+    for (u32 i = 0; i < result.move_count; i++) {
+      putchar(move_dir_to_char(result.moves[i]));
+    }
+    putchar('\n');
+  }
+
+  bool reached = result.reached;
+  plan_result_free(&result);
+
+  return reached ? 0 : 2;
+}
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "planner.h"
+
+#define PLANNER_NO_PARENT U32_MAX
+
+///////////////////////////////////
+//
+//
+// Expansion
+//
+//
+///////////////////////////////////
+
+// The tile sum is the same for every board of a layer, so the sum of the
+// squared tile values only grows by merging bigger tiles together.
+static u64 rank_board(Board b) {
+  u64 rank = 0;
+  for (u8 i = 0; i < 16; i++) {
+    u8 exponent = (b >> (i * 4)) & 0xF;
+    if (exponent) {
+      rank += 1ULL << (exponent * 2);
+    }
+  }
+  return rank;
+}
+
+static void expand_slice(Planner *planner, u32 worker) {
+  u32 per_worker = CORE_DIV_ROUND_UP(planner->beam_size, planner->thread_count);
+  u32 start = worker * per_worker;
+  u32 end = CORE_MIN(planner->beam_size, start + per_worker);
+  if (start >= end) return;
+
+  u32 count = end - start;
+  Board *moved = &planner->moved[start * MOVE_DIR_COUNT];
+  u32 *gained = &planner->gained[start * MOVE_DIR_COUNT];
+
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    board_move_many(&planner->beam[start], &moved[dir * count], &gained[dir * count], count, dir);
+  }
+
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    for (u32 i = 0; i < count; i++) {
+      u32 parent = start + i;
+      BeamCandidate *cand = &planner->candidates[parent * MOVE_DIR_COUNT + dir];
+      Board after = moved[dir * count + i];
+
+      if (after == planner->beam[parent]) {
+        cand->board = 0;
+        continue;
+      }
+
+      Rng rng = planner->rng;
+      Board next = board_spawn_random_tile(after, &rng);
+      *cand = (BeamCandidate){
+        .board = next,
+        .rank = rank_board(next),
+        .parent = parent,
+        .move = dir,
+        .empty = board_count_empty(next),
+        .score = planner->beam_scores[parent] + gained[dir * count + i],
+      };
+    }
+  }
+}
+
+static void *planner_thread(void *arg) {
+  PlannerWorker *worker = arg;
+  Planner *planner = worker->planner;
+
+  for (;;) {
+    pthread_barrier_wait(&planner->barrier);
+    if (planner->quit) break;
+
+    expand_slice(planner, worker->index);
+    pthread_barrier_wait(&planner->barrier);
+  }
+
+  return NULL;
+}
+
+static void expand_layer(Planner *planner) {
+  // worker 0 is the calling thread
+  pthread_barrier_wait(&planner->barrier);
+  expand_slice(planner, 0);
+  pthread_barrier_wait(&planner->barrier);
+}
+
+///////////////////////////////////
+//
+//
+// Planner
+//
+//
+///////////////////////////////////
+
+bool planner_create(Planner *planner, u32 beam_width, u32 thread_count) {
+  memset(planner, 0, sizeof(*planner));
+  planner->beam_width = CORE_MAX(1, beam_width);
+  planner->max_moves = PLANNER_DEFAULT_MAX_MOVES;
+  planner->thread_count = CORE_MAX(1, thread_count);
+
+  u32 width = planner->beam_width;
+  planner->beam = malloc(width * sizeof(Board));
+  planner->beam_scores = malloc(width * sizeof(u32));
+  planner->beam_ids = malloc(width * sizeof(u32));
+  planner->candidates = malloc(width * MOVE_DIR_COUNT * sizeof(BeamCandidate));
+  planner->moved = malloc(width * MOVE_DIR_COUNT * sizeof(Board));
+  planner->gained = malloc(width * MOVE_DIR_COUNT * sizeof(u32));
+  planner->workers = calloc(planner->thread_count, sizeof(PlannerWorker));
+  planner->threads = calloc(planner->thread_count, sizeof(pthread_t));
+  if (!planner->beam || !planner->beam_scores || !planner->beam_ids || !planner->candidates || !planner->moved ||
+      !planner->gained || !planner->workers || !planner->threads) {
+    printf("[ERROR]: could not allocate a planner with a beam of %u boards\n", width);
+    planner_destroy(planner);
+    return false;
+  }
+
+  pthread_barrier_init(&planner->barrier, NULL, planner->thread_count);
+  for (u32 i = 1; i < planner->thread_count; i++) {
+    PlannerWorker *worker = &planner->workers[i];
+    worker->planner = planner;
+    worker->index = i;
+    pthread_create(&planner->threads[i], NULL, planner_thread, worker);
+  }
+  planner->running = true;
+
+  return true;
+}
+
+void planner_destroy(Planner *planner) {
+  if (planner->running) {
+    planner->quit = true;
+    pthread_barrier_wait(&planner->barrier);
+    for (u32 i = 1; i < planner->thread_count; i++) {
+      pthread_join(planner->threads[i], NULL);
+    }
+    pthread_barrier_destroy(&planner->barrier);
+  }
+
+  free(planner->beam);
+  free(planner->beam_scores);
+  free(planner->beam_ids);
+  free(planner->candidates);
+  free(planner->moved);
+  free(planner->gained);
+  free(planner->workers);
+  free(planner->threads);
+  free(planner->history_parents);
+  free(planner->history_moves);
+  memset(planner, 0, sizeof(*planner));
+}
+
+static u32 add_history(Planner *planner, u32 parent, u8 move) {
+  if (planner->history_size >= planner->history_cap) {
+    planner->history_cap = planner->history_cap ? planner->history_cap * 2 : 4096;
+    u32 *parents = realloc(planner->history_parents, planner->history_cap * sizeof(u32));
+    u8 *moves = realloc(planner->history_moves, planner->history_cap * sizeof(u8));
+    if (!parents || !moves) {
+      printf("[FATAL] Failed to reallocate memory for the plan history\n");
+      exit(1);
+    }
+    planner->history_parents = parents;
+    planner->history_moves = moves;
+  }
+
+  planner->history_parents[planner->history_size] = parent;
+  planner->history_moves[planner->history_size] = move;
+  return (u32)planner->history_size++;
+}
+
+static int compare_candidates(const void *a, const void *b) {
+  const BeamCandidate *ca = a;
+  const BeamCandidate *cb = b;
+  if (ca->rank != cb->rank) return ca->rank > cb->rank ? -1 : 1;
+  if (ca->empty != cb->empty) return ca->empty > cb->empty ? -1 : 1;
+  // equal boards end up next to each other so they can be skipped
+  if (ca->board != cb->board) return ca->board < cb->board ? -1 : 1;
+  return 0;
+}
+
+// Walks the history back from `id` and appends `last_move` if it's a valid
+// move, i.e. the plan ends on a candidate that isn't in the history.
+static void build_result(Planner *planner, u32 id, i32 last_move, Board board, u32 score, bool reached,
+    PlanResult *result) {
+  u32 length = last_move >= 0 ? 1 : 0;
+  for (u32 i = id; planner->history_parents[i] != PLANNER_NO_PARENT; i = planner->history_parents[i]) {
+    length++;
+  }
+
+  *result = (PlanResult){
+    .reached = reached,
+    .move_count = length,
+    .moves = malloc(CORE_MAX(1, length)),
+    .final_board = board,
+    .score = score,
+  };
+
+  u32 pos = length;
+  if (last_move >= 0) {
+    result->moves[--pos] = (u8)last_move;
+  }
+  for (u32 i = id; planner->history_parents[i] != PLANNER_NO_PARENT; i = planner->history_parents[i]) {
+    result->moves[--pos] = planner->history_moves[i];
+  }
+}
+
+void planner_plan(Planner *planner, Board start, Rng rng, u8 target_exponent, PlanResult *result) {
+  planner->history_size = 0;
+  planner->beam[0] = start;
+  planner->beam_scores[0] = 0;
+  planner->beam_ids[0] = add_history(planner, PLANNER_NO_PARENT, 0);
+  planner->beam_size = 1;
+  planner->rng = rng;
+
+  if (board_max_exponent(start) >= target_exponent) {
+    build_result(planner, planner->beam_ids[0], -1, start, 0, true, result);
+    return;
+  }
+
+  for (u32 move = 0; move < planner->max_moves; move++) {
+    expand_layer(planner);
+
+    // drop the illegal moves
+    u32 count = 0;
+    for (u32 i = 0; i < planner->beam_size * MOVE_DIR_COUNT; i++) {
+      if (planner->candidates[i].board != 0) {
+        planner->candidates[count++] = planner->candidates[i];
+      }
+    }
+    if (count == 0) break;
+
+    for (u32 i = 0; i < count; i++) {
+      BeamCandidate *cand = &planner->candidates[i];
+      if (board_max_exponent(cand->board) >= target_exponent) {
+        build_result(planner, planner->beam_ids[cand->parent], cand->move, cand->board, cand->score, true, result);
+        return;
+      }
+    }
+
+    qsort(planner->candidates, count, sizeof(BeamCandidate), compare_candidates);
+
+    // the candidates are read through their parents, so the new layer is only
+    // written once every candidate has been looked at
+    u32 size = 0;
+    for (u32 i = 0; i < count && size < planner->beam_width; i++) {
+      BeamCandidate *cand = &planner->candidates[i];
+      if (i > 0 && cand->board == planner->candidates[i - 1].board) continue;
+      cand->parent = add_history(planner, planner->beam_ids[cand->parent], cand->move);
+      size++;
+    }
+
+    size = 0;
+    for (u32 i = 0; i < count && size < planner->beam_width; i++) {
+      BeamCandidate *cand = &planner->candidates[i];
+      if (i > 0 && cand->board == planner->candidates[i - 1].board) continue;
+      planner->beam[size] = cand->board;
+      planner->beam_scores[size] = cand->score;
+      planner->beam_ids[size] = cand->parent;
+      size++;
+    }
+    planner->beam_size = size;
+
+    // every spawn draws twice whatever the board, see planner.h
+    rng_next(&planner->rng);
+    rng_next(&planner->rng);
+  }
+
+  build_result(planner, planner->beam_ids[0], -1, planner->beam[0], planner->beam_scores[0], false, result);
+}
+
+void plan_result_free(PlanResult *result) {
+  free(result->moves);
+  memset(result, 0, sizeof(*result));
+}
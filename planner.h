@@ -0,0 +1,84 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "board.h"
+
+// Beam search for the shortest sequence of moves reaching a target tile.
+//
+// Every spawn draws exactly two numbers from the game's Rng whatever the move
+// was, so once the generator state is known the tiles that will appear are
+// fixed and a game is deterministic. The planner exploits this: all the
+// boards of a beam layer share one generator state, and the next layer keeps
+// the `beam_width` best distinct boards reachable in one more move, ranked by
+// how concentrated their tiles are (the sum of the tiles is the same for the
+// whole layer). Layers are expanded on a pool of threads that lives as long
+// as the planner, so repeated plans don't pay for thread creation.
+
+#define PLANNER_DEFAULT_BEAM_WIDTH 1024
+#define PLANNER_DEFAULT_MAX_MOVES 100000
+
+typedef struct PlanResult {
+  bool reached;
+  u32 move_count;
+  // one MoveDir per move, owned by the result
+  u8 *moves;
+  Board final_board;
+  u32 score;
+} PlanResult;
+
+typedef struct BeamCandidate {
+  Board board;
+  u64 rank;
+  u32 parent;
+  u8 move;
+  u8 empty;
+  u32 score;
+} BeamCandidate;
+
+typedef struct Planner Planner;
+
+typedef struct PlannerWorker {
+  Planner *planner;
+  u32 index;
+} PlannerWorker;
+
+struct Planner {
+  u32 beam_width;
+  u32 max_moves;
+  u32 thread_count;
+  PlannerWorker *workers;
+  pthread_t *threads;
+  pthread_barrier_t barrier;
+  bool running;
+  bool quit;
+
+  // current layer, `beam_size` boards all sharing `rng`
+  Board *beam;
+  u32 *beam_scores;
+  // history entry of every beam board
+  u32 *beam_ids;
+  u32 beam_size;
+  Rng rng;
+
+  // MOVE_DIR_COUNT candidates per beam board, filled by the workers
+  BeamCandidate *candidates;
+  Board *moved;
+  u32 *gained;
+
+  // parent and move of every board of every layer, to rebuild the plan
+  u32 *history_parents;
+  u8 *history_moves;
+  u64 history_size;
+  u64 history_cap;
+};
+
+// `thread_count` includes the thread calling planner_plan()
+bool planner_create(Planner *planner, u32 beam_width, u32 thread_count);
+void planner_destroy(Planner *planner);
+
+// Plans from board `start` where the next spawn will be drawn from `rng`.
+// If the target can't be reached within planner->max_moves, the result holds
+// the line that survived longest.
+void planner_plan(Planner *planner, Board start, Rng rng, u8 target_exponent, PlanResult *result);
+void plan_result_free(PlanResult *result);
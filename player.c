@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "player.h"
+
+const char *player_names[PLAYER_KIND_COUNT] = {
+  [PLAYER_RANDOM] = "random",
+  [PLAYER_GREEDY] = "greedy",
+  [PLAYER_POLICY] = "policy",
+};
+
+void player_init(Player *player, PlayerKind kind, u64 seed) {
+  memset(player, 0, sizeof(*player));
+  player->kind = kind;
+  rng_seed_independent(&player->rng, seed);
+}
+
+void player_deinit(Player *player) {
+  CORE_UNUSED(player);
+}
+
+bool player_kind_from_name(const char *name, PlayerKind *kind) {
+  for (u32 i = 0; i < PLAYER_KIND_COUNT; i++) {
+    if (strcmp(name, player_names[i]) == 0) {
+      *kind = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *player_kind_name(PlayerKind kind) {
+  return player_names[kind];
+}
+
+///////////////////////////////////
+//
+//
+// Policies
+//
+//
+///////////////////////////////////
+
+MoveDir choose_random_move(Player *player, Board b) {
+  u8 legal = board_legal_moves(b);
+  u8 count = (u8)__builtin_popcount(legal);
+  u32 pick = rng_bounded(&player->rng, count);
+
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    if (legal & (1 << dir)) {
+      if (pick == 0) return dir;
+      pick--;
+    }
+  }
+
+  return MOVE_DIR_LEFT;
+}
+
+// highest immediate score, ties broken by the number of empty tiles left
+MoveDir choose_greedy_move(Board b) {
+  MoveDir best = MOVE_DIR_LEFT;
+  i64 best_value = -1;
+
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    u32 score = 0;
+    Board moved = board_move(b, dir, &score);
+    if (moved == b) continue;
+
+    i64 value = (i64)score * 16 + board_count_empty(moved);
+    if (value > best_value) {
+      best_value = value;
+      best = dir;
+    }
+  }
+
+  return best;
+}
+
+MoveDir player_choose_move(Player *player, Board b) {
+  switch (player->kind) {
+    case PLAYER_RANDOM:
+      return choose_random_move(player, b);
+    case PLAYER_GREEDY:
+      return choose_greedy_move(b);
+    case PLAYER_POLICY:
+      CORE_DEBUG_ASSERT(player->policy, "policy players need a model");
+      return policy_choose_move(player->policy, b);
+    case PLAYER_KIND_COUNT:
+      break;
+  }
+
+  return choose_random_move(player, b);
+}
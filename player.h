@@ -0,0 +1,28 @@
+#pragma once
+
+#include "board.h"
+#include "policy.h"
+
+// Built-in move policies used for self-play and benchmarks.
+
+typedef enum PlayerKind {
+  PLAYER_RANDOM,
+  PLAYER_GREEDY,
+  // needs `policy` to be set after player_init()
+  PLAYER_POLICY,
+
+  PLAYER_KIND_COUNT,
+} PlayerKind;
+
+typedef struct Player {
+  PlayerKind kind;
+  Rng rng;
+  const PolicyModel *policy;
+} Player;
+
+void player_init(Player *player, PlayerKind kind, u64 seed);
+void player_deinit(Player *player);
+bool player_kind_from_name(const char *name, PlayerKind *kind);
+const char *player_kind_name(PlayerKind kind);
+// `b` must have at least one legal move
+MoveDir player_choose_move(Player *player, Board b);
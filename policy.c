@@ -0,0 +1,482 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "policy.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define POLICY_X86 1
+#include <immintrin.h>
+#else
+#define POLICY_X86 0
+#endif
+
+#define POLICY_MAGIC "C2PN"
+#define POLICY_HEADER_SIZE 28
+
+const char *kernel_names[POLICY_KERNEL_COUNT] = {
+  [POLICY_KERNEL_SCALAR] = "scalar",
+  [POLICY_KERNEL_AVX2] = "avx2",
+  [POLICY_KERNEL_AVX_VNNI] = "avx-vnni",
+  [POLICY_KERNEL_AVX512_VNNI] = "avx512-vnni",
+};
+
+///////////////////////////////////
+//
+//
+// Kernels
+//
+//
+///////////////////////////////////
+
+static u8 clamp_activation(i32 v, u8 shift) {
+  return (u8)CORE_CLAMP(v >> shift, 0, 127);
+}
+
+// shared by every kernel, 4 x 32 weights aren't worth vectorizing
+static void output_layer(const PolicyModel *model, const u8 *h2, i32 *logits) {
+  for (u32 o = 0; o < POLICY_OUTPUTS; o++) {
+    i32 sum = model->b3[o];
+    for (u32 i = 0; i < POLICY_HIDDEN2; i++) {
+      sum += h2[i] * model->w3[o][i];
+    }
+    logits[o] = sum;
+  }
+}
+
+static void forward_scalar(const PolicyModel *model, Board b, i32 *logits) {
+  i16 acc1[POLICY_HIDDEN1];
+  memcpy(acc1, model->b1, sizeof(acc1));
+  for (u32 tile = 0; tile < 16; tile++) {
+    const i16 *row = model->w1[tile * 16 + ((b >> (tile * 4)) & 0xF)];
+    for (u32 i = 0; i < POLICY_HIDDEN1; i++) {
+      acc1[i] = (i16)(acc1[i] + row[i]);
+    }
+  }
+
+  u8 h1[POLICY_HIDDEN1];
+  for (u32 i = 0; i < POLICY_HIDDEN1; i++) {
+    h1[i] = clamp_activation(acc1[i], model->shift1);
+  }
+
+  // same order as the vector kernels so the weights are read sequentially
+  i32 acc2[POLICY_HIDDEN2];
+  memcpy(acc2, model->b2, sizeof(acc2));
+  for (u32 k = 0; k < POLICY_HIDDEN1 / 4; k++) {
+    for (u32 o = 0; o < POLICY_HIDDEN2; o++) {
+      for (u32 j = 0; j < 4; j++) {
+        acc2[o] += h1[k * 4 + j] * model->w2[k][o][j];
+      }
+    }
+  }
+
+  u8 h2[POLICY_HIDDEN2];
+  for (u32 o = 0; o < POLICY_HIDDEN2; o++) {
+    h2[o] = clamp_activation(acc2[o], model->shift2);
+  }
+
+  output_layer(model, h2, logits);
+}
+
+#if POLICY_X86
+
+// first layer and its activation, the 64 u8 activations are written to `h1`
+__attribute__((target("avx2")))
+static void first_layer_avx2(const PolicyModel *model, Board b, u8 *h1) {
+  __m256i acc[4];
+  for (u32 i = 0; i < 4; i++) {
+    acc[i] = _mm256_loadu_si256((const __m256i *)&model->b1[i * 16]);
+  }
+
+  for (u32 tile = 0; tile < 16; tile++) {
+    const i16 *row = model->w1[tile * 16 + ((b >> (tile * 4)) & 0xF)];
+    for (u32 i = 0; i < 4; i++) {
+      acc[i] = _mm256_add_epi16(acc[i], _mm256_loadu_si256((const __m256i *)&row[i * 16]));
+    }
+  }
+
+  __m128i shift = _mm_cvtsi32_si128(model->shift1);
+  __m256i max = _mm256_set1_epi16(127);
+  for (u32 i = 0; i < 4; i += 2) {
+    __m256i lo = _mm256_min_epi16(_mm256_sra_epi16(acc[i], shift), max);
+    __m256i hi = _mm256_min_epi16(_mm256_sra_epi16(acc[i + 1], shift), max);
+    // packus clamps negatives to 0 but interleaves the 128 bit lanes
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+    _mm256_storeu_si256((__m256i *)&h1[i * 16], packed);
+  }
+}
+
+__attribute__((target("avx2")))
+static void store_hidden2_avx2(const PolicyModel *model, __m256i *acc, u8 *h2) {
+  __m128i shift = _mm_cvtsi32_si128(model->shift2);
+  __m256i max = _mm256_set1_epi32(127);
+  __m256i zero = _mm256_setzero_si256();
+  i32 out[POLICY_HIDDEN2];
+  for (u32 q = 0; q < POLICY_HIDDEN2 / 8; q++) {
+    __m256i v = _mm256_add_epi32(acc[q], _mm256_loadu_si256((const __m256i *)&model->b2[q * 8]));
+    v = _mm256_max_epi32(_mm256_min_epi32(_mm256_sra_epi32(v, shift), max), zero);
+    _mm256_storeu_si256((__m256i *)&out[q * 8], v);
+  }
+  for (u32 i = 0; i < POLICY_HIDDEN2; i++) {
+    h2[i] = (u8)out[i];
+  }
+}
+
+__attribute__((target("avx2")))
+static void forward_avx2(const PolicyModel *model, Board b, i32 *logits) {
+  u8 h1[POLICY_HIDDEN1];
+  first_layer_avx2(model, b, h1);
+
+  __m256i acc[POLICY_HIDDEN2 / 8] = {0};
+  __m256i ones = _mm256_set1_epi16(1);
+  for (u32 k = 0; k < POLICY_HIDDEN1 / 4; k++) {
+    u32 group;
+    memcpy(&group, &h1[k * 4], 4);
+    __m256i in = _mm256_set1_epi32((i32)group);
+    for (u32 q = 0; q < POLICY_HIDDEN2 / 8; q++) {
+      __m256i w = _mm256_loadu_si256((const __m256i *)model->w2[k][q * 8]);
+      // activations <= 127 keep the pairwise i16 sums from saturating
+      __m256i sum = _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones);
+      acc[q] = _mm256_add_epi32(acc[q], sum);
+    }
+  }
+
+  u8 h2[POLICY_HIDDEN2];
+  store_hidden2_avx2(model, acc, h2);
+  output_layer(model, h2, logits);
+}
+
+__attribute__((target("avx2,avxvnni")))
+static void forward_avx_vnni(const PolicyModel *model, Board b, i32 *logits) {
+  u8 h1[POLICY_HIDDEN1];
+  first_layer_avx2(model, b, h1);
+
+  __m256i acc[POLICY_HIDDEN2 / 8] = {0};
+  for (u32 k = 0; k < POLICY_HIDDEN1 / 4; k++) {
+    u32 group;
+    memcpy(&group, &h1[k * 4], 4);
+    __m256i in = _mm256_set1_epi32((i32)group);
+    for (u32 q = 0; q < POLICY_HIDDEN2 / 8; q++) {
+      __m256i w = _mm256_loadu_si256((const __m256i *)model->w2[k][q * 8]);
+      acc[q] = _mm256_dpbusd_avx_epi32(acc[q], in, w);
+    }
+  }
+
+  u8 h2[POLICY_HIDDEN2];
+  store_hidden2_avx2(model, acc, h2);
+  output_layer(model, h2, logits);
+}
+
+__attribute__((target("avx2,avx512vnni,avx512vl")))
+static void forward_avx512_vnni(const PolicyModel *model, Board b, i32 *logits) {
+  u8 h1[POLICY_HIDDEN1];
+  first_layer_avx2(model, b, h1);
+
+  __m256i acc[POLICY_HIDDEN2 / 8] = {0};
+  for (u32 k = 0; k < POLICY_HIDDEN1 / 4; k++) {
+    u32 group;
+    memcpy(&group, &h1[k * 4], 4);
+    __m256i in = _mm256_set1_epi32((i32)group);
+    for (u32 q = 0; q < POLICY_HIDDEN2 / 8; q++) {
+      __m256i w = _mm256_loadu_si256((const __m256i *)model->w2[k][q * 8]);
+      acc[q] = _mm256_dpbusd_epi32(acc[q], in, w);
+    }
+  }
+
+  u8 h2[POLICY_HIDDEN2];
+  store_hidden2_avx2(model, acc, h2);
+  output_layer(model, h2, logits);
+}
+
+#endif
+
+bool policy_kernel_supported(PolicyKernel kernel) {
+  switch (kernel) {
+    case POLICY_KERNEL_SCALAR:
+      return true;
+#if POLICY_X86
+    case POLICY_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case POLICY_KERNEL_AVX_VNNI:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avxvnni");
+    case POLICY_KERNEL_AVX512_VNNI:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512vnni") &&
+        __builtin_cpu_supports("avx512vl");
+#endif
+    default:
+      return false;
+  }
+}
+
+const char *policy_kernel_name(PolicyKernel kernel) {
+  return kernel_names[kernel];
+}
+
+bool policy_set_kernel(PolicyModel *model, PolicyKernel kernel) {
+  if (!policy_kernel_supported(kernel)) return false;
+  model->kernel = kernel;
+  return true;
+}
+
+// VEX encoded VNNI first, it doesn't pull the cores down to AVX-512 clocks
+static void pick_kernel(PolicyModel *model) {
+  const PolicyKernel preferred[] = {
+    POLICY_KERNEL_AVX_VNNI,
+    POLICY_KERNEL_AVX512_VNNI,
+    POLICY_KERNEL_AVX2,
+    POLICY_KERNEL_SCALAR,
+  };
+
+  for (u32 i = 0; i < CORE_ARRAY_COUNT(preferred); i++) {
+    if (policy_set_kernel(model, preferred[i])) return;
+  }
+}
+
+///////////////////////////////////
+//
+//
+// Model
+//
+//
+///////////////////////////////////
+
+static void set_w2(PolicyModel *model, u32 output, u32 input, i8 weight) {
+  model->w2[input / 4][output][input % 4] = weight;
+}
+
+static i8 get_w2(const PolicyModel *model, u32 output, u32 input) {
+  return model->w2[input / 4][output][input % 4];
+}
+
+void policy_init_random(PolicyModel *model, u64 seed) {
+  memset(model, 0, sizeof(*model));
+
+  Rng rng;
+  rng_seed(&rng, seed);
+
+  for (u32 i = 0; i < POLICY_INPUTS; i++) {
+    for (u32 h = 0; h < POLICY_HIDDEN1; h++) {
+      model->w1[i][h] = (i16)((i32)rng_bounded(&rng, 255) - 127);
+    }
+  }
+  for (u32 h = 0; h < POLICY_HIDDEN1; h++) {
+    model->b1[h] = (i16)((i32)rng_bounded(&rng, 1024) - 256);
+  }
+  for (u32 o = 0; o < POLICY_HIDDEN2; o++) {
+    for (u32 i = 0; i < POLICY_HIDDEN1; i++) {
+      set_w2(model, o, i, (i8)((i32)rng_bounded(&rng, 255) - 127));
+    }
+    model->b2[o] = (i32)rng_bounded(&rng, 8192) - 2048;
+  }
+  for (u32 o = 0; o < POLICY_OUTPUTS; o++) {
+    for (u32 i = 0; i < POLICY_HIDDEN2; i++) {
+      model->w3[o][i] = (i8)((i32)rng_bounded(&rng, 255) - 127);
+    }
+  }
+
+  // keeps the activations spread over [0, 127] for random boards
+  model->shift1 = 3;
+  model->shift2 = 8;
+
+  pick_kernel(model);
+}
+
+typedef struct PolicyReader {
+  const u8 *data;
+  u64 size;
+  u64 pos;
+} PolicyReader;
+
+static bool read_bytes(PolicyReader *reader, void *dst, u64 size) {
+  if (reader->size - reader->pos < size) return false;
+  memcpy(dst, reader->data + reader->pos, size);
+  reader->pos += size;
+  return true;
+}
+
+bool policy_load_memory(PolicyModel *model, const void *data, u64 size) {
+  memset(model, 0, sizeof(*model));
+
+  PolicyReader reader = {.data = data, .size = size};
+  u8 header[POLICY_HEADER_SIZE];
+  i8 w1[POLICY_INPUTS][POLICY_HIDDEN1];
+  i8 w2[POLICY_HIDDEN2][POLICY_HIDDEN1];
+  if (!read_bytes(&reader, header, sizeof(header))) return false;
+
+  u32 dims[5];
+  memcpy(dims, header + 4, sizeof(dims));
+  bool ok = memcmp(header, POLICY_MAGIC, 4) == 0 && dims[0] == POLICY_VERSION && dims[1] == POLICY_INPUTS &&
+    dims[2] == POLICY_HIDDEN1 && dims[3] == POLICY_HIDDEN2 && dims[4] == POLICY_OUTPUTS;
+  model->shift1 = header[24];
+  model->shift2 = header[25];
+
+  ok = ok && read_bytes(&reader, model->b1, sizeof(model->b1)) && read_bytes(&reader, w1, sizeof(w1)) &&
+    read_bytes(&reader, model->b2, sizeof(model->b2)) && read_bytes(&reader, w2, sizeof(w2)) &&
+    read_bytes(&reader, model->b3, sizeof(model->b3)) && read_bytes(&reader, model->w3, sizeof(model->w3));
+
+  for (u32 h = 0; ok && h < POLICY_HIDDEN1; h++) {
+    ok = model->b1[h] >= -POLICY_MAX_BIAS1 && model->b1[h] <= POLICY_MAX_BIAS1;
+  }
+  ok = ok && model->shift1 < 16 && model->shift2 < 32;
+  if (!ok) return false;
+
+  for (u32 i = 0; i < POLICY_INPUTS; i++) {
+    for (u32 h = 0; h < POLICY_HIDDEN1; h++) {
+      model->w1[i][h] = w1[i][h];
+    }
+  }
+  for (u32 o = 0; o < POLICY_HIDDEN2; o++) {
+    for (u32 i = 0; i < POLICY_HIDDEN1; i++) {
+      set_w2(model, o, i, w2[o][i]);
+    }
+  }
+
+  pick_kernel(model);
+
+  return true;
+}
+
+bool policy_load(PolicyModel *model, const char *path) {
+  u64 size;
+  u8 *data = policy_read_file(path, &size);
+  if (!data) return false;
+
+  bool ok = policy_load_memory(model, data, size);
+  free(data);
+
+  if (!ok) {
+    printf("[ERROR]: \"%s\" is not a valid policy\n", path);
+  }
+
+  return ok;
+}
+
+u8 *policy_read_file(const char *path, u64 *size) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    printf("[ERROR]: could not open policy \"%s\": %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  u8 *data = len > 0 ? malloc(len) : NULL;
+  if (!data || fread(data, 1, len, fp) != (u64)len) {
+    printf("[ERROR]: could not read policy \"%s\"\n", path);
+    free(data);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+
+  *size = len;
+  return data;
+}
+
+bool policy_save(const PolicyModel *model, const char *path) {
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    printf("[ERROR]: could not create policy \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  u8 header[POLICY_HEADER_SIZE] = {0};
+  u32 dims[5] = {POLICY_VERSION, POLICY_INPUTS, POLICY_HIDDEN1, POLICY_HIDDEN2, POLICY_OUTPUTS};
+  memcpy(header, POLICY_MAGIC, 4);
+  memcpy(header + 4, dims, sizeof(dims));
+  header[24] = model->shift1;
+  header[25] = model->shift2;
+
+  i8 w1[POLICY_INPUTS][POLICY_HIDDEN1];
+  i8 w2[POLICY_HIDDEN2][POLICY_HIDDEN1];
+  for (u32 i = 0; i < POLICY_INPUTS; i++) {
+    for (u32 h = 0; h < POLICY_HIDDEN1; h++) {
+      w1[i][h] = (i8)model->w1[i][h];
+    }
+  }
+  for (u32 o = 0; o < POLICY_HIDDEN2; o++) {
+    for (u32 i = 0; i < POLICY_HIDDEN1; i++) {
+      w2[o][i] = get_w2(model, o, i);
+    }
+  }
+
+  bool ok = fwrite(header, sizeof(header), 1, fp) == 1 && fwrite(model->b1, sizeof(model->b1), 1, fp) == 1 &&
+    fwrite(w1, sizeof(w1), 1, fp) == 1 && fwrite(model->b2, sizeof(model->b2), 1, fp) == 1 &&
+    fwrite(w2, sizeof(w2), 1, fp) == 1 && fwrite(model->b3, sizeof(model->b3), 1, fp) == 1 &&
+    fwrite(model->w3, sizeof(model->w3), 1, fp) == 1;
+  ok = fclose(fp) == 0 && ok;
+
+  if (!ok) {
+    printf("[ERROR]: failed to write policy \"%s\"\n", path);
+  }
+
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// Inference
+//
+//
+///////////////////////////////////
+
+void policy_logits(const PolicyModel *model, Board b, i32 *logits) {
+  switch (model->kernel) {
+#if POLICY_X86
+    case POLICY_KERNEL_AVX2:
+      forward_avx2(model, b, logits);
+      return;
+    case POLICY_KERNEL_AVX_VNNI:
+      forward_avx_vnni(model, b, logits);
+      return;
+    case POLICY_KERNEL_AVX512_VNNI:
+      forward_avx512_vnni(model, b, logits);
+      return;
+#endif
+    default:
+      forward_scalar(model, b, logits);
+      return;
+  }
+}
+
+MoveDir policy_choose_move(const PolicyModel *model, Board b) {
+  i32 logits[POLICY_OUTPUTS];
+  policy_logits(model, b, logits);
+
+  u8 legal = board_legal_moves(b);
+  MoveDir best = MOVE_DIR_LEFT;
+  i64 best_logit = I64_MIN;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    if ((legal & (1 << dir)) && logits[dir] > best_logit) {
+      best_logit = logits[dir];
+      best = dir;
+    }
+  }
+
+  return best;
+}
+
+u8 policy_order_moves(const PolicyModel *model, Board b, MoveDir *order) {
+  i32 logits[POLICY_OUTPUTS];
+  policy_logits(model, b, logits);
+
+  u8 legal = board_legal_moves(b);
+  u8 count = 0;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    if (!(legal & (1 << dir))) continue;
+
+    // insertion sort, there are at most 4 moves
+    u8 pos = count++;
+    while (pos > 0 && logits[order[pos - 1]] < logits[dir]) {
+      order[pos] = order[pos - 1];
+      pos--;
+    }
+    order[pos] = dir;
+  }
+
+  return count;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "board.h"
+
+// Small quantized move policy.
+//
+// The input is the one-hot exponent of each of the 16 tiles (256 inputs),
+// followed by two ReLU layers of 64 and 32 units and one logit per MoveDir.
+// Weights are int8 and activations are clamped to [0, 127] u8, so every layer
+// after the first is a u8 x s8 dot product that maps onto AVX2 maddubs or a
+// single VNNI dpbusd. The first layer needs no multiplications at all: a
+// one-hot input only selects 16 rows of the weights to sum.
+//
+// Every kernel computes the exact same integers, the fastest one supported by
+// the CPU is picked when a model is loaded.
+//
+// Model file, little endian:
+//
+//   header  "C2PN" u32 version u32 inputs u32 hidden1 u32 hidden2 u32 outputs
+//           u8 shift1 u8 shift2 u16 reserved
+//   b1      i16[hidden1], |b1| <= POLICY_MAX_BIAS1
+//   w1      i8[inputs][hidden1], row `tile * 16 + exponent`
+//   b2      i32[hidden2]
+//   w2      i8[hidden2][hidden1]
+//   b3      i32[outputs]
+//   w3      i8[outputs][hidden2]
+//
+// A layer's activation is clamp((bias + sum) >> shift, 0, 127), the logits are
+// the raw sums of the last layer.
+
+#define POLICY_VERSION 1
+#define POLICY_INPUTS 256
+#define POLICY_HIDDEN1 64
+#define POLICY_HIDDEN2 32
+#define POLICY_OUTPUTS MOVE_DIR_COUNT
+// keeps the first layer's 16 bit sums from overflowing
+#define POLICY_MAX_BIAS1 16384
+
+typedef enum PolicyKernel {
+  POLICY_KERNEL_SCALAR,
+  POLICY_KERNEL_AVX2,
+  POLICY_KERNEL_AVX_VNNI,
+  POLICY_KERNEL_AVX512_VNNI,
+
+  POLICY_KERNEL_COUNT,
+} PolicyKernel;
+
+typedef struct PolicyModel {
+  // stored widened to i16 so the one-hot sum is plain 16 bit additions
+  i16 w1[POLICY_INPUTS][POLICY_HIDDEN1];
+  i16 b1[POLICY_HIDDEN1];
+  // interleaved by groups of 4 inputs: w2[k][o][j] weighs input 4k+j for
+  // output o, one broadcast group of inputs then feeds 8 outputs per vector
+  i8 w2[POLICY_HIDDEN1 / 4][POLICY_HIDDEN2][4];
+  i32 b2[POLICY_HIDDEN2];
+  i8 w3[POLICY_OUTPUTS][POLICY_HIDDEN2];
+  i32 b3[POLICY_OUTPUTS];
+  u8 shift1;
+  u8 shift2;
+  PolicyKernel kernel;
+} PolicyModel;
+
+bool policy_load(PolicyModel *model, const char *path);
+// Same as policy_load() on the bytes of a model file, e.g. received over the
+// network. Fails silently.
+bool policy_load_memory(PolicyModel *model, const void *data, u64 size);
+// Reads a whole model file into a malloc'ed buffer, NULL on failure.
+u8 *policy_read_file(const char *path, u64 *size);
+bool policy_save(const PolicyModel *model, const char *path);
+// Random weights, only meant for benchmarks and tests of the kernels.
+void policy_init_random(PolicyModel *model, u64 seed);
+
+bool policy_kernel_supported(PolicyKernel kernel);
+const char *policy_kernel_name(PolicyKernel kernel);
+// Defaults to the fastest supported kernel, returns false if `kernel` isn't
+// supported by this CPU.
+bool policy_set_kernel(PolicyModel *model, PolicyKernel kernel);
+
+void policy_logits(const PolicyModel *model, Board b, i32 *logits);
+// The legal move with the highest logit, `b` must have a legal move.
+MoveDir policy_choose_move(const PolicyModel *model, Board b);
+// Writes the legal moves by decreasing logit, e.g. to search the likely best
+// move first, and returns how many there are.
+u8 policy_order_moves(const PolicyModel *model, Board b, MoveDir *order);
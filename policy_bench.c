@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "policy.h"
+#include "timer.h"
+
+// Times a policy decision (inference plus picking the best legal move) with
+// every kernel the CPU supports, checks that they all agree with the scalar
+// kernel and fails if the fastest one misses the rollout budget.
+
+#define POLICY_BUDGET_NS 1000.0
+
+Board *collect_boards(u32 count, u64 seed) {
+  Board *boards = malloc(count * sizeof(Board));
+  Rng rng;
+  rng_seed(&rng, seed);
+
+  Board b = board_new_game(&rng);
+  for (u32 i = 0; i < count; i++) {
+    u8 legal = board_legal_moves(b);
+    if (!legal) {
+      b = board_new_game(&rng);
+      legal = board_legal_moves(b);
+    }
+    boards[i] = b;
+
+    MoveDir dir;
+    do {
+      dir = rng_bounded(&rng, MOVE_DIR_COUNT);
+    } while (!(legal & (1 << dir)));
+    b = board_spawn_random_tile(board_move(b, dir, NULL), &rng);
+  }
+
+  return boards;
+}
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options]\n"
+      "\n"
+      "options:\n"
+      "  -m <file>   policy to benchmark (default: random weights)\n"
+      "  -n <count>  positions per run (default 100000)\n"
+      "  -r <runs>   runs per kernel, the fastest counts (default 5)\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+  const char *model_path = NULL;
+  u32 count = 100000;
+  u32 runs = 5;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:r:h")) != -1) {
+    switch (opt) {
+      case 'm':
+        model_path = optarg;
+        break;
+      case 'n':
+        count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'r':
+        runs = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  board_init_tables();
+  start_internal_timer();
+
+  PolicyModel *model = malloc(sizeof(PolicyModel));
+  if (model_path) {
+    if (!policy_load(model, model_path)) return 1;
+  } else {
+    policy_init_random(model, 1);
+  }
+
+  Board *boards = collect_boards(count, 1);
+  i32 (*reference)[POLICY_OUTPUTS] = malloc(count * sizeof(*reference));
+  policy_set_kernel(model, POLICY_KERNEL_SCALAR);
+  for (u32 i = 0; i < count; i++) {
+    policy_logits(model, boards[i], reference[i]);
+  }
+
+  printf("%-12s %12s %8s\n", "kernel", "ns/decision", "matches");
+
+  f64 best_ns = 0;
+  bool all_match = true;
+  for (PolicyKernel kernel = 0; kernel < POLICY_KERNEL_COUNT; kernel++) {
+    if (!policy_set_kernel(model, kernel)) {
+      printf("%-12s %12s\n", policy_kernel_name(kernel), "unsupported");
+      continue;
+    }
+
+    bool match = true;
+    for (u32 i = 0; i < count; i++) {
+      i32 logits[POLICY_OUTPUTS];
+      policy_logits(model, boards[i], logits);
+      for (u32 o = 0; o < POLICY_OUTPUTS; o++) {
+        match = match && logits[o] == reference[i][o];
+      }
+    }
+    all_match = all_match && match;
+
+    f64 fastest = 0;
+    u32 checksum = 0;
+    for (u32 r = 0; r < runs; r++) {
+      f64 start = get_time();
+      for (u32 i = 0; i < count; i++) {
+        checksum += policy_choose_move(model, boards[i]);
+      }
+      f64 elapsed = get_time() - start;
+      fastest = r == 0 ? elapsed : CORE_MIN(fastest, elapsed);
+    }
+    // keeps the timed calls from being optimized away
+    CORE_UNUSED(*(volatile u32 *)&checksum);
+
+    f64 ns = fastest * 1e9 / count;
+    best_ns = best_ns == 0 ? ns : CORE_MIN(best_ns, ns);
+    printf("%-12s %12.1f %8s\n", policy_kernel_name(kernel), ns, match ? "yes" : "NO");
+  }
+
+  free(reference);
+  free(boards);
+  free(model);
+
+  if (!all_match) {
+    printf("[ERROR]: kernels disagree with the scalar kernel\n");
+    return 1;
+  }
+  if (best_ns >= POLICY_BUDGET_NS) {
+    printf("[ERROR]: %.1f ns per decision is over the %.0f ns budget\n", best_ns, POLICY_BUDGET_NS);
+    return 1;
+  }
+
+  return 0;
+}
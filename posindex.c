@@ -0,0 +1,117 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "posindex.h"
+
+void posindex_entry_init(PosIndexEntry *entry, Board board, u32 score, u8 max_exponent) {
+  memset(entry, 0, sizeof(*entry));
+  entry->board = board;
+  entry->score_sum = score;
+  entry->count = 1;
+  for (u32 e = POSINDEX_REACH_MIN_EXPONENT; e <= max_exponent; e++) {
+    entry->reached[e - POSINDEX_REACH_MIN_EXPONENT] = 1;
+  }
+}
+
+void posindex_entry_merge(PosIndexEntry *into, const PosIndexEntry *from) {
+  into->score_sum += from->score_sum;
+  into->count += from->count;
+  for (u32 i = 0; i < POSINDEX_REACH_COUNT; i++) {
+    into->reached[i] += from->reached[i];
+  }
+}
+
+int posindex_entry_compare(const void *a, const void *b) {
+  Board ba = ((const PosIndexEntry *)a)->board;
+  Board bb = ((const PosIndexEntry *)b)->board;
+  return (ba > bb) - (ba < bb);
+}
+
+bool posindex_write_header(FILE *fp, u64 entry_count, u64 games, u64 positions) {
+  u8 header[POSINDEX_HEADER_SIZE] = {0};
+  u32 version = POSINDEX_VERSION;
+  memcpy(header, POSINDEX_MAGIC, 4);
+  memcpy(header + 4, &version, 4);
+  memcpy(header + 8, &entry_count, 8);
+  memcpy(header + 16, &games, 8);
+  memcpy(header + 24, &positions, 8);
+
+  return fwrite(header, sizeof(header), 1, fp) == 1;
+}
+
+bool posindex_open(PosIndex *index, const char *path) {
+  memset(index, 0, sizeof(*index));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("[ERROR]: could not open position index \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < POSINDEX_HEADER_SIZE) {
+    printf("[ERROR]: \"%s\" is not a position index\n", path);
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("[ERROR]: could not map position index \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+  // lookups jump around the file
+  madvise(data, st.st_size, MADV_RANDOM);
+
+  index->data = data;
+  index->size = st.st_size;
+
+  u32 version;
+  memcpy(&version, index->data + 4, 4);
+  memcpy(&index->entry_count, index->data + 8, 8);
+  memcpy(&index->games, index->data + 16, 8);
+  memcpy(&index->positions, index->data + 24, 8);
+  index->entries = (const PosIndexEntry *)(index->data + POSINDEX_HEADER_SIZE);
+
+  if (memcmp(index->data, POSINDEX_MAGIC, 4) != 0 || version != POSINDEX_VERSION) {
+    printf("[ERROR]: \"%s\" is not a position index\n", path);
+    posindex_close(index);
+    return false;
+  }
+  if (index->entry_count > (index->size - POSINDEX_HEADER_SIZE) / sizeof(PosIndexEntry)) {
+    printf("[ERROR]: position index \"%s\" is truncated\n", path);
+    posindex_close(index);
+    return false;
+  }
+
+  return true;
+}
+
+void posindex_close(PosIndex *index) {
+  if (index->data) {
+    munmap((void *)index->data, index->size);
+  }
+  memset(index, 0, sizeof(*index));
+}
+
+const PosIndexEntry *posindex_lookup(const PosIndex *index, Board b) {
+  Board key = board_canonical(b);
+
+  u64 lo = 0;
+  u64 hi = index->entry_count;
+  while (lo < hi) {
+    u64 mid = lo + (hi - lo) / 2;
+    if (index->entries[mid].board < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo < index->entry_count && index->entries[lo].board == key ? &index->entries[lo] : NULL;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "board.h"
+
+// Index of every position played in a corpus of games, with how the games
+// that went through it ended.
+//
+// Positions are keyed by board_canonical(), so the 8 rotations and
+// reflections of a board share an entry. A game goes through a position at
+// most once (the sum of its tiles only grows), so `count` is a number of
+// games. Entries are sorted by board and looked up with a binary search in
+// the mapped file. File layout, little endian:
+//
+//   header   "C2PI" u32 version u64 entry_count u64 games u64 positions,
+//            padded to POSINDEX_HEADER_SIZE bytes
+//   entries  entry_count * PosIndexEntry (48 bytes), sorted by board
+//
+// `reached[i]` counts the games whose largest tile at the end had an exponent
+// of at least POSINDEX_REACH_MIN_EXPONENT + i.
+//
+// c2048-positions builds the index with an external sort: sorted runs of
+// entries (the same layout, without the header) are merged by key range on
+// every core.
+
+#define POSINDEX_MAGIC "C2PI"
+#define POSINDEX_VERSION 1
+#define POSINDEX_HEADER_SIZE 64
+// 1024
+#define POSINDEX_REACH_MIN_EXPONENT 10
+#define POSINDEX_REACH_COUNT (BOARD_MAX_EXPONENT - POSINDEX_REACH_MIN_EXPONENT + 1)
+
+typedef struct PosIndexEntry {
+  Board board;
+  // of the final scores
+  u64 score_sum;
+  u32 count;
+  u32 reached[POSINDEX_REACH_COUNT];
+  // pads the entry to 48 bytes
+  u32 reserved;
+} PosIndexEntry;
+
+typedef struct PosIndex {
+  const u8 *data;
+  u64 size;
+  const PosIndexEntry *entries;
+  u64 entry_count;
+  u64 games;
+  u64 positions;
+} PosIndex;
+
+// An entry for one game through `board` that ended with `score` and
+// `max_exponent`.
+void posindex_entry_init(PosIndexEntry *entry, Board board, u32 score, u8 max_exponent);
+// Adds the games of `from`, an entry for the same board, to `into`.
+void posindex_entry_merge(PosIndexEntry *into, const PosIndexEntry *from);
+int posindex_entry_compare(const void *a, const void *b);
+
+// Writes the header, the entries follow it.
+bool posindex_write_header(FILE *fp, u64 entry_count, u64 games, u64 positions);
+
+bool posindex_open(PosIndex *index, const char *path);
+void posindex_close(PosIndex *index);
+// The entry of `b` or any of its symmetries, NULL if it was never played.
+const PosIndexEntry *posindex_lookup(const PosIndex *index, Board b);
@@ -0,0 +1,774 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "posindex.h"
+#include "record.h"
+#include "replay.h"
+#include "timer.h"
+
+// Builds a position index (posindex.h) of game record files and replays, or
+// looks positions up in one.
+//
+// Building is an external merge sort in two passes. Threads replay chunks of
+// games and append an entry per position to their own buffer; a full buffer
+// is sorted, its duplicates merged, and written out as a run file next to the
+// output. Then the key space is split into one range per thread at splitters
+// sampled from the runs, and every thread merges its range of all the mapped
+// runs into a part file with a heap. The parts, in key order, are the index.
+// Memory stays within the run buffers (-m) whatever the size of the corpus.
+
+#define POSITIONS_CHUNK_GAMES 1024
+#define POSITIONS_DEFAULT_MEMORY_MB 1024
+// boards taken from each run to pick the splitters
+#define POSITIONS_SAMPLES_PER_RUN 256
+#define POSITIONS_COPY_BUFFER_SIZE (1 << 20)
+
+typedef struct Source {
+  const char *path;
+  bool opened;
+  bool is_replay;
+  RecordCodec codec;
+  const u8 *data;
+  u64 size;
+} Source;
+
+// Games handed to a thread.
+typedef struct Claim {
+  Source *source;
+  u64 offset;
+  u32 game_count;
+} Claim;
+
+typedef struct Scanner {
+  PosIndexEntry *run;
+  u64 run_len;
+  // boards of the game being replayed
+  Board *boards;
+  u32 board_cap;
+
+  u64 games;
+  u64 positions;
+  u64 skipped;
+  bool failed;
+} Scanner;
+
+// A sorted run file, mapped for the merge.
+typedef struct Run {
+  const PosIndexEntry *entries;
+  u64 count;
+  u64 size;
+} Run;
+
+typedef struct MergeRange {
+  u32 idx;
+  // first board of the range, the range ends at the next one's
+  Board start;
+  bool last;
+  u64 entry_count;
+  bool failed;
+} MergeRange;
+
+typedef struct Builder {
+  const char *output_path;
+  Source *sources;
+  u32 source_count;
+  u32 thread_count;
+  u64 run_cap;
+
+  // cursor of the next games to hand out, and the runs written so far
+  pthread_mutex_t lock;
+  u32 next_source;
+  u64 next_offset;
+  u32 run_count;
+
+  Run *runs;
+} Builder;
+
+Builder builder = {0};
+
+void run_path(u32 idx, char *path, size_t size) {
+  snprintf(path, size, "%s.run.%u", builder.output_path, idx);
+}
+
+void part_path(u32 idx, char *path, size_t size) {
+  snprintf(path, size, "%s.part.%u", builder.output_path, idx);
+}
+
+///////////////////////////////////
+//
+//
+// Runs
+//
+//
+///////////////////////////////////
+
+// Maps the file and finds out what it holds. Called with the lock held.
+bool open_source(Source *source) {
+  source->opened = true;
+
+  int fd = open(source->path, O_RDONLY);
+  if (fd < 0) {
+    printf("[WARN] skipped \"%s\": %s\n", source->path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= 8) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("[WARN] skipped \"%s\": neither a game record file nor a replay\n", source->path);
+    return false;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  source->data = data;
+  source->size = st.st_size;
+
+  u32 version;
+  memcpy(&version, source->data + 4, 4);
+  if (memcmp(source->data, RECORD_FILE_MAGIC, 4) == 0 && (version == RECORD_CODEC_PACKED || version == RECORD_CODEC_RANS)) {
+    source->codec = version;
+  } else if (memcmp(source->data, REPLAY_MAGIC, 4) == 0) {
+    source->is_replay = true;
+  } else {
+    printf("[WARN] skipped \"%s\": neither a game record file nor a replay\n", source->path);
+    munmap((void *)source->data, source->size);
+    source->data = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+// Takes the next chunk of records of a record file, or the next replay. False
+// once every file is handed out.
+bool claim_games(Claim *claim) {
+  pthread_mutex_lock(&builder.lock);
+
+  bool found = false;
+  while (!found && builder.next_source < builder.source_count) {
+    Source *source = &builder.sources[builder.next_source];
+    if (!source->opened) {
+      builder.next_offset = 8;
+      if (!open_source(source)) {
+        builder.next_source++;
+        continue;
+      }
+    }
+
+    if (source->is_replay) {
+      *claim = (Claim){.source = source, .game_count = 1};
+      builder.next_source++;
+      found = true;
+      break;
+    }
+
+    *claim = (Claim){.source = source, .offset = builder.next_offset};
+    while (claim->game_count < POSITIONS_CHUNK_GAMES && builder.next_offset < source->size) {
+      u64 size = record_file_record_size(source->codec, source->data + builder.next_offset,
+          source->size - builder.next_offset);
+      if (size == 0) {
+        printf("[WARN] %s: stopped on a truncated record\n", source->path);
+        builder.next_offset = source->size;
+        break;
+      }
+      builder.next_offset += size;
+      claim->game_count++;
+    }
+
+    if (builder.next_offset >= source->size) {
+      builder.next_source++;
+    }
+    found = claim->game_count > 0;
+  }
+
+  pthread_mutex_unlock(&builder.lock);
+  return found;
+}
+
+// Sorts the buffer, merges its duplicates and writes it as the next run.
+void flush_run(Scanner *scanner) {
+  if (scanner->failed) {
+    scanner->run_len = 0;
+  }
+  if (scanner->run_len == 0) return;
+
+  PosIndexEntry *run = scanner->run;
+  qsort(run, scanner->run_len, sizeof(PosIndexEntry), posindex_entry_compare);
+  u64 len = 1;
+  for (u64 i = 1; i < scanner->run_len; i++) {
+    if (run[i].board == run[len - 1].board) {
+      posindex_entry_merge(&run[len - 1], &run[i]);
+    } else {
+      run[len++] = run[i];
+    }
+  }
+  scanner->run_len = 0;
+
+  pthread_mutex_lock(&builder.lock);
+  u32 idx = builder.run_count++;
+  pthread_mutex_unlock(&builder.lock);
+
+  char path[4096];
+  run_path(idx, path, sizeof(path));
+  FILE *fp = fopen(path, "wb");
+  if (!fp || fwrite(run, sizeof(PosIndexEntry), len, fp) != len || fclose(fp) != 0) {
+    printf("[ERROR]: could not write run \"%s\": %s\n", path, strerror(errno));
+    scanner->failed = true;
+  }
+}
+
+void scan_game(Scanner *scanner, const GameRecord *record) {
+  if (record->move_count + 1 > scanner->board_cap) {
+    scanner->board_cap = CORE_MAX(record->move_count + 1, scanner->board_cap * 2);
+    Board *temp = realloc(scanner->boards, scanner->board_cap * sizeof(Board));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for game boards\n");
+      exit(1);
+    }
+    scanner->boards = temp;
+  }
+
+  Rng rng;
+  rng_seed(&rng, record->seed);
+  Board b = board_new_game(&rng);
+  u32 score = 0;
+
+  scanner->boards[0] = b;
+  for (u32 i = 0; i < record->move_count; i++) {
+    Board moved = board_move(b, record_get_move(record, i), &score);
+    if (moved == b) {
+      scanner->skipped++;
+      return;
+    }
+    b = board_spawn_random_tile(moved, &rng);
+    scanner->boards[i + 1] = b;
+  }
+
+  // the outcome is only known at the end
+  u8 max_exponent = board_max_exponent(b);
+  for (u32 i = 0; i <= record->move_count; i++) {
+    if (scanner->run_len == builder.run_cap) {
+      flush_run(scanner);
+    }
+    posindex_entry_init(&scanner->run[scanner->run_len++], board_canonical(scanner->boards[i]), score, max_exponent);
+  }
+
+  scanner->games++;
+  scanner->positions += record->move_count + 1;
+}
+
+void *scan_thread(void *arg) {
+  Scanner *scanner = arg;
+  GameRecord decoded;
+  record_init(&decoded, 0);
+
+  Claim claim;
+  while (!scanner->failed && claim_games(&claim)) {
+    Source *source = claim.source;
+    if (source->is_replay) {
+      ReplayHeader header;
+      bool valid = source->size >= REPLAY_HEADER_SIZE && replay_decode_header(source->data, &header) &&
+        header.move_count != REPLAY_UNFINISHED &&
+        source->size >= REPLAY_HEADER_SIZE + ((u64)header.move_count + 3) / 4;
+      if (valid) {
+        GameRecord view = {
+          .seed = header.seed,
+          .score = header.score,
+          .move_count = header.move_count,
+          .moves = (u8 *)source->data + REPLAY_HEADER_SIZE,
+        };
+        scan_game(scanner, &view);
+      } else {
+        scanner->skipped++;
+      }
+
+      // nothing else reads it
+      munmap((void *)source->data, source->size);
+      source->data = NULL;
+      continue;
+    }
+
+    u64 offset = claim.offset;
+    for (u32 i = 0; i < claim.game_count; i++) {
+      const u8 *data = source->data + offset;
+      u64 size = source->size - offset;
+      offset += record_file_record_size(source->codec, data, size);
+
+      GameRecord view;
+      if (source->codec == RECORD_CODEC_PACKED) {
+        record_view(&view, data, size);
+        scan_game(scanner, &view);
+      } else if (record_file_decode(source->codec, &decoded, data, size)) {
+        scan_game(scanner, &decoded);
+      } else {
+        scanner->skipped++;
+      }
+    }
+  }
+
+  flush_run(scanner);
+  record_free(&decoded);
+  return NULL;
+}
+
+///////////////////////////////////
+//
+//
+// Merge
+//
+//
+///////////////////////////////////
+
+// First entry of the run whose board isn't below `b`.
+u64 lower_bound(const Run *run, Board b) {
+  u64 lo = 0;
+  u64 hi = run->count;
+  while (lo < hi) {
+    u64 mid = lo + (hi - lo) / 2;
+    if (run->entries[mid].board < b) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+typedef struct HeapItem {
+  Board board;
+  u32 run;
+} HeapItem;
+
+void heap_sift_down(HeapItem *heap, u32 len, u32 i) {
+  while (true) {
+    u32 smallest = i;
+    u32 left = i * 2 + 1;
+    u32 right = left + 1;
+    if (left < len && heap[left].board < heap[smallest].board) smallest = left;
+    if (right < len && heap[right].board < heap[smallest].board) smallest = right;
+    if (smallest == i) return;
+
+    HeapItem temp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = temp;
+    i = smallest;
+  }
+}
+
+void *merge_thread(void *arg) {
+  MergeRange *range = arg;
+  u32 run_count = builder.run_count;
+  u64 *next = malloc(run_count * sizeof(u64));
+  u64 *end = malloc(run_count * sizeof(u64));
+  HeapItem *heap = malloc(run_count * sizeof(HeapItem));
+  u32 heap_len = 0;
+
+  for (u32 r = 0; r < run_count; r++) {
+    const Run *run = &builder.runs[r];
+    next[r] = lower_bound(run, range->start);
+    end[r] = range->last ? run->count : lower_bound(run, (range + 1)->start);
+    if (next[r] < end[r]) {
+      heap[heap_len++] = (HeapItem){.board = run->entries[next[r]].board, .run = r};
+    }
+  }
+  for (u32 i = heap_len / 2; i-- > 0;) {
+    heap_sift_down(heap, heap_len, i);
+  }
+
+  char path[4096];
+  part_path(range->idx, path, sizeof(path));
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    printf("[ERROR]: could not create \"%s\": %s\n", path, strerror(errno));
+    range->failed = true;
+  }
+
+  PosIndexEntry current;
+  bool has_current = false;
+  while (fp && heap_len > 0) {
+    u32 r = heap[0].run;
+    const PosIndexEntry *entry = &builder.runs[r].entries[next[r]++];
+    if (next[r] < end[r]) {
+      heap[0].board = builder.runs[r].entries[next[r]].board;
+    } else {
+      heap[0] = heap[--heap_len];
+    }
+    heap_sift_down(heap, heap_len, 0);
+
+    if (has_current && entry->board == current.board) {
+      posindex_entry_merge(&current, entry);
+      continue;
+    }
+    if (has_current && fwrite(&current, sizeof(current), 1, fp) != 1) {
+      range->failed = true;
+      break;
+    }
+    current = *entry;
+    has_current = true;
+    range->entry_count++;
+  }
+
+  if (fp) {
+    if (has_current && !range->failed && fwrite(&current, sizeof(current), 1, fp) != 1) {
+      range->failed = true;
+    }
+    if (fclose(fp) != 0 || range->failed) {
+      printf("[ERROR]: could not write \"%s\": %s\n", path, strerror(errno));
+      range->failed = true;
+    }
+  }
+
+  free(next);
+  free(end);
+  free(heap);
+  return NULL;
+}
+
+int compare_boards(const void *a, const void *b) {
+  Board ba = *(const Board *)a;
+  Board bb = *(const Board *)b;
+  return (ba > bb) - (ba < bb);
+}
+
+bool map_runs(void) {
+  builder.runs = calloc(CORE_MAX(1, builder.run_count), sizeof(Run));
+  for (u32 i = 0; i < builder.run_count; i++) {
+    char path[4096];
+    run_path(i, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      printf("[ERROR]: could not open run \"%s\": %s\n", path, strerror(errno));
+      if (fd >= 0) close(fd);
+      return false;
+    }
+
+    void *data = MAP_FAILED;
+    if (st.st_size > 0) {
+      data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+      printf("[ERROR]: could not map run \"%s\": %s\n", path, strerror(errno));
+      return false;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    builder.runs[i] = (Run){.entries = data, .count = st.st_size / sizeof(PosIndexEntry), .size = st.st_size};
+  }
+
+  return true;
+}
+
+// Splits the keys into one range per thread, at evenly spaced boards of a
+// sample of every run.
+void split_ranges(MergeRange *ranges) {
+  u64 sample_count = 0;
+  Board *samples = malloc(CORE_MAX(1, builder.run_count) * POSITIONS_SAMPLES_PER_RUN * sizeof(Board));
+  for (u32 r = 0; r < builder.run_count; r++) {
+    const Run *run = &builder.runs[r];
+    u64 n = CORE_MIN(run->count, POSITIONS_SAMPLES_PER_RUN);
+    for (u64 i = 0; i < n; i++) {
+      samples[sample_count++] = run->entries[i * run->count / n].board;
+    }
+  }
+  qsort(samples, sample_count, sizeof(Board), compare_boards);
+
+  for (u32 t = 0; t < builder.thread_count; t++) {
+    ranges[t] = (MergeRange){.idx = t, .last = t + 1 == builder.thread_count};
+    if (t > 0 && sample_count > 0) {
+      ranges[t].start = samples[t * sample_count / builder.thread_count];
+    }
+  }
+  free(samples);
+}
+
+// Appends the file at `path` to `out_fd`, in the kernel when it can.
+bool append_file(int out_fd, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  bool ok = true;
+  bool in_kernel = true;
+  char *buf = NULL;
+  while (true) {
+    ssize_t n;
+    if (in_kernel) {
+      n = copy_file_range(fd, NULL, out_fd, NULL, POSITIONS_COPY_BUFFER_SIZE, 0);
+      if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+        in_kernel = false;
+        continue;
+      }
+    } else {
+      if (!buf) buf = malloc(POSITIONS_COPY_BUFFER_SIZE);
+      n = read(fd, buf, POSITIONS_COPY_BUFFER_SIZE);
+      if (n > 0 && write(out_fd, buf, n) != n) {
+        n = -1;
+      }
+    }
+
+    if (n == 0) break;
+    if (n < 0) {
+      ok = false;
+      break;
+    }
+  }
+
+  free(buf);
+  close(fd);
+  return ok;
+}
+
+bool build_index(u64 memory_mb) {
+  builder.run_cap = CORE_MAX(1024, memory_mb * 1024 * 1024 / sizeof(PosIndexEntry) / builder.thread_count);
+  pthread_mutex_init(&builder.lock, NULL);
+
+  // scan
+  Scanner *scanners = calloc(builder.thread_count, sizeof(Scanner));
+  pthread_t *threads = malloc(builder.thread_count * sizeof(pthread_t));
+  for (u32 i = 0; i < builder.thread_count; i++) {
+    scanners[i].run = malloc(builder.run_cap * sizeof(PosIndexEntry));
+    if (!scanners[i].run) {
+      printf("[FATAL] Failed to allocate memory for runs, lower -m\n");
+      exit(1);
+    }
+    pthread_create(&threads[i], NULL, scan_thread, &scanners[i]);
+  }
+
+  u64 games = 0;
+  u64 positions = 0;
+  u64 skipped = 0;
+  bool ok = true;
+  for (u32 i = 0; i < builder.thread_count; i++) {
+    pthread_join(threads[i], NULL);
+    games += scanners[i].games;
+    positions += scanners[i].positions;
+    skipped += scanners[i].skipped;
+    ok = ok && !scanners[i].failed;
+    free(scanners[i].run);
+    free(scanners[i].boards);
+  }
+  free(scanners);
+
+  for (u32 i = 0; i < builder.source_count; i++) {
+    if (builder.sources[i].data) {
+      munmap((void *)builder.sources[i].data, builder.sources[i].size);
+    }
+  }
+
+  f64 scanned_at = get_time();
+  fprintf(stderr, "%llu games, %llu positions in %u runs in %.2fs\n", (unsigned long long)games,
+      (unsigned long long)positions, builder.run_count, scanned_at);
+  if (skipped) {
+    printf("[WARN] %llu games with illegal moves or unfinished were left out\n", (unsigned long long)skipped);
+  }
+
+  // merge
+  MergeRange *ranges = calloc(builder.thread_count, sizeof(MergeRange));
+  u64 entry_count = 0;
+  if (ok && map_runs()) {
+    split_ranges(ranges);
+    for (u32 i = 0; i < builder.thread_count; i++) {
+      pthread_create(&threads[i], NULL, merge_thread, &ranges[i]);
+    }
+    for (u32 i = 0; i < builder.thread_count; i++) {
+      pthread_join(threads[i], NULL);
+      entry_count += ranges[i].entry_count;
+      ok = ok && !ranges[i].failed;
+    }
+  } else {
+    ok = false;
+  }
+  free(threads);
+
+  for (u32 i = 0; i < builder.run_count; i++) {
+    char path[4096];
+    run_path(i, path, sizeof(path));
+    if (builder.runs && builder.runs[i].entries) {
+      munmap((void *)builder.runs[i].entries, builder.runs[i].size);
+    }
+    unlink(path);
+  }
+  free(builder.runs);
+
+  // the parts in order are the index
+  FILE *fp = ok ? fopen(builder.output_path, "wb") : NULL;
+  if (ok && (!fp || !posindex_write_header(fp, entry_count, games, positions) || fflush(fp) != 0)) {
+    printf("[ERROR]: could not write \"%s\": %s\n", builder.output_path, strerror(errno));
+    ok = false;
+  }
+  for (u32 i = 0; i < builder.thread_count; i++) {
+    char path[4096];
+    part_path(i, path, sizeof(path));
+    if (ok && !append_file(fileno(fp), path)) {
+      printf("[ERROR]: could not write \"%s\": %s\n", builder.output_path, strerror(errno));
+      ok = false;
+    }
+    unlink(path);
+  }
+  if (fp && fclose(fp) != 0) {
+    ok = false;
+  }
+  free(ranges);
+
+  if (ok) {
+    fprintf(stderr, "%llu distinct positions, merged in %.2fs\n", (unsigned long long)entry_count,
+        get_time() - scanned_at);
+  }
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// Queries
+//
+//
+///////////////////////////////////
+
+void print_lookup(const PosIndex *index, Board b) {
+  char hex[BOARD_HEX_LEN + 1];
+  board_to_hex(b, hex);
+
+  const PosIndexEntry *entry = posindex_lookup(index, b);
+  if (!entry) {
+    printf("%s %10u\n", hex, 0);
+    return;
+  }
+
+  printf("%s %10u %12.1f", hex, entry->count, (f64)entry->score_sum / entry->count);
+  for (u32 i = 0; i < POSINDEX_REACH_COUNT; i++) {
+    printf(" %7.2f%%", 100.0 * entry->reached[i] / entry->count);
+  }
+  printf("\n");
+}
+
+bool query_index(const char *path, char **boards, u32 board_count) {
+  PosIndex index;
+  if (!posindex_open(&index, path)) return false;
+
+  printf("# %llu games, %llu positions, %llu distinct\n", (unsigned long long)index.games,
+      (unsigned long long)index.positions, (unsigned long long)index.entry_count);
+  printf("%-16s %10s %12s", "# board", "games", "mean score");
+  for (u32 i = 0; i < POSINDEX_REACH_COUNT; i++) {
+    printf(" %8u", 1u << (POSINDEX_REACH_MIN_EXPONENT + i));
+  }
+  printf("\n");
+
+  bool ok = true;
+  if (board_count > 0) {
+    for (u32 i = 0; i < board_count; i++) {
+      Board b;
+      if (!board_from_hex(boards[i], &b)) {
+        printf("[ERROR]: \"%s\" isn't a board of %d hex digits\n", boards[i], BOARD_HEX_LEN);
+        ok = false;
+        continue;
+      }
+      print_lookup(&index, b);
+    }
+  } else {
+    char line[256];
+    while (fgets(line, sizeof(line), stdin)) {
+      char *start = line + strspn(line, " \t");
+      if (*start == '\n' || *start == '\0' || *start == '#') continue;
+
+      Board b;
+      if (!board_from_hex(start, &b)) {
+        printf("[ERROR]: expected a board of %d hex digits\n", BOARD_HEX_LEN);
+        ok = false;
+        continue;
+      }
+      print_lookup(&index, b);
+    }
+  }
+
+  posindex_close(&index);
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_usage(const char *prog) {
+  printf("usage: %s -o <index> [options] <file>...\n"
+      "       %s -q <index> [board]...\n"
+      "\n"
+      "Indexes every position of game record files and replays with how often it\n"
+      "was played and how the games through it ended, or looks up boards (hex, one\n"
+      "per argument or per line of stdin) in an index.\n"
+      "\n"
+      "options:\n"
+      "  -o <path>   index to build, runs are written next to it\n"
+      "  -j <count>  worker threads (default: number of cores)\n"
+      "  -m <mb>     memory for the sort runs (default %d)\n"
+      "  -q <path>   index to look boards up in\n", prog, prog, POSITIONS_DEFAULT_MEMORY_MB);
+}
+
+int main(int argc, char *argv[]) {
+  const char *query_path = NULL;
+  u64 memory_mb = POSITIONS_DEFAULT_MEMORY_MB;
+  builder.thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:j:m:q:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        builder.output_path = optarg;
+        break;
+      case 'j':
+        builder.thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'm':
+        memory_mb = CORE_MAX(1, strtoull(optarg, NULL, 10));
+        break;
+      case 'q':
+        query_path = optarg;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  board_init_tables();
+
+  if (query_path) {
+    return query_index(query_path, argv + optind, (u32)(argc - optind)) ? 0 : 1;
+  }
+
+  if (!builder.output_path || optind >= argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  start_internal_timer();
+
+  builder.source_count = (u32)(argc - optind);
+  builder.sources = calloc(builder.source_count, sizeof(Source));
+  for (u32 i = 0; i < builder.source_count; i++) {
+    builder.sources[i].path = argv[optind + i];
+  }
+
+  bool ok = build_index(memory_mb);
+  free(builder.sources);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "puzzle.h"
+
+MoveDir puzzle_move(const Puzzle *puzzle, u32 idx) {
+  return (MoveDir)((puzzle->solution >> (idx * 2)) & 3);
+}
+
+///////////////////////////////////
+//
+//
+// Solver
+//
+//
+///////////////////////////////////
+
+void puzzle_solver_init(PuzzleSolver *solver) {
+  memset(solver, 0, sizeof(*solver));
+  solver->max_nodes = PUZZLE_SOLVER_DEFAULT_MAX_NODES;
+}
+
+void puzzle_solver_free(PuzzleSolver *solver) {
+  free(solver->nodes);
+  memset(solver, 0, sizeof(*solver));
+}
+
+static void push_node(PuzzleSolver *solver, Board board, u32 parent, u8 move) {
+  if (solver->node_count >= solver->node_cap) {
+    solver->node_cap = solver->node_cap ? solver->node_cap * 2 : 4096;
+    SolverNode *temp = realloc(solver->nodes, solver->node_cap * sizeof(SolverNode));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for the puzzle solver\n");
+      exit(1);
+    }
+    solver->nodes = temp;
+  }
+
+  solver->nodes[solver->node_count++] = (SolverNode){.board = board, .parent = parent, .move = move};
+}
+
+// Ties are broken by parent, then move, so the line found doesn't depend on
+// the sort.
+static int compare_nodes(const void *a, const void *b) {
+  const SolverNode *na = a;
+  const SolverNode *nb = b;
+  if (na->board != nb->board) return na->board < nb->board ? -1 : 1;
+  if (na->parent != nb->parent) return na->parent < nb->parent ? -1 : 1;
+  return (na->move > nb->move) - (na->move < nb->move);
+}
+
+static u32 tile_sum(Board b) {
+  u32 sum = 0;
+  for (u32 i = 0; i < 16; i++) {
+    u32 exponent = (b >> (i * 4)) & 0xF;
+    sum += exponent ? 1u << exponent : 0;
+  }
+  return sum;
+}
+
+// Breadth first over the boards reachable in one more move, all of a layer
+// sharing a generator state. Boards reached by different lines are kept once,
+// so a layer holds the distinct positions of its depth rather than 4^depth.
+u32 puzzle_solve(PuzzleSolver *solver, Board b, Rng rng, u8 target_exponent, u32 max_moves, u64 *solution) {
+  max_moves = CORE_MIN(max_moves, PUZZLE_MAX_MOVES);
+  *solution = 0;
+
+  // merges keep the sum of the tiles and every spawn adds at most 4
+  if (tile_sum(b) + 4 * max_moves < 1u << target_exponent) return 0;
+
+  u64 max_nodes = CORE_MIN(solver->max_nodes, (u64)U32_MAX);
+  solver->node_count = 0;
+  push_node(solver, b, U32_MAX, 0);
+  u64 layer_start = 0;
+  u64 layer_end = 1;
+
+  for (u32 depth = 1; depth <= max_moves; depth++) {
+    Rng next = rng;
+
+    for (u64 i = layer_start; i < layer_end; i++) {
+      Board parent = solver->nodes[i].board;
+      u8 legal = board_legal_moves(parent);
+
+      for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+        if (!(legal & (1 << dir))) continue;
+
+        Board moved = board_move(parent, dir, NULL);
+        if (board_max_exponent(moved) >= target_exponent) {
+          *solution = (u64)dir << ((depth - 1) * 2);
+          u64 idx = i;
+          for (u32 d = depth - 1; d > 0; d--) {
+            *solution |= (u64)solver->nodes[idx].move << ((d - 1) * 2);
+            idx = solver->nodes[idx].parent;
+          }
+          return depth;
+        }
+
+        if (solver->node_count >= max_nodes) return U32_MAX;
+        next = rng;
+        push_node(solver, board_spawn_random_tile(moved, &next), (u32)i, dir);
+      }
+    }
+
+    if (solver->node_count == layer_end) return 0;
+    rng = next;
+
+    SolverNode *layer = solver->nodes + layer_end;
+    u64 count = solver->node_count - layer_end;
+    qsort(layer, count, sizeof(SolverNode), compare_nodes);
+    u64 unique = 1;
+    for (u64 i = 1; i < count; i++) {
+      if (layer[i].board != layer[unique - 1].board) {
+        layer[unique++] = layer[i];
+      }
+    }
+    solver->node_count = layer_end + unique;
+
+    layer_start = layer_end;
+    layer_end = solver->node_count;
+  }
+
+  return 0;
+}
+
+bool puzzle_check_solution(const Puzzle *puzzle) {
+  if (puzzle->move_count == 0 || puzzle->move_count > PUZZLE_MAX_MOVES) return false;
+
+  Board b = puzzle->board;
+  Rng rng = {puzzle->rng_state};
+  for (u32 i = 0; i < puzzle->move_count; i++) {
+    MoveDir dir = puzzle_move(puzzle, i);
+    if (!(board_legal_moves(b) & (1 << dir))) return false;
+
+    Board moved = board_move(b, dir, NULL);
+    // the target is made by the last move, not before
+    if ((board_max_exponent(moved) >= puzzle->target_exponent) != (i + 1 == puzzle->move_count)) return false;
+    b = board_spawn_random_tile(moved, &rng);
+  }
+
+  return true;
+}
+
+///////////////////////////////////
+//
+//
+// Packs
+//
+//
+///////////////////////////////////
+
+bool puzzle_write_header(FILE *fp, u32 puzzle_count) {
+  u8 header[PUZZLE_HEADER_SIZE] = {0};
+  u32 version = PUZZLE_VERSION;
+  memcpy(header, PUZZLE_MAGIC, 4);
+  memcpy(header + 4, &version, 4);
+  memcpy(header + 8, &puzzle_count, 4);
+
+  return fwrite(header, sizeof(header), 1, fp) == 1;
+}
+
+bool puzzle_pack_open(PuzzlePack *pack, const char *path) {
+  memset(pack, 0, sizeof(*pack));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("[ERROR]: could not open puzzle pack \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < PUZZLE_HEADER_SIZE) {
+    printf("[ERROR]: \"%s\" is not a puzzle pack\n", path);
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("[ERROR]: could not map puzzle pack \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  pack->data = data;
+  pack->size = st.st_size;
+
+  u32 version;
+  memcpy(&version, pack->data + 4, 4);
+  memcpy(&pack->puzzle_count, pack->data + 8, 4);
+  pack->puzzles = (const Puzzle *)(pack->data + PUZZLE_HEADER_SIZE);
+
+  if (memcmp(pack->data, PUZZLE_MAGIC, 4) != 0 || version != PUZZLE_VERSION) {
+    printf("[ERROR]: \"%s\" is not a puzzle pack\n", path);
+    puzzle_pack_close(pack);
+    return false;
+  }
+  if (pack->puzzle_count > (pack->size - PUZZLE_HEADER_SIZE) / sizeof(Puzzle)) {
+    printf("[ERROR]: puzzle pack \"%s\" is truncated\n", path);
+    puzzle_pack_close(pack);
+    return false;
+  }
+
+  return true;
+}
+
+void puzzle_pack_close(PuzzlePack *pack) {
+  if (pack->data) {
+    munmap((void *)pack->data, pack->size);
+  }
+  memset(pack, 0, sizeof(*pack));
+}
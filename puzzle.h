@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "board.h"
+
+// Puzzles: a position, the state of its spawn generator and a tile to make
+// within a number of moves, e.g. "reach 2048 in 12 moves".
+//
+// Every spawn draws exactly two numbers from the game's Rng whatever the move
+// was (see planner.h), so from a known generator state the game is a one
+// player puzzle without chance, and puzzle_solve() finds its shortest winning
+// line exactly. `move_count` is the length of that line, so a puzzle is
+// solvable in its moves and not in fewer.
+//
+// Packs are generated offline by c2048-puzzles and memory mapped by the game,
+// puzzles being read in place. File layout, little endian:
+//
+//   header   "C2PZ" u32 version u32 puzzle_count u32 reserved
+//   puzzles  puzzle_count * Puzzle (32 bytes)
+
+#define PUZZLE_MAGIC "C2PZ"
+#define PUZZLE_VERSION 1
+#define PUZZLE_HEADER_SIZE 16
+// the solution is 2 bits per move in a u64
+#define PUZZLE_MAX_MOVES 32
+// boards kept by puzzle_solve() over all its layers, about 16 bytes each
+#define PUZZLE_SOLVER_DEFAULT_MAX_NODES (1 << 22)
+
+typedef struct Puzzle {
+  Board board;
+  // generator state the next spawn is drawn from
+  u64 rng_state;
+  // shortest winning line, one MoveDir per 2 bits, first move in the low bits
+  u64 solution;
+  u8 target_exponent;
+  u8 move_count;
+  // first moves that can still make the target in time, 1 is the hardest
+  u8 winning_first_moves;
+  u8 reserved[5];
+} Puzzle;
+
+typedef struct PuzzlePack {
+  const u8 *data;
+  u64 size;
+  const Puzzle *puzzles;
+  u32 puzzle_count;
+} PuzzlePack;
+
+typedef struct SolverNode {
+  Board board;
+  // index of the node of the previous layer it was reached from
+  u32 parent;
+  u8 move;
+} SolverNode;
+
+// Scratch memory of puzzle_solve(), reused from one call to the next.
+typedef struct PuzzleSolver {
+  SolverNode *nodes;
+  u64 node_count;
+  u64 node_cap;
+  // puzzle_solve() gives up rather than keep more boards than this
+  u64 max_nodes;
+} PuzzleSolver;
+
+MoveDir puzzle_move(const Puzzle *puzzle, u32 idx);
+
+void puzzle_solver_init(PuzzleSolver *solver);
+void puzzle_solver_free(PuzzleSolver *solver);
+// Finds the shortest line from `b`, where the next spawn is drawn from `rng`,
+// making a tile of `target_exponent` within `max_moves` moves. Returns its
+// length and stores it in `solution`, 0 when there's none, and U32_MAX when
+// the search outgrew solver->max_nodes before it could tell.
+u32 puzzle_solve(PuzzleSolver *solver, Board b, Rng rng, u8 target_exponent, u32 max_moves, u64 *solution);
+// Replays the solution of `puzzle` through the rules engine.
+bool puzzle_check_solution(const Puzzle *puzzle);
+
+// Writes the header, the puzzles follow it.
+bool puzzle_write_header(FILE *fp, u32 puzzle_count);
+bool puzzle_pack_open(PuzzlePack *pack, const char *path);
+void puzzle_pack_close(PuzzlePack *pack);
@@ -0,0 +1,401 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "planner.h"
+#include "player.h"
+#include "puzzle.h"
+#include "timer.h"
+
+// Generates puzzle packs (puzzle.h) and checks them.
+//
+// Every seed gives at most one puzzle. The beam planner finds a short game
+// from the seed to the target tile, the puzzle starts some moves before its
+// end, and the exact solver then finds the shortest line from there, which
+// becomes the puzzle's move count and solution. Puzzles the greedy player
+// solves in time, or shorter than asked for, are dropped. Seeds are handed
+// out to the threads one at a time, and the pack holds the puzzles of the
+// lowest seeds, so it's the same whatever the number of threads.
+
+typedef struct Generator {
+  u64 first_seed;
+  u32 puzzle_count;
+  u8 target_exponent;
+  u32 min_moves;
+  u32 max_moves;
+  u32 beam_width;
+
+  u64 next_seed;
+  pthread_mutex_t lock;
+  // by seed, unsorted
+  Puzzle *puzzles;
+  u64 *puzzle_seeds;
+  u32 found;
+  u32 cap;
+  u64 seeds_tried;
+  u64 solver_gave_up;
+} Generator;
+
+Generator gen = {0};
+
+// Whether the greedy player makes the target from the start of `puzzle`
+// within its moves.
+bool greedy_solves(const Puzzle *puzzle) {
+  Player player;
+  player_init(&player, PLAYER_GREEDY, puzzle->rng_state);
+  Board b = puzzle->board;
+  Rng rng = {puzzle->rng_state};
+
+  bool solved = false;
+  for (u32 i = 0; i < puzzle->move_count && !solved && board_legal_moves(b); i++) {
+    Board moved = board_move(b, player_choose_move(&player, b), NULL);
+    solved = board_max_exponent(moved) >= puzzle->target_exponent;
+    b = board_spawn_random_tile(moved, &rng);
+  }
+
+  player_deinit(&player);
+  return solved;
+}
+
+u8 count_winning_first_moves(PuzzleSolver *solver, const Puzzle *puzzle) {
+  u8 count = 0;
+  u8 legal = board_legal_moves(puzzle->board);
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    if (!(legal & (1 << dir))) continue;
+
+    Board moved = board_move(puzzle->board, dir, NULL);
+    if (board_max_exponent(moved) >= puzzle->target_exponent) {
+      count++;
+      continue;
+    }
+
+    Rng rng = {puzzle->rng_state};
+    Board spawned = board_spawn_random_tile(moved, &rng);
+    u64 solution;
+    u32 moves = puzzle_solve(solver, spawned, rng, puzzle->target_exponent, puzzle->move_count - 1u, &solution);
+    // a line the solver couldn't finish counts as winning, the puzzle only
+    // looks easier than it is
+    if (moves != 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+// The puzzle of `seed`, false if it has none.
+bool make_puzzle(Planner *planner, PuzzleSolver *solver, u64 seed, Puzzle *puzzle) {
+  Rng rng;
+  rng_seed(&rng, seed);
+  Board b = board_new_game(&rng);
+
+  PlanResult plan;
+  planner_plan(planner, b, rng, gen.target_exponent, &plan);
+  if (!plan.reached) {
+    plan_result_free(&plan);
+    return false;
+  }
+
+  // the length asked for is drawn from the seed too
+  Rng length_rng;
+  rng_seed(&length_rng, seed ^ 0x5eed5eed5eed5eedull);
+  u32 length = gen.min_moves + rng_bounded(&length_rng, gen.max_moves - gen.min_moves + 1);
+  length = CORE_MIN(length, plan.move_count);
+
+  for (u32 i = 0; i + length < plan.move_count; i++) {
+    b = board_spawn_random_tile(board_move(b, plan.moves[i], NULL), &rng);
+  }
+  plan_result_free(&plan);
+
+  *puzzle = (Puzzle){.board = b, .rng_state = rng.state, .target_exponent = gen.target_exponent};
+  u32 moves = puzzle_solve(solver, b, rng, gen.target_exponent, length, &puzzle->solution);
+  if (moves == U32_MAX) {
+    __atomic_fetch_add(&gen.solver_gave_up, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  if (moves < gen.min_moves) return false;
+
+  puzzle->move_count = (u8)moves;
+  if (!puzzle_check_solution(puzzle)) {
+    printf("[ERROR]: the solution of the puzzle of seed %llu doesn't replay\n", (unsigned long long)seed);
+    return false;
+  }
+  if (greedy_solves(puzzle)) return false;
+
+  puzzle->winning_first_moves = count_winning_first_moves(solver, puzzle);
+  return true;
+}
+
+void add_puzzle(u64 seed, const Puzzle *puzzle) {
+  if (gen.found >= gen.cap) {
+    gen.cap = gen.cap ? gen.cap * 2 : 256;
+    Puzzle *puzzles = realloc(gen.puzzles, gen.cap * sizeof(Puzzle));
+    u64 *seeds = realloc(gen.puzzle_seeds, gen.cap * sizeof(u64));
+    if (!puzzles || !seeds) {
+      printf("[FATAL] Failed to reallocate memory for puzzles\n");
+      exit(1);
+    }
+    gen.puzzles = puzzles;
+    gen.puzzle_seeds = seeds;
+  }
+
+  gen.puzzles[gen.found] = *puzzle;
+  gen.puzzle_seeds[gen.found] = seed;
+  gen.found++;
+}
+
+void *generate_thread(void *arg) {
+  CORE_UNUSED(arg);
+
+  Planner planner;
+  if (!planner_create(&planner, gen.beam_width, 1)) return NULL;
+  PuzzleSolver solver;
+  puzzle_solver_init(&solver);
+
+  // every seed below one claimed is done before the threads are joined, so
+  // the lowest seeds with a puzzle are all found
+  while (__atomic_load_n(&gen.found, __ATOMIC_RELAXED) < gen.puzzle_count) {
+    u64 seed = gen.first_seed + __atomic_fetch_add(&gen.next_seed, 1, __ATOMIC_RELAXED);
+
+    Puzzle puzzle;
+    bool made = make_puzzle(&planner, &solver, seed, &puzzle);
+
+    pthread_mutex_lock(&gen.lock);
+    gen.seeds_tried++;
+    if (made) {
+      add_puzzle(seed, &puzzle);
+      if (gen.found % 100 == 0) {
+        fprintf(stderr, "\r%u / %u puzzles, %llu seeds", gen.found, gen.puzzle_count,
+            (unsigned long long)gen.seeds_tried);
+      }
+    }
+    pthread_mutex_unlock(&gen.lock);
+  }
+
+  puzzle_solver_free(&solver);
+  planner_destroy(&planner);
+  return NULL;
+}
+
+int compare_by_seed(const void *a, const void *b) {
+  u64 sa = gen.puzzle_seeds[*(const u32 *)a];
+  u64 sb = gen.puzzle_seeds[*(const u32 *)b];
+  return (sa > sb) - (sa < sb);
+}
+
+bool generate(const char *path, u32 thread_count) {
+  pthread_mutex_init(&gen.lock, NULL);
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
+  for (u32 i = 0; i < thread_count; i++) {
+    pthread_create(&threads[i], NULL, generate_thread, NULL);
+  }
+  for (u32 i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  u32 *order = malloc(CORE_MAX(1, gen.found) * sizeof(u32));
+  for (u32 i = 0; i < gen.found; i++) {
+    order[i] = i;
+  }
+  qsort(order, gen.found, sizeof(u32), compare_by_seed);
+  u32 count = CORE_MIN(gen.found, gen.puzzle_count);
+
+  FILE *fp = fopen(path, "wb");
+  bool ok = fp && puzzle_write_header(fp, count);
+  for (u32 i = 0; ok && i < count; i++) {
+    ok = fwrite(&gen.puzzles[order[i]], sizeof(Puzzle), 1, fp) == 1;
+  }
+  if (!ok) {
+    printf("[ERROR]: could not write \"%s\": %s\n", path, strerror(errno));
+  }
+  if (fp && fclose(fp) != 0) {
+    ok = false;
+  }
+
+  u32 moves_sum = 0;
+  u32 forced = 0;
+  for (u32 i = 0; i < count; i++) {
+    moves_sum += gen.puzzles[order[i]].move_count;
+    forced += gen.puzzles[order[i]].winning_first_moves == 1;
+  }
+
+  f64 elapsed = get_time();
+  fprintf(stderr, "\r%u puzzles from %llu seeds in %.2fs, %.1f moves on average, %u with a single winning first move",
+      count, (unsigned long long)gen.seeds_tried, elapsed, count ? (f64)moves_sum / count : 0, forced);
+  if (gen.solver_gave_up) {
+    fprintf(stderr, ", %llu too large to solve", (unsigned long long)gen.solver_gave_up);
+  }
+  fprintf(stderr, "\n");
+
+  free(order);
+  free(gen.puzzles);
+  free(gen.puzzle_seeds);
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// List and check
+//
+//
+///////////////////////////////////
+
+void list_puzzles(const PuzzlePack *pack) {
+  printf("%-6s %6s %5s %5s %-16s %-16s %s\n", "# idx", "target", "moves", "wins", "board", "rng", "solution");
+  for (u32 i = 0; i < pack->puzzle_count; i++) {
+    const Puzzle *puzzle = &pack->puzzles[i];
+    char hex[BOARD_HEX_LEN + 1];
+    board_to_hex(puzzle->board, hex);
+
+    char solution[PUZZLE_MAX_MOVES + 1];
+    u32 moves = CORE_MIN(puzzle->move_count, PUZZLE_MAX_MOVES);
+    for (u32 m = 0; m < moves; m++) {
+      solution[m] = move_dir_to_char(puzzle_move(puzzle, m));
+    }
+    solution[moves] = '\0';
+
+    printf("%-6u %6u %5u %5u %s %016llx %s\n", i, 1u << puzzle->target_exponent, puzzle->move_count,
+        puzzle->winning_first_moves, hex, (unsigned long long)puzzle->rng_state, solution);
+  }
+}
+
+// Replays every solution and solves every puzzle again to check that there's
+// no shorter line.
+bool check_puzzles(const PuzzlePack *pack) {
+  PuzzleSolver solver;
+  puzzle_solver_init(&solver);
+
+  u32 bad = 0;
+  for (u32 i = 0; i < pack->puzzle_count; i++) {
+    const Puzzle *puzzle = &pack->puzzles[i];
+    Rng rng = {puzzle->rng_state};
+    u64 solution;
+    u32 moves = puzzle_check_solution(puzzle)
+      ? puzzle_solve(&solver, puzzle->board, rng, puzzle->target_exponent, puzzle->move_count, &solution)
+      : 0;
+    if (moves != puzzle->move_count) {
+      printf("[WARN] puzzle %u: %s\n", i, moves == U32_MAX ? "too large to solve"
+          : moves == 0 ? "the solution doesn't make the target" : "has a shorter solution");
+      bad++;
+    }
+  }
+
+  puzzle_solver_free(&solver);
+  fprintf(stderr, "%u puzzles, %u bad\n", pack->puzzle_count, bad);
+  return bad == 0;
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] -o <pack>\n"
+      "       %s -l <pack>\n"
+      "       %s -c <pack>\n"
+      "\n"
+      "options:\n"
+      "  -o <pack>   generate a puzzle pack\n"
+      "  -l <pack>   list the puzzles of a pack\n"
+      "  -c <pack>   check every puzzle of a pack with the solver\n"
+      "  -n <count>  number of puzzles (default 100)\n"
+      "  -t <tile>   tile to make (default 2048)\n"
+      "  -m <moves>  fewest moves of a puzzle (default 6)\n"
+      "  -M <moves>  most moves of a puzzle, at most %d (default 14)\n"
+      "  -s <seed>   first seed (default 1)\n"
+      "  -w <width>  beam width of the planner (default 256)\n"
+      "  -j <count>  threads (default: number of cores)\n", prog, prog, prog, PUZZLE_MAX_MOVES);
+}
+
+int main(int argc, char *argv[]) {
+  const char *out_path = NULL;
+  const char *list_path = NULL;
+  const char *check_path = NULL;
+  u32 target_tile = 2048;
+  u32 thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+  gen.puzzle_count = 100;
+  gen.min_moves = 6;
+  gen.max_moves = 14;
+  gen.first_seed = 1;
+  gen.beam_width = 256;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:l:c:n:t:m:M:s:w:j:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        out_path = optarg;
+        break;
+      case 'l':
+        list_path = optarg;
+        break;
+      case 'c':
+        check_path = optarg;
+        break;
+      case 'n':
+        gen.puzzle_count = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        target_tile = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        gen.min_moves = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'M':
+        gen.max_moves = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        gen.first_seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'w':
+        gen.beam_width = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'j':
+        thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  board_init_tables();
+  start_internal_timer();
+
+  if (list_path || check_path) {
+    PuzzlePack pack;
+    if (!puzzle_pack_open(&pack, list_path ? list_path : check_path)) return 1;
+    bool ok = true;
+    if (list_path) {
+      list_puzzles(&pack);
+    } else {
+      ok = check_puzzles(&pack);
+    }
+    puzzle_pack_close(&pack);
+    return ok ? 0 : 1;
+  }
+
+  if (!out_path) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (!CORE_IS_POWER_OF_TWO(target_tile) || target_tile < 8 || target_tile > (1u << BOARD_MAX_EXPONENT)) {
+    printf("[ERROR]: the target must be a tile value between 8 and %u\n", 1u << BOARD_MAX_EXPONENT);
+    return 1;
+  }
+  if (gen.max_moves > PUZZLE_MAX_MOVES || gen.min_moves > gen.max_moves) {
+    printf("[ERROR]: puzzles take between 1 and %d moves, -m at most -M\n", PUZZLE_MAX_MOVES);
+    return 1;
+  }
+  gen.target_exponent = (u8)__builtin_ctz(target_tile);
+
+  return generate(out_path, thread_count) ? 0 : 1;
+}
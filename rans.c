@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rans.h"
+
+// probabilities are out of 1 << RANS_PROB_BITS
+#define RANS_PROB_BITS 15
+#define RANS_PROB_ONE (1u << RANS_PROB_BITS)
+// a decision's probability never gets closer than this to 0 or 1, a wrong
+// guess costs at most 10 bits
+#define RANS_PROB_MIN 32
+// the coder state stays in [RANS_L, RANS_L << 8)
+#define RANS_L (1u << 23)
+// adaptation starts fast and slows down to 1/2^RANS_RATE_MAX per decision, so
+// a context settles after a few moves but isn't thrown off by one surprise
+#define RANS_RATE_MAX 4
+
+#define RANS_CORNERS 5
+#define RANS_CONTEXTS (16 * MOVE_DIR_COUNT * RANS_CORNERS * MOVE_DIR_COUNT)
+// the vertical or horizontal decision, then the way along each axis
+#define RANS_NODES 3
+
+typedef struct RansBit {
+  u16 prob;
+  u8 rate;
+} RansBit;
+
+typedef struct RansModel {
+  RansBit bits[RANS_CONTEXTS][RANS_NODES];
+} RansModel;
+
+static void model_init(RansModel *model) {
+  for (u32 i = 0; i < RANS_CONTEXTS; i++) {
+    for (u32 j = 0; j < RANS_NODES; j++) {
+      model->bits[i][j] = (RansBit){.prob = RANS_PROB_ONE / 2, .rate = 1};
+    }
+  }
+}
+
+// `prob` is the probability of a 0
+static void model_update(RansBit *bit, u32 value) {
+  if (value) {
+    bit->prob -= bit->prob >> bit->rate;
+  } else {
+    bit->prob += (RANS_PROB_ONE - bit->prob) >> bit->rate;
+  }
+  bit->prob = (u16)CORE_CLAMP(bit->prob, RANS_PROB_MIN, RANS_PROB_ONE - RANS_PROB_MIN);
+  if (bit->rate < RANS_RATE_MAX) {
+    bit->rate++;
+  }
+}
+
+// 0 to 3 for the corner holding the largest tile, 4 if it isn't in one
+static u32 max_tile_corner(Board b) {
+  u32 max = 0;
+  u32 max_idx = 0;
+  for (u32 i = 0; i < 16; i++) {
+    u32 exponent = (b >> (i * 4)) & 0xF;
+    if (exponent > max) {
+      max = exponent;
+      max_idx = i;
+    }
+  }
+
+  switch (max_idx) {
+  case 0:
+    return 0;
+  case 3:
+    return 1;
+  case 12:
+    return 2;
+  case 15:
+    return 3;
+  default:
+    return 4;
+  }
+}
+
+static u32 count_tiles(Board b) {
+  // a bit per nibble, set when any of its bits is
+  b |= b >> 1;
+  b |= b >> 2;
+  return (u32)__builtin_popcountll(b & 0x1111111111111111ULL);
+}
+
+// The legal move merging the most tiles, the first one among ties.
+static MoveDir most_merging(const Board moved[MOVE_DIR_COUNT], u8 legal) {
+  MoveDir best = MOVE_DIR_UP;
+  u32 fewest = 17;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    u32 tiles = count_tiles(moved[dir]);
+    if (((legal >> dir) & 1) && tiles < fewest) {
+      fewest = tiles;
+      best = dir;
+    }
+  }
+  return best;
+}
+
+static u32 context_of(Board b, const Board moved[MOVE_DIR_COUNT], u8 legal, MoveDir prev) {
+  u32 ctx = (u32)legal * MOVE_DIR_COUNT + prev;
+  ctx = ctx * RANS_CORNERS + max_tile_corner(b);
+  return ctx * MOVE_DIR_COUNT + most_merging(moved, legal);
+}
+
+// Every board a move can lead to, and the mask of legal moves.
+static u8 move_all(Board b, Board moved[MOVE_DIR_COUNT]) {
+  u8 legal = 0;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    moved[dir] = board_move(b, dir, NULL);
+    if (moved[dir] != b) {
+      legal |= 1 << dir;
+    }
+  }
+  return legal;
+}
+
+///////////////////////////////////
+//
+//
+// Coder
+//
+//
+///////////////////////////////////
+
+// A decision to code, kept in the order they're made as rANS codes them
+// backwards.
+typedef struct RansSymbol {
+  u16 prob;
+  u8 value;
+} RansSymbol;
+
+static void push_decision(RansSymbol *symbols, u32 *count, RansBit *bit, u32 value) {
+  symbols[(*count)++] = (RansSymbol){.prob = bit->prob, .value = (u8)value};
+  model_update(bit, value);
+}
+
+u64 rans_encode_moves(const GameRecord *record, u8 *out) {
+  RansModel *model = malloc(sizeof(RansModel));
+  RansSymbol *symbols = malloc(((u64)record->move_count * 2 + 1) * sizeof(RansSymbol));
+  if (!model || !symbols) {
+    printf("[FATAL] Failed to allocate memory for the move coder\n");
+    exit(1);
+  }
+  model_init(model);
+
+  Rng rng;
+  rng_seed(&rng, record->seed);
+  Board b = board_new_game(&rng);
+  MoveDir prev = MOVE_DIR_UP;
+  u32 count = 0;
+  bool valid = true;
+  for (u32 i = 0; i < record->move_count && valid; i++) {
+    Board moved[MOVE_DIR_COUNT];
+    u8 legal = move_all(b, moved);
+    MoveDir dir = record_get_move(record, i);
+    valid = (legal >> dir) & 1;
+
+    RansBit *bits = model->bits[context_of(b, moved, legal, prev)];
+    u32 axis = dir >> 1;
+    u8 vertical = legal & 3;
+    u8 horizontal = legal >> 2;
+    if (vertical && horizontal) {
+      push_decision(symbols, &count, &bits[0], axis);
+    }
+    u8 along = axis ? horizontal : vertical;
+    if (along == 3) {
+      push_decision(symbols, &count, &bits[1 + axis], dir & 1);
+    }
+
+    b = board_spawn_random_tile(moved[dir], &rng);
+    prev = dir;
+  }
+  free(model);
+
+  if (!valid) {
+    free(symbols);
+    return 0;
+  }
+
+  // written from the end of the buffer to its start
+  u8 *end = out + RANS_MOVES_BOUND(record->move_count);
+  u8 *ptr = end;
+  u32 x = RANS_L;
+  for (u32 i = count; i > 0; i--) {
+    RansSymbol symbol = symbols[i - 1];
+    u32 start = symbol.value ? symbol.prob : 0;
+    u32 freq = symbol.value ? RANS_PROB_ONE - symbol.prob : symbol.prob;
+
+    u32 x_max = ((RANS_L >> RANS_PROB_BITS) << 8) * freq;
+    while (x >= x_max) {
+      *--ptr = (u8)x;
+      x >>= 8;
+    }
+    x = ((x / freq) << RANS_PROB_BITS) + (x % freq) + start;
+  }
+  ptr -= 4;
+  memcpy(ptr, &x, 4);
+  free(symbols);
+
+  u64 size = (u64)(end - ptr);
+  memmove(out, ptr, size);
+  return size;
+}
+
+typedef struct RansDecoder {
+  u32 x;
+  const u8 *ptr;
+  const u8 *end;
+} RansDecoder;
+
+static u32 decode_decision(RansDecoder *dec, RansBit *bit) {
+  u32 slot = dec->x & (RANS_PROB_ONE - 1);
+  u32 value = slot >= bit->prob;
+  if (value) {
+    dec->x = (RANS_PROB_ONE - bit->prob) * (dec->x >> RANS_PROB_BITS) + slot - bit->prob;
+  } else {
+    dec->x = bit->prob * (dec->x >> RANS_PROB_BITS) + slot;
+  }
+  while (dec->x < RANS_L && dec->ptr < dec->end) {
+    dec->x = (dec->x << 8) | *dec->ptr++;
+  }
+
+  model_update(bit, value);
+  return value;
+}
+
+bool rans_decode_moves(GameRecord *record, u32 move_count, const u8 *data, u64 size) {
+  if (size < 4) return false;
+
+  RansModel *model = malloc(sizeof(RansModel));
+  if (!model) {
+    printf("[FATAL] Failed to allocate memory for the move coder\n");
+    exit(1);
+  }
+  model_init(model);
+
+  RansDecoder dec = {.ptr = data + 4, .end = data + size};
+  memcpy(&dec.x, data, 4);
+
+  Rng rng;
+  rng_seed(&rng, record->seed);
+  Board b = board_new_game(&rng);
+  MoveDir prev = MOVE_DIR_UP;
+  // moves are or-ed into place
+  record->move_count = 0;
+  if (record->moves) {
+    memset(record->moves, 0, record->move_cap);
+  }
+  bool valid = dec.x >= RANS_L;
+  for (u32 i = 0; i < move_count && valid; i++) {
+    Board moved[MOVE_DIR_COUNT];
+    u8 legal = move_all(b, moved);
+    if (legal == 0) {
+      valid = false;
+      break;
+    }
+
+    // a decision with one legal side is taken without reading anything
+    RansBit *bits = model->bits[context_of(b, moved, legal, prev)];
+    u8 vertical = legal & 3;
+    u8 horizontal = legal >> 2;
+    u32 axis = horizontal ? 1 : 0;
+    if (vertical && horizontal) {
+      axis = decode_decision(&dec, &bits[0]);
+    }
+    u8 along = axis ? horizontal : vertical;
+    u32 way = along >> 1;
+    if (along == 3) {
+      way = decode_decision(&dec, &bits[1 + axis]);
+    }
+
+    MoveDir dir = (MoveDir)(axis << 1 | way);
+    record_add_move(record, dir);
+    b = board_spawn_random_tile(moved[dir], &rng);
+    prev = dir;
+  }
+  free(model);
+
+  // the encoder started from RANS_L and every byte it wrote is read back
+  return valid && dec.x == RANS_L && dec.ptr == dec.end;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "record.h"
+
+// Entropy coded moves of a game, for archiving game records in fewer than the
+// 2 bits per move of the packed form.
+//
+// Moves are coded with a byte-wise rANS coder, each as up to two binary
+// decisions (vertical or horizontal, then which way). Illegal moves are never
+// played, so a decision with only one legal side costs nothing and a position
+// with a single legal move takes no bits at all. Every decision has an
+// adaptive probability per context, the context being cheap features of the
+// board the move is played on: its legal moves, the previous move, the corner
+// holding the largest tile and the move merging the most tiles. The model
+// starts over with every game so each game decodes on its own.
+//
+// Coding and decoding replay the game to know its boards and try every move of
+// each, decoding costs two to three record_replay().
+
+// Largest coded size of a game of `move_count` moves.
+#define RANS_MOVES_BOUND(move_count) (4 + (u64)(move_count) * 4)
+
+// Writes the moves of `record` to `out`, which must hold
+// RANS_MOVES_BOUND(record->move_count) bytes, and returns the number of
+// bytes written. 0 if a move doesn't change the board, those can't be coded.
+u64 rans_encode_moves(const GameRecord *record, u8 *out);
+// Decodes `move_count` moves into `record`, which must be initialized and
+// hold the game's seed. False if `data` isn't a valid coding of them.
+bool rans_decode_moves(GameRecord *record, u32 move_count, const u8 *data, u64 size);
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "record.h"
+#include "timer.h"
+
+// Rewrites game record files (record.h) into one file with the moves coded
+// another way, by default entropy coded (rans.h) to shrink an archive of
+// self-play games. Every game is decoded from its input and encoded again, so
+// the output holds the same games in the same order.
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] <record file>...\n"
+      "\n"
+      "options:\n"
+      "  -o <file>   record file to write (required)\n"
+      "  -p          pack the moves 2 bits each instead of entropy coding them\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+  const char *out_path = NULL;
+  RecordCodec codec = RECORD_CODEC_RANS;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:ph")) != -1) {
+    switch (opt) {
+      case 'o':
+        out_path = optarg;
+        break;
+      case 'p':
+        codec = RECORD_CODEC_PACKED;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!out_path || optind == argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  board_init_tables();
+  start_internal_timer();
+
+  FILE *out = fopen(out_path, "wb");
+  if (!out || !record_file_write_header(out, codec)) {
+    printf("[ERROR]: could not create \"%s\"\n", out_path);
+    return 1;
+  }
+
+  GameRecord record;
+  record_init(&record, 0);
+  u64 games = 0;
+  u64 moves = 0;
+  u64 skipped = 0;
+  bool ok = true;
+
+  for (i32 i = optind; i < argc && ok; i++) {
+    RecordFileReader reader;
+    if (!record_file_open(&reader, argv[i])) {
+      ok = false;
+      break;
+    }
+
+    while (ok && record_file_next(&reader, &record)) {
+      // only games of legal moves can be entropy coded
+      if (codec == RECORD_CODEC_RANS && !record_replay(&record, NULL, NULL)) {
+        skipped++;
+        continue;
+      }
+
+      ok = record_file_write(out, codec, &record);
+      games++;
+      moves += record.move_count;
+    }
+
+    if (reader.error) {
+      printf("[WARN] %s: stopped on a truncated or damaged record\n", argv[i]);
+    }
+    record_file_close(&reader);
+  }
+
+  long size = ftell(out);
+  if (fclose(out) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    printf("[ERROR]: failed to write \"%s\"\n", out_path);
+  }
+  if (skipped) {
+    printf("[WARN] skipped %llu games with illegal moves\n", (unsigned long long)skipped);
+  }
+
+  printf("%llu games, %llu moves, %.3f bits per move with the headers, %.1fs\n", (unsigned long long)games,
+      (unsigned long long)moves, moves ? (f64)(size - 8) * 8.0 / (f64)moves : 0.0, get_time());
+
+  record_free(&record);
+
+  return ok ? 0 : 1;
+}
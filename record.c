@@ -0,0 +1,267 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rans.h"
+#include "record.h"
+
+void record_init(GameRecord *record, u64 seed) {
+  memset(record, 0, sizeof(*record));
+  record->seed = seed;
+}
+
+void record_free(GameRecord *record) {
+  free(record->moves);
+  memset(record, 0, sizeof(*record));
+}
+
+static void reserve_moves(GameRecord *record, u32 move_count) {
+  u32 bytes = (move_count + 3) / 4;
+  if (bytes <= record->move_cap) return;
+
+  u32 cap = record->move_cap ? record->move_cap : 64;
+  while (cap < bytes) {
+    cap *= 2;
+  }
+
+  u8 *temp = realloc(record->moves, cap);
+  if (!temp) {
+    printf("[FATAL] Failed to reallocate memory for a game record\n");
+    exit(1);
+  }
+  // moves are or-ed into place, so new bytes must start cleared
+  memset(temp + record->move_cap, 0, cap - record->move_cap);
+  record->moves = temp;
+  record->move_cap = cap;
+}
+
+void record_add_move(GameRecord *record, MoveDir dir) {
+  reserve_moves(record, record->move_count + 1);
+  u32 idx = record->move_count++;
+  record->moves[idx / 4] |= (u8)((dir & 3) << ((idx % 4) * 2));
+}
+
+MoveDir record_get_move(const GameRecord *record, u32 idx) {
+  return (record->moves[idx / 4] >> ((idx % 4) * 2)) & 3;
+}
+
+u64 record_encoded_size(const GameRecord *record) {
+  return RECORD_HEADER_SIZE + (record->move_count + 3) / 4;
+}
+
+u8 *record_encode(const GameRecord *record, u8 *out) {
+  u32 bytes = (record->move_count + 3) / 4;
+  memcpy(out, &record->seed, 8);
+  memcpy(out + 8, &record->move_count, 4);
+  memcpy(out + 12, &record->score, 4);
+  if (bytes) {
+    memcpy(out + RECORD_HEADER_SIZE, record->moves, bytes);
+  }
+  return out + RECORD_HEADER_SIZE + bytes;
+}
+
+u64 record_decode(GameRecord *record, const u8 *data, u64 size) {
+  if (size < RECORD_HEADER_SIZE) return 0;
+
+  u32 move_count;
+  memcpy(&move_count, data + 8, 4);
+  u64 bytes = ((u64)move_count + 3) / 4;
+  if (size - RECORD_HEADER_SIZE < bytes) return 0;
+
+  memcpy(&record->seed, data, 8);
+  memcpy(&record->score, data + 12, 4);
+  record->move_count = 0;
+  reserve_moves(record, move_count);
+  memset(record->moves, 0, record->move_cap);
+  if (bytes) {
+    memcpy(record->moves, data + RECORD_HEADER_SIZE, bytes);
+  }
+  record->move_count = move_count;
+
+  return RECORD_HEADER_SIZE + bytes;
+}
+
+u64 record_view(GameRecord *record, const u8 *data, u64 size) {
+  if (size < RECORD_HEADER_SIZE) return 0;
+
+  u32 move_count;
+  memcpy(&move_count, data + 8, 4);
+  u64 bytes = ((u64)move_count + 3) / 4;
+  if (size - RECORD_HEADER_SIZE < bytes) return 0;
+
+  memcpy(&record->seed, data, 8);
+  memcpy(&record->score, data + 12, 4);
+  record->move_count = move_count;
+  record->move_cap = 0;
+  record->moves = (u8 *)data + RECORD_HEADER_SIZE;
+
+  return RECORD_HEADER_SIZE + bytes;
+}
+
+bool record_replay(const GameRecord *record, Board *final_board, u32 *score) {
+  Rng rng;
+  rng_seed(&rng, record->seed);
+  Board b = board_new_game(&rng);
+  u32 total = 0;
+
+  for (u32 i = 0; i < record->move_count; i++) {
+    Board moved = board_move(b, record_get_move(record, i), &total);
+    if (moved == b) return false;
+    b = board_spawn_random_tile(moved, &rng);
+  }
+
+  if (final_board) {
+    *final_board = b;
+  }
+  if (score) {
+    *score = total;
+  }
+
+  return true;
+}
+
+///////////////////////////////////
+//
+//
+// Files
+//
+//
+///////////////////////////////////
+
+// the size of the coded moves follows the header of a RECORD_CODEC_RANS record
+#define RECORD_RANS_HEADER_SIZE (RECORD_HEADER_SIZE + 4)
+
+u64 record_file_record_size(RecordCodec codec, const u8 *data, u64 size) {
+  if (codec == RECORD_CODEC_PACKED) {
+    if (size < RECORD_HEADER_SIZE) return 0;
+
+    u32 move_count;
+    memcpy(&move_count, data + 8, 4);
+    u64 record_size = RECORD_HEADER_SIZE + ((u64)move_count + 3) / 4;
+    return record_size <= size ? record_size : 0;
+  }
+
+  if (size < RECORD_RANS_HEADER_SIZE) return 0;
+
+  u32 coded_size;
+  memcpy(&coded_size, data + RECORD_HEADER_SIZE, 4);
+  u64 record_size = RECORD_RANS_HEADER_SIZE + (u64)coded_size;
+  return record_size <= size ? record_size : 0;
+}
+
+u64 record_file_decode(RecordCodec codec, GameRecord *record, const u8 *data, u64 size) {
+  if (codec == RECORD_CODEC_PACKED) return record_decode(record, data, size);
+
+  u64 record_size = record_file_record_size(codec, data, size);
+  if (record_size == 0) return 0;
+
+  u32 move_count;
+  memcpy(&record->seed, data, 8);
+  memcpy(&move_count, data + 8, 4);
+  memcpy(&record->score, data + 12, 4);
+  const u8 *coded = data + RECORD_RANS_HEADER_SIZE;
+  if (!rans_decode_moves(record, move_count, coded, record_size - RECORD_RANS_HEADER_SIZE)) return 0;
+
+  return record_size;
+}
+
+bool record_file_write_header(FILE *fp, RecordCodec codec) {
+  u32 version = codec;
+  return fwrite(RECORD_FILE_MAGIC, 4, 1, fp) == 1 && fwrite(&version, 4, 1, fp) == 1;
+}
+
+u64 record_file_encode(RecordCodec codec, const GameRecord *record, u8 *out) {
+  memcpy(out, &record->seed, 8);
+  memcpy(out + 8, &record->move_count, 4);
+  memcpy(out + 12, &record->score, 4);
+
+  if (codec == RECORD_CODEC_PACKED) {
+    u32 bytes = (record->move_count + 3) / 4;
+    memcpy(out + RECORD_HEADER_SIZE, record->moves, bytes);
+    return RECORD_HEADER_SIZE + bytes;
+  }
+
+  u32 coded_size = (u32)rans_encode_moves(record, out + RECORD_RANS_HEADER_SIZE);
+  if (coded_size == 0) return 0;
+  memcpy(out + RECORD_HEADER_SIZE, &coded_size, 4);
+  return RECORD_RANS_HEADER_SIZE + coded_size;
+}
+
+bool record_file_write(FILE *fp, RecordCodec codec, const GameRecord *record) {
+  u8 *encoded = malloc(RECORD_FILE_RECORD_BOUND(record->move_count));
+  if (!encoded) {
+    printf("[FATAL] Failed to allocate memory for a game record\n");
+    exit(1);
+  }
+
+  u64 size = record_file_encode(codec, record, encoded);
+  bool ok = size > 0 && fwrite(encoded, size, 1, fp) == 1;
+  free(encoded);
+
+  return ok;
+}
+
+bool record_file_open(RecordFileReader *reader, const char *path) {
+  memset(reader, 0, sizeof(*reader));
+  reader->fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (!reader->fp) {
+    printf("[ERROR]: could not open \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  char magic[4];
+  u32 version;
+  if (fread(magic, 4, 1, reader->fp) != 1 || memcmp(magic, RECORD_FILE_MAGIC, 4) != 0 ||
+      fread(&version, 4, 1, reader->fp) != 1 || (version != RECORD_CODEC_PACKED && version != RECORD_CODEC_RANS)) {
+    printf("[ERROR]: \"%s\" is not a game record file\n", path);
+    record_file_close(reader);
+    return false;
+  }
+  reader->codec = version;
+
+  return true;
+}
+
+bool record_file_next(RecordFileReader *reader, GameRecord *record) {
+  u64 header_size = reader->codec == RECORD_CODEC_PACKED ? RECORD_HEADER_SIZE : RECORD_RANS_HEADER_SIZE;
+  u8 header[RECORD_RANS_HEADER_SIZE];
+  size_t got = fread(header, 1, header_size, reader->fp);
+  if (got != header_size) {
+    reader->error = got != 0 || ferror(reader->fp);
+    return false;
+  }
+
+  // a header is all it takes to know the size
+  u64 size = record_file_record_size(reader->codec, header, U64_MAX);
+  if (size > reader->buf_cap) {
+    u8 *temp = realloc(reader->buf, size);
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for a game record\n");
+      exit(1);
+    }
+    reader->buf = temp;
+    reader->buf_cap = size;
+  }
+
+  memcpy(reader->buf, header, header_size);
+  if (size > header_size && fread(reader->buf + header_size, size - header_size, 1, reader->fp) != 1) {
+    reader->error = true;
+    return false;
+  }
+
+  if (record_file_decode(reader->codec, record, reader->buf, size) != size) {
+    reader->error = true;
+    return false;
+  }
+
+  return true;
+}
+
+void record_file_close(RecordFileReader *reader) {
+  if (reader->fp && reader->fp != stdin) {
+    fclose(reader->fp);
+  }
+  free(reader->buf);
+  memset(reader, 0, sizeof(*reader));
+}
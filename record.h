@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "board.h"
+
+// Compact record of a game.
+//
+// Every spawn is drawn from the game's Rng, so a game is fully determined by
+// its seed and its moves: the boards are rebuilt by replaying the moves from
+// board_new_game(). Moves are packed 4 per byte, 2 bits each, first move in
+// the low bits. Encoded form, little endian:
+//
+//   u64 seed u32 move_count u32 score u8 moves[(move_count + 3) / 4]
+
+#define RECORD_HEADER_SIZE 16
+
+// A record file is "C2GR" u32 version followed by records back to back, the
+// version telling how their moves are coded.
+#define RECORD_FILE_MAGIC "C2GR"
+
+typedef enum RecordCodec {
+  // the encoded form above
+  RECORD_CODEC_PACKED = 1,
+  // entropy coded moves (rans.h), 0.6 to 1.5 bits per move for games of the
+  // built-in players, as u64 seed u32 move_count u32 score u32 size
+  // u8 coded[size]
+  RECORD_CODEC_RANS = 2,
+} RecordCodec;
+
+typedef struct GameRecord {
+  u64 seed;
+  u32 score;
+  u32 move_count;
+  u32 move_cap;
+  u8 *moves;
+} GameRecord;
+
+void record_init(GameRecord *record, u64 seed);
+void record_free(GameRecord *record);
+void record_add_move(GameRecord *record, MoveDir dir);
+MoveDir record_get_move(const GameRecord *record, u32 idx);
+
+u64 record_encoded_size(const GameRecord *record);
+// Writes record_encoded_size() bytes to `out` and returns the end of them.
+u8 *record_encode(const GameRecord *record, u8 *out);
+// Decodes the record at the start of `data` into `record`, which must be
+// initialized, and returns the number of bytes read or 0 if it's truncated.
+u64 record_decode(GameRecord *record, const u8 *data, u64 size);
+// Like record_decode() but `record` points at the moves in `data` instead of
+// copying them, so it must not be added to or freed.
+u64 record_view(GameRecord *record, const u8 *data, u64 size);
+
+// Replays the moves from the seed. Fails if a move doesn't change the board.
+// `final_board` and `score` may be NULL.
+bool record_replay(const GameRecord *record, Board *final_board, u32 *score);
+
+// Size of the record at the start of `data` in a file of `codec`, 0 if it's
+// truncated.
+u64 record_file_record_size(RecordCodec codec, const u8 *data, u64 size);
+// record_decode() for a record of a file of `codec`. Also 0 if its moves don't
+// decode.
+u64 record_file_decode(RecordCodec codec, GameRecord *record, const u8 *data, u64 size);
+
+// Most bytes a record of `move_count` moves takes in a file of either codec.
+#define RECORD_FILE_RECORD_BOUND(move_count) (RECORD_HEADER_SIZE + 8 + (u64)(move_count) * 4)
+
+bool record_file_write_header(FILE *fp, RecordCodec codec);
+// Encodes the record as it's stored in a file of `codec` into `out`, which
+// holds RECORD_FILE_RECORD_BOUND() bytes, and returns its size. 0 on a move
+// that doesn't change the board with RECORD_CODEC_RANS.
+u64 record_file_encode(RecordCodec codec, const GameRecord *record, u8 *out);
+// Fails on a move that doesn't change the board with RECORD_CODEC_RANS.
+bool record_file_write(FILE *fp, RecordCodec codec, const GameRecord *record);
+
+typedef struct RecordFileReader {
+  FILE *fp;
+  RecordCodec codec;
+  u8 *buf;
+  u64 buf_cap;
+  // set when reading stopped on something else than the end of the file
+  bool error;
+} RecordFileReader;
+
+bool record_file_open(RecordFileReader *reader, const char *path);
+// Reads the next record into `record`, which must be initialized. False at
+// the end of the file or on a truncated or undecodable record.
+bool record_file_next(RecordFileReader *reader, GameRecord *record);
+void record_file_close(RecordFileReader *reader);
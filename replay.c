@@ -0,0 +1,333 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+#define REPLAY_MOVE_COUNT_OFFSET 16
+
+static void encode_header(const ReplayHeader *header, u8 *out) {
+  u16 version = REPLAY_VERSION;
+  memcpy(out, REPLAY_MAGIC, 4);
+  memcpy(out + 4, &version, 2);
+  out[6] = header->rules;
+  out[7] = header->board_size;
+  memcpy(out + 8, &header->seed, 8);
+  memcpy(out + 16, &header->move_count, 4);
+  memcpy(out + 20, &header->score, 4);
+}
+
+bool replay_decode_header(const u8 *data, ReplayHeader *header) {
+  u16 version;
+  memcpy(&version, data + 4, 2);
+  header->rules = data[6];
+  header->board_size = data[7];
+  memcpy(&header->seed, data + 8, 8);
+  memcpy(&header->move_count, data + 16, 4);
+  memcpy(&header->score, data + 20, 4);
+
+  return memcmp(data, REPLAY_MAGIC, 4) == 0 && version == REPLAY_VERSION &&
+    header->rules == REPLAY_RULES_CLASSIC && header->board_size == 4;
+}
+
+void replay_decode_keyframe(const u8 *data, ReplayKeyframe *keyframe) {
+  memcpy(&keyframe->board, data, 8);
+  memcpy(&keyframe->rng.state, data + 8, 8);
+  memcpy(&keyframe->score, data + 16, 4);
+}
+
+static void add_keyframe(ReplayKeyframes *keyframes, Board board, Rng rng, u32 score) {
+  if (keyframes->size >= keyframes->capacity) {
+    keyframes->capacity = keyframes->capacity ? keyframes->capacity * 2 : 64;
+    ReplayKeyframe *temp = realloc(keyframes->data, keyframes->capacity * sizeof(ReplayKeyframe));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for replay keyframes\n");
+      exit(1);
+    }
+    keyframes->data = temp;
+  }
+
+  keyframes->data[keyframes->size++] = (ReplayKeyframe){.board = board, .rng = rng, .score = score};
+}
+
+///////////////////////////////////
+//
+//
+// Writer
+//
+//
+///////////////////////////////////
+
+bool replay_writer_open(ReplayWriter *writer, const char *path, u64 seed) {
+  memset(writer, 0, sizeof(*writer));
+  writer->seed = seed;
+
+  writer->fp = fopen(path, "wb");
+  if (!writer->fp) {
+    printf("[ERROR]: could not create replay \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  ReplayHeader header = {
+    .rules = REPLAY_RULES_CLASSIC,
+    .board_size = 4,
+    .seed = seed,
+    .move_count = REPLAY_UNFINISHED,
+  };
+  u8 bytes[REPLAY_HEADER_SIZE];
+  encode_header(&header, bytes);
+  writer->failed = fwrite(bytes, sizeof(bytes), 1, writer->fp) != 1;
+
+  rng_seed(&writer->rng, seed);
+  writer->board = board_new_game(&writer->rng);
+  add_keyframe(&writer->keyframes, writer->board, writer->rng, 0);
+
+  return true;
+}
+
+bool replay_writer_flush(ReplayWriter *writer) {
+  if (writer->buf_len > 0 && !writer->failed) {
+    writer->failed = fwrite(writer->buf, writer->buf_len, 1, writer->fp) != 1 || fflush(writer->fp) != 0;
+  }
+  writer->buf_len = 0;
+
+  return !writer->failed;
+}
+
+void replay_writer_add_move(ReplayWriter *writer, MoveDir dir) {
+  writer->board = board_move(writer->board, dir, &writer->score);
+  writer->board = board_spawn_random_tile(writer->board, &writer->rng);
+
+  u32 slot = writer->move_count++ % 4;
+  writer->pending |= (u8)((dir & 3) << (slot * 2));
+  if (writer->move_count % REPLAY_KEYFRAME_INTERVAL == 0) {
+    add_keyframe(&writer->keyframes, writer->board, writer->rng, writer->score);
+  }
+  if (slot < 3) return;
+
+  writer->buf[writer->buf_len++] = writer->pending;
+  writer->pending = 0;
+  // flushed regularly so a crash loses few moves, not the game
+  if (writer->buf_len == REPLAY_WRITER_BUFFER_SIZE || writer->move_count % REPLAY_WRITER_FLUSH_MOVES == 0) {
+    replay_writer_flush(writer);
+  }
+}
+
+static void write_keyframes(ReplayWriter *writer) {
+  u32 counts[2] = {REPLAY_KEYFRAME_INTERVAL, writer->keyframes.size};
+  writer->failed = writer->failed || fwrite(counts, sizeof(counts), 1, writer->fp) != 1;
+
+  for (u32 i = 0; i < writer->keyframes.size && !writer->failed; i++) {
+    ReplayKeyframe *keyframe = &writer->keyframes.data[i];
+    u8 bytes[REPLAY_KEYFRAME_SIZE] = {0};
+    memcpy(bytes, &keyframe->board, 8);
+    memcpy(bytes + 8, &keyframe->rng.state, 8);
+    memcpy(bytes + 16, &keyframe->score, 4);
+    writer->failed = fwrite(bytes, sizeof(bytes), 1, writer->fp) != 1;
+  }
+}
+
+bool replay_writer_close(ReplayWriter *writer, u32 score) {
+  if (!writer->fp) return false;
+
+  if (writer->move_count % 4 != 0) {
+    writer->buf[writer->buf_len++] = writer->pending;
+  }
+  replay_writer_flush(writer);
+  write_keyframes(writer);
+
+  u8 counts[8];
+  memcpy(counts, &writer->move_count, 4);
+  memcpy(counts + 4, &score, 4);
+  if (!writer->failed) {
+    writer->failed = fseek(writer->fp, REPLAY_MOVE_COUNT_OFFSET, SEEK_SET) != 0 ||
+      fwrite(counts, sizeof(counts), 1, writer->fp) != 1;
+  }
+
+  bool ok = fclose(writer->fp) == 0 && !writer->failed;
+  if (!ok) {
+    printf("[ERROR]: failed to write the replay of game %llu\n", (unsigned long long)writer->seed);
+  }
+  writer->fp = NULL;
+  free(writer->keyframes.data);
+  memset(&writer->keyframes, 0, sizeof(writer->keyframes));
+
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// Reader
+//
+//
+///////////////////////////////////
+
+static bool read_header(FILE *fp, const char *path, ReplayHeader *header) {
+  u8 bytes[REPLAY_HEADER_SIZE];
+  if (fread(bytes, sizeof(bytes), 1, fp) != 1 || !replay_decode_header(bytes, header)) {
+    printf("[ERROR]: \"%s\" is not a version %d replay of the classic rules\n", path, REPLAY_VERSION);
+    return false;
+  }
+
+  return true;
+}
+
+static bool read_moves(FILE *fp, ReplayHeader *header, GameRecord *record) {
+  u8 buf[REPLAY_WRITER_BUFFER_SIZE];
+  bool unfinished = header->move_count == REPLAY_UNFINISHED;
+  u64 bytes_left = unfinished ? U64_MAX : ((u64)header->move_count + 3) / 4;
+
+  while (bytes_left > 0) {
+    size_t got = fread(buf, 1, CORE_MIN(sizeof(buf), bytes_left), fp);
+    if (got == 0) break;
+    bytes_left -= got;
+
+    for (size_t i = 0; i < got; i++) {
+      for (u32 slot = 0; slot < 4; slot++) {
+        record_add_move(record, (buf[i] >> (slot * 2)) & 3);
+      }
+    }
+  }
+
+  if (unfinished) return true;
+
+  // the padding of the last byte decoded as moves
+  if (record->move_count < header->move_count) return false;
+  record->move_count = header->move_count;
+  return true;
+}
+
+static bool read_keyframes(FILE *fp, Replay *replay) {
+  u32 counts[2];
+  if (fread(counts, sizeof(counts), 1, fp) != 1) return false;
+
+  u32 interval = counts[0];
+  u32 count = counts[1];
+  if (interval == 0 || count != replay->record.move_count / interval + 1) return false;
+
+  replay->keyframe_interval = interval;
+  for (u32 i = 0; i < count; i++) {
+    u8 bytes[REPLAY_KEYFRAME_SIZE];
+    if (fread(bytes, sizeof(bytes), 1, fp) != 1) return false;
+
+    ReplayKeyframe keyframe;
+    replay_decode_keyframe(bytes, &keyframe);
+    add_keyframe(&replay->keyframes, keyframe.board, keyframe.rng, keyframe.score);
+  }
+
+  return true;
+}
+
+// Replays the whole game once, for replays that were never closed.
+static bool build_keyframes(Replay *replay) {
+  replay->keyframes.size = 0;
+  replay->keyframe_interval = REPLAY_KEYFRAME_INTERVAL;
+
+  Rng rng;
+  rng_seed(&rng, replay->header.seed);
+  Board b = board_new_game(&rng);
+  u32 score = 0;
+  add_keyframe(&replay->keyframes, b, rng, score);
+
+  for (u32 i = 0; i < replay->record.move_count; i++) {
+    Board moved = board_move(b, record_get_move(&replay->record, i), &score);
+    if (moved == b) {
+      // only legal moves are recorded, anything after this is damage
+      replay->record.move_count = i;
+      break;
+    }
+    b = board_spawn_random_tile(moved, &rng);
+
+    if ((i + 1) % REPLAY_KEYFRAME_INTERVAL == 0) {
+      add_keyframe(&replay->keyframes, b, rng, score);
+    }
+  }
+
+  replay->record.score = score;
+  return true;
+}
+
+static bool read_replay(Replay *replay, FILE *fp, const char *path) {
+  // rebuilding keyframes and seeking replay the moves, callers may not have
+  // set the tables up yet (main() opens replays before game_init())
+  board_init_tables();
+
+  if (!read_header(fp, path, &replay->header)) {
+    return false;
+  }
+
+  record_init(&replay->record, replay->header.seed);
+  if (!read_moves(fp, &replay->header, &replay->record)) {
+    printf("[ERROR]: replay \"%s\" is truncated\n", path);
+    replay_close(replay);
+    return false;
+  }
+
+  bool unfinished = replay->header.move_count == REPLAY_UNFINISHED;
+  replay->record.score = replay->header.score;
+  if (unfinished || !read_keyframes(fp, replay)) {
+    if (!unfinished) {
+      printf("[WARN] replay \"%s\" has no valid keyframes, rebuilding them\n", path);
+    }
+    build_keyframes(replay);
+  }
+
+  return true;
+}
+
+bool replay_open(Replay *replay, const char *path) {
+  memset(replay, 0, sizeof(*replay));
+
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    printf("[ERROR]: could not open replay \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  bool ok = read_replay(replay, fp, path);
+  fclose(fp);
+
+  return ok;
+}
+
+bool replay_open_memory(Replay *replay, const u8 *data, u64 size, const char *name) {
+  memset(replay, 0, sizeof(*replay));
+
+  FILE *fp = fmemopen((void *)data, size, "rb");
+  if (!fp) {
+    printf("[ERROR]: could not open replay \"%s\": %s\n", name, strerror(errno));
+    return false;
+  }
+
+  bool ok = read_replay(replay, fp, name);
+  fclose(fp);
+
+  return ok;
+}
+
+void replay_close(Replay *replay) {
+  record_free(&replay->record);
+  free(replay->keyframes.data);
+  memset(replay, 0, sizeof(*replay));
+}
+
+void replay_seek(const Replay *replay, u32 move, Board *board, Rng *rng, u32 *score) {
+  move = CORE_MIN(move, replay->record.move_count);
+
+  const ReplayKeyframe *keyframe = &replay->keyframes.data[move / replay->keyframe_interval];
+  Board b = keyframe->board;
+  Rng r = keyframe->rng;
+  u32 s = keyframe->score;
+
+  for (u32 i = move - move % replay->keyframe_interval; i < move; i++) {
+    b = board_move(b, record_get_move(&replay->record, i), &s);
+    b = board_spawn_random_tile(b, &r);
+  }
+
+  *board = b;
+  *score = s;
+  if (rng) {
+    *rng = r;
+  }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "record.h"
+
+// Replay file of a single game, written move by move while it's played.
+//
+// Spawns come from the game's seeded Rng, so only the seed and the moves are
+// stored and a full game costs a few hundred bytes. File layout, little
+// endian:
+//
+//   header     "C2RP" u16 version u8 rules u8 board_size u64 seed
+//              u32 move_count u32 score
+//   moves      2 bits per move, 4 per byte, first move in the low bits
+//   keyframes  u32 interval u32 count, then per keyframe
+//              u64 board u64 rng_state u32 score u32 reserved
+//
+// Keyframe `i` is the game after `i * interval` moves, so seeking anywhere
+// restores the keyframe before it and replays less than `interval` moves.
+//
+// move_count, score and the keyframes are only written when the game is
+// closed. The moves are flushed every REPLAY_WRITER_FLUSH_MOVES moves, so a
+// file whose writer never got there (move_count == REPLAY_UNFINISHED) holds
+// every move up to the last flush, and its keyframes are rebuilt when it's
+// opened.
+
+#define REPLAY_MAGIC "C2RP"
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 24
+#define REPLAY_UNFINISHED U32_MAX
+#define REPLAY_WRITER_BUFFER_SIZE 4096
+// a multiple of 4, the moves of a byte
+#define REPLAY_WRITER_FLUSH_MOVES 32
+#define REPLAY_KEYFRAME_INTERVAL 256
+#define REPLAY_KEYFRAME_SIZE 24
+
+typedef enum ReplayRules {
+  // 4x4 board, 90% 2s and 10% 4s spawned with board_spawn_random_tile()
+  REPLAY_RULES_CLASSIC,
+} ReplayRules;
+
+typedef struct ReplayHeader {
+  u8 rules;
+  u8 board_size;
+  u64 seed;
+  u32 move_count;
+  u32 score;
+} ReplayHeader;
+
+typedef struct ReplayKeyframe {
+  Board board;
+  Rng rng;
+  u32 score;
+} ReplayKeyframe;
+
+typedef struct ReplayKeyframes {
+  ReplayKeyframe *data;
+  u32 size;
+  u32 capacity;
+} ReplayKeyframes;
+
+typedef struct ReplayWriter {
+  FILE *fp;
+  u64 seed;
+  u32 move_count;
+  // moves of the byte being filled
+  u8 pending;
+  u8 buf[REPLAY_WRITER_BUFFER_SIZE];
+  u32 buf_len;
+  bool failed;
+
+  // the game as replayed from the moves, to take the keyframes
+  Board board;
+  Rng rng;
+  u32 score;
+  ReplayKeyframes keyframes;
+} ReplayWriter;
+
+typedef struct Replay {
+  ReplayHeader header;
+  GameRecord record;
+  u32 keyframe_interval;
+  ReplayKeyframes keyframes;
+} Replay;
+
+// Decode the header at the start of a replay and a keyframe of its keyframe
+// section. False if the header isn't one of a replay this version can play.
+bool replay_decode_header(const u8 *data, ReplayHeader *header);
+void replay_decode_keyframe(const u8 *data, ReplayKeyframe *keyframe);
+
+bool replay_writer_open(ReplayWriter *writer, const char *path, u64 seed);
+// Buffered, a full buffer is written in one go. Errors are reported once by
+// replay_writer_close().
+void replay_writer_add_move(ReplayWriter *writer, MoveDir dir);
+// Writes the buffered moves, e.g. before the process may go away.
+bool replay_writer_flush(ReplayWriter *writer);
+// Writes the last moves and the keyframes, and fills in the header.
+bool replay_writer_close(ReplayWriter *writer, u32 score);
+
+// Loads the moves and keyframes of a replay. An unfinished replay loads the
+// moves it has and the score they make.
+bool replay_open(Replay *replay, const char *path);
+// replay_open() of the `size` bytes at `data`, e.g. a game of an archive
+// (archive.h). `name` is the replay's name in messages.
+bool replay_open_memory(Replay *replay, const u8 *data, u64 size, const char *name);
+void replay_close(Replay *replay);
+// The game after its first `move` moves (at most the replay's move count).
+// `rng` may be NULL.
+void replay_seek(const Replay *replay, u32 move, Board *board, Rng *rng, u32 *score);
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "replay.h"
+
+// Opens a replay whose writer went away without closing it, from a process
+// that never set the move tables up, like main() does for --replay.
+
+#define TEST_SEED 2048
+#define TEST_MOVES 100
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("[FAIL] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    failures++; \
+  } \
+} while (0)
+
+// Plays the first legal move of every position, from `board` and `rng`.
+// Returns the number of moves played.
+static u32 play(Board *board, Rng *rng, u32 *score, u32 moves, ReplayWriter *writer) {
+  for (u32 i = 0; i < moves; i++) {
+    Board moved = *board;
+    MoveDir dir = 0;
+    for (; dir < 4; dir++) {
+      moved = board_move(*board, dir, score);
+      if (moved != *board) break;
+    }
+    if (dir == 4) return i;
+
+    if (writer) replay_writer_add_move(writer, dir);
+    *board = board_spawn_random_tile(moved, rng);
+  }
+
+  return moves;
+}
+
+// Writes TEST_MOVES moves in a child process that exits without closing.
+static bool write_unfinished(const char *path) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+
+  if (pid == 0) {
+    board_init_tables();
+
+    ReplayWriter writer;
+    if (!replay_writer_open(&writer, path, TEST_SEED)) _exit(1);
+
+    Rng rng;
+    rng_seed(&rng, TEST_SEED);
+    Board b = board_new_game(&rng);
+    u32 score = 0;
+    if (play(&b, &rng, &score, TEST_MOVES, &writer) != TEST_MOVES) _exit(1);
+
+    _exit(0);
+  }
+
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void check_replay(const Replay *replay) {
+  u32 flushed = TEST_MOVES / REPLAY_WRITER_FLUSH_MOVES * REPLAY_WRITER_FLUSH_MOVES;
+  CHECK(replay->header.move_count == REPLAY_UNFINISHED);
+  CHECK(replay->record.move_count == flushed);
+
+  Rng rng;
+  rng_seed(&rng, TEST_SEED);
+  Board expected = board_new_game(&rng);
+  u32 expected_score = 0;
+  CHECK(play(&expected, &rng, &expected_score, flushed, NULL) == flushed);
+
+  Board b;
+  Rng replay_rng;
+  u32 score;
+  replay_seek(replay, replay->record.move_count, &b, &replay_rng, &score);
+  CHECK(b == expected);
+  CHECK(replay_rng.state == rng.state);
+  CHECK(score == expected_score);
+}
+
+int main(void) {
+  char path[] = "/tmp/c2048-replay-test-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  close(fd);
+
+  if (!write_unfinished(path)) {
+    printf("[FAIL] could not write the unfinished replay \"%s\"\n", path);
+    unlink(path);
+    return 1;
+  }
+
+  Replay replay;
+  CHECK(replay_open(&replay, path));
+  check_replay(&replay);
+  replay_close(&replay);
+
+  FILE *fp = fopen(path, "rb");
+  u8 data[1024];
+  u64 size = fp ? fread(data, 1, sizeof(data), fp) : 0;
+  if (fp) fclose(fp);
+  CHECK(size > REPLAY_HEADER_SIZE);
+
+  CHECK(replay_open_memory(&replay, data, size, path));
+  check_replay(&replay);
+  replay_close(&replay);
+
+  unlink(path);
+
+  if (failures) {
+    printf("[FAIL] %d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("[OK] unfinished replays open\n");
+
+  return 0;
+}
@@ -0,0 +1,27 @@
+#include "rng.h"
+
+void rng_seed(Rng *rng, u64 seed) {
+  rng->state = seed;
+}
+
+void rng_seed_independent(Rng *rng, u64 seed) {
+  // one splitmix step, the mixed output is far from any state the game's
+  // stream goes through
+  rng->state = seed;
+  rng->state = rng_next(rng);
+}
+
+u64 rng_next(Rng *rng) {
+  u64 z = (rng->state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+// returns a number in [0, bound). uses the upper bits through a multiply
+// instead of a modulo so small bounds don't pick up the low bit bias
+u32 rng_bounded(Rng *rng, u32 bound) {
+  CORE_DEBUG_ASSERT(bound > 0, "rng_bounded() requires a non zero bound");
+
+  return (u32)(((rng_next(rng) >> 32) * bound) >> 32);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "core.h"
+
+// splitmix64. The whole generator state is a single u64 so it can be stored
+// next to a board wherever a game needs to be resumed or re-simulated.
+typedef struct Rng {
+  u64 state;
+} Rng;
+
+void rng_seed(Rng *rng, u64 seed);
+// A stream that doesn't follow the one of rng_seed(seed), for whatever
+// draws its own numbers next to a game seeded with the same seed (e.g. a
+// player's random moves and the game's spawns).
+void rng_seed_independent(Rng *rng, u64 seed);
+u64 rng_next(Rng *rng);
+u32 rng_bounded(Rng *rng, u32 bound);
@@ -0,0 +1,283 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scores.h"
+
+static void encode_entry(const ScoreEntry *entry, u8 *out) {
+  memset(out, 0, SCORES_ENTRY_SIZE);
+  memcpy(out, &entry->seed, 8);
+  memcpy(out + 8, &entry->finished_at, 8);
+  memcpy(out + 16, &entry->score, 4);
+  memcpy(out + 20, &entry->moves, 4);
+  memcpy(out + 24, &entry->duration_ms, 4);
+  out[28] = entry->max_exponent;
+
+  u32 checksum = core_fnv_hash32(out, SCORES_ENTRY_SIZE - 4, CORE_FNV_HASH32_INIT);
+  memcpy(out + 32, &checksum, 4);
+}
+
+static bool decode_entry(const u8 *data, ScoreEntry *entry) {
+  u32 checksum;
+  memcpy(&checksum, data + 32, 4);
+  if (checksum != core_fnv_hash32(data, SCORES_ENTRY_SIZE - 4, CORE_FNV_HASH32_INIT)) return false;
+
+  memcpy(&entry->seed, data, 8);
+  memcpy(&entry->finished_at, data + 8, 8);
+  memcpy(&entry->score, data + 16, 4);
+  memcpy(&entry->moves, data + 20, 4);
+  memcpy(&entry->duration_ms, data + 24, 4);
+  entry->max_exponent = data[28];
+
+  return entry->max_exponent < 16;
+}
+
+static void push_entry(ScoreStore *store, const ScoreEntry *entry) {
+  if (store->count >= store->cap) {
+    store->cap = store->cap ? store->cap * 2 : 1024;
+    ScoreEntry *temp = realloc(store->entries, store->cap * sizeof(ScoreEntry));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for scores\n");
+      exit(1);
+    }
+    store->entries = temp;
+
+    // the index always has room for every entry
+    u32 *index = realloc(store->by_score, store->cap * sizeof(u32));
+    if (!index) {
+      printf("[FATAL] Failed to reallocate memory for the score index\n");
+      exit(1);
+    }
+    store->by_score = index;
+  }
+
+  store->entries[store->count++] = *entry;
+  store->score_sum += entry->score;
+  store->move_sum += entry->moves;
+  store->duration_ms_sum += entry->duration_ms;
+  store->max_exponent_counts[entry->max_exponent]++;
+}
+
+bool scores_open(ScoreStore *store, const char *path) {
+  memset(store, 0, sizeof(*store));
+  store->path = path;
+
+  store->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (store->fd < 0) {
+    printf("[ERROR]: could not open the score store \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(store->fd, &st) != 0) {
+    printf("[ERROR]: could not open the score store \"%s\": %s\n", path, strerror(errno));
+    close(store->fd);
+    return false;
+  }
+
+  u8 header[SCORES_HEADER_SIZE];
+  u32 version = SCORES_VERSION;
+  if (st.st_size == 0) {
+    memcpy(header, SCORES_MAGIC, 4);
+    memcpy(header + 4, &version, 4);
+    if (write(store->fd, header, sizeof(header)) != sizeof(header)) {
+      printf("[ERROR]: could not create the score store \"%s\": %s\n", path, strerror(errno));
+      close(store->fd);
+      return false;
+    }
+    return true;
+  }
+
+  bool valid = pread(store->fd, header, sizeof(header), 0) == sizeof(header);
+  if (valid) {
+    memcpy(&version, header + 4, 4);
+    valid = memcmp(header, SCORES_MAGIC, 4) == 0 && version == SCORES_VERSION;
+  }
+  if (!valid) {
+    printf("[ERROR]: \"%s\" is not a version %d score store\n", path, SCORES_VERSION);
+    close(store->fd);
+    return false;
+  }
+
+  // read in big blocks, hundreds of thousands of games are a few MB
+  u64 count = ((u64)st.st_size - SCORES_HEADER_SIZE) / SCORES_ENTRY_SIZE;
+  u8 buf[SCORES_ENTRY_SIZE * 1024];
+  u64 skipped = 0;
+  for (u64 first = 0; first < count; first += 1024) {
+    u64 n = CORE_MIN(count - first, 1024);
+    off_t offset = (off_t)(SCORES_HEADER_SIZE + first * SCORES_ENTRY_SIZE);
+    if (pread(store->fd, buf, n * SCORES_ENTRY_SIZE, offset) != (ssize_t)(n * SCORES_ENTRY_SIZE)) break;
+
+    for (u64 i = 0; i < n; i++) {
+      ScoreEntry entry;
+      if (decode_entry(buf + i * SCORES_ENTRY_SIZE, &entry)) {
+        push_entry(store, &entry);
+      } else {
+        skipped++;
+      }
+    }
+  }
+  if (skipped) {
+    printf("[WARN] skipped %llu damaged games of \"%s\"\n", (unsigned long long)skipped, path);
+  }
+
+  // a torn last entry would misalign the ones appended after it
+  store->file_entries = count;
+  off_t end = (off_t)(SCORES_HEADER_SIZE + count * SCORES_ENTRY_SIZE);
+  if (st.st_size != end && ftruncate(store->fd, end) != 0) {
+    printf("[WARN] could not cut the torn end of \"%s\"\n", path);
+  }
+
+  return true;
+}
+
+void scores_close(ScoreStore *store) {
+  if (store->fd >= 0) {
+    close(store->fd);
+  }
+  free(store->entries);
+  free(store->by_score);
+  memset(store, 0, sizeof(*store));
+  store->fd = -1;
+}
+
+///////////////////////////////////
+//
+//
+// Index
+//
+//
+///////////////////////////////////
+
+// the score in the high bits and the complemented entry in the low bits, so
+// larger keys rank first and earlier games first among ties
+static u64 index_key(const ScoreStore *store, u32 idx) {
+  return ((u64)store->entries[idx].score << 32) | (u32)~idx;
+}
+
+// Radix sort of (score, entry) pairs a byte of the score at a time, highest
+// bucket first. Each pass is stable, so ties stay in the order the games were
+// played.
+static void build_index(ScoreStore *store) {
+  u64 *pairs = malloc((u64)CORE_MAX(store->count, 1) * 2 * sizeof(u64));
+  if (!pairs) {
+    printf("[FATAL] Failed to allocate memory for the score index\n");
+    exit(1);
+  }
+
+  u64 *src = pairs;
+  u64 *dst = pairs + store->count;
+  for (u32 i = 0; i < store->count; i++) {
+    src[i] = ((u64)store->entries[i].score << 32) | i;
+  }
+
+  for (u32 shift = 32; shift < 64; shift += 8) {
+    u32 offsets[256] = {0};
+    for (u32 i = 0; i < store->count; i++) {
+      offsets[(src[i] >> shift) & 0xff]++;
+    }
+
+    u32 pos = 0;
+    for (i32 bucket = 255; bucket >= 0; bucket--) {
+      u32 count = offsets[bucket];
+      offsets[bucket] = pos;
+      pos += count;
+    }
+
+    for (u32 i = 0; i < store->count; i++) {
+      dst[offsets[(src[i] >> shift) & 0xff]++] = src[i];
+    }
+
+    u64 *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  for (u32 i = 0; i < store->count; i++) {
+    store->by_score[i] = (u32)src[i];
+  }
+
+  free(pairs);
+  store->indexed = true;
+}
+
+bool scores_add(ScoreStore *store, const ScoreEntry *entry) {
+  u8 bytes[SCORES_ENTRY_SIZE];
+  encode_entry(entry, bytes);
+  off_t offset = (off_t)(SCORES_HEADER_SIZE + store->file_entries * SCORES_ENTRY_SIZE);
+  bool ok = pwrite(store->fd, bytes, sizeof(bytes), offset) == sizeof(bytes);
+  if (ok) {
+    store->file_entries++;
+  } else {
+    printf("[ERROR]: could not save the game to \"%s\": %s\n", store->path, strerror(errno));
+  }
+
+  push_entry(store, entry);
+  if (!store->indexed) return ok;
+
+  // after every game with at least its score
+  u32 idx = store->count - 1;
+  u64 key = index_key(store, idx);
+  u32 lo = 0;
+  u32 hi = idx;
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+    if (index_key(store, store->by_score[mid]) > key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  memmove(store->by_score + lo + 1, store->by_score + lo, (idx - lo) * sizeof(u32));
+  store->by_score[lo] = idx;
+
+  return ok;
+}
+
+///////////////////////////////////
+//
+//
+// Queries
+//
+//
+///////////////////////////////////
+
+u32 scores_top(ScoreStore *store, u32 k, ScoreEntry *out) {
+  if (!store->indexed) {
+    build_index(store);
+  }
+
+  k = CORE_MIN(k, store->count);
+  for (u32 i = 0; i < k; i++) {
+    out[i] = store->entries[store->by_score[i]];
+  }
+
+  return k;
+}
+
+u32 scores_percentile(ScoreStore *store, f64 p) {
+  if (store->count == 0) return 0;
+  if (!store->indexed) {
+    build_index(store);
+  }
+
+  // nearest rank, counted from the lowest score
+  u32 ascending = (u32)CORE_CLAMP(ceil(p * (f64)store->count), 1.0, (f64)store->count) - 1;
+  return store->entries[store->by_score[store->count - 1 - ascending]].score;
+}
+
+f64 scores_reach_rate(const ScoreStore *store, u8 exponent) {
+  if (store->count == 0) return 0;
+
+  u32 reached = 0;
+  for (u32 e = exponent; e < 16; e++) {
+    reached += store->max_exponent_counts[e];
+  }
+
+  return (f64)reached / (f64)store->count;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "board.h"
+
+// Local store of finished games, for the leaderboard and the stats.
+//
+// Games are appended to a file of fixed size entries, each with a checksum so
+// an entry torn by a crash is skipped. File layout, little endian:
+//
+//   header  "C2SC" u32 version
+//   entry   u64 seed u64 finished_at (unix seconds) u32 score u32 moves
+//           u32 duration_ms u8 max_exponent u8 pad[3] u32 fnv32 of the entry
+//           before it
+//
+// Opening reads the entries only. The index, every game sorted by score, is
+// built by the first query needing it and then kept sorted as games are
+// added, so top-K is a slice of it and a percentile a single lookup. The
+// aggregates are kept up to date on every add.
+
+#define SCORES_MAGIC "C2SC"
+#define SCORES_VERSION 1
+#define SCORES_HEADER_SIZE 8
+#define SCORES_ENTRY_SIZE 36
+
+typedef struct ScoreEntry {
+  u64 seed;
+  u64 finished_at;
+  u32 score;
+  u32 moves;
+  u32 duration_ms;
+  u8 max_exponent;
+} ScoreEntry;
+
+typedef struct ScoreStore {
+  const char *path;
+  int fd;
+  // damaged ones included
+  u64 file_entries;
+
+  ScoreEntry *entries;
+  u32 count;
+  u32 cap;
+
+  // entries by descending score, ties by the earliest game, valid only when
+  // indexed is set
+  u32 *by_score;
+  bool indexed;
+
+  u64 score_sum;
+  u64 move_sum;
+  u64 duration_ms_sum;
+  // games whose largest tile had this exponent
+  u32 max_exponent_counts[16];
+} ScoreStore;
+
+// Creates the store if missing.
+bool scores_open(ScoreStore *store, const char *path);
+void scores_close(ScoreStore *store);
+bool scores_add(ScoreStore *store, const ScoreEntry *entry);
+
+// Fills `out` with up to `k` best games and returns how many.
+u32 scores_top(ScoreStore *store, u32 k, ScoreEntry *out);
+// The score a share `p` (0 to 1) of the games are at or below, 0 without games.
+u32 scores_percentile(ScoreStore *store, f64 p);
+// Share of the games whose largest tile has at least this exponent.
+f64 scores_reach_rate(const ScoreStore *store, u8 exponent);
@@ -0,0 +1,356 @@
+#include <math.h>
+#include <string.h>
+
+#include "search.h"
+
+#define SCORE_LOST_PENALTY 200000.0f
+#define SCORE_MONOTONICITY_POWER 4.0f
+#define SCORE_MONOTONICITY_WEIGHT 47.0f
+#define SCORE_SUM_POWER 3.5f
+#define SCORE_SUM_WEIGHT 11.0f
+#define SCORE_MERGES_WEIGHT 700.0f
+#define SCORE_EMPTY_WEIGHT 270.0f
+
+static bool tables_initialized = false;
+static f32 row_heuristic_table[65536];
+
+// transposition table kind of expected values, reach probabilities use their
+// target exponent (1 to 15)
+#define SEARCH_TT_KIND_EXPECTED_VALUE 0
+
+typedef struct SearchState {
+  Search *search;
+  u32 depth_limit;
+  u32 depth;
+} SearchState;
+
+///////////////////////////////////
+//
+//
+// Evaluation
+//
+//
+///////////////////////////////////
+
+static f32 row_heuristic(u16 row) {
+  u8 line[4];
+  for (u8 i = 0; i < 4; i++) {
+    line[i] = (row >> (i * 4)) & 0xF;
+  }
+
+  f32 sum = 0;
+  u32 empty = 0;
+  u32 merges = 0;
+  u8 prev = 0;
+  u32 counter = 0;
+  for (u8 i = 0; i < 4; i++) {
+    u8 rank = line[i];
+    sum += powf(rank, SCORE_SUM_POWER);
+    if (rank == 0) {
+      empty++;
+    } else {
+      if (prev == rank) {
+        counter++;
+      } else if (counter > 0) {
+        merges += 1 + counter;
+        counter = 0;
+      }
+      prev = rank;
+    }
+  }
+  if (counter > 0) {
+    merges += 1 + counter;
+  }
+
+  // penalize rows that are neither increasing nor decreasing
+  f32 monotonicity_left = 0;
+  f32 monotonicity_right = 0;
+  for (u8 i = 1; i < 4; i++) {
+    f32 a = powf(line[i - 1], SCORE_MONOTONICITY_POWER);
+    f32 b = powf(line[i], SCORE_MONOTONICITY_POWER);
+    if (line[i - 1] > line[i]) {
+      monotonicity_left += a - b;
+    } else {
+      monotonicity_right += b - a;
+    }
+  }
+
+  return SCORE_LOST_PENALTY + SCORE_EMPTY_WEIGHT * (f32)empty + SCORE_MERGES_WEIGHT * (f32)merges -
+    SCORE_MONOTONICITY_WEIGHT * CORE_MIN(monotonicity_left, monotonicity_right) - SCORE_SUM_WEIGHT * sum;
+}
+
+void search_init_tables(void) {
+  if (tables_initialized) return;
+
+  for (u32 row = 0; row < 65536; row++) {
+    row_heuristic_table[row] = row_heuristic((u16)row);
+  }
+
+  tables_initialized = true;
+}
+
+static f32 evaluate_rows(Board b) {
+  return row_heuristic_table[b & 0xFFFF] + row_heuristic_table[(b >> 16) & 0xFFFF] +
+    row_heuristic_table[(b >> 32) & 0xFFFF] + row_heuristic_table[(b >> 48) & 0xFFFF];
+}
+
+f32 search_evaluate(Board b) {
+  CORE_DEBUG_ASSERT(tables_initialized, "search_init_tables() must be called before evaluating");
+  return evaluate_rows(b) + evaluate_rows(board_transpose(b));
+}
+
+///////////////////////////////////
+//
+//
+// Search
+//
+//
+///////////////////////////////////
+
+void search_init(Search *search, TransTable *tt, u32 depth) {
+  memset(search, 0, sizeof(*search));
+  search->tt = tt;
+  search->depth = depth;
+  search->prob_cutoff = SEARCH_DEFAULT_PROB_CUTOFF;
+  search->objective = SEARCH_OBJECTIVE_EXPECTED_VALUE;
+}
+
+void search_set_target(Search *search, u8 target_exponent) {
+  CORE_DEBUG_ASSERT(target_exponent >= 1 && target_exponent <= BOARD_MAX_EXPONENT, "invalid target exponent %u",
+      target_exponent);
+  search->objective = SEARCH_OBJECTIVE_REACH_TILE;
+  search->target_exponent = target_exponent;
+}
+
+static u32 count_distinct_tiles(Board b) {
+  u16 seen = 0;
+  for (u8 i = 0; i < 16; i++) {
+    seen |= 1 << ((b >> (i * 4)) & 0xF);
+  }
+  // the empty tile doesn't count
+  return __builtin_popcount(seen & ~1u);
+}
+
+u32 search_depth_for(Search *search, Board b) {
+  if (search->depth > 0) return search->depth;
+  return CORE_MAX(3, (i32)count_distinct_tiles(b) - 2);
+}
+
+static f32 chance_node(SearchState *state, Board b, f32 prob);
+
+static f32 max_node(SearchState *state, Board b, f32 prob) {
+  f32 best = 0;
+  state->depth++;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    Board moved = board_move(b, dir, NULL);
+    if (moved == b) continue;
+    best = CORE_MAX(best, chance_node(state, moved, prob));
+  }
+  state->depth--;
+
+  return best;
+}
+
+static f32 chance_node(SearchState *state, Board b, f32 prob) {
+  Search *search = state->search;
+  search->stats.nodes++;
+
+  if (prob < search->prob_cutoff || state->depth >= state->depth_limit) {
+    return search_evaluate(b);
+  }
+
+  // keyed on the depth left rather than the depth reached, so values stay
+  // meaningful to searches started from other positions
+  u8 remaining = (u8)(state->depth_limit - state->depth);
+  f32 value;
+  if (search->tt) {
+    search->stats.tt_probes++;
+    if (tt_probe(search->tt, b, SEARCH_TT_KIND_EXPECTED_VALUE, remaining, &value)) {
+      search->stats.tt_hits++;
+      return value;
+    }
+  }
+
+  u32 empty = board_count_empty(b);
+  prob /= (f32)empty;
+
+  f32 sum = 0;
+  for (u8 i = 0; i < 16; i++) {
+    if ((b >> (i * 4)) & 0xF) continue;
+
+    sum += max_node(state, b | (1ULL << (i * 4)), prob * 0.9f) * 0.9f;
+    sum += max_node(state, b | (2ULL << (i * 4)), prob * 0.1f) * 0.1f;
+  }
+  value = sum / (f32)empty;
+
+  if (search->tt) {
+    tt_store(search->tt, b, SEARCH_TT_KIND_EXPECTED_VALUE, remaining, value);
+  }
+
+  return value;
+}
+
+///////////////////////////////////
+//
+//
+// Reach tile
+//
+//
+///////////////////////////////////
+
+static u32 tile_sum(Board b) {
+  u32 sum = 0;
+  for (u8 i = 0; i < 16; i++) {
+    u8 exponent = (b >> (i * 4)) & 0xF;
+    if (exponent) {
+      sum += 1u << exponent;
+    }
+  }
+  return sum;
+}
+
+static f32 reach_chance_node(SearchState *state, Board b);
+
+static f32 reach_max_node(SearchState *state, Board b) {
+  u8 target = state->search->target_exponent;
+  // a spawned 4 is enough when the target is 4
+  if (board_max_exponent(b) >= target) return 1.0f;
+
+  f32 best = 0;
+  state->depth++;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT && best < 1.0f; dir++) {
+    Board moved = board_move(b, dir, NULL);
+    if (moved == b) continue;
+
+    f32 value = board_max_exponent(moved) >= target ? 1.0f : reach_chance_node(state, moved);
+    best = CORE_MAX(best, value);
+  }
+  state->depth--;
+
+  return best;
+}
+
+// `b` is a board right after a move that didn't make the target. Unlike the
+// expected value there's no probability cutoff: each unlikely line adds
+// little, but together they're most of the probability deep in the tree and
+// cutting them reads as the target being out of reach.
+static f32 reach_chance_node(SearchState *state, Board b) {
+  Search *search = state->search;
+  search->stats.nodes++;
+
+  if (state->depth >= state->depth_limit) return 0;
+
+  // merging never changes the tile sum and every spawn adds at most 4, so a
+  // line that can't sum up to the target before the horizon never makes it
+  u32 remaining = state->depth_limit - state->depth;
+  if (tile_sum(b) + 4 * remaining < (1u << search->target_exponent)) return 0;
+
+  f32 value;
+  if (search->tt) {
+    search->stats.tt_probes++;
+    if (tt_probe(search->tt, b, search->target_exponent, (u8)remaining, &value)) {
+      search->stats.tt_hits++;
+      return value;
+    }
+  }
+
+  u32 empty = board_count_empty(b);
+
+  f32 sum = 0;
+  for (u8 i = 0; i < 16; i++) {
+    if ((b >> (i * 4)) & 0xF) continue;
+
+    sum += reach_max_node(state, b | (1ULL << (i * 4))) * 0.9f;
+    sum += reach_max_node(state, b | (2ULL << (i * 4))) * 0.1f;
+  }
+  value = sum / (f32)empty;
+
+  if (search->tt) {
+    tt_store(search->tt, b, search->target_exponent, (u8)remaining, value);
+  }
+
+  return value;
+}
+
+// Returns false if no move has a chance to reach the target in the horizon.
+static bool reach_best_move(Search *search, Board b, f32 *values, MoveDir *best) {
+  SearchState state = {
+    .search = search,
+    .depth_limit = search_depth_for(search, b),
+  };
+
+  f32 best_value = 0;
+  bool best_immediate = false;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    Board moved = board_move(b, dir, NULL);
+    f32 value = -INFINITY;
+    if (moved != b) {
+      bool immediate = board_max_exponent(moved) >= search->target_exponent;
+      value = immediate ? 1.0f : reach_chance_node(&state, moved);
+      // a sure line is no better than making the tile right now
+      if (value > best_value || (immediate && !best_immediate && value >= best_value)) {
+        best_value = value;
+        best_immediate = immediate;
+        *best = dir;
+      }
+    }
+
+    values[dir] = value;
+  }
+
+  return best_value > 0;
+}
+
+///////////////////////////////////
+//
+//
+// Best move
+//
+//
+///////////////////////////////////
+
+static MoveDir expected_value_best_move(Search *search, Board b, f32 *values) {
+  SearchState state = {
+    .search = search,
+    .depth_limit = search_depth_for(search, b),
+  };
+
+  MoveDir best = MOVE_DIR_LEFT;
+  f32 best_value = -INFINITY;
+  for (u8 dir = 0; dir < MOVE_DIR_COUNT; dir++) {
+    Board moved = board_move(b, dir, NULL);
+    f32 value = -INFINITY;
+    if (moved != b) {
+      // a lost position evaluates to 0, any legal move must beat it
+      value = chance_node(&state, moved, 1.0f) + 1e-6f;
+      if (value > best_value) {
+        best_value = value;
+        best = dir;
+      }
+    }
+
+    if (values) {
+      values[dir] = value;
+    }
+  }
+
+  return best;
+}
+
+MoveDir search_best_move(Search *search, Board b, f32 *values) {
+  if (search->objective == SEARCH_OBJECTIVE_REACH_TILE) {
+    f32 probabilities[MOVE_DIR_COUNT];
+    MoveDir best = MOVE_DIR_LEFT;
+    bool reachable = reach_best_move(search, b, probabilities, &best);
+    if (!reachable) {
+      best = expected_value_best_move(search, b, NULL);
+    }
+
+    if (values) {
+      memcpy(values, probabilities, sizeof(probabilities));
+    }
+    return best;
+  }
+
+  return expected_value_best_move(search, b, values);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "board.h"
+#include "tt.h"
+
+// Depth limited expectimax search.
+//
+// Max nodes try every legal move, chance nodes average over every empty tile
+// receiving a 2 (90%) or a 4 (10%). For the expected value, branches whose
+// probability of being reached falls under `prob_cutoff` are cut. Chance nodes are cached in an
+// optional transposition table which may be shared by any number of searches
+// running in parallel.
+//
+// Two objectives are supported:
+//   - expected value: the leaves are scored with a heuristic evaluation
+//   - reach tile: the value of a node is the probability of making a tile of
+//     `target_exponent` within the remaining depth. Lines that can't add up
+//     enough tiles in time are cut immediately, so this stays cheap until the
+//     target is close. No branch is cut by probability, so the probability
+//     is exact within the horizon. When no move can reach it within the
+//     horizon the move is chosen by expected value.
+
+// stored as the tag of persistent transposition tables, bump whenever the
+// evaluation or the meaning of the cached values changes
+#define SEARCH_EVAL_VERSION 2
+#define SEARCH_DEFAULT_PROB_CUTOFF 0.0001f
+
+typedef enum SearchObjective {
+  SEARCH_OBJECTIVE_EXPECTED_VALUE,
+  SEARCH_OBJECTIVE_REACH_TILE,
+} SearchObjective;
+
+typedef struct SearchStats {
+  u64 nodes;
+  u64 tt_probes;
+  u64 tt_hits;
+} SearchStats;
+
+typedef struct Search {
+  TransTable *tt;
+  // number of chance nodes along a line, 0 picks one from the number of
+  // distinct tiles on the board
+  u32 depth;
+  // expected value only
+  f32 prob_cutoff;
+  SearchObjective objective;
+  u8 target_exponent;
+  SearchStats stats;
+} Search;
+
+// Must be called once, after board_init_tables(), before any other search_*
+// function.
+void search_init_tables(void);
+
+// `tt` may be NULL. Searches for the expected value by default.
+void search_init(Search *search, TransTable *tt, u32 depth);
+// Switches to the reach tile objective. Values are cached per target, so one
+// table can serve searches for different targets.
+void search_set_target(Search *search, u8 target_exponent);
+f32 search_evaluate(Board b);
+u32 search_depth_for(Search *search, Board b);
+
+// Returns the best move for the objective. `values` may be NULL, otherwise it
+// receives the value of every move (the reach probability for the reach tile
+// objective), -INFINITY for illegal ones. `b` must have at least one legal
+// move.
+MoveDir search_best_move(Search *search, Board b, f32 *values);
@@ -0,0 +1,320 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "player.h"
+#include "record.h"
+#include "timer.h"
+
+// Scans seeds for games where a built-in policy meets some conditions, for
+// regression fixtures and puzzles: reaching a tile within a number of moves,
+// losing before a tile, or both. Every game is determined by its seed, so a
+// matching seed replays the same game anywhere.
+//
+// Games are cut short as soon as they can no longer match, and matches are
+// printed as they're found, roughly in seed order with several threads.
+
+// seeds claimed by a thread at a time
+#define SEEDS_CHUNK 256
+
+typedef struct SeedSearch {
+  PlayerKind player_kind;
+  PolicyModel *policy;
+  u64 first_seed;
+  // 0 to scan until enough matches are found
+  u64 seed_count;
+  u64 next_chunk;
+  bool stop;
+
+  // conditions, 0 when unused
+  u32 reach_exponent;
+  u32 reach_within;
+  u32 lose_before_exponent;
+  u64 max_matches;
+
+  pthread_mutex_t lock;
+  FILE *records_fp;
+  RecordCodec records_codec;
+  u64 matches;
+  u64 scanned;
+} SeedSearch;
+
+SeedSearch search = {0};
+
+typedef struct GameOutcome {
+  bool matched;
+  u32 moves;
+  u32 score;
+  u32 max_exponent;
+  // move on which the tile of -r was reached
+  u32 reach_move;
+} GameOutcome;
+
+// Plays the game of `seed`, giving up as soon as it can't match, so only
+// matching games are played to the end. Its moves go into `record` when it's
+// non NULL.
+GameOutcome play_seed(u64 seed, GameRecord *record) {
+  Player player;
+  player_init(&player, search.player_kind, seed);
+  player.policy = search.policy;
+
+  Rng rng;
+  rng_seed(&rng, seed);
+  Board b = board_new_game(&rng);
+
+  GameOutcome outcome = {0};
+  bool reached = search.reach_exponent == 0;
+  bool doomed = false;
+
+  while (!doomed && board_legal_moves(b) != 0) {
+    MoveDir dir = player_choose_move(&player, b);
+    u32 gained = 0;
+    b = board_spawn_random_tile(board_move(b, dir, &gained), &rng);
+    outcome.score += gained;
+    outcome.moves++;
+    if (record) {
+      record_add_move(record, dir);
+    }
+
+    u32 max_exponent = board_max_exponent(b);
+    if (!reached && max_exponent >= search.reach_exponent) {
+      reached = true;
+      outcome.reach_move = outcome.moves;
+    }
+    if (!reached && search.reach_within && outcome.moves >= search.reach_within) {
+      doomed = true;
+    }
+    if (search.lose_before_exponent && max_exponent >= search.lose_before_exponent) {
+      doomed = true;
+    }
+  }
+
+  outcome.max_exponent = board_max_exponent(b);
+  outcome.matched = reached && !doomed;
+  if (record) {
+    record->score = outcome.score;
+  }
+
+  player_deinit(&player);
+  return outcome;
+}
+
+void report_match(u64 seed, const GameOutcome *outcome, const GameRecord *record) {
+  pthread_mutex_lock(&search.lock);
+
+  if (!search.stop) {
+    printf("%20llu %8u %10u %8u %10u\n", (unsigned long long)seed, outcome->moves, outcome->score,
+        1u << outcome->max_exponent, outcome->reach_move);
+    fflush(stdout);
+
+    if (search.records_fp && !record_file_write(search.records_fp, search.records_codec, record)) {
+      printf("[ERROR]: failed to write game records: %s\n", strerror(errno));
+      fclose(search.records_fp);
+      search.records_fp = NULL;
+    }
+
+    search.matches++;
+    if (search.max_matches && search.matches >= search.max_matches) {
+      __atomic_store_n(&search.stop, true, __ATOMIC_RELAXED);
+    }
+  }
+
+  pthread_mutex_unlock(&search.lock);
+}
+
+void *search_thread(void *arg) {
+  CORE_UNUSED(arg);
+
+  u64 scanned = 0;
+  bool recording = search.records_fp != NULL;
+
+  while (!__atomic_load_n(&search.stop, __ATOMIC_RELAXED)) {
+    u64 start = __atomic_fetch_add(&search.next_chunk, 1, __ATOMIC_RELAXED) * SEEDS_CHUNK;
+    if (search.seed_count && start >= search.seed_count) break;
+
+    u64 end = start + SEEDS_CHUNK;
+    if (search.seed_count) {
+      end = CORE_MIN(end, search.seed_count);
+    }
+
+    for (u64 i = start; i < end && !__atomic_load_n(&search.stop, __ATOMIC_RELAXED); i++) {
+      u64 seed = search.first_seed + i;
+      GameRecord record;
+      record_init(&record, seed);
+
+      GameOutcome outcome = play_seed(seed, recording ? &record : NULL);
+      scanned++;
+      if (outcome.matched) {
+        report_match(seed, &outcome, &record);
+      }
+
+      record_free(&record);
+    }
+  }
+
+  __atomic_fetch_add(&search.scanned, scanned, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+// Exponent of `tile`, 0 if it isn't a tile.
+u32 tile_exponent(const char *tile) {
+  u64 value = strtoull(tile, NULL, 10);
+  for (u32 e = 1; e <= BOARD_MAX_EXPONENT; e++) {
+    if (value == 1ull << e) return e;
+  }
+  return 0;
+}
+
+void print_usage(const char *prog) {
+  printf("usage: %s [-r <tile> [-w <moves>]] [-l <tile>] [options]\n"
+      "\n"
+      "Plays the game of every seed and prints those matching all conditions as\n"
+      "they're found: seed, moves, final score, max tile and the move on which the\n"
+      "tile of -r was reached.\n"
+      "\n"
+      "conditions:\n"
+      "  -r <tile>   the game reaches <tile>\n"
+      "  -w <moves>  ... within <moves> moves\n"
+      "  -l <tile>   the game is lost before reaching <tile>\n"
+      "\n"
+      "options:\n"
+      "  -s <seed>   first seed (default 1)\n"
+      "  -n <count>  number of seeds to scan, 0 for no limit (default 1000000)\n"
+      "  -c <count>  stop after <count> matches\n"
+      "  -p <name>   policy playing the games: random, greedy or policy (default greedy)\n"
+      "  -m <file>   model of the policy player\n"
+      "  -j <count>  threads (default: number of cores)\n"
+      "  -o <file>   also write the matching games to this record file\n"
+      "  -z          entropy code the moves of the written records\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+  const char *model_path = NULL;
+  const char *records_path = NULL;
+  u32 thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+  search.first_seed = 1;
+  search.seed_count = 1000000;
+  search.player_kind = PLAYER_GREEDY;
+  search.records_codec = RECORD_CODEC_PACKED;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:w:l:s:n:c:p:m:j:o:zh")) != -1) {
+    switch (opt) {
+      case 'r':
+      case 'l': {
+        u32 exponent = tile_exponent(optarg);
+        if (exponent == 0) {
+          printf("[ERROR]: \"%s\" is not a tile\n", optarg);
+          return 1;
+        }
+        *(opt == 'r' ? &search.reach_exponent : &search.lose_before_exponent) = exponent;
+        break;
+      }
+      case 'w':
+        search.reach_within = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        search.first_seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'n':
+        search.seed_count = strtoull(optarg, NULL, 10);
+        break;
+      case 'c':
+        search.max_matches = strtoull(optarg, NULL, 10);
+        break;
+      case 'p':
+        if (!player_kind_from_name(optarg, &search.player_kind)) {
+          printf("[ERROR]: unknown policy \"%s\"\n", optarg);
+          return 1;
+        }
+        break;
+      case 'm':
+        model_path = optarg;
+        break;
+      case 'j':
+        thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'o':
+        records_path = optarg;
+        break;
+      case 'z':
+        search.records_codec = RECORD_CODEC_RANS;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind != argc || (search.reach_exponent == 0 && search.lose_before_exponent == 0)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (search.reach_within && search.reach_exponent == 0) {
+    printf("[ERROR]: -w needs a tile to reach (-r)\n");
+    return 1;
+  }
+  if (search.reach_exponent && search.lose_before_exponent &&
+      search.reach_exponent >= search.lose_before_exponent) {
+    printf("[ERROR]: no game reaches %u but is lost before %u\n", 1u << search.reach_exponent,
+        1u << search.lose_before_exponent);
+    return 1;
+  }
+
+  board_init_tables();
+  start_internal_timer();
+
+  if (search.player_kind == PLAYER_POLICY) {
+    if (!model_path) {
+      printf("[ERROR]: the policy player needs a model (-m)\n");
+      return 1;
+    }
+    search.policy = malloc(sizeof(PolicyModel));
+    if (!policy_load(search.policy, model_path)) return 1;
+  }
+
+  if (records_path) {
+    search.records_fp = fopen(records_path, "wb");
+    if (!search.records_fp || !record_file_write_header(search.records_fp, search.records_codec)) {
+      printf("[ERROR]: could not create \"%s\": %s\n", records_path, strerror(errno));
+      return 1;
+    }
+  }
+
+  pthread_mutex_init(&search.lock, NULL);
+  printf("# %18s %8s %10s %8s %10s\n", "seed", "moves", "score", "max", "reach move");
+  fflush(stdout);
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
+  for (u32 i = 0; i < thread_count; i++) {
+    pthread_create(&threads[i], NULL, search_thread, NULL);
+  }
+  for (u32 i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  free(search.policy);
+
+  bool ok = true;
+  if (search.records_fp && fclose(search.records_fp) != 0) {
+    printf("[ERROR]: failed to write \"%s\"\n", records_path);
+    ok = false;
+  }
+
+  f64 elapsed = get_time();
+  fprintf(stderr, "%llu matches in %llu seeds in %.2fs (%.0f seeds/s)\n", (unsigned long long)search.matches,
+      (unsigned long long)search.scanned, elapsed, elapsed > 0 ? (f64)search.scanned / elapsed : 0);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dataset.h"
+#include "player.h"
+#include "timer.h"
+
+// Plays games with a built-in policy on a pool of threads and writes every
+// position into a columnar dataset (see dataset.h).
+
+typedef struct SelfPlay {
+  PlayerKind player_kind;
+  PolicyModel *policy;
+  u64 first_seed;
+  u32 game_count;
+  u32 next_game;
+  DatasetWriter writer;
+  pthread_mutex_t writer_lock;
+  u64 rows_written;
+} SelfPlay;
+
+SelfPlay selfplay = {0};
+
+typedef struct RowList {
+  DatasetRow *data;
+  u32 size;
+  u32 capacity;
+} RowList;
+
+void add_row(RowList *list, DatasetRow row) {
+  if (list->size >= list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 1024;
+    DatasetRow *temp = realloc(list->data, list->capacity * sizeof(DatasetRow));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for self-play rows\n");
+      exit(1);
+    }
+    list->data = temp;
+  }
+
+  list->data[list->size++] = row;
+}
+
+void play_game(u32 game_idx, RowList *rows) {
+  u64 seed = selfplay.first_seed + game_idx;
+  Player player;
+  player_init(&player, selfplay.player_kind, seed);
+  player.policy = selfplay.policy;
+
+  Rng rng;
+  rng_seed(&rng, seed);
+  Board b = board_new_game(&rng);
+  u32 score = 0;
+
+  rows->size = 0;
+
+  u8 legal;
+  while ((legal = board_legal_moves(b)) != 0) {
+    MoveDir dir = player_choose_move(&player, b);
+    u32 gained = 0;
+    Board moved = board_move(b, dir, &gained);
+
+    add_row(rows, (DatasetRow){
+      .game = game_idx,
+      .board = b,
+      .legal_moves = legal,
+      .move = (u8)dir,
+      .reward = gained,
+    });
+
+    score += gained;
+    b = board_spawn_random_tile(moved, &rng);
+  }
+
+  // the final score is only known once the game is over
+  for (u32 i = 0; i < rows->size; i++) {
+    rows->data[i].final_score = score;
+  }
+
+  player_deinit(&player);
+}
+
+void *selfplay_thread(void *arg) {
+  CORE_UNUSED(arg);
+
+  RowList rows = {0};
+
+  for (;;) {
+    u32 game_idx = __atomic_fetch_add(&selfplay.next_game, 1, __ATOMIC_RELAXED);
+    if (game_idx >= selfplay.game_count) break;
+
+    play_game(game_idx, &rows);
+
+    pthread_mutex_lock(&selfplay.writer_lock);
+    bool ok = true;
+    for (u32 i = 0; i < rows.size && ok; i++) {
+      ok = dataset_writer_append(&selfplay.writer, &rows.data[i]);
+    }
+    selfplay.rows_written += rows.size;
+    pthread_mutex_unlock(&selfplay.writer_lock);
+
+    // the dataset is lost, no point playing on
+    if (!ok) break;
+  }
+
+  free(rows.data);
+
+  return NULL;
+}
+
+///////////////////////////////////
+//
+//
+// Inspect
+//
+//
+///////////////////////////////////
+
+int inspect_dataset(const char *path) {
+  DatasetReader reader;
+  if (!dataset_reader_open(&reader, path)) return 1;
+
+  u64 rows = 0;
+  u64 raw_sizes[DATASET_COLUMN_COUNT] = {0};
+  u64 stored_sizes[DATASET_COLUMN_COUNT] = {0};
+  u64 games = 0;
+  u64 final_score_sum = 0;
+  // games span chunks, a game starts where the game column changes
+  bool have_prev_game = false;
+  u32 prev_game = 0;
+  u32 max_rows = 0;
+
+  for (u32 i = 0; i < reader.chunk_count; i++) {
+    max_rows = CORE_MAX(max_rows, reader.chunks[i].row_count);
+  }
+  u32 *game_scratch = malloc((u64)max_rows * sizeof(u32));
+  u32 *score_scratch = malloc((u64)max_rows * sizeof(u32));
+
+  for (u32 i = 0; i < reader.chunk_count; i++) {
+    DatasetChunkInfo *chunk = &reader.chunks[i];
+    rows += chunk->row_count;
+
+    for (u32 c = 0; c < DATASET_COLUMN_COUNT; c++) {
+      raw_sizes[c] += (u64)chunk->row_count * dataset_column_width(c);
+      stored_sizes[c] += chunk->sizes[c];
+    }
+
+    // only the two small columns needed for the summary are decoded
+    const u32 *games_col = dataset_reader_column(&reader, i, DATASET_COLUMN_GAME, game_scratch);
+    const u32 *scores_col = dataset_reader_column(&reader, i, DATASET_COLUMN_FINAL_SCORE, score_scratch);
+    if (!games_col || !scores_col) {
+      printf("[ERROR]: chunk %u failed to decode\n", i);
+      free(game_scratch);
+      free(score_scratch);
+      dataset_reader_close(&reader);
+      return 1;
+    }
+
+    for (u32 r = 0; r < chunk->row_count; r++) {
+      if (!have_prev_game || games_col[r] != prev_game) {
+        games++;
+        final_score_sum += scores_col[r];
+      }
+      have_prev_game = true;
+      prev_game = games_col[r];
+    }
+  }
+
+  printf("%s: %llu rows in %u chunks, %llu games, avg final score %.1f\n", path,
+      (unsigned long long)rows, reader.chunk_count, (unsigned long long)games, games ? (f64)final_score_sum / games : 0);
+  printf("%-12s %14s %14s %7s\n", "column", "raw bytes", "stored bytes", "ratio");
+  for (u32 c = 0; c < DATASET_COLUMN_COUNT; c++) {
+    printf("%-12s %14llu %14llu %6.2fx\n", dataset_column_name(c),
+        (unsigned long long)raw_sizes[c], (unsigned long long)stored_sizes[c],
+        stored_sizes[c] ? (f64)raw_sizes[c] / stored_sizes[c] : 0);
+  }
+
+  free(game_scratch);
+  free(score_scratch);
+  dataset_reader_close(&reader);
+
+  return 0;
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] -o <file>\n"
+      "       %s -i <file>\n"
+      "\n"
+      "options:\n"
+      "  -o <file>   dataset to write\n"
+      "  -i <file>   print a summary of an existing dataset\n"
+      "  -n <count>  number of games (default 1000)\n"
+      "  -s <seed>   seed of the first game, games are seeded consecutively (default 1)\n"
+      "  -p <name>   policy playing the games: random, greedy or policy (default greedy)\n"
+      "  -m <file>   model of the policy player\n"
+      "  -j <count>  worker threads (default: number of cores)\n"
+      "  -c <rows>   rows per chunk (default %d)\n", prog, prog, DATASET_DEFAULT_CHUNK_ROWS);
+}
+
+int main(int argc, char *argv[]) {
+  const char *out_path = NULL;
+  const char *inspect_path = NULL;
+  const char *model_path = NULL;
+  u32 thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+  u32 chunk_rows = DATASET_DEFAULT_CHUNK_ROWS;
+  selfplay.game_count = 1000;
+  selfplay.first_seed = 1;
+  selfplay.player_kind = PLAYER_GREEDY;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:i:n:s:p:m:j:c:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        out_path = optarg;
+        break;
+      case 'i':
+        inspect_path = optarg;
+        break;
+      case 'n':
+        selfplay.game_count = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        selfplay.first_seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'p':
+        if (!player_kind_from_name(optarg, &selfplay.player_kind)) {
+          printf("[ERROR]: unknown policy \"%s\"\n", optarg);
+          return 1;
+        }
+        break;
+      case 'm':
+        model_path = optarg;
+        break;
+      case 'j':
+        thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'c':
+        chunk_rows = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (inspect_path) {
+    return inspect_dataset(inspect_path);
+  }
+
+  if (!out_path) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  board_init_tables();
+  start_internal_timer();
+
+  if (selfplay.player_kind == PLAYER_POLICY) {
+    if (!model_path) {
+      printf("[ERROR]: the policy player needs a model (-m)\n");
+      return 1;
+    }
+    selfplay.policy = malloc(sizeof(PolicyModel));
+    if (!policy_load(selfplay.policy, model_path)) return 1;
+  }
+
+  if (!dataset_writer_open(&selfplay.writer, out_path, chunk_rows)) return 1;
+  pthread_mutex_init(&selfplay.writer_lock, NULL);
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
+  for (u32 i = 0; i < thread_count; i++) {
+    pthread_create(&threads[i], NULL, selfplay_thread, NULL);
+  }
+  for (u32 i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  free(selfplay.policy);
+
+  if (!dataset_writer_close(&selfplay.writer)) {
+    printf("[ERROR]: failed to write dataset \"%s\"\n", out_path);
+    return 1;
+  }
+
+  f64 elapsed = get_time();
+  printf("wrote %llu positions from %u %s games to %s in %.2fs\n", (unsigned long long)selfplay.rows_written,
+      selfplay.game_count, player_kind_name(selfplay.player_kind), out_path, elapsed);
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+#version 330 core
+
+in vec2 v_Coords;
+in vec2 v_TexCoords;
+flat in vec4 v_Shape;
+flat in vec4 v_Color;
+out vec4 FragColor;
+
+uniform sampler2D tex;
+
+const float smoothness = 1.0;
+
+void main() {
+  float uiWidth = v_Shape.x;
+  float uiHeight = v_Shape.y;
+  float borderRadius = v_Shape.z;
+  float alpha = v_Color.a;
+
+  if (borderRadius > 0.0) {
+    vec2 dimensions = v_Coords * vec2(uiWidth, uiHeight);
+    float xMax = uiWidth - borderRadius;
+    float yMax = uiHeight - borderRadius;
+
+    if (dimensions.x < borderRadius && dimensions.y < borderRadius) {
+      alpha *= 1.0 - smoothstep(borderRadius - smoothness, borderRadius + smoothness, length(dimensions - vec2(borderRadius)));
+    } else if (dimensions.x < borderRadius && dimensions.y > yMax) {
+      alpha *= 1.0 - smoothstep(borderRadius - smoothness, borderRadius + smoothness, length(dimensions - vec2(borderRadius, yMax)));
+    } else if (dimensions.x > xMax && dimensions.y < borderRadius) {
+      alpha *= 1.0 - smoothstep(borderRadius - smoothness, borderRadius + smoothness, length(dimensions - vec2(xMax, borderRadius)));
+    } else if (dimensions.x > xMax && dimensions.y > yMax) {
+      alpha *= 1.0 - smoothstep(borderRadius - smoothness, borderRadius + smoothness, length(dimensions - vec2(xMax, yMax)));
+    }
+  }
+
+  if (v_Shape.w > 0.5) {
+    FragColor = texture(tex, v_TexCoords) * vec4(v_Color.rgb, alpha);
+  } else {
+    FragColor = vec4(v_Color.rgb, alpha);
+  }
+}
@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec2 vertex;
+
+// per instance
+layout (location = 1) in vec4 shape; // width, height, border radius, textured
+layout (location = 2) in vec4 color;
+layout (location = 3) in vec4 tex_rect; // x, y, width, height in texture coordinates
+layout (location = 4) in mat4 model; // this takes locations 4,5,6,7
+
+out vec2 v_Coords;
+out vec2 v_TexCoords;
+flat out vec4 v_Shape;
+flat out vec4 v_Color;
+uniform mat4 projection;
+
+void main() {
+  gl_Position = projection * model * vec4(vertex * shape.xy, 0.0, 1.0);
+  v_Coords = vertex;
+  v_TexCoords = tex_rect.xy + vertex * tex_rect.zw;
+  v_Shape = shape;
+  v_Color = color;
+}
@@ -0,0 +1,255 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dataset.h"
+#include "search.h"
+#include "timer.h"
+
+// Finds the best move of a list of positions with the expectimax search.
+// Positions are read one hex board per line, or from the board column of a
+// self-play dataset, and analysed in parallel against one shared
+// transposition table. With -t the table lives in a file, so a later run (or
+// another process running at the same time) starts from the work of this one.
+
+typedef struct Position {
+  Board board;
+  MoveDir move;
+  f32 value;
+  bool game_over;
+} Position;
+
+typedef struct Solver {
+  Position *positions;
+  u32 position_count;
+  u32 position_cap;
+  u32 next_position;
+  u32 depth;
+  u8 target_exponent;
+  TransTable tt;
+  pthread_mutex_t stats_lock;
+  SearchStats stats;
+} Solver;
+
+Solver solver = {0};
+
+void add_position(Board b) {
+  if (solver.position_count >= solver.position_cap) {
+    solver.position_cap = solver.position_cap ? solver.position_cap * 2 : 1024;
+    Position *temp = realloc(solver.positions, solver.position_cap * sizeof(Position));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for positions\n");
+      exit(1);
+    }
+    solver.positions = temp;
+  }
+
+  solver.positions[solver.position_count++] = (Position){.board = b};
+}
+
+bool read_positions_text(const char *path) {
+  FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  if (!fp) {
+    printf("[ERROR]: could not open \"%s\"\n", path);
+    return false;
+  }
+
+  char line[256];
+  u32 line_number = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    line_number++;
+    char *start = line + strspn(line, " \t");
+    if (*start == '\n' || *start == '\0' || *start == '#') continue;
+
+    Board b;
+    if (!board_from_hex(start, &b)) {
+      printf("[ERROR]: %s:%u: expected a board of %d hex digits\n", path, line_number, BOARD_HEX_LEN);
+      if (fp != stdin) fclose(fp);
+      return false;
+    }
+    add_position(b);
+  }
+
+  if (fp != stdin) fclose(fp);
+
+  return true;
+}
+
+bool read_positions_dataset(const char *path) {
+  DatasetReader reader;
+  if (!dataset_reader_open(&reader, path)) return false;
+
+  for (u32 i = 0; i < reader.chunk_count; i++) {
+    u32 rows = reader.chunks[i].row_count;
+    Board *scratch = malloc(CORE_MAX(1, rows) * sizeof(Board));
+    const Board *boards = dataset_reader_column(&reader, i, DATASET_COLUMN_BOARD, scratch);
+    if (!boards) {
+      printf("[ERROR]: chunk %u of \"%s\" failed to decode\n", i, path);
+      free(scratch);
+      dataset_reader_close(&reader);
+      return false;
+    }
+
+    for (u32 r = 0; r < rows; r++) {
+      add_position(boards[r]);
+    }
+    free(scratch);
+  }
+
+  dataset_reader_close(&reader);
+
+  return true;
+}
+
+void *solver_thread(void *arg) {
+  CORE_UNUSED(arg);
+
+  Search search;
+  search_init(&search, &solver.tt, solver.depth);
+  if (solver.target_exponent) {
+    search_set_target(&search, solver.target_exponent);
+  }
+
+  for (;;) {
+    u32 idx = __atomic_fetch_add(&solver.next_position, 1, __ATOMIC_RELAXED);
+    if (idx >= solver.position_count) break;
+
+    Position *pos = &solver.positions[idx];
+    if (board_is_game_over(pos->board)) {
+      pos->game_over = true;
+      continue;
+    }
+
+    f32 values[MOVE_DIR_COUNT];
+    pos->move = search_best_move(&search, pos->board, values);
+    pos->value = values[pos->move];
+  }
+
+  pthread_mutex_lock(&solver.stats_lock);
+  solver.stats.nodes += search.stats.nodes;
+  solver.stats.tt_probes += search.stats.tt_probes;
+  solver.stats.tt_hits += search.stats.tt_hits;
+  pthread_mutex_unlock(&solver.stats_lock);
+
+  return NULL;
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] [positions...]\n"
+      "\n"
+      "Prints the best move and its value for every position, one hex board per\n"
+      "line (\"-\" or no argument reads stdin).\n"
+      "\n"
+      "options:\n"
+      "  -D <file>   analyse every board of a self-play dataset\n"
+      "  -d <depth>  search depth in chance nodes (default: from the board)\n"
+      "  -T <tile>   maximize the probability of reaching this tile, the value\n"
+      "              printed is that probability\n"
+      "  -t <file>   persistent transposition table, created if missing\n"
+      "  -m <MB>     size of a new transposition table (default %d)\n"
+      "  -j <count>  worker threads (default: number of cores)\n"
+      "  -q          only print the summary\n", prog, TT_DEFAULT_SIZE_MB);
+}
+
+int main(int argc, char *argv[]) {
+  const char *dataset_path = NULL;
+  const char *tt_path = NULL;
+  u64 tt_size_mb = TT_DEFAULT_SIZE_MB;
+  u32 thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+  bool quiet = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "D:d:T:t:m:j:qh")) != -1) {
+    switch (opt) {
+      case 'D':
+        dataset_path = optarg;
+        break;
+      case 'd':
+        solver.depth = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 'T': {
+        u32 tile = (u32)strtoul(optarg, NULL, 10);
+        if (!CORE_IS_POWER_OF_TWO(tile) || tile < 4 || tile > (1u << BOARD_MAX_EXPONENT)) {
+          printf("[ERROR]: the target must be a tile value between 4 and %u\n", 1u << BOARD_MAX_EXPONENT);
+          return 1;
+        }
+        solver.target_exponent = (u8)__builtin_ctz(tile);
+        break;
+      }
+      case 't':
+        tt_path = optarg;
+        break;
+      case 'm':
+        tt_size_mb = CORE_MAX(1, strtoull(optarg, NULL, 10));
+        break;
+      case 'j':
+        thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (dataset_path) {
+    if (!read_positions_dataset(dataset_path)) return 1;
+  } else if (optind == argc) {
+    if (!read_positions_text("-")) return 1;
+  }
+  for (int i = optind; i < argc; i++) {
+    if (!read_positions_text(argv[i])) return 1;
+  }
+
+  board_init_tables();
+  search_init_tables();
+  start_internal_timer();
+
+  bool tt_ok = tt_path ? tt_open_file(&solver.tt, tt_path, tt_size_mb, SEARCH_EVAL_VERSION)
+    : tt_create(&solver.tt, tt_size_mb);
+  if (!tt_ok) return 1;
+  pthread_mutex_init(&solver.stats_lock, NULL);
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
+  for (u32 i = 0; i < thread_count; i++) {
+    pthread_create(&threads[i], NULL, solver_thread, NULL);
+  }
+  for (u32 i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  f64 elapsed = get_time();
+
+  if (!quiet) {
+    for (u32 i = 0; i < solver.position_count; i++) {
+      Position *pos = &solver.positions[i];
+      char hex[BOARD_HEX_LEN + 1];
+      board_to_hex(pos->board, hex);
+      char move = pos->game_over ? '-' : move_dir_to_char(pos->move);
+      printf(solver.target_exponent ? "%s %c %.4f\n" : "%s %c %.1f\n", hex, move, pos->value);
+    }
+  }
+
+  fprintf(stderr, "analysed %u positions in %.2fs, %llu nodes, transposition table hits %.1f%% of %llu probes\n",
+      solver.position_count, elapsed, (unsigned long long)solver.stats.nodes,
+      solver.stats.tt_probes ? 100.0 * (f64)solver.stats.tt_hits / (f64)solver.stats.tt_probes : 0.0,
+      (unsigned long long)solver.stats.tt_probes);
+
+  tt_destroy(&solver.tt);
+  free(solver.positions);
+
+  return 0;
+}
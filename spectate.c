@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "spectate.h"
+
+static void set_nonblocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void drop_subscriber(Spectator *spectator, u32 idx) {
+  close(spectator->subscribers[idx].fd);
+  spectator->subscribers[idx] = spectator->subscribers[--spectator->subscriber_count];
+}
+
+// Sends what the socket takes right now. False if the subscriber is gone.
+static bool flush_subscriber(SpectateSubscriber *sub) {
+  while (sub->sent < sub->len) {
+    ssize_t n = send(sub->fd, sub->buf + sub->sent, sub->len - sub->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    sub->sent += (u32)n;
+  }
+
+  sub->sent = 0;
+  sub->len = 0;
+  return true;
+}
+
+static void encode_keyframe(const Spectator *spectator, u8 *out) {
+  out[0] = SPECTATE_MSG_KEYFRAME;
+  memcpy(out + 1, &spectator->seed, 8);
+  memcpy(out + 9, &spectator->board, 8);
+  memcpy(out + 17, &spectator->score, 4);
+  memcpy(out + 21, &spectator->move_count, 4);
+}
+
+static void encode_game_over(const Spectator *spectator, u8 *out) {
+  out[0] = SPECTATE_MSG_GAME_OVER;
+  memcpy(out + 1, &spectator->score, 4);
+}
+
+// Queues a message, or marks the subscriber as lagging when it doesn't fit.
+static void queue_message(SpectateSubscriber *sub, const u8 *msg, u32 size) {
+  if (sub->lagging) return;
+
+  if (sub->sent > 0 && sub->len + size > SPECTATE_BUFFER_SIZE) {
+    memmove(sub->buf, sub->buf + sub->sent, sub->len - sub->sent);
+    sub->len -= sub->sent;
+    sub->sent = 0;
+  }
+
+  if (sub->len + size > SPECTATE_BUFFER_SIZE) {
+    sub->lagging = true;
+    return;
+  }
+
+  memcpy(sub->buf + sub->len, msg, size);
+  sub->len += size;
+}
+
+// The game as it is, for a subscriber that doesn't know it.
+static void queue_state(const Spectator *spectator, SpectateSubscriber *sub) {
+  u8 keyframe[SPECTATE_KEYFRAME_SIZE];
+  encode_keyframe(spectator, keyframe);
+  queue_message(sub, keyframe, sizeof(keyframe));
+
+  if (spectator->lost) {
+    u8 game_over[SPECTATE_GAME_OVER_SIZE];
+    encode_game_over(spectator, game_over);
+    queue_message(sub, game_over, sizeof(game_over));
+  }
+}
+
+static void publish(Spectator *spectator, const u8 *msg, u32 size) {
+  for (u32 i = 0; i < spectator->subscriber_count;) {
+    SpectateSubscriber *sub = &spectator->subscribers[i];
+    queue_message(sub, msg, size);
+    if (!flush_subscriber(sub)) {
+      drop_subscriber(spectator, i);
+    } else {
+      i++;
+    }
+  }
+}
+
+bool spectate_open(Spectator *spectator, const char *path) {
+  memset(spectator, 0, sizeof(*spectator));
+  spectator->path = path;
+  spectator->listen_fd = -1;
+
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    printf("[ERROR]: spectator socket path \"%s\" is too long\n", path);
+    return false;
+  }
+  strcpy(addr.sun_path, path);
+
+  // left behind by a game that didn't exit cleanly, anything else is kept
+  struct stat st;
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SPECTATE_MAX_SUBSCRIBERS) != 0) {
+    printf("[ERROR]: could not listen for spectators on \"%s\": %s\n", path, strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  set_nonblocking(fd);
+  spectator->listen_fd = fd;
+
+  printf("[INFO] Spectators can connect to \"%s\"\n", path);
+  return true;
+}
+
+void spectate_poll(Spectator *spectator) {
+  int fd;
+  while ((fd = accept(spectator->listen_fd, NULL, NULL)) >= 0) {
+    if (spectator->subscriber_count == SPECTATE_MAX_SUBSCRIBERS) {
+      close(fd);
+      continue;
+    }
+    set_nonblocking(fd);
+
+    SpectateSubscriber *sub = &spectator->subscribers[spectator->subscriber_count++];
+    sub->fd = fd;
+    sub->sent = 0;
+    sub->len = 0;
+    sub->lagging = false;
+
+    u8 header[8];
+    u32 version = SPECTATE_VERSION;
+    memcpy(header, SPECTATE_MAGIC, 4);
+    memcpy(header + 4, &version, 4);
+    queue_message(sub, header, sizeof(header));
+    queue_state(spectator, sub);
+  }
+
+  for (u32 i = 0; i < spectator->subscriber_count;) {
+    SpectateSubscriber *sub = &spectator->subscribers[i];
+    bool alive = flush_subscriber(sub);
+    if (alive && sub->lagging && sub->len == 0) {
+      sub->lagging = false;
+      queue_state(spectator, sub);
+      alive = flush_subscriber(sub);
+    }
+
+    if (!alive) {
+      drop_subscriber(spectator, i);
+    } else {
+      i++;
+    }
+  }
+}
+
+void spectate_keyframe(Spectator *spectator, u64 seed, Board board, u32 score, u32 move_count) {
+  spectator->seed = seed;
+  spectator->board = board;
+  spectator->score = score;
+  spectator->move_count = move_count;
+  spectator->lost = false;
+
+  u8 keyframe[SPECTATE_KEYFRAME_SIZE];
+  encode_keyframe(spectator, keyframe);
+  publish(spectator, keyframe, sizeof(keyframe));
+}
+
+void spectate_move(Spectator *spectator, MoveDir dir, Board spawned, u32 score) {
+  Board moved = board_move(spectator->board, dir, NULL);
+  u8 cell = (u8)(__builtin_ctzll(spawned ^ moved) / 4);
+  u8 exponent = (u8)((spawned >> (cell * 4)) & 0xf);
+
+  spectator->board = spawned;
+  spectator->score = score;
+  spectator->move_count++;
+
+  u8 msg = (u8)(SPECTATE_MSG_MOVE | dir | cell << 2 | (exponent == 2) << 6);
+  publish(spectator, &msg, 1);
+}
+
+void spectate_game_over(Spectator *spectator) {
+  spectator->lost = true;
+
+  u8 game_over[SPECTATE_GAME_OVER_SIZE];
+  encode_game_over(spectator, game_over);
+  publish(spectator, game_over, sizeof(game_over));
+}
+
+void spectate_close(Spectator *spectator) {
+  for (u32 i = 0; i < spectator->subscriber_count; i++) {
+    // a last chance for what's left to go out
+    flush_subscriber(&spectator->subscribers[i]);
+    close(spectator->subscribers[i].fd);
+  }
+  spectator->subscriber_count = 0;
+
+  if (spectator->listen_fd >= 0) {
+    close(spectator->listen_fd);
+    unlink(spectator->path);
+  }
+  spectator->listen_fd = -1;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "board.h"
+
+// Live stream of the game being played to local subscribers over a unix
+// socket, for overlays and dashboards.
+//
+// A subscriber connects and reads. It gets the stream header, a keyframe of
+// the current game, then a message per move. Little endian:
+//
+//   header     "C2SP" u32 version
+//   keyframe   u8 SPECTATE_MSG_KEYFRAME u64 seed u64 board u32 score
+//              u32 move_count
+//   move       u8 0x80 | dir | cell << 2 | (spawned a 4) << 6
+//   game over  u8 SPECTATE_MSG_GAME_OVER u32 score
+//
+// A move is a single byte: the direction played (MoveDir) and the tile spawned
+// after it, `cell` being its nibble in the board (y * 4 + x). The board and
+// score after a move follow from board_move(). A new game starts with a
+// keyframe.
+//
+// Publishing never blocks the game. Sockets are non-blocking and every
+// subscriber has a buffer of SPECTATE_BUFFER_SIZE bytes; one that doesn't read
+// fast enough to keep it from filling up skips what's published meanwhile and
+// gets a keyframe of the game as it is once its buffer is drained.
+
+#define SPECTATE_MAGIC "C2SP"
+#define SPECTATE_VERSION 1
+#define SPECTATE_MAX_SUBSCRIBERS 16
+#define SPECTATE_BUFFER_SIZE 4096
+
+#define SPECTATE_MSG_KEYFRAME 1
+#define SPECTATE_MSG_GAME_OVER 2
+#define SPECTATE_MSG_MOVE 0x80
+
+#define SPECTATE_KEYFRAME_SIZE 25
+#define SPECTATE_GAME_OVER_SIZE 5
+
+typedef struct SpectateSubscriber {
+  int fd;
+  u8 buf[SPECTATE_BUFFER_SIZE];
+  u32 sent;
+  u32 len;
+  // messages were skipped, it's owed a keyframe
+  bool lagging;
+} SpectateSubscriber;
+
+typedef struct Spectator {
+  const char *path;
+  int listen_fd;
+  SpectateSubscriber subscribers[SPECTATE_MAX_SUBSCRIBERS];
+  u32 subscriber_count;
+
+  // the game as subscribers last heard of it, for the keyframes
+  u64 seed;
+  Board board;
+  u32 score;
+  u32 move_count;
+  bool lost;
+} Spectator;
+
+// Listens on the unix socket at `path`, replacing a stale socket left there.
+bool spectate_open(Spectator *spectator, const char *path);
+// Takes new subscribers and sends what's buffered. Called once a frame.
+void spectate_poll(Spectator *spectator);
+// A new or resumed game.
+void spectate_keyframe(Spectator *spectator, u64 seed, Board board, u32 score, u32 move_count);
+// `spawned` is the board after the move and its spawn, `score` the score
+// after the move.
+void spectate_move(Spectator *spectator, MoveDir dir, Board spawned, u32 score);
+void spectate_game_over(Spectator *spectator);
+// Disconnects every subscriber and removes the socket.
+void spectate_close(Spectator *spectator);
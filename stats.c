@@ -0,0 +1,466 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "record.h"
+#include "replay.h"
+#include "tdigest.h"
+#include "timer.h"
+
+// Replays every game of game record files (record.h) and replays (replay.h)
+// on every core and prints the distribution of scores and game lengths, how
+// often each tile is reached and at which move, and the number of empty cells
+// by move number.
+//
+// Threads take games a chunk at a time from a shared cursor over the files,
+// which are mapped when the cursor first reaches them, and aggregate into
+// their own partial: t-digests for the quantiles (tdigest.h), counters for
+// the rest. Partials are merged once every game is scanned, so memory only
+// depends on the number of threads and the length of the longest game,
+// never on the number of games.
+//
+// A game with an illegal move is left out of the per game statistics, its
+// positions up to that move still count.
+
+#define STATS_CHUNK_GAMES 1024
+#define STATS_DEFAULT_STEP 100
+// tiles reached are reported from 128 on, smaller ones always are
+#define STATS_FIRST_REPORTED_EXPONENT 7
+
+typedef struct Source {
+  const char *path;
+  bool opened;
+  bool is_replay;
+  RecordCodec codec;
+  const u8 *data;
+  u64 size;
+} Source;
+
+// Games handed to a thread.
+typedef struct Claim {
+  Source *source;
+  u64 offset;
+  u32 game_count;
+} Claim;
+
+typedef struct Partial {
+  u64 games;
+  u64 moves;
+  u64 skipped;
+  TDigest scores;
+  TDigest lengths;
+  // games whose largest tile has at least this exponent
+  u64 reached[BOARD_MAX_EXPONENT + 1];
+  // move on which the tile was first made
+  TDigest reach_moves[BOARD_MAX_EXPONENT + 1];
+
+  // by move number divided by the step
+  u32 bucket_count;
+  // games still going at the first move of the bucket
+  u64 *alive;
+  u64 *positions;
+  u64 *empty_sum;
+  u64 *empty_sq_sum;
+} Partial;
+
+typedef struct Analyzer {
+  Source *sources;
+  u32 source_count;
+  u32 thread_count;
+  u32 step;
+
+  // cursor of the next games to hand out
+  pthread_mutex_t lock;
+  u32 next_source;
+  u64 next_offset;
+} Analyzer;
+
+Analyzer analyzer = {0};
+
+void partial_init(Partial *partial) {
+  memset(partial, 0, sizeof(*partial));
+  tdigest_init(&partial->scores, TDIGEST_DEFAULT_COMPRESSION);
+  tdigest_init(&partial->lengths, TDIGEST_DEFAULT_COMPRESSION);
+  for (u32 e = 0; e <= BOARD_MAX_EXPONENT; e++) {
+    tdigest_init(&partial->reach_moves[e], TDIGEST_DEFAULT_COMPRESSION);
+  }
+}
+
+void partial_free(Partial *partial) {
+  tdigest_free(&partial->scores);
+  tdigest_free(&partial->lengths);
+  for (u32 e = 0; e <= BOARD_MAX_EXPONENT; e++) {
+    tdigest_free(&partial->reach_moves[e]);
+  }
+  free(partial->alive);
+  free(partial->positions);
+  free(partial->empty_sum);
+  free(partial->empty_sq_sum);
+}
+
+void reserve_buckets(Partial *partial, u32 count) {
+  if (count <= partial->bucket_count) return;
+
+  u32 cap = CORE_MAX(count, partial->bucket_count * 2);
+  u64 **arrays[] = {&partial->alive, &partial->positions, &partial->empty_sum, &partial->empty_sq_sum};
+  for (u32 i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+    u64 *temp = realloc(*arrays[i], cap * sizeof(u64));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for move statistics\n");
+      exit(1);
+    }
+    memset(temp + partial->bucket_count, 0, (cap - partial->bucket_count) * sizeof(u64));
+    *arrays[i] = temp;
+  }
+  partial->bucket_count = cap;
+}
+
+void partial_merge(Partial *into, const Partial *from) {
+  into->games += from->games;
+  into->moves += from->moves;
+  into->skipped += from->skipped;
+  tdigest_merge(&into->scores, &from->scores);
+  tdigest_merge(&into->lengths, &from->lengths);
+  for (u32 e = 0; e <= BOARD_MAX_EXPONENT; e++) {
+    into->reached[e] += from->reached[e];
+    tdigest_merge(&into->reach_moves[e], &from->reach_moves[e]);
+  }
+
+  reserve_buckets(into, from->bucket_count);
+  for (u32 i = 0; i < from->bucket_count; i++) {
+    into->alive[i] += from->alive[i];
+    into->positions[i] += from->positions[i];
+    into->empty_sum[i] += from->empty_sum[i];
+    into->empty_sq_sum[i] += from->empty_sq_sum[i];
+  }
+}
+
+///////////////////////////////////
+//
+//
+// Scanning
+//
+//
+///////////////////////////////////
+
+void add_position(Partial *partial, u32 move, Board b) {
+  u32 bucket = move / analyzer.step;
+  reserve_buckets(partial, bucket + 1);
+
+  u64 empty = board_count_empty(b);
+  partial->alive[bucket] += move % analyzer.step == 0;
+  partial->positions[bucket]++;
+  partial->empty_sum[bucket] += empty;
+  partial->empty_sq_sum[bucket] += empty * empty;
+}
+
+void scan_game(Partial *partial, const GameRecord *record) {
+  Rng rng;
+  rng_seed(&rng, record->seed);
+  Board b = board_new_game(&rng);
+  u8 max_exponent = board_max_exponent(b);
+  u32 score = 0;
+
+  add_position(partial, 0, b);
+  for (u32 i = 0; i < record->move_count; i++) {
+    Board moved = board_move(b, record_get_move(record, i), &score);
+    if (moved == b) {
+      partial->skipped++;
+      return;
+    }
+    b = board_spawn_random_tile(moved, &rng);
+    add_position(partial, i + 1, b);
+
+    // a merge makes at most one tile bigger than the rest
+    u8 exponent = board_max_exponent(b);
+    if (exponent > max_exponent) {
+      for (u8 e = max_exponent + 1; e <= exponent; e++) {
+        tdigest_add(&partial->reach_moves[e], i + 1, 1);
+      }
+      max_exponent = exponent;
+    }
+  }
+
+  partial->games++;
+  partial->moves += record->move_count;
+  tdigest_add(&partial->scores, score, 1);
+  tdigest_add(&partial->lengths, record->move_count, 1);
+  for (u8 e = 0; e <= max_exponent; e++) {
+    partial->reached[e]++;
+  }
+}
+
+void scan_replay(Partial *partial, Source *source) {
+  ReplayHeader header;
+  bool valid = source->size >= REPLAY_HEADER_SIZE && replay_decode_header(source->data, &header) &&
+    header.move_count != REPLAY_UNFINISHED && source->size >= REPLAY_HEADER_SIZE + ((u64)header.move_count + 3) / 4;
+
+  if (valid) {
+    GameRecord record = {
+      .seed = header.seed,
+      .score = header.score,
+      .move_count = header.move_count,
+      .moves = (u8 *)source->data + REPLAY_HEADER_SIZE,
+    };
+    scan_game(partial, &record);
+  } else {
+    partial->skipped++;
+  }
+
+  // nothing else reads it
+  munmap((void *)source->data, source->size);
+  source->data = NULL;
+}
+
+// Maps the file and finds out what it holds. Called with the lock held.
+bool open_source(Source *source) {
+  source->opened = true;
+
+  int fd = open(source->path, O_RDONLY);
+  if (fd < 0) {
+    printf("[WARN] skipped \"%s\": %s\n", source->path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= 8) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("[WARN] skipped \"%s\": neither a game record file nor a replay\n", source->path);
+    return false;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  source->data = data;
+  source->size = st.st_size;
+
+  u32 version;
+  memcpy(&version, source->data + 4, 4);
+  if (memcmp(source->data, RECORD_FILE_MAGIC, 4) == 0 && (version == RECORD_CODEC_PACKED || version == RECORD_CODEC_RANS)) {
+    source->codec = version;
+  } else if (memcmp(source->data, REPLAY_MAGIC, 4) == 0) {
+    source->is_replay = true;
+  } else {
+    printf("[WARN] skipped \"%s\": neither a game record file nor a replay\n", source->path);
+    munmap((void *)source->data, source->size);
+    source->data = NULL;
+    return false;
+  }
+
+  return true;
+}
+
+// Takes the next chunk of records of a record file, or the next replay, by
+// reading record headers only. False once every file is handed out.
+bool claim_games(Claim *claim) {
+  pthread_mutex_lock(&analyzer.lock);
+
+  bool found = false;
+  while (!found && analyzer.next_source < analyzer.source_count) {
+    Source *source = &analyzer.sources[analyzer.next_source];
+    if (!source->opened) {
+      analyzer.next_offset = 8;
+      if (!open_source(source)) {
+        analyzer.next_source++;
+        continue;
+      }
+    }
+
+    if (source->is_replay) {
+      *claim = (Claim){.source = source, .game_count = 1};
+      analyzer.next_source++;
+      found = true;
+      break;
+    }
+
+    *claim = (Claim){.source = source, .offset = analyzer.next_offset};
+    while (claim->game_count < STATS_CHUNK_GAMES && analyzer.next_offset < source->size) {
+      u64 size = record_file_record_size(source->codec, source->data + analyzer.next_offset,
+          source->size - analyzer.next_offset);
+      if (size == 0) {
+        printf("[WARN] %s: stopped on a truncated record\n", source->path);
+        analyzer.next_offset = source->size;
+        break;
+      }
+      analyzer.next_offset += size;
+      claim->game_count++;
+    }
+
+    if (analyzer.next_offset >= source->size) {
+      analyzer.next_source++;
+    }
+    found = claim->game_count > 0;
+  }
+
+  pthread_mutex_unlock(&analyzer.lock);
+  return found;
+}
+
+void *scan_thread(void *arg) {
+  Partial *partial = arg;
+  GameRecord decoded;
+  record_init(&decoded, 0);
+
+  Claim claim;
+  while (claim_games(&claim)) {
+    Source *source = claim.source;
+    if (source->is_replay) {
+      scan_replay(partial, source);
+      continue;
+    }
+
+    u64 offset = claim.offset;
+    for (u32 i = 0; i < claim.game_count; i++) {
+      const u8 *data = source->data + offset;
+      u64 size = source->size - offset;
+      offset += record_file_record_size(source->codec, data, size);
+
+      GameRecord view;
+      if (source->codec == RECORD_CODEC_PACKED) {
+        record_view(&view, data, size);
+        scan_game(partial, &view);
+      } else if (record_file_decode(source->codec, &decoded, data, size)) {
+        scan_game(partial, &decoded);
+      } else {
+        partial->skipped++;
+      }
+    }
+  }
+
+  record_free(&decoded);
+  return NULL;
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_distribution(const char *name, TDigest *digest) {
+  static const f64 quantiles[] = {0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99};
+  printf("%-8s %10.0f", name, tdigest_quantile(digest, 0));
+  for (u32 i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+    printf(" %10.0f", tdigest_quantile(digest, quantiles[i]));
+  }
+  printf(" %10.0f\n", tdigest_quantile(digest, 1));
+}
+
+void print_report(Partial *total) {
+  printf("%llu games, %llu moves\n\n", (unsigned long long)total->games, (unsigned long long)total->moves);
+  if (total->games == 0) return;
+
+  printf("%-8s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "", "min", "p1", "p10", "p25", "p50", "p75", "p90",
+      "p99", "max");
+  print_distribution("score", &total->scores);
+  print_distribution("moves", &total->lengths);
+
+  printf("\n%6s %9s %10s %10s %10s\n", "tile", "reached", "p10 move", "p50 move", "p90 move");
+  for (u32 e = STATS_FIRST_REPORTED_EXPONENT; e <= BOARD_MAX_EXPONENT && total->reached[e]; e++) {
+    TDigest *moves = &total->reach_moves[e];
+    printf("%6u %8.2f%% %10.0f %10.0f %10.0f\n", 1u << e, 100.0 * (f64)total->reached[e] / (f64)total->games,
+        tdigest_quantile(moves, 0.1), tdigest_quantile(moves, 0.5), tdigest_quantile(moves, 0.9));
+  }
+
+  printf("\n%8s %10s %12s %12s\n", "move", "alive", "mean empty", "stddev");
+  for (u32 i = 0; i < total->bucket_count && total->positions[i]; i++) {
+    f64 n = (f64)total->positions[i];
+    f64 mean = (f64)total->empty_sum[i] / n;
+    f64 variance = CORE_MAX((f64)total->empty_sq_sum[i] / n - mean * mean, 0.0);
+    printf("%8u %10llu %12.2f %12.2f\n", i * analyzer.step, (unsigned long long)total->alive[i], mean, sqrt(variance));
+  }
+}
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] <file>...\n"
+      "\n"
+      "Prints score and game length quantiles, tile reach rates and empty cells by\n"
+      "move number over every game of game record files and replays.\n"
+      "\n"
+      "options:\n"
+      "  -j <count>  worker threads (default: number of cores)\n"
+      "  -s <moves>  moves per row of the empty cell table (default %d)\n", prog, STATS_DEFAULT_STEP);
+}
+
+int main(int argc, char *argv[]) {
+  analyzer.thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+  analyzer.step = STATS_DEFAULT_STEP;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:s:h")) != -1) {
+    switch (opt) {
+      case 'j':
+        analyzer.thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 's':
+        analyzer.step = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind >= argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  board_init_tables();
+  start_internal_timer();
+  pthread_mutex_init(&analyzer.lock, NULL);
+
+  analyzer.source_count = (u32)(argc - optind);
+  analyzer.sources = calloc(analyzer.source_count, sizeof(Source));
+  for (u32 i = 0; i < analyzer.source_count; i++) {
+    analyzer.sources[i].path = argv[optind + i];
+  }
+
+  Partial *partials = malloc(analyzer.thread_count * sizeof(Partial));
+  pthread_t *threads = malloc(analyzer.thread_count * sizeof(pthread_t));
+  for (u32 i = 0; i < analyzer.thread_count; i++) {
+    partial_init(&partials[i]);
+    pthread_create(&threads[i], NULL, scan_thread, &partials[i]);
+  }
+  for (u32 i = 0; i < analyzer.thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  for (u32 i = 1; i < analyzer.thread_count; i++) {
+    partial_merge(&partials[0], &partials[i]);
+    partial_free(&partials[i]);
+  }
+
+  f64 elapsed = get_time();
+  print_report(&partials[0]);
+  if (partials[0].skipped) {
+    printf("\n[WARN] %llu games with illegal moves or unfinished were left out\n",
+        (unsigned long long)partials[0].skipped);
+  }
+  fprintf(stderr, "%llu games, %llu moves in %.2fs (%.0f games/s)\n", (unsigned long long)partials[0].games,
+      (unsigned long long)partials[0].moves, elapsed, elapsed > 0 ? (f64)partials[0].games / elapsed : 0.0);
+
+  for (u32 i = 0; i < analyzer.source_count; i++) {
+    if (analyzer.sources[i].data) {
+      munmap((void *)analyzer.sources[i].data, analyzer.sources[i].size);
+    }
+  }
+  partial_free(&partials[0]);
+  free(partials);
+  free(analyzer.sources);
+
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tdigest.h"
+
+void tdigest_init(TDigest *digest, f64 compression) {
+  memset(digest, 0, sizeof(*digest));
+  digest->compression = compression;
+  digest->min = INFINITY;
+  digest->max = -INFINITY;
+
+  // the centroids never outgrow compression / 2 plus rounding, the rest is
+  // the buffer
+  digest->cap = (u32)(compression * 5) + 16;
+  digest->centroids = malloc(digest->cap * sizeof(TDigestCentroid));
+  if (!digest->centroids) {
+    printf("[FATAL] Failed to allocate memory for a t-digest\n");
+    exit(1);
+  }
+}
+
+void tdigest_free(TDigest *digest) {
+  free(digest->centroids);
+  memset(digest, 0, sizeof(*digest));
+}
+
+static int compare_centroids(const void *a, const void *b) {
+  f64 ma = ((const TDigestCentroid *)a)->mean;
+  f64 mb = ((const TDigestCentroid *)b)->mean;
+  return (ma > mb) - (ma < mb);
+}
+
+// Largest share of the values a centroid starting at `q` may end at. The k1
+// scale k(q) = compression / 2pi * asin(2q - 1) grows by at most 1 per
+// centroid, its slope being steepest at the tails keeps centroids small there.
+static f64 q_limit(const TDigest *digest, f64 q) {
+  f64 k = digest->compression / (2 * M_PI) * asin(2 * q - 1) + 1;
+  if (k >= digest->compression / 4) return 1;
+  return (sin(k * 2 * M_PI / digest->compression) + 1) / 2;
+}
+
+// Merges the buffered values into the centroids.
+static void compress(TDigest *digest) {
+  if (digest->buffered == 0) return;
+
+  u32 n = digest->count + digest->buffered;
+  TDigestCentroid *c = digest->centroids;
+  qsort(c, n, sizeof(TDigestCentroid), compare_centroids);
+
+  // weight of the centroids before the last one
+  f64 before = 0;
+  f64 limit = digest->weight * q_limit(digest, 0);
+  u32 last = 0;
+  for (u32 i = 1; i < n; i++) {
+    if (before + c[last].weight + c[i].weight <= limit) {
+      c[last].weight += c[i].weight;
+      c[last].mean += (c[i].mean - c[last].mean) * c[i].weight / c[last].weight;
+    } else {
+      before += c[last].weight;
+      limit = digest->weight * q_limit(digest, before / digest->weight);
+      c[++last] = c[i];
+    }
+  }
+
+  digest->count = last + 1;
+  digest->buffered = 0;
+}
+
+void tdigest_add(TDigest *digest, f64 value, f64 weight) {
+  if (digest->count + digest->buffered == digest->cap) {
+    compress(digest);
+  }
+
+  digest->centroids[digest->count + digest->buffered++] = (TDigestCentroid){.mean = value, .weight = weight};
+  digest->weight += weight;
+  digest->min = CORE_MIN(digest->min, value);
+  digest->max = CORE_MAX(digest->max, value);
+}
+
+void tdigest_merge(TDigest *into, const TDigest *from) {
+  for (u32 i = 0; i < from->count + from->buffered; i++) {
+    tdigest_add(into, from->centroids[i].mean, from->centroids[i].weight);
+  }
+
+  // the extremes of `from` may have been merged into centroids
+  into->min = CORE_MIN(into->min, from->min);
+  into->max = CORE_MAX(into->max, from->max);
+}
+
+// Each centroid is taken as its weight spread around its mean, half on each
+// side. Between two means the quantile is interpolated, past the first and
+// last means it's interpolated towards the exact min and max.
+f64 tdigest_quantile(TDigest *digest, f64 q) {
+  compress(digest);
+  if (digest->count == 0) return 0;
+
+  const TDigestCentroid *c = digest->centroids;
+  u32 n = digest->count;
+  f64 index = CORE_CLAMP(q, 0.0, 1.0) * digest->weight;
+
+  if (index < c[0].weight / 2) {
+    return digest->min + (c[0].mean - digest->min) * index / (c[0].weight / 2);
+  }
+
+  f64 seen = c[0].weight / 2;
+  for (u32 i = 0; i + 1 < n; i++) {
+    f64 span = (c[i].weight + c[i + 1].weight) / 2;
+    if (seen + span > index) {
+      return c[i].mean + (c[i + 1].mean - c[i].mean) * (index - seen) / span;
+    }
+    seen += span;
+  }
+
+  f64 tail = c[n - 1].weight / 2;
+  return c[n - 1].mean + (digest->max - c[n - 1].mean) * CORE_MIN((index - seen) / tail, 1.0);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "core.h"
+
+// Streaming quantile sketch (merging t-digest).
+//
+// Values are summarized by at most about `compression` centroids, small near
+// both tails and large around the median, so extreme quantiles stay accurate
+// to a fraction of a percent in a fixed amount of memory whatever the number
+// of values. Added values are buffered and merged into the centroids a buffer
+// at a time. Digests built separately, one per thread, merge into one.
+
+#define TDIGEST_DEFAULT_COMPRESSION 200
+
+typedef struct TDigestCentroid {
+  f64 mean;
+  f64 weight;
+} TDigestCentroid;
+
+typedef struct TDigest {
+  f64 compression;
+  // centroids then the buffered values, sorted by mean after a merge
+  TDigestCentroid *centroids;
+  u32 count;
+  u32 buffered;
+  u32 cap;
+  f64 weight;
+  f64 min;
+  f64 max;
+} TDigest;
+
+void tdigest_init(TDigest *digest, f64 compression);
+void tdigest_free(TDigest *digest);
+void tdigest_add(TDigest *digest, f64 value, f64 weight);
+// Adds every value summarized by `from` to `into`.
+void tdigest_merge(TDigest *into, const TDigest *from);
+// The value a share `q` (0 to 1) of the values are below, 0 without values.
+f64 tdigest_quantile(TDigest *digest, f64 q);
@@ -377,6 +377,7 @@ GlyphInstanceList get_glyph_instance_list_from_text(const char *text, int font_s
 }
 
 void draw_text(const char* text, int font_size, UIConstraints constraints, const Color color, Alignment alignment) {
+  flush_quad_batch();
   GlyphInstanceList glyph_instance_list = get_glyph_instance_list_from_text(text, font_size, constraints, color, alignment);
 
   glActiveTexture(GL_TEXTURE0);
@@ -395,6 +396,9 @@ void draw_text(const char* text, int font_size, UIConstraints constraints, const
 }
 
 void draw_text_batch(GlyphInstanceList *batch) {
+  flush_quad_batch();
+  use_shader(font_shader);
+
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, zephr_ctx->font.atlas_texture_id);
   glBindVertexArray(font_vao);
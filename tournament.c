@@ -0,0 +1,358 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "bot.h"
+#include "timer.h"
+
+// Plays every engine on the same list of seeds. Each engine runs on its own
+// thread and keeps `concurrency` games in flight, asking for the next move of
+// all of them in a single batched request.
+
+#define HANDSHAKE_TIMEOUT_MS 5000
+
+typedef enum GameStatus {
+  GAME_STATUS_NOT_PLAYED,
+  GAME_STATUS_FINISHED,
+  GAME_STATUS_ILLEGAL_MOVE,
+  GAME_STATUS_TIMEOUT,
+  GAME_STATUS_ERROR,
+} GameStatus;
+
+typedef struct GameResult {
+  u32 score;
+  u32 moves;
+  u8 max_exponent;
+  GameStatus status;
+} GameResult;
+
+typedef struct LiveGame {
+  u32 seed_idx;
+  Board board;
+  Rng rng;
+  u32 score;
+  u32 moves;
+} LiveGame;
+
+typedef struct Engine {
+  const char *spec;
+  BotConn conn;
+  GameResult *results;
+  f64 think_time;
+  u64 total_moves;
+  const char *error;
+  pthread_t thread;
+} Engine;
+
+typedef struct Tournament {
+  u64 *seeds;
+  u32 seed_count;
+  u32 concurrency;
+  int move_time_ms;
+  Engine *engines;
+  u32 engine_count;
+} Tournament;
+
+Tournament tournament = {0};
+
+void finish_game(Engine *engine, LiveGame *game, GameStatus status) {
+  engine->results[game->seed_idx] = (GameResult){
+    .score = game->score,
+    .moves = game->moves,
+    .max_exponent = board_max_exponent(game->board),
+    .status = status,
+  };
+}
+
+// Seeds an engine never got to play are forfeited, so stopping early doesn't
+// spare it the games it would have lost.
+void forfeit_unplayed(Engine *engine, u32 first_seed_idx, GameStatus status) {
+  for (u32 i = first_seed_idx; i < tournament.seed_count; i++) {
+    engine->results[i] = (GameResult){.status = status};
+  }
+}
+
+void *engine_thread(void *arg) {
+  Engine *engine = arg;
+
+  BotResult res = bot_handshake(&engine->conn, HANDSHAKE_TIMEOUT_MS);
+  if (res != BOT_OK) {
+    engine->error = bot_result_str(res);
+    forfeit_unplayed(engine, 0, GAME_STATUS_ERROR);
+    return NULL;
+  }
+
+  LiveGame *live = malloc(sizeof(LiveGame) * tournament.concurrency);
+  Board *boards = malloc(sizeof(Board) * tournament.concurrency);
+  MoveDir *moves = malloc(sizeof(MoveDir) * tournament.concurrency);
+  u32 live_count = 0;
+  u32 next_seed = 0;
+
+  for (;;) {
+    while (live_count < tournament.concurrency && next_seed < tournament.seed_count) {
+      LiveGame *game = &live[live_count++];
+      game->seed_idx = next_seed;
+      game->score = 0;
+      game->moves = 0;
+      rng_seed(&game->rng, tournament.seeds[next_seed]);
+      game->board = board_new_game(&game->rng);
+      next_seed++;
+    }
+
+    if (live_count == 0) break;
+
+    for (u32 i = 0; i < live_count; i++) {
+      boards[i] = live[i].board;
+    }
+
+    // the time control is a budget for the whole batch, n boards get n times
+    // the time per move and the engine may share it out as it likes
+    f64 start = get_time();
+    res = bot_request_moves(&engine->conn, boards, live_count, moves, tournament.move_time_ms * (int)live_count);
+    engine->think_time += get_time() - start;
+
+    if (res != BOT_OK) {
+      GameStatus status = res == BOT_TIMEOUT ? GAME_STATUS_TIMEOUT : GAME_STATUS_ERROR;
+      for (u32 i = 0; i < live_count; i++) {
+        finish_game(engine, &live[i], status);
+      }
+      forfeit_unplayed(engine, next_seed, status);
+      engine->error = bot_result_str(res);
+      break;
+    }
+
+    engine->total_moves += live_count;
+
+    u32 kept = 0;
+    for (u32 i = 0; i < live_count; i++) {
+      LiveGame *game = &live[i];
+
+      if (!(board_legal_moves(game->board) & (1 << moves[i]))) {
+        finish_game(engine, game, GAME_STATUS_ILLEGAL_MOVE);
+        continue;
+      }
+
+      game->board = board_move(game->board, moves[i], &game->score);
+      game->board = board_spawn_random_tile(game->board, &game->rng);
+      game->moves++;
+
+      if (board_is_game_over(game->board)) {
+        finish_game(engine, game, GAME_STATUS_FINISHED);
+        continue;
+      }
+
+      live[kept++] = *game;
+    }
+    live_count = kept;
+  }
+
+  free(live);
+  free(boards);
+  free(moves);
+
+  return NULL;
+}
+
+///////////////////////////////////
+//
+//
+// Reporting
+//
+//
+///////////////////////////////////
+
+void print_results(void) {
+  printf("\n%-24s %6s %10s %10s %7s %7s %9s %12s\n",
+      "engine", "games", "avg score", "max score", "2048%", "4096%", "forfeits", "ms/move");
+
+  for (u32 e = 0; e < tournament.engine_count; e++) {
+    Engine *engine = &tournament.engines[e];
+    u32 played = 0, forfeits = 0, reached_2048 = 0, reached_4096 = 0;
+    u64 total_score = 0;
+    u32 max_score = 0;
+
+    for (u32 i = 0; i < tournament.seed_count; i++) {
+      GameResult *r = &engine->results[i];
+      if (r->status == GAME_STATUS_NOT_PLAYED) continue;
+
+      played++;
+      total_score += r->score;
+      max_score = CORE_MAX(max_score, r->score);
+      if (r->status != GAME_STATUS_FINISHED) forfeits++;
+      if (r->max_exponent >= 11) reached_2048++;
+      if (r->max_exponent >= 12) reached_4096++;
+    }
+
+    f64 div = played ? played : 1;
+    f64 ms_per_move = engine->total_moves ? engine->think_time * 1000.0 / engine->total_moves : 0;
+    printf("%-24.24s %6u %10.1f %10u %6.1f%% %6.1f%% %9u %12.4f\n",
+        engine->conn.name, played, total_score / div, max_score,
+        reached_2048 * 100.0 / div, reached_4096 * 100.0 / div, forfeits, ms_per_move);
+
+    if (engine->error) {
+      printf("  stopped early: %s, the games left are forfeited\n", engine->error);
+    }
+  }
+
+  if (tournament.engine_count < 2) return;
+
+  // head to head on identical seeds, a forfeited game always loses
+  printf("\nhead to head (wins-losses-draws)\n");
+  for (u32 a = 0; a < tournament.engine_count; a++) {
+    for (u32 b = a + 1; b < tournament.engine_count; b++) {
+      u32 wins = 0, losses = 0, draws = 0;
+
+      for (u32 i = 0; i < tournament.seed_count; i++) {
+        GameResult *ra = &tournament.engines[a].results[i];
+        GameResult *rb = &tournament.engines[b].results[i];
+        if (ra->status == GAME_STATUS_NOT_PLAYED || rb->status == GAME_STATUS_NOT_PLAYED) continue;
+
+        i64 sa = ra->status == GAME_STATUS_FINISHED ? (i64)ra->score : -1;
+        i64 sb = rb->status == GAME_STATUS_FINISHED ? (i64)rb->score : -1;
+        if (sa > sb) wins++;
+        else if (sa < sb) losses++;
+        else draws++;
+      }
+
+      printf("  %s vs %s: %u-%u-%u\n", tournament.engines[a].conn.name, tournament.engines[b].conn.name, wins, losses, draws);
+    }
+  }
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] <engine>...\n"
+      "\n"
+      "An engine is a shell command speaking the bot protocol over stdin/stdout,\n"
+      "or \"unix:<path>\" for an engine listening on a unix socket.\n"
+      "\n"
+      "options:\n"
+      "  -n <count>  number of seeds to play (default 100)\n"
+      "  -s <seed>   first seed, seeds are consecutive from here (default 1)\n"
+      "  -f <file>   read the seeds from a file, one per line\n"
+      "  -t <ms>     time per move (default 100), given per batched request: a\n"
+      "              request for n boards has n times this to answer all of them\n"
+      "  -j <count>  games played concurrently per engine (default 64)\n", prog);
+}
+
+bool load_seeds_file(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    printf("[ERROR]: could not open seeds file \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  u32 cap = 128;
+  tournament.seeds = malloc(sizeof(u64) * cap);
+  tournament.seed_count = 0;
+
+  unsigned long long seed;
+  while (fscanf(fp, "%llu", &seed) == 1) {
+    if (tournament.seed_count == cap) {
+      cap *= 2;
+      tournament.seeds = realloc(tournament.seeds, sizeof(u64) * cap);
+    }
+    tournament.seeds[tournament.seed_count++] = seed;
+  }
+
+  fclose(fp);
+  return tournament.seed_count > 0;
+}
+
+int main(int argc, char *argv[]) {
+  u32 seed_count = 100;
+  u64 first_seed = 1;
+  const char *seeds_path = NULL;
+  tournament.move_time_ms = 100;
+  tournament.concurrency = 64;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:f:t:j:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        seed_count = (u32)strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        first_seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'f':
+        seeds_path = optarg;
+        break;
+      case 't':
+        tournament.move_time_ms = atoi(optarg);
+        break;
+      case 'j':
+        tournament.concurrency = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind >= argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  // engines that die mid request must not take the runner down with them
+  signal(SIGPIPE, SIG_IGN);
+  board_init_tables();
+  start_internal_timer();
+
+  if (seeds_path) {
+    if (!load_seeds_file(seeds_path)) return 1;
+  } else {
+    tournament.seed_count = seed_count;
+    tournament.seeds = malloc(sizeof(u64) * seed_count);
+    for (u32 i = 0; i < seed_count; i++) {
+      tournament.seeds[i] = first_seed + i;
+    }
+  }
+
+  tournament.engine_count = argc - optind;
+  tournament.engines = calloc(tournament.engine_count, sizeof(Engine));
+
+  for (u32 e = 0; e < tournament.engine_count; e++) {
+    Engine *engine = &tournament.engines[e];
+    engine->spec = argv[optind + e];
+    engine->results = calloc(tournament.seed_count, sizeof(GameResult));
+
+    if (!bot_open(&engine->conn, engine->spec)) {
+      return 1;
+    }
+  }
+
+  printf("playing %u seeds on %u engines, %d ms per move, %u concurrent games\n",
+      tournament.seed_count, tournament.engine_count, tournament.move_time_ms, tournament.concurrency);
+
+  for (u32 e = 0; e < tournament.engine_count; e++) {
+    pthread_create(&tournament.engines[e].thread, NULL, engine_thread, &tournament.engines[e]);
+  }
+  for (u32 e = 0; e < tournament.engine_count; e++) {
+    pthread_join(tournament.engines[e].thread, NULL);
+  }
+
+  print_results();
+
+  for (u32 e = 0; e < tournament.engine_count; e++) {
+    bot_close(&tournament.engines[e].conn);
+    free(tournament.engines[e].results);
+  }
+  free(tournament.engines);
+  free(tournament.seeds);
+
+  return 0;
+}
@@ -0,0 +1,270 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tt.h"
+
+#define TT_MAGIC "C2TT"
+#define TT_HUGE_PAGE_SIZE (2ULL << 20)
+#define TT_BUCKET_SIZE (TT_BUCKET_ENTRIES * sizeof(TTEntry))
+
+// data layout: bits 0-31 the f32 value, bits 32-39 the depth, bits 40-47 the
+// kind, bit 63 set for every written entry so a zeroed entry never matches
+#define TT_DATA_VALID (1ULL << 63)
+
+///////////////////////////////////
+//
+//
+// Mapping
+//
+//
+///////////////////////////////////
+
+static u64 bucket_count_for_size(u64 size_mb) {
+  u64 buckets = CORE_MAX(1, (size_mb << 20) / TT_BUCKET_SIZE);
+  // round down to a power of two so a bucket is picked with a mask
+  while (!CORE_IS_POWER_OF_TWO(buckets)) {
+    buckets &= buckets - 1;
+  }
+  return buckets;
+}
+
+// Reserves address space for `size` bytes placed so that the byte at
+// `aligned_offset` lands on a huge page boundary and returns that placement.
+static void *reserve_aligned(TransTable *tt, u64 size, u64 aligned_offset) {
+  u64 reservation_size = size + TT_HUGE_PAGE_SIZE;
+  void *reservation = mmap(NULL, reservation_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reservation == MAP_FAILED) return NULL;
+
+  tt->reservation = reservation;
+  tt->reservation_size = reservation_size;
+
+  uptr start = CORE_INT_ROUND_UP_ALIGN((uptr)reservation + aligned_offset, TT_HUGE_PAGE_SIZE) - aligned_offset;
+  return (void *)start;
+}
+
+bool tt_create(TransTable *tt, u64 size_mb) {
+  memset(tt, 0, sizeof(*tt));
+
+  u64 buckets = bucket_count_for_size(size_mb);
+  u64 size = buckets * TT_BUCKET_SIZE;
+
+  // explicit huge pages only exist if the administrator reserved some, so
+  // fall back to transparent huge pages on a 2MB aligned mapping
+  void *entries = MAP_FAILED;
+  if (size % TT_HUGE_PAGE_SIZE == 0) {
+    entries = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+
+  if (entries != MAP_FAILED) {
+    tt->reservation = entries;
+    tt->reservation_size = size;
+  } else {
+    void *start = reserve_aligned(tt, size, 0);
+    if (start) {
+      entries = mmap(start, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    }
+    if (entries == MAP_FAILED) {
+      printf("[ERROR]: could not allocate a %llu MB transposition table: %s\n",
+          (unsigned long long)(size >> 20), strerror(errno));
+      tt_destroy(tt);
+      return false;
+    }
+    madvise(entries, size, MADV_HUGEPAGE);
+  }
+
+  tt->entries = entries;
+  tt->bucket_mask = buckets - 1;
+
+  return true;
+}
+
+static bool read_file_header(int fd, u64 file_size, u32 tag, u64 *bucket_count) {
+  u8 header[32];
+  if (file_size < TT_FILE_HEADER_SIZE || pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+    return false;
+  }
+
+  u32 version, file_tag;
+  u64 buckets;
+  memcpy(&version, header + 4, 4);
+  memcpy(&file_tag, header + 8, 4);
+  memcpy(&buckets, header + 16, 8);
+
+  bool valid = memcmp(header, TT_MAGIC, 4) == 0 && version == TT_VERSION && file_tag == tag &&
+    CORE_IS_POWER_OF_TWO(buckets) && file_size == TT_FILE_HEADER_SIZE + buckets * TT_BUCKET_SIZE;
+  if (valid) {
+    *bucket_count = buckets;
+  }
+
+  return valid;
+}
+
+static bool write_file_header(int fd, u64 buckets, u32 tag) {
+  u8 header[32] = {0};
+  u32 version = TT_VERSION;
+  memcpy(header, TT_MAGIC, 4);
+  memcpy(header + 4, &version, 4);
+  memcpy(header + 8, &tag, 4);
+  memcpy(header + 16, &buckets, 8);
+
+  // truncating first drops the old contents, the file is then sparse and reads
+  // back as zeroes, i.e. empty entries
+  u64 size = TT_FILE_HEADER_SIZE + buckets * TT_BUCKET_SIZE;
+  return ftruncate(fd, 0) == 0 && ftruncate(fd, size) == 0 &&
+    pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header);
+}
+
+bool tt_open_file(TransTable *tt, const char *path, u64 size_mb, u32 tag) {
+  memset(tt, 0, sizeof(*tt));
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    printf("[ERROR]: could not open transposition table \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  // held while the header is checked so two processes opening a new file
+  // don't both initialize it
+  flock(fd, LOCK_EX);
+
+  struct stat st;
+  u64 buckets = 0;
+  if (fstat(fd, &st) != 0 || !read_file_header(fd, st.st_size, tag, &buckets)) {
+    if (st.st_size > 0) {
+      printf("[WARN] transposition table \"%s\" is from another version, clearing it\n", path);
+    }
+
+    buckets = bucket_count_for_size(size_mb);
+    if (!write_file_header(fd, buckets, tag)) {
+      printf("[ERROR]: could not initialize transposition table \"%s\": %s\n", path, strerror(errno));
+      flock(fd, LOCK_UN);
+      close(fd);
+      return false;
+    }
+  }
+
+  u64 size = TT_FILE_HEADER_SIZE + buckets * TT_BUCKET_SIZE;
+  void *start = reserve_aligned(tt, size, TT_FILE_HEADER_SIZE);
+  void *map = MAP_FAILED;
+  if (start) {
+    map = mmap(start, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+  }
+
+  flock(fd, LOCK_UN);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    printf("[ERROR]: could not map transposition table \"%s\": %s\n", path, strerror(errno));
+    tt_destroy(tt);
+    return false;
+  }
+
+  tt->entries = CORE_PTR_ADD(map, TT_FILE_HEADER_SIZE);
+  tt->bucket_mask = buckets - 1;
+  tt->file_backed = true;
+
+  // only honoured by filesystems with huge page support (e.g. tmpfs mounted
+  // with huge=), elsewhere the aligned buckets just cost nothing
+  madvise(tt->entries, buckets * TT_BUCKET_SIZE, MADV_HUGEPAGE);
+
+  return true;
+}
+
+void tt_destroy(TransTable *tt) {
+  // unmapping a shared mapping leaves the written pages to the page cache,
+  // which writes them back to the file
+  if (tt->reservation) {
+    munmap(tt->reservation, tt->reservation_size);
+  }
+  memset(tt, 0, sizeof(*tt));
+}
+
+void tt_clear(TransTable *tt) {
+  memset(tt->entries, 0, (tt->bucket_mask + 1) * TT_BUCKET_SIZE);
+}
+
+u64 tt_entry_count(TransTable *tt) {
+  return (tt->bucket_mask + 1) * TT_BUCKET_ENTRIES;
+}
+
+///////////////////////////////////
+//
+//
+// Lookup
+//
+//
+///////////////////////////////////
+
+static u64 hash_board(Board b) {
+  b ^= b >> 33;
+  b *= 0xff51afd7ed558ccdULL;
+  b ^= b >> 33;
+  b *= 0xc4ceb9fe1a85ec53ULL;
+  b ^= b >> 33;
+  return b;
+}
+
+static TTEntry *get_bucket(TransTable *tt, Board b) {
+  return &tt->entries[(hash_board(b) & tt->bucket_mask) * TT_BUCKET_ENTRIES];
+}
+
+static bool entry_matches(u64 check, u64 data, Board b, u8 kind) {
+  return (data & TT_DATA_VALID) && (check ^ data) == b && (u8)(data >> 40) == kind;
+}
+
+bool tt_probe(TransTable *tt, Board b, u8 kind, u8 depth, f32 *value) {
+  TTEntry *bucket = get_bucket(tt, b);
+
+  for (u32 i = 0; i < TT_BUCKET_ENTRIES; i++) {
+    u64 check = __atomic_load_n(&bucket[i].check, __ATOMIC_RELAXED);
+    u64 data = __atomic_load_n(&bucket[i].data, __ATOMIC_RELAXED);
+    if (!entry_matches(check, data, b, kind)) continue;
+
+    if ((u8)(data >> 32) < depth) return false;
+
+    u32 bits = (u32)data;
+    memcpy(value, &bits, sizeof(*value));
+    return true;
+  }
+
+  return false;
+}
+
+void tt_store(TransTable *tt, Board b, u8 kind, u8 depth, f32 value) {
+  TTEntry *bucket = get_bucket(tt, b);
+
+  u32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  u64 data = TT_DATA_VALID | ((u64)kind << 40) | ((u64)depth << 32) | bits;
+
+  // replace the entry of the same board and kind if it was searched less deep,
+  // otherwise the shallowest entry of the bucket
+  TTEntry *victim = NULL;
+  i32 victim_depth = I32_MAX;
+  for (u32 i = 0; i < TT_BUCKET_ENTRIES; i++) {
+    u64 old_check = __atomic_load_n(&bucket[i].check, __ATOMIC_RELAXED);
+    u64 old_data = __atomic_load_n(&bucket[i].data, __ATOMIC_RELAXED);
+    bool valid = (old_data & TT_DATA_VALID) != 0;
+    i32 old_depth = valid ? (u8)(old_data >> 32) : -1;
+
+    if (entry_matches(old_check, old_data, b, kind)) {
+      if (old_depth > depth) return;
+      victim = &bucket[i];
+      break;
+    }
+
+    if (old_depth < victim_depth) {
+      victim = &bucket[i];
+      victim_depth = old_depth;
+    }
+  }
+
+  __atomic_store_n(&victim->data, data, __ATOMIC_RELAXED);
+  __atomic_store_n(&victim->check, b ^ data, __ATOMIC_RELAXED);
+}
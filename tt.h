@@ -0,0 +1,58 @@
+#pragma once
+
+#include "board.h"
+
+// Transposition table mapping a board to a searched value and the depth it was
+// searched to. A `kind` byte tells apart values that mean different things for
+// the same board (e.g. searches with different objectives), entries only match
+// the kind they were stored with.
+//
+// Entries are grouped in buckets of four that fill one cache line and are read
+// and written without locks: an entry stores its key xored with its data, so
+// an entry torn by a concurrent writer reads back as a miss instead of a wrong
+// value. This makes it safe to share one table between threads and, when it is
+// backed by a file mapped with MAP_SHARED, between processes. A file backed
+// table also keeps its contents between runs. File layout:
+//
+//   header   "C2TT" u32 version u32 tag u32 reserved u64 bucket_count, padded
+//            to TT_FILE_HEADER_SIZE bytes
+//   buckets  bucket_count * TT_BUCKET_ENTRIES * 16 bytes
+//
+// The tag identifies what the stored values mean (e.g. the version of the
+// evaluation function); opening a file with a different tag clears it. Every
+// process sharing a file must use the same tag.
+
+#define TT_VERSION 1
+#define TT_BUCKET_ENTRIES 4
+#define TT_FILE_HEADER_SIZE 4096
+#define TT_DEFAULT_SIZE_MB 256
+
+typedef struct TTEntry {
+  u64 check;
+  u64 data;
+} TTEntry;
+
+typedef struct TransTable {
+  TTEntry *entries;
+  u64 bucket_mask;
+
+  // the address range reserved to align the buckets, which contains the mapping
+  void *reservation;
+  u64 reservation_size;
+  bool file_backed;
+} TransTable;
+
+// Anonymous table private to this process of at most `size_mb` megabytes.
+bool tt_create(TransTable *tt, u64 size_mb);
+// Maps the table stored at `path`, creating it with at most `size_mb`
+// megabytes if the file doesn't exist or was written with another tag. An
+// existing table keeps its size.
+bool tt_open_file(TransTable *tt, const char *path, u64 size_mb, u32 tag);
+void tt_destroy(TransTable *tt);
+// Forgets every entry, e.g. so that a search doesn't depend on earlier ones.
+void tt_clear(TransTable *tt);
+
+u64 tt_entry_count(TransTable *tt);
+// Succeeds only if `b` was stored for `kind` with a depth of at least `depth`.
+bool tt_probe(TransTable *tt, Board b, u8 kind, u8 depth, f32 *value);
+void tt_store(TransTable *tt, Board b, u8 kind, u8 depth, f32 value);
@@ -1,5 +1,6 @@
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <glad/glx.h>
@@ -11,13 +12,169 @@
 
 Shader ui_shader;
 Shader color_chooser_shader;
+Shader quad_shader;
 unsigned int ui_vao;
 unsigned int ui_vbo;
+unsigned int quad_vao;
+unsigned int quad_instance_vbo;
+QuadBatch quad_batch;
 
 const UIConstraints default_constraints = {
   .scale = {.height = 1, .width = 1},
 };
 
+///////////////////////////////////
+//
+//
+// Quad batch
+//
+//
+///////////////////////////////////
+
+static void init_quad_batch(void) {
+  u32 quad_vbo;
+  u32 quad_ebo;
+
+  quad_shader = create_shader("shaders/quad.vert", "shaders/quad.frag");
+
+  quad_batch.capacity = 256;
+  quad_batch.data = malloc(quad_batch.capacity * sizeof(QuadInstance));
+  if (!quad_batch.data) {
+    printf("[FATAL] Failed to allocate memory for the quad batch\n");
+    exit(1);
+  }
+
+  glGenVertexArrays(1, &quad_vao);
+  glGenBuffers(1, &quad_vbo);
+  glGenBuffers(1, &quad_instance_vbo);
+  glGenBuffers(1, &quad_ebo);
+
+  float quad_vertices[4][2] = {
+    {0.0, 1.0}, // bottom left
+    {1.0, 1.0}, // bottom right
+    {1.0, 0.0}, // top right
+    {0.0, 0.0}, // top left
+  };
+
+  int quad_indices[6] = {
+    0, 1, 2,
+    2, 3, 0
+  };
+
+  glBindVertexArray(quad_vao);
+
+  // quad vbo
+  glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+
+  // quad instance vbo
+  glBindBuffer(GL_ARRAY_BUFFER, quad_instance_vbo);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void *)0);
+  glVertexAttribDivisor(1, 1);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void *)sizeof(Vec4f));
+  glVertexAttribDivisor(2, 1);
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void *)(sizeof(Vec4f) * 2));
+  glVertexAttribDivisor(3, 1);
+  glEnableVertexAttribArray(4);
+  glEnableVertexAttribArray(5);
+  glEnableVertexAttribArray(6);
+  glEnableVertexAttribArray(7);
+  glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void *)(sizeof(Vec4f) * 3));
+  glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void *)(sizeof(Vec4f) * 4));
+  glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void *)(sizeof(Vec4f) * 5));
+  glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void *)(sizeof(Vec4f) * 6));
+  glVertexAttribDivisor(4, 1);
+  glVertexAttribDivisor(5, 1);
+  glVertexAttribDivisor(6, 1);
+  glVertexAttribDivisor(7, 1);
+
+  // quad ebo
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quad_indices), quad_indices, GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void flush_quad_batch(void) {
+  if (quad_batch.size == 0) return;
+
+  use_shader(quad_shader);
+  set_mat4f(quad_shader, "projection", (float *)zephr_ctx->projection.m);
+
+  if (quad_batch.texture_id) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, quad_batch.texture_id);
+  }
+
+  glBindVertexArray(quad_vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, quad_instance_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(QuadInstance) * quad_batch.size, quad_batch.data, GL_DYNAMIC_DRAW);
+
+  glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, quad_batch.size);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  quad_batch.size = 0;
+  quad_batch.texture_id = 0;
+}
+
+// Queues a quad placed like every other element. A batch samples a single
+// texture, so a quad of another one flushes it first, untextured quads going
+// with any.
+static void add_quad(UIConstraints *constraints, Alignment align, Color color, f32 radius, TextureId texture_id) {
+  if (texture_id && quad_batch.texture_id && texture_id != quad_batch.texture_id) {
+    flush_quad_batch();
+  }
+  if (texture_id) {
+    quad_batch.texture_id = texture_id;
+  }
+
+  Rect rect = {0};
+
+  apply_constraints(constraints, &rect.pos, &rect.size);
+  apply_alignment(align, constraints, &rect.pos, rect.size);
+
+  // set the positions after applying alignment so children can use them
+  constraints->x = rect.pos.x;
+  constraints->y = rect.pos.y;
+
+  Matrix4x4 model = identity();
+  apply_translation(&model, (Vec2f){-rect.size.width / 2.f, -rect.size.height / 2.f});
+  apply_scale(&model, constraints->scale);
+  apply_translation(&model, (Vec2f){rect.size.width / 2.f, rect.size.height / 2.f});
+
+  apply_translation(&model, (Vec2f){-rect.size.width / 2.f, -rect.size.height / 2.f});
+  apply_rotation(&model, to_radians(constraints->rotation));
+  apply_translation(&model, (Vec2f){rect.size.width / 2.f, rect.size.height / 2.f});
+
+  apply_translation(&model, rect.pos);
+
+  if (quad_batch.size >= quad_batch.capacity) {
+    quad_batch.capacity *= 2;
+    QuadInstance *temp = realloc(quad_batch.data, quad_batch.capacity * sizeof(QuadInstance));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for the quad batch\n");
+      exit(1);
+    }
+    quad_batch.data = temp;
+  }
+
+  QuadInstance *instance = &quad_batch.data[quad_batch.size++];
+  instance->shape = (Vec4f){rect.size.width, rect.size.height, radius, texture_id ? 1.f : 0.f};
+  instance->color = (Colorf){color.r / 255.f, color.g / 255.f, color.b / 255.f, color.a / 255.f};
+  instance->tex_rect = (Vec4f){0.f, 0.f, 1.f, 1.f};
+  memcpy(instance->model, model.m, sizeof(instance->model));
+}
+
 int init_ui(const char* font_path) {
   int res = init_fonts(font_path);
   if (res == -1) {
@@ -43,6 +200,8 @@ int init_ui(const char* font_path) {
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
 
+  init_quad_batch();
+
   return 0;
 }
 
@@ -217,57 +376,7 @@ bool inside_rect(Rect *rect, Vec2 *point) {
 }
 
 void draw_quad(UIConstraints *constraints, const UiStyle style) {
-  use_shader(ui_shader);
-
-  set_vec4f(ui_shader, "aColor", style.bg_color.r / 255.f, style.bg_color.g / 255.f, style.bg_color.b / 255.f, style.bg_color.a / 255.f);
-  set_float(ui_shader, "uiWidth", constraints->width);
-  set_float(ui_shader, "uiHeight", constraints->height);
-  set_float(ui_shader, "borderRadius", style.border_radius);
-  set_mat4f(ui_shader, "projection", (float *)zephr_ctx->projection.m);
-
-  Rect rect = {0};
-
-  apply_constraints(constraints, &rect.pos, &rect.size);
-  apply_alignment(style.align, constraints, &rect.pos, rect.size);
-
-  // set the positions after applying alignment so children can use them
-  constraints->x = rect.pos.x;
-  constraints->y = rect.pos.y;
-
-  Matrix4x4 model = identity();
-  apply_translation(&model, (Vec2f){-rect.size.width / 2.f, -rect.size.height / 2.f});
-  apply_scale(&model, constraints->scale);
-  apply_translation(&model, (Vec2f){rect.size.width / 2.f, rect.size.height / 2.f});
-
-  apply_translation(&model, (Vec2f){-rect.size.width / 2.f, -rect.size.height / 2.f});
-  apply_rotation(&model, to_radians(constraints->rotation));
-  apply_translation(&model, (Vec2f){rect.size.width / 2.f, rect.size.height / 2.f});
-
-  apply_translation(&model, rect.pos);
-
-  set_mat4f(ui_shader, "model", (float *)model.m);
-
-  glBindVertexArray(ui_vao);
-
-  float vertices[6][4] = {
-    // bottom left tri
-    {0,                   0 + rect.size.height, 0.0, 1.0},
-    {0,                   0,                    0.0, 0.0},
-    {0 + rect.size.width, 0,                    1.0, 0.0},
-
-    // top right tri
-    {0,                   0 + rect.size.height, 0.0, 1.0},
-    {0 + rect.size.width, 0,                    1.0, 0.0},
-    {0 + rect.size.width, 0 + rect.size.height, 1.0, 1.0},
-  };
-
-  glBindBuffer(GL_ARRAY_BUFFER, ui_vbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  glDrawArrays(GL_TRIANGLES, 0, 6);
-
-  glBindVertexArray(0);
+  add_quad(constraints, style.align, style.bg_color, style.border_radius, 0);
 }
 
 void draw_circle(UIConstraints *constraints, const UiStyle style) {
@@ -286,6 +395,7 @@ void draw_circle(UIConstraints *constraints, const UiStyle style) {
 }
 
 void draw_triangle(UIConstraints *constraints, const UiStyle style) {
+  flush_quad_batch();
   use_shader(ui_shader);
 
   set_vec4f(ui_shader, "aColor", style.bg_color.r / 255.f, style.bg_color.g / 255.f, style.bg_color.b / 255.f, style.bg_color.a / 255.f);
@@ -333,64 +443,7 @@ void draw_triangle(UIConstraints *constraints, const UiStyle style) {
 }
 
 void draw_texture(UIConstraints *constraints, const TextureId texture_id, const Color color, f32 radius, Alignment align) {
-  use_shader(ui_shader);
-
-  set_vec4f(ui_shader, "aColor", color.r / 255.f, color.g / 255.f, color.b / 255.f, color.a / 255.f);
-  set_float(ui_shader, "uiWidth", constraints->width);
-  set_float(ui_shader, "uiHeight", constraints->height);
-  set_float(ui_shader, "borderRadius", radius);
-  set_bool(ui_shader, "hasTexture", true);
-
-  set_mat4f(ui_shader, "projection", (float *)zephr_ctx->projection.m);
-
-  Vec2f pos = { 0.f, 0.f };
-  Sizef size = { 0.f, 0.f };
-
-  apply_constraints(constraints, &pos, &size);
-  apply_alignment(align, constraints, &pos, size);
-
-  // set the positions after applying alignment so children can use them
-  constraints->x = pos.x;
-  constraints->y = pos.y;
-
-  Matrix4x4 model = identity();
-  apply_translation(&model, (Vec2f){-size.width / 2.f, -size.height / 2.f});
-  apply_scale(&model, constraints->scale);
-  apply_translation(&model, (Vec2f){size.width / 2.f, size.height / 2.f});
-
-  apply_translation(&model, (Vec2f){-size.width / 2.f, -size.height / 2.f});
-  apply_rotation(&model, to_radians(constraints->rotation));
-  apply_translation(&model, (Vec2f){size.width / 2.f, size.height / 2.f});
-
-  apply_translation(&model, pos);
-
-  set_mat4f(ui_shader, "model", (float *)model.m);
-
-  glBindVertexArray(ui_vao);
-
-  float vertices[6][4] = {
-    // bottom left tri
-    {0,              0 + size.height, 0.0, 1.0},
-    {0,              0,               0.0, 0.0},
-    {0 + size.width, 0,               1.0, 0.0},
-
-    // top right tri
-    {0,              0 + size.height, 0.0, 1.0},
-    {0 + size.width, 0,               1.0, 0.0},
-    {0 + size.width, 0 + size.height, 1.0, 1.0},
-  };
-
-  glBindBuffer(GL_ARRAY_BUFFER, ui_vbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture_id);
-
-  glDrawArrays(GL_TRIANGLES, 0, 6);
-
-  glBindVertexArray(0);
-  set_bool(ui_shader, "hasTexture", false);
+  add_quad(constraints, align, color, radius, texture_id);
 }
 
 bool draw_button_with_location(const char *file, int line, UIConstraints *constraints, const char *text, UiStyle style, ButtonState state) {
@@ -533,6 +586,75 @@ bool draw_icon_button_with_location(const char *file, int line, UIConstraints *c
   return false;
 }
 
+f32 draw_slider_with_location(const char *file, int line, UIConstraints *constraints, f32 value, UiStyle style, ButtonState state) {
+  UiIdHash hash = core_fnv_hash32(file, strlen(file), CORE_FNV_HASH32_INIT);
+  hash = core_fnv_hash32(&line, sizeof(line), hash);
+
+  Rect rect = {0};
+
+  apply_constraints(constraints, &rect.pos, &rect.size);
+  apply_alignment(style.align, constraints, &rect.pos, rect.size);
+
+  bool is_hovered = inside_rect(&rect, &zephr_ctx->mouse.pos);
+  bool left_mouse_pressed = zephr_ctx->mouse.pressed && zephr_ctx->mouse.button == ZEPHR_MOUSE_BUTTON_LEFT;
+  bool left_mouse_released = zephr_ctx->mouse.released && zephr_ctx->mouse.button == ZEPHR_MOUSE_BUTTON_LEFT;
+
+  if (zephr_ctx->ui.active_element == 0) {
+    if (is_hovered && left_mouse_pressed && state == BUTTON_STATE_ACTIVE) {
+      zephr_ctx->ui.active_element = hash;
+    }
+  } else if (zephr_ctx->ui.active_element == hash) {
+    if (left_mouse_released) {
+      zephr_ctx->ui.active_element = 0;
+    }
+  }
+
+  // the value follows the mouse for as long as the button is held, even off the track
+  if (zephr_ctx->ui.active_element == hash) {
+    value = (zephr_ctx->mouse.pos.x - rect.pos.x) / rect.size.width;
+  }
+  value = CORE_CLAMP(value, 0, 1);
+
+  if (is_hovered && state == BUTTON_STATE_ACTIVE) {
+    zephr_set_cursor(ZEPHR_CURSOR_HAND);
+  } else if (state == BUTTON_STATE_DISABLED) {
+    if (is_hovered) {
+      zephr_set_cursor(ZEPHR_CURSOR_DISABLED);
+    }
+
+    style.fg_color.a = 100;
+    style.bg_color.a = 100;
+  }
+
+  // track
+  draw_quad(constraints, style);
+
+  UiStyle fill_style = {
+    .bg_color = style.fg_color,
+    .border_radius = style.border_radius,
+    .align = ALIGN_TOP_LEFT,
+  };
+  UIConstraints fill_con = default_constraints;
+  set_parent_constraint(&fill_con, constraints);
+  set_x_constraint(&fill_con, 0, UI_CONSTRAINT_FIXED);
+  set_y_constraint(&fill_con, 0, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&fill_con, constraints->width * value, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&fill_con, constraints->height, UI_CONSTRAINT_FIXED);
+  draw_quad(&fill_con, fill_style);
+
+  // knob
+  f32 knob_size = constraints->height * 1.8f;
+  UIConstraints knob_con = default_constraints;
+  set_parent_constraint(&knob_con, constraints);
+  set_x_constraint(&knob_con, constraints->width * value - knob_size / 2.f, UI_CONSTRAINT_FIXED);
+  set_y_constraint(&knob_con, (constraints->height - knob_size) / 2.f, UI_CONSTRAINT_FIXED);
+  set_width_constraint(&knob_con, knob_size, UI_CONSTRAINT_FIXED);
+  set_height_constraint(&knob_con, knob_size, UI_CONSTRAINT_FIXED);
+  draw_circle(&knob_con, fill_style);
+
+  return value;
+}
+
 #define draw_color_picker_slider(constraints, align) draw_color_picker_slider_with_location(__FILE__, __LINE__, constraints, align)
 
 f32 draw_color_picker_slider_with_location(const char *file, int line, UIConstraints *constraints, Alignment align) {
@@ -542,6 +664,7 @@ f32 draw_color_picker_slider_with_location(const char *file, int line, UIConstra
   UiIdHash hash = core_fnv_hash32(file, strlen(file), CORE_FNV_HASH32_INIT);
   hash = core_fnv_hash32(&line, sizeof(line), hash);
 
+  flush_quad_batch();
   use_shader(color_chooser_shader);
 
   set_bool(color_chooser_shader, "isSlider", true);
@@ -637,6 +760,7 @@ Color draw_color_picker_canvas_with_location(const char* file, int line, UIConst
   UiIdHash hash = core_fnv_hash32(file, strlen(file), CORE_FNV_HASH32_INIT);
   hash = core_fnv_hash32(&line, sizeof(line), hash);
 
+  flush_quad_batch();
   use_shader(color_chooser_shader);
 
   set_bool(color_chooser_shader, "isSlider", false);
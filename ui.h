@@ -63,6 +63,24 @@ typedef struct UiStyle {
   Alignment align;
 } UiStyle;
 
+typedef struct QuadInstance {
+  Vec4f shape; // width, height, border radius, 1 if textured
+  Colorf color;
+  Vec4f tex_rect; // part of the texture drawn, in texture coordinates
+  float model[4][4];
+} QuadInstance;
+
+// Quads, circles and textures queued since the last flush, drawn together by
+// a single instanced call. Anything else drawing flushes the batch first so
+// the order of the draws is kept.
+typedef struct QuadBatch {
+  QuadInstance *data;
+  u32 size;
+  u32 capacity;
+  // texture of the textured quads queued, 0 while there's none
+  TextureId texture_id;
+} QuadBatch;
+
 int init_ui(const char* font_path);
 void set_parent_constraint(UIConstraints *constraints, UIConstraints *parent_constraints);
 void set_x_constraint(UIConstraints *constraints, float value, UIConstraint type);
@@ -76,12 +94,17 @@ bool inside_rect(Rect *rect, Vec2 *point);
 void draw_quad(UIConstraints *constraints, const UiStyle style);
 void draw_circle(UIConstraints *constraints, const UiStyle style);
 void draw_triangle(UIConstraints *constraints, const UiStyle style);
+// Draws the queued quads. Called before other draws and at the end of a frame.
+void flush_quad_batch(void);
 bool draw_button_with_location(const char* file, int line, UIConstraints *constraints, const char *text, UiStyle style, ButtonState state);
 bool draw_icon_button_with_location(const char* file, int line, UIConstraints *constraints, const TextureId icon_tex_id, UiStyle style, ButtonState state);
+// Horizontal slider over [0, 1]. Returns `value`, or where the track is being dragged to.
+f32 draw_slider_with_location(const char* file, int line, UIConstraints *constraints, f32 value, UiStyle style, ButtonState state);
 void draw_color_picker_popup(UIConstraints *picker_button_con);
 void draw_color_picker_with_location_and_id(u32 id, const char *file, int line, UIConstraints *constraints, Color *color, Alignment align, ButtonState state);
 
 #define draw_button(constraints, text, style, state) draw_button_with_location(__FILE__, __LINE__, constraints, text, style, state)
 #define draw_icon_button(constraints, icon_tex_id, style, state) draw_icon_button_with_location(__FILE__, __LINE__, constraints, icon_tex_id, style, state)
+#define draw_slider(constraints, value, style, state) draw_slider_with_location(__FILE__, __LINE__, constraints, value, style, state)
 #define draw_color_picker(constraints, color, align, state) draw_color_picker_with_location_and_id(0, __FILE__, __LINE__, constraints, color, align, state)
 #define draw_color_picker_with_id(id, constraints, color, align, state) draw_color_picker_with_location_and_id(id, __FILE__, __LINE__, constraints, color, align, state)
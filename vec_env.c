@@ -0,0 +1,141 @@
+#include <stdlib.h>
+
+#include "board.h"
+#include "vec_env.h"
+
+struct VecEnv {
+  u32 count;
+  Board *boards;
+  Rng *rngs;
+  u32 *scores;
+  u32 *lengths;
+  VecEnvBuffers out;
+};
+
+static void write_observation(VecEnv *env, u32 i, u8 legal) {
+  Board b = env->boards[i];
+  u8 *obs = env->out.observations + (u64)i * VEC_ENV_OBSERVATION_SIZE;
+
+  for (u8 tile = 0; tile < 16; tile++) {
+    obs[tile] = (b >> (tile * 4)) & 0xF;
+  }
+
+  if (env->out.legal_moves) {
+    env->out.legal_moves[i] = legal;
+  }
+  if (env->out.boards) {
+    env->out.boards[i] = b;
+  }
+}
+
+static void start_game(VecEnv *env, u32 i) {
+  env->boards[i] = board_new_game(&env->rngs[i]);
+  env->scores[i] = 0;
+  env->lengths[i] = 0;
+}
+
+u32 vec_env_abi_version(void) {
+  return VEC_ENV_ABI_VERSION;
+}
+
+VecEnv *vec_env_create(u32 count, u64 seed) {
+  board_init_tables();
+
+  VecEnv *env = calloc(1, sizeof(VecEnv));
+  env->count = count;
+  env->boards = calloc(count, sizeof(Board));
+  env->rngs = calloc(count, sizeof(Rng));
+  env->scores = calloc(count, sizeof(u32));
+  env->lengths = calloc(count, sizeof(u32));
+
+  // every env gets its own stream derived from the seed so results don't
+  // depend on how the envs are batched
+  Rng seeder;
+  rng_seed(&seeder, seed);
+  for (u32 i = 0; i < count; i++) {
+    rng_seed(&env->rngs[i], rng_next(&seeder));
+    start_game(env, i);
+  }
+
+  return env;
+}
+
+void vec_env_destroy(VecEnv *env) {
+  if (!env) return;
+
+  free(env->boards);
+  free(env->rngs);
+  free(env->scores);
+  free(env->lengths);
+  free(env);
+}
+
+u32 vec_env_count(const VecEnv *env) {
+  return env->count;
+}
+
+void vec_env_bind(VecEnv *env, const VecEnvBuffers *buffers) {
+  CORE_ASSERT(buffers->observations && buffers->rewards && buffers->dones,
+      "vec_env_bind() requires the observations, rewards and dones buffers");
+
+  env->out = *buffers;
+}
+
+void vec_env_reset(VecEnv *env) {
+  CORE_DEBUG_ASSERT(env->out.observations, "vec_env_bind() must be called before vec_env_reset()");
+
+  for (u32 i = 0; i < env->count; i++) {
+    start_game(env, i);
+    write_observation(env, i, board_legal_moves(env->boards[i]));
+    env->out.rewards[i] = 0;
+    env->out.dones[i] = 0;
+  }
+}
+
+bool vec_env_step(VecEnv *env, const u8 *actions) {
+  CORE_DEBUG_ASSERT(env->out.observations, "vec_env_bind() must be called before vec_env_step()");
+
+  // checked before anything moves, so a bad batch leaves every env as it was
+  for (u32 i = 0; i < env->count; i++) {
+    if (actions[i] >= MOVE_DIR_COUNT) return false;
+  }
+
+  for (u32 i = 0; i < env->count; i++) {
+    Board before = env->boards[i];
+    u32 gained = 0;
+    Board after = board_move(before, (MoveDir)actions[i], &gained);
+
+    if (after == before) {
+      env->out.rewards[i] = 0;
+      env->out.dones[i] = 0;
+      write_observation(env, i, board_legal_moves(before));
+      continue;
+    }
+
+    after = board_spawn_random_tile(after, &env->rngs[i]);
+    env->boards[i] = after;
+    env->scores[i] += gained;
+    env->lengths[i]++;
+    env->out.rewards[i] = (f32)gained;
+
+    u8 legal = board_legal_moves(after);
+    if (legal == 0) {
+      env->out.dones[i] = 1;
+      if (env->out.episode_scores) {
+        env->out.episode_scores[i] = env->scores[i];
+      }
+      if (env->out.episode_lengths) {
+        env->out.episode_lengths[i] = env->lengths[i];
+      }
+
+      start_game(env, i);
+      legal = board_legal_moves(env->boards[i]);
+    } else {
+      env->out.dones[i] = 0;
+    }
+
+    write_observation(env, i, legal);
+  }
+
+  return true;
+}
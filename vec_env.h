@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core.h"
+
+// Vectorized environment for reinforcement learning.
+//
+// A VecEnv steps `count` games at once. Results are written straight into
+// contiguous arrays owned by the caller (e.g. numpy arrays handed over through
+// ctypes), which are bound once with vec_env_bind() and then reused for every
+// step, so stepping never allocates or copies observations around.
+//
+// Games that end during a step are reset right away: their `dones` entry is
+// set, `episode_scores`/`episode_lengths` hold the stats of the finished game
+// and `observations` already holds the first state of the next one.
+//
+// Actions are MoveDir values. An action that doesn't move any tile is a no-op
+// with a reward of 0, use `legal_moves` to mask those out.
+
+#define VEC_ENV_ABI_VERSION 2
+#define VEC_ENV_OBSERVATION_SIZE 16
+
+typedef struct VecEnv VecEnv;
+
+typedef struct VecEnvBuffers {
+  u8 *observations;     // count * VEC_ENV_OBSERVATION_SIZE tile exponents, row major
+  f32 *rewards;         // count, score gained by the step
+  u8 *dones;            // count, 1 when the step ended the game
+  u8 *legal_moves;      // count, optional, bit `1 << dir` set for every legal action
+  u64 *boards;          // count, optional, observations as packed boards
+  u32 *episode_scores;  // count, optional, only written for finished games
+  u32 *episode_lengths; // count, optional, only written for finished games
+} VecEnvBuffers;
+
+u32 vec_env_abi_version(void);
+VecEnv *vec_env_create(u32 count, u64 seed);
+void vec_env_destroy(VecEnv *env);
+u32 vec_env_count(const VecEnv *env);
+void vec_env_bind(VecEnv *env, const VecEnvBuffers *buffers);
+// starts a new game on every env and writes the observations
+void vec_env_reset(VecEnv *env);
+// `actions` holds one action per env. False, with no env stepped, if any of
+// them isn't a MoveDir.
+bool vec_env_step(VecEnv *env, const u8 *actions);
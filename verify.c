@@ -0,0 +1,454 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "record.h"
+#include "replay.h"
+#include "timer.h"
+
+// Re-simulates every game of game record files (record.h) and replays
+// (replay.h) and checks that each move is legal, that the score is the one
+// recorded, that the game ends lost and that the keyframes of replays are the
+// positions they claim to be.
+//
+// Files are mapped rather than read and games are verified in place, so the
+// heap only holds the list of chunks to verify. Entropy coded records are
+// decoded one at a time into a buffer of the thread. A record file is cut into
+// chunks of VERIFY_CHUNK_GAMES games by a first pass over the record headers,
+// threads then take chunks one at a time.
+//
+// Every divergence is printed as
+//
+//   <file>: game <index> move <move>: <reason>
+//
+// sorted by file and game, the index counting from 0 in its file.
+
+#define VERIFY_CHUNK_GAMES 1024
+#define VERIFY_REASON_LEN 96
+
+typedef enum CorpusKind {
+  CORPUS_RECORDS,
+  CORPUS_REPLAY,
+} CorpusKind;
+
+typedef struct Corpus {
+  const char *path;
+  CorpusKind kind;
+  // of record files
+  RecordCodec codec;
+  const u8 *data;
+  u64 size;
+} Corpus;
+
+typedef struct Chunk {
+  u32 corpus;
+  u32 game_count;
+  u64 first_game;
+  // of the first game
+  u64 offset;
+} Chunk;
+
+typedef struct Divergence {
+  u32 corpus;
+  u32 move;
+  u64 game;
+  char reason[VERIFY_REASON_LEN];
+} Divergence;
+
+typedef struct Verifier {
+  Corpus *corpora;
+  u32 corpus_count;
+  u32 thread_count;
+  bool allow_unfinished;
+
+  Chunk *chunks;
+  u32 chunk_count;
+  u32 chunk_cap;
+  u32 next_chunk;
+
+  pthread_mutex_t lock;
+  Divergence *divergences;
+  u64 divergence_count;
+  u64 divergence_cap;
+  u64 games;
+  u64 moves;
+} Verifier;
+
+Verifier verifier = {0};
+
+void add_chunk(Chunk chunk) {
+  if (verifier.chunk_count >= verifier.chunk_cap) {
+    verifier.chunk_cap = verifier.chunk_cap ? verifier.chunk_cap * 2 : 256;
+    Chunk *temp = realloc(verifier.chunks, verifier.chunk_cap * sizeof(Chunk));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for chunks\n");
+      exit(1);
+    }
+    verifier.chunks = temp;
+  }
+
+  verifier.chunks[verifier.chunk_count++] = chunk;
+}
+
+__attribute__((format(printf, 4, 5)))
+void add_divergence(u32 corpus, u64 game, u32 move, const char *fmt, ...) {
+  Divergence divergence = {.corpus = corpus, .game = game, .move = move};
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(divergence.reason, sizeof(divergence.reason), fmt, args);
+  va_end(args);
+
+  pthread_mutex_lock(&verifier.lock);
+  if (verifier.divergence_count >= verifier.divergence_cap) {
+    verifier.divergence_cap = verifier.divergence_cap ? verifier.divergence_cap * 2 : 64;
+    Divergence *temp = realloc(verifier.divergences, verifier.divergence_cap * sizeof(Divergence));
+    if (!temp) {
+      printf("[FATAL] Failed to reallocate memory for divergences\n");
+      exit(1);
+    }
+    verifier.divergences = temp;
+  }
+  verifier.divergences[verifier.divergence_count++] = divergence;
+  pthread_mutex_unlock(&verifier.lock);
+}
+
+///////////////////////////////////
+//
+//
+// Verification
+//
+//
+///////////////////////////////////
+
+// The keyframe section of a replay, still encoded.
+typedef struct KeyframeView {
+  const u8 *data;
+  u32 interval;
+  u32 count;
+} KeyframeView;
+
+bool check_keyframe(const KeyframeView *keyframes, u32 move, Board b, Rng rng, u32 score) {
+  if (!keyframes || move % keyframes->interval != 0) return true;
+
+  ReplayKeyframe keyframe;
+  replay_decode_keyframe(keyframes->data + (u64)(move / keyframes->interval) * REPLAY_KEYFRAME_SIZE, &keyframe);
+  return keyframe.board == b && keyframe.rng.state == rng.state && keyframe.score == score;
+}
+
+// Replays the game and adds the first divergence from what the record
+// claims. `keyframes` may be NULL.
+void verify_game(u32 corpus, u64 game, const GameRecord *record, const KeyframeView *keyframes) {
+  Rng rng;
+  rng_seed(&rng, record->seed);
+  Board b = board_new_game(&rng);
+  u32 score = 0;
+
+  for (u32 i = 0; i < record->move_count; i++) {
+    if (!check_keyframe(keyframes, i, b, rng, score)) {
+      add_divergence(corpus, game, i, "keyframe %u isn't the position it claims", i / keyframes->interval);
+      return;
+    }
+
+    MoveDir dir = record_get_move(record, i);
+    Board moved = board_move(b, dir, &score);
+    if (moved == b) {
+      add_divergence(corpus, game, i, "illegal move '%c'", move_dir_to_char(dir));
+      return;
+    }
+    b = board_spawn_random_tile(moved, &rng);
+  }
+
+  if (!check_keyframe(keyframes, record->move_count, b, rng, score)) {
+    add_divergence(corpus, game, record->move_count, "keyframe %u isn't the position it claims",
+        record->move_count / keyframes->interval);
+  } else if (score != record->score) {
+    add_divergence(corpus, game, record->move_count, "score %u, recorded %u", score, record->score);
+  } else if (!verifier.allow_unfinished && board_legal_moves(b) != 0) {
+    add_divergence(corpus, game, record->move_count, "game stops with legal moves left");
+  }
+}
+
+// Returns the number of moves replayed.
+u32 verify_replay(u32 corpus_idx) {
+  const Corpus *corpus = &verifier.corpora[corpus_idx];
+
+  ReplayHeader header;
+  if (corpus->size < REPLAY_HEADER_SIZE || !replay_decode_header(corpus->data, &header)) {
+    add_divergence(corpus_idx, 0, 0, "not a replay of the classic rules");
+    return 0;
+  }
+  if (header.move_count == REPLAY_UNFINISHED) {
+    add_divergence(corpus_idx, 0, 0, "replay was never closed");
+    return 0;
+  }
+
+  u64 move_bytes = ((u64)header.move_count + 3) / 4;
+  u64 end = REPLAY_HEADER_SIZE + move_bytes;
+  if (corpus->size < end) {
+    add_divergence(corpus_idx, 0, 0, "truncated moves");
+    return 0;
+  }
+
+  GameRecord record = {
+    .seed = header.seed,
+    .score = header.score,
+    .move_count = header.move_count,
+    .moves = (u8 *)corpus->data + REPLAY_HEADER_SIZE,
+  };
+
+  // replays from before keyframes end with their moves
+  if (corpus->size == end) {
+    verify_game(corpus_idx, 0, &record, NULL);
+    return record.move_count;
+  }
+
+  KeyframeView keyframes = {0};
+  if (corpus->size >= end + 8) {
+    memcpy(&keyframes.interval, corpus->data + end, 4);
+    memcpy(&keyframes.count, corpus->data + end + 4, 4);
+    keyframes.data = corpus->data + end + 8;
+  }
+  bool keyframes_valid = keyframes.interval != 0 && keyframes.count == header.move_count / keyframes.interval + 1 &&
+    corpus->size - end - 8 == (u64)keyframes.count * REPLAY_KEYFRAME_SIZE;
+  if (!keyframes_valid) {
+    add_divergence(corpus_idx, 0, header.move_count, "malformed keyframe section");
+    return 0;
+  }
+
+  verify_game(corpus_idx, 0, &record, &keyframes);
+  return record.move_count;
+}
+
+void *verify_thread(void *arg) {
+  CORE_UNUSED(arg);
+
+  u64 games = 0;
+  u64 moves = 0;
+  GameRecord decoded;
+  record_init(&decoded, 0);
+
+  for (;;) {
+    u32 chunk_idx = __atomic_fetch_add(&verifier.next_chunk, 1, __ATOMIC_RELAXED);
+    if (chunk_idx >= verifier.chunk_count) break;
+
+    const Chunk *chunk = &verifier.chunks[chunk_idx];
+    const Corpus *corpus = &verifier.corpora[chunk->corpus];
+
+    if (corpus->kind == CORPUS_REPLAY) {
+      moves += verify_replay(chunk->corpus);
+      games++;
+      continue;
+    }
+
+    // the chunk's records were bounds checked when it was made
+    u64 offset = chunk->offset;
+    for (u32 i = 0; i < chunk->game_count; i++) {
+      const u8 *data = corpus->data + offset;
+      u64 size = corpus->size - offset;
+      offset += record_file_record_size(corpus->codec, data, size);
+
+      GameRecord view;
+      const GameRecord *record = &view;
+      if (corpus->codec == RECORD_CODEC_PACKED) {
+        record_view(&view, data, size);
+      } else if (record_file_decode(corpus->codec, &decoded, data, size)) {
+        record = &decoded;
+      } else {
+        add_divergence(chunk->corpus, chunk->first_game + i, 0, "moves don't decode");
+        continue;
+      }
+
+      verify_game(chunk->corpus, chunk->first_game + i, record, NULL);
+      moves += record->move_count;
+    }
+    games += chunk->game_count;
+  }
+  record_free(&decoded);
+
+  __atomic_fetch_add(&verifier.games, games, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&verifier.moves, moves, __ATOMIC_RELAXED);
+
+  return NULL;
+}
+
+///////////////////////////////////
+//
+//
+// Corpora
+//
+//
+///////////////////////////////////
+
+bool map_corpus(Corpus *corpus, const char *path) {
+  corpus->path = path;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("[ERROR]: could not open \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 8) {
+    printf("[ERROR]: \"%s\" is neither a game record file nor a replay\n", path);
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("[ERROR]: could not map \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+  // every thread reads its chunks front to back
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  corpus->data = data;
+  corpus->size = st.st_size;
+
+  u32 version;
+  memcpy(&version, corpus->data + 4, 4);
+  if (memcmp(corpus->data, RECORD_FILE_MAGIC, 4) == 0 && (version == RECORD_CODEC_PACKED || version == RECORD_CODEC_RANS)) {
+    corpus->kind = CORPUS_RECORDS;
+    corpus->codec = version;
+  } else if (memcmp(corpus->data, REPLAY_MAGIC, 4) == 0) {
+    corpus->kind = CORPUS_REPLAY;
+  } else {
+    printf("[ERROR]: \"%s\" is neither a game record file nor a replay\n", path);
+    munmap((void *)corpus->data, corpus->size);
+    return false;
+  }
+
+  return true;
+}
+
+// Cuts a record file into chunks, reading only the record headers.
+void add_record_chunks(u32 corpus_idx) {
+  const Corpus *corpus = &verifier.corpora[corpus_idx];
+  Chunk chunk = {.corpus = corpus_idx, .offset = 8};
+  u64 offset = chunk.offset;
+
+  while (offset < corpus->size) {
+    u64 size = record_file_record_size(corpus->codec, corpus->data + offset, corpus->size - offset);
+    if (size == 0) {
+      add_divergence(corpus_idx, chunk.first_game + chunk.game_count, 0, "truncated record");
+      break;
+    }
+    offset += size;
+
+    if (++chunk.game_count == VERIFY_CHUNK_GAMES) {
+      add_chunk(chunk);
+      chunk = (Chunk){.corpus = corpus_idx, .first_game = chunk.first_game + chunk.game_count, .offset = offset};
+    }
+  }
+
+  if (chunk.game_count > 0) {
+    add_chunk(chunk);
+  }
+}
+
+int compare_divergences(const void *a, const void *b) {
+  const Divergence *da = a;
+  const Divergence *db = b;
+  if (da->corpus != db->corpus) return da->corpus < db->corpus ? -1 : 1;
+  if (da->game != db->game) return da->game < db->game ? -1 : 1;
+  return (da->move > db->move) - (da->move < db->move);
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options] <file>...\n"
+      "\n"
+      "Replays every game of game record files and replays and reports where they\n"
+      "diverge from what they claim. Exits with 1 if any does.\n"
+      "\n"
+      "options:\n"
+      "  -j <count>  worker threads (default: number of cores)\n"
+      "  -a          accept games that stop before they are lost\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+  verifier.thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:ah")) != -1) {
+    switch (opt) {
+      case 'j':
+        verifier.thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      case 'a':
+        verifier.allow_unfinished = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind >= argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  board_init_tables();
+  start_internal_timer();
+  pthread_mutex_init(&verifier.lock, NULL);
+
+  verifier.corpus_count = (u32)(argc - optind);
+  verifier.corpora = calloc(verifier.corpus_count, sizeof(Corpus));
+  for (u32 i = 0; i < verifier.corpus_count; i++) {
+    if (!map_corpus(&verifier.corpora[i], argv[optind + i])) return 1;
+
+    if (verifier.corpora[i].kind == CORPUS_REPLAY) {
+      add_chunk((Chunk){.corpus = i, .game_count = 1});
+    } else {
+      add_record_chunks(i);
+    }
+  }
+
+  pthread_t *threads = malloc(verifier.thread_count * sizeof(pthread_t));
+  for (u32 i = 0; i < verifier.thread_count; i++) {
+    pthread_create(&threads[i], NULL, verify_thread, NULL);
+  }
+  for (u32 i = 0; i < verifier.thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  f64 elapsed = get_time();
+
+  qsort(verifier.divergences, verifier.divergence_count, sizeof(Divergence), compare_divergences);
+  for (u64 i = 0; i < verifier.divergence_count; i++) {
+    Divergence *d = &verifier.divergences[i];
+    printf("%s: game %llu move %u: %s\n", verifier.corpora[d->corpus].path, (unsigned long long)d->game, d->move,
+        d->reason);
+  }
+
+  fprintf(stderr, "%llu games, %llu moves in %.2fs (%.0f games/s), %llu diverging\n",
+      (unsigned long long)verifier.games, (unsigned long long)verifier.moves, elapsed,
+      elapsed > 0 ? (f64)verifier.games / elapsed : 0.0, (unsigned long long)verifier.divergence_count);
+
+  for (u32 i = 0; i < verifier.corpus_count; i++) {
+    munmap((void *)verifier.corpora[i].data, verifier.corpora[i].size);
+  }
+  free(verifier.corpora);
+  free(verifier.chunks);
+  free(verifier.divergences);
+
+  return verifier.divergence_count ? 1 : 0;
+}
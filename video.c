@@ -0,0 +1,129 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "video.h"
+
+static bool has_suffix(const char *s, const char *suffix) {
+  size_t len = strlen(s);
+  size_t suffix_len = strlen(suffix);
+  return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+bool video_open(VideoWriter *writer, const char *path, u32 width, u32 height, u32 fps) {
+  memset(writer, 0, sizeof(*writer));
+  writer->width = width;
+  writer->height = height;
+
+  bool to_stdout = strcmp(path, "-") == 0;
+  writer->format = to_stdout || has_suffix(path, ".y4m") ? VIDEO_FORMAT_Y4M : VIDEO_FORMAT_RGBA;
+  if (to_stdout) {
+    // the video gets the real stdout to itself, what's printed from now on
+    // goes to stderr
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    writer->fp = fd >= 0 && dup2(STDERR_FILENO, STDOUT_FILENO) >= 0 ? fdopen(fd, "wb") : NULL;
+  } else {
+    writer->fp = fopen(path, "wb");
+  }
+  if (!writer->fp) {
+    printf("[ERROR]: could not create \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+
+  u64 frame_size = (u64)width * height * 4;
+  if (writer->format == VIDEO_FORMAT_Y4M) {
+    frame_size = (u64)width * height + 2 * (u64)((width + 1) / 2) * ((height + 1) / 2);
+    if (fprintf(writer->fp, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, fps) < 0) {
+      printf("[ERROR]: could not write to \"%s\"\n", path);
+      video_close(writer);
+      return false;
+    }
+  }
+
+  writer->buf = malloc(frame_size);
+  if (!writer->buf) {
+    printf("[FATAL] Failed to allocate memory for a video frame\n");
+    exit(1);
+  }
+
+  return true;
+}
+
+// Full range BT.601 in 16.16 fixed point. Chroma is taken from the average
+// of each 2x2 block.
+static void rgba_to_yuv420(const VideoWriter *writer, const u8 *rgba, u8 *out) {
+  u32 w = writer->width;
+  u32 h = writer->height;
+  u32 chroma_w = (w + 1) / 2;
+  u32 chroma_h = (h + 1) / 2;
+  u8 *y_plane = out;
+  u8 *u_plane = out + (u64)w * h;
+  u8 *v_plane = u_plane + (u64)chroma_w * chroma_h;
+
+  for (u32 y = 0; y < h; y++) {
+    const u8 *row = rgba + (u64)(h - 1 - y) * w * 4;
+    u8 *luma = y_plane + (u64)y * w;
+    for (u32 x = 0; x < w; x++) {
+      const u8 *p = row + x * 4;
+      luma[x] = (u8)((19595 * p[0] + 38470 * p[1] + 7471 * p[2] + 32768) >> 16);
+    }
+  }
+
+  for (u32 cy = 0; cy < chroma_h; cy++) {
+    // the last row and column of odd sizes are averaged with themselves
+    u32 y0 = cy * 2;
+    u32 y1 = CORE_MIN(y0 + 1, h - 1);
+    const u8 *row0 = rgba + (u64)(h - 1 - y0) * w * 4;
+    const u8 *row1 = rgba + (u64)(h - 1 - y1) * w * 4;
+    for (u32 cx = 0; cx < chroma_w; cx++) {
+      u32 x0 = cx * 2 * 4;
+      u32 x1 = CORE_MIN(cx * 2 + 1, w - 1) * 4;
+      i32 r = row0[x0] + row0[x1] + row1[x0] + row1[x1];
+      i32 g = row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1];
+      i32 b = row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2];
+
+      // sums of 4 pixels, hence the 18 bit shift
+      i32 u = (-11059 * r - 21709 * g + 32768 * b + (128 << 18) + (1 << 17)) >> 18;
+      i32 v = (32768 * r - 27439 * g - 5329 * b + (128 << 18) + (1 << 17)) >> 18;
+      u_plane[(u64)cy * chroma_w + cx] = (u8)CORE_CLAMP(u, 0, 255);
+      v_plane[(u64)cy * chroma_w + cx] = (u8)CORE_CLAMP(v, 0, 255);
+    }
+  }
+}
+
+bool video_write_frame(VideoWriter *writer, const u8 *rgba) {
+  u32 w = writer->width;
+  u32 h = writer->height;
+  u64 size;
+
+  if (writer->format == VIDEO_FORMAT_Y4M) {
+    rgba_to_yuv420(writer, rgba, writer->buf);
+    size = (u64)w * h + 2 * (u64)((w + 1) / 2) * ((h + 1) / 2);
+    if (fputs("FRAME\n", writer->fp) < 0) return false;
+  } else {
+    // flipped to top row first, blending leaves the alpha of the framebuffer
+    // meaningless so it's made opaque
+    for (u32 y = 0; y < h; y++) {
+      u8 *row = writer->buf + (u64)y * w * 4;
+      memcpy(row, rgba + (u64)(h - 1 - y) * w * 4, (u64)w * 4);
+      for (u32 x = 0; x < w; x++) {
+        row[x * 4 + 3] = 255;
+      }
+    }
+    size = (u64)w * h * 4;
+  }
+
+  writer->frames++;
+  return fwrite(writer->buf, size, 1, writer->fp) == 1;
+}
+
+bool video_close(VideoWriter *writer) {
+  bool ok = !writer->fp || fclose(writer->fp) == 0;
+
+  free(writer->buf);
+  memset(writer, 0, sizeof(*writer));
+
+  return ok;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "core.h"
+
+// Uncompressed video output, for piping rendered frames into an encoder.
+//
+// Two formats, picked by the path:
+//   - Y4M (a path ending in ".y4m", or "-" for stdout): YUV 4:2:0 with full
+//     range BT.601 colors, flagged with XCOLORRANGE=FULL in the header so
+//     ffmpeg doesn't take them for limited range. When writing to stdout
+//     everything else printed goes to stderr instead.
+//   - raw RGBA otherwise, 4 bytes per pixel top row first with no header, the
+//     size and frame rate have to be given to whatever reads it
+
+typedef enum VideoFormat {
+  VIDEO_FORMAT_Y4M,
+  VIDEO_FORMAT_RGBA,
+} VideoFormat;
+
+typedef struct VideoWriter {
+  FILE *fp;
+  VideoFormat format;
+  u32 width;
+  u32 height;
+  // a converted frame
+  u8 *buf;
+  u64 frames;
+} VideoWriter;
+
+bool video_open(VideoWriter *writer, const char *path, u32 width, u32 height, u32 fps);
+// `rgba` holds the frame bottom row first, as GL reads it back.
+bool video_write_frame(VideoWriter *writer, const u8 *rgba);
+// False if the last frames couldn't be written.
+bool video_close(VideoWriter *writer);
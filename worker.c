@@ -0,0 +1,279 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "distrib.h"
+#include "player.h"
+#include "record.h"
+#include "timer.h"
+
+// Connects to c2048-coordinator, plays the games of every job it is given and
+// sends them back as game records. Exits once the coordinator has no more
+// jobs or goes away.
+
+#define WORKER_CONNECT_TIMEOUT 10.0
+
+typedef struct Job {
+  u32 id;
+  u64 first_seed;
+  u32 game_count;
+  PlayerKind player_kind;
+  u32 model_version;
+} Job;
+
+typedef struct SelfPlayWorker {
+  DistribConn conn;
+  u32 thread_count;
+
+  PolicyModel *policy;
+  u32 policy_version;
+
+  Job job;
+  GameRecord *records;
+  u32 next_game;
+} SelfPlayWorker;
+
+SelfPlayWorker worker = {0};
+
+///////////////////////////////////
+//
+//
+// Games
+//
+//
+///////////////////////////////////
+
+void play_game(u32 game_idx) {
+  u64 seed = worker.job.first_seed + game_idx;
+  Player player;
+  player_init(&player, worker.job.player_kind, seed);
+  player.policy = worker.policy;
+
+  GameRecord *record = &worker.records[game_idx];
+  record_init(record, seed);
+
+  Rng rng;
+  rng_seed(&rng, seed);
+  Board b = board_new_game(&rng);
+
+  while (!board_is_game_over(b)) {
+    MoveDir dir = player_choose_move(&player, b);
+    Board moved = board_move(b, dir, &record->score);
+    record_add_move(record, dir);
+    b = board_spawn_random_tile(moved, &rng);
+  }
+
+  player_deinit(&player);
+}
+
+void *play_thread(void *arg) {
+  CORE_UNUSED(arg);
+
+  for (;;) {
+    u32 game_idx = __atomic_fetch_add(&worker.next_game, 1, __ATOMIC_RELAXED);
+    if (game_idx >= worker.job.game_count) break;
+    play_game(game_idx);
+  }
+
+  return NULL;
+}
+
+void play_job(void) {
+  worker.records = calloc(CORE_MAX(1, worker.job.game_count), sizeof(GameRecord));
+  worker.next_game = 0;
+
+  pthread_t *threads = malloc(worker.thread_count * sizeof(pthread_t));
+  for (u32 i = 0; i < worker.thread_count; i++) {
+    pthread_create(&threads[i], NULL, play_thread, NULL);
+  }
+  for (u32 i = 0; i < worker.thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+///////////////////////////////////
+//
+//
+// Protocol
+//
+//
+///////////////////////////////////
+
+// Waits for the model of the current job, false if it can't be had.
+bool fetch_model(void) {
+  DistribWriter msg = {0};
+  distrib_put_u32(&msg, worker.job.model_version);
+  bool sent = distrib_send(&worker.conn, DISTRIB_MSG_MODEL_REQUEST, msg.data, msg.size);
+  distrib_writer_free(&msg);
+  if (!sent) return false;
+
+  DistribMessage reply;
+  if (!distrib_receive(&worker.conn, &reply) || reply.type != DISTRIB_MSG_MODEL) return false;
+
+  DistribReader reader;
+  distrib_reader_init(&reader, &reply);
+  u32 version = distrib_get_u32(&reader);
+  u32 size = reader.size - reader.pos;
+  const u8 *data = distrib_get(&reader, size);
+  if (!reader.ok || version != worker.job.model_version) return false;
+
+  if (!worker.policy) {
+    worker.policy = malloc(sizeof(PolicyModel));
+  }
+  if (!policy_load_memory(worker.policy, data, size)) {
+    printf("[ERROR]: received an invalid model (version %u)\n", version);
+    return false;
+  }
+  worker.policy_version = version;
+
+  return true;
+}
+
+bool send_result(void) {
+  DistribWriter msg = {0};
+  distrib_put_u32(&msg, worker.job.id);
+  distrib_put_u32(&msg, worker.job.game_count);
+  for (u32 i = 0; i < worker.job.game_count; i++) {
+    GameRecord *record = &worker.records[i];
+    record_encode(record, distrib_reserve(&msg, (u32)record_encoded_size(record)));
+    record_free(record);
+  }
+  free(worker.records);
+  worker.records = NULL;
+
+  bool sent = distrib_send(&worker.conn, DISTRIB_MSG_RESULT, msg.data, msg.size);
+  distrib_writer_free(&msg);
+  return sent;
+}
+
+bool handle_job(const DistribMessage *msg) {
+  DistribReader reader;
+  distrib_reader_init(&reader, msg);
+  worker.job.id = distrib_get_u32(&reader);
+  worker.job.first_seed = distrib_get_u64(&reader);
+  worker.job.game_count = distrib_get_u32(&reader);
+  worker.job.player_kind = distrib_get_u8(&reader);
+  worker.job.model_version = distrib_get_u32(&reader);
+  if (!reader.ok || worker.job.player_kind >= PLAYER_KIND_COUNT) {
+    printf("[ERROR]: malformed job\n");
+    return false;
+  }
+
+  if (worker.job.player_kind == PLAYER_POLICY && worker.job.model_version != worker.policy_version) {
+    if (worker.job.model_version == 0 || !fetch_model()) {
+      printf("[ERROR]: could not get model version %u\n", worker.job.model_version);
+      return false;
+    }
+  }
+
+  f64 start = get_time();
+  play_job();
+  printf("[INFO] job %u: %u games from seed %llu in %.2fs\n", worker.job.id, worker.job.game_count,
+      (unsigned long long)worker.job.first_seed, get_time() - start);
+
+  return send_result();
+}
+
+int connect_to_coordinator(const char *address) {
+  f64 give_up = get_time() + WORKER_CONNECT_TIMEOUT;
+  for (;;) {
+    int fd = distrib_connect(address);
+    if (fd >= 0 || get_time() > give_up) return fd;
+    // the coordinator may still be starting
+    usleep(200 * 1000);
+  }
+}
+
+///////////////////////////////////
+//
+//
+// Main
+//
+//
+///////////////////////////////////
+
+void print_usage(const char *prog) {
+  printf("usage: %s [options]\n"
+      "\n"
+      "options:\n"
+      "  -c <addr>   coordinator to connect to (default %s)\n"
+      "  -n <name>   name reported to the coordinator (default: hostname and pid)\n"
+      "  -j <count>  threads playing games (default: number of cores)\n", prog, DISTRIB_DEFAULT_ADDRESS);
+}
+
+int main(int argc, char *argv[]) {
+  const char *address = DISTRIB_DEFAULT_ADDRESS;
+  char name[64] = {0};
+  worker.thread_count = (u32)CORE_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:n:j:h")) != -1) {
+    switch (opt) {
+      case 'c':
+        address = optarg;
+        break;
+      case 'n':
+        snprintf(name, sizeof(name), "%s", optarg);
+        break;
+      case 'j':
+        worker.thread_count = CORE_MAX(1, (u32)strtoul(optarg, NULL, 10));
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (name[0] == '\0') {
+    char host[32] = "worker";
+    gethostname(host, sizeof(host) - 1);
+    snprintf(name, sizeof(name), "%s:%d", host, (int)getpid());
+  }
+
+  board_init_tables();
+  start_internal_timer();
+
+  int fd = connect_to_coordinator(address);
+  if (fd < 0) {
+    printf("[ERROR]: could not connect to %s\n", address);
+    return 1;
+  }
+  distrib_conn_init(&worker.conn, fd);
+
+  DistribWriter hello = {0};
+  distrib_put_u32(&hello, DISTRIB_PROTOCOL_VERSION);
+  distrib_put_u32(&hello, (u32)strlen(name));
+  distrib_put(&hello, name, (u32)strlen(name));
+  bool ok = distrib_send(&worker.conn, DISTRIB_MSG_HELLO, hello.data, hello.size);
+  distrib_writer_free(&hello);
+
+  u32 jobs_done = 0;
+  while (ok) {
+    DistribMessage msg;
+    if (!distrib_receive(&worker.conn, &msg)) {
+      printf("[ERROR]: lost the connection to the coordinator\n");
+      ok = false;
+      break;
+    }
+
+    if (msg.type == DISTRIB_MSG_DONE) break;
+    if (msg.type != DISTRIB_MSG_JOB) {
+      printf("[ERROR]: unexpected message %u\n", msg.type);
+      ok = false;
+      break;
+    }
+
+    ok = handle_job(&msg);
+    jobs_done += ok;
+  }
+
+  printf("[INFO] %u jobs done\n", jobs_done);
+
+  distrib_conn_close(&worker.conn);
+  free(worker.policy);
+
+  return ok ? 0 : 1;
+}
@@ -19,6 +19,8 @@ Display *x11_display;
 Window x11_window;
 Colormap x11_colormap;
 GLXContext glx_context;
+// stands in for the window of offscreen contexts
+GLXPbuffer glx_pbuffer;
 /* XIC x11_xic; */
 
 ZephrContext *zephr_ctx = NULL;
@@ -784,12 +786,106 @@ int x11_init(const char* title, int window_width, int window_height, const char
   return res;
 }
 
+// The context is made current on a 1x1 pbuffer, nothing is drawn to it: frames
+// go to framebuffer objects of the requested size, a pbuffer can't be resized
+// and not every driver can multisample one.
+int x11_create_offscreen(int width, int height) {
+  x11_display = XOpenDisplay(NULL);
+  if (!x11_display) {
+    printf("[FATAL] Cannot open x11 display connection\n");
+    return 1;
+  }
+
+  int screen_num = DefaultScreen(x11_display);
+  if (!gladLoaderLoadGLX(x11_display, screen_num)) {
+    printf("[FATAL] Failed to load GLX\n");
+    return 1;
+  }
+
+  GLint fb_attributes[] = {
+    GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT,
+    GLX_RENDER_TYPE, GLX_RGBA_BIT,
+    None
+  };
+
+  int num_fbc = 0;
+  GLXFBConfig *fbc = glXChooseFBConfig(x11_display, screen_num, fb_attributes, &num_fbc);
+  if (!fbc || num_fbc == 0) {
+    printf("[FATAL] No GLX config supports pbuffers\n");
+    return 1;
+  }
+
+  GLint pbuffer_attributes[] = {
+    GLX_PBUFFER_WIDTH, 1,
+    GLX_PBUFFER_HEIGHT, 1,
+    None
+  };
+  glx_pbuffer = glXCreatePbuffer(x11_display, fbc[0], pbuffer_attributes);
+
+  GLint context_attributes[] = {
+    GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+    GLX_CONTEXT_MINOR_VERSION_ARB, 3,
+    GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+    None
+  };
+  glx_context = glXCreateContextAttribsARB(x11_display, fbc[0], NULL, 1, context_attributes);
+  XFree(fbc);
+
+  if (!glx_pbuffer || !glx_context || !glXMakeCurrent(x11_display, glx_pbuffer, glx_context)) {
+    printf("[FATAL] Failed to create an offscreen GLX context\n");
+    return 1;
+  }
+
+  if (!gladLoaderLoadGL()) {
+    printf("[FATAL] Failed to load GL\n");
+    return 1;
+  }
+
+  ZephrOffscreen *offscreen = &zephr_ctx->offscreen;
+  glGenFramebuffers(2, offscreen->fbos);
+  glGenRenderbuffers(2, offscreen->rbos);
+  for (u32 i = 0; i < 2; i++) {
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreen->rbos[i]);
+    // same MSAA as the window
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, i == 0 ? 4 : 0, GL_RGBA8, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreen->fbos[i]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen->rbos[i]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      printf("[FATAL] Failed to create a %dx%d framebuffer\n", width, height);
+      return 1;
+    }
+  }
+
+  glGenBuffers(ZEPHR_READBACK_FRAMES, offscreen->pbos);
+  for (u32 i = 0; i < ZEPHR_READBACK_FRAMES; i++) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbos[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  offscreen->mapped = -1;
+  offscreen->active = true;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, offscreen->fbos[0]);
+  glEnable(GL_BLEND);
+  glEnable(GL_MULTISAMPLE);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glViewport(0, 0, width, height);
+  glClearColor(0, 0, 0, 1);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  return 0;
+}
+
 void x11_close(void) {
   glXMakeCurrent(x11_display, 0, 0);
   glXDestroyContext(x11_display, glx_context);
 
-  XDestroyWindow(x11_display, x11_window);
-  XFreeColormap(x11_display, x11_colormap);
+  if (zephr_ctx->offscreen.active) {
+    glXDestroyPbuffer(x11_display, glx_pbuffer);
+  } else {
+    XDestroyWindow(x11_display, x11_window);
+    XFreeColormap(x11_display, x11_colormap);
+  }
   XCloseDisplay(x11_display);
 
   gladLoaderUnloadGLX();
@@ -840,9 +936,28 @@ void zephr_init(const char* font_path, const char* icon_path, const char* window
   start_internal_timer();
 }
 
+void zephr_init_offscreen(const char* font_path, Size size) {
+  zephr_ctx = calloc(1, sizeof(ZephrContext));
+
+  int res = x11_create_offscreen(size.width, size.height);
+  CORE_ASSERT(res == 0, "Failed to initialize offscreen rendering");
+
+  res = init_ui(font_path);
+  CORE_ASSERT(res == 0, "Failed to initialize UI");
+
+  zephr_ctx->window.size = size;
+  zephr_ctx->window.non_resizable = true;
+  zephr_ctx->projection = orthographic_projection_2d(0.f, size.width, size.height, 0.f);
+
+  start_internal_timer();
+}
+
 void zephr_deinit(void) {
+  bool offscreen = zephr_ctx->offscreen.active;
   x11_close();
-  audio_close();
+  if (!offscreen) {
+    audio_close();
+  }
 }
 
 bool zephr_should_quit(void) {
@@ -868,11 +983,77 @@ void zephr_swap_buffers(void) {
     draw_color_picker_popup(&zephr_ctx->ui.popup_parent_constraints);
   }
   zephr_ctx->ui.popup_open = false;
+  flush_quad_batch();
 
   glXSwapBuffers(x11_display, x11_window);
   XDefineCursor(x11_display, x11_window, zephr_ctx->cursors[zephr_ctx->cursor]);
 }
 
+static void unmap_frame(ZephrOffscreen *offscreen) {
+  if (offscreen->mapped >= 0) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbos[offscreen->mapped]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    offscreen->mapped = -1;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+static const u8 *map_oldest_frame(ZephrOffscreen *offscreen) {
+  u32 slot = offscreen->first;
+  glClientWaitSync(offscreen->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(offscreen->fences[slot]);
+
+  Size size = zephr_ctx->window.size;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbos[slot]);
+  const u8 *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)size.width * size.height * 4, GL_MAP_READ_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  offscreen->mapped = (i32)slot;
+  offscreen->first = (slot + 1) % ZEPHR_READBACK_FRAMES;
+  offscreen->in_flight--;
+
+  return pixels;
+}
+
+const u8 *zephr_read_frame(void) {
+  CORE_DEBUG_ASSERT(zephr_ctx && zephr_ctx->offscreen.active, "Offscreen context not initialized");
+  ZephrOffscreen *offscreen = &zephr_ctx->offscreen;
+  Size size = zephr_ctx->window.size;
+
+  flush_quad_batch();
+  // the pixel buffer handed out last is the one this frame goes to
+  unmap_frame(offscreen);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen->fbos[0]);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, offscreen->fbos[1]);
+  glBlitFramebuffer(0, 0, size.width, size.height, 0, 0, size.width, size.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+  // returns right away, the copy lands in the pixel buffer when the GPU gets
+  // to it
+  u32 slot = (offscreen->first + offscreen->in_flight) % ZEPHR_READBACK_FRAMES;
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen->fbos[1]);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbos[slot]);
+  glReadPixels(0, 0, size.width, size.height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  offscreen->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  offscreen->in_flight++;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, offscreen->fbos[0]);
+  glClearColor(0, 0, 0, 1);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  if (offscreen->in_flight < ZEPHR_READBACK_FRAMES) return NULL;
+  return map_oldest_frame(offscreen);
+}
+
+const u8 *zephr_flush_frame(void) {
+  ZephrOffscreen *offscreen = &zephr_ctx->offscreen;
+  unmap_frame(offscreen);
+
+  if (offscreen->in_flight == 0) return NULL;
+  return map_oldest_frame(offscreen);
+}
+
 Size zephr_get_window_size(void) {
   return zephr_ctx->window.size;
 }
@@ -373,6 +373,25 @@ typedef struct ZephrMouse {
   ZephrMouseButton button;
 } ZephrMouse;
 
+// Frames an offscreen context reads back at once. A frame is returned this
+// many frames minus one after it's drawn, by then the copy is long done and
+// mapping it doesn't stall.
+#define ZEPHR_READBACK_FRAMES 3
+
+typedef struct ZephrOffscreen {
+  bool active;
+  // multisampled framebuffer drawn to and the one it's resolved to
+  GLuint fbos[2];
+  GLuint rbos[2];
+  GLuint pbos[ZEPHR_READBACK_FRAMES];
+  GLsync fences[ZEPHR_READBACK_FRAMES];
+  // oldest frame being read back and how many are
+  u32 first;
+  u32 in_flight;
+  // the pixel buffer handed out by the last read, until the next one
+  i32 mapped;
+} ZephrOffscreen;
+
 typedef struct ZephrContext {
   Atom window_delete_atom;
   bool should_quit;
@@ -383,6 +402,7 @@ typedef struct ZephrContext {
   ZephrCursor cursor;
   ZephrCursor cursors[ZEPHR_CURSOR_COUNT];
   UI ui;
+  ZephrOffscreen offscreen;
 
   /* ZephrKeyboard keyboard; */
   /* XkbDescPtr xkb; */
@@ -394,7 +414,18 @@ typedef struct ZephrContext {
 } ZephrContext;
 
 void zephr_init(const char* font_path, const char* icon_path, const char* window_title, Size window_size, bool window_non_resizable);
+// Like zephr_init() but draws to a framebuffer of `size` instead of a window,
+// for rendering as fast as the GPU goes. There's no audio and no events,
+// frames are taken with zephr_read_frame() instead of swapping buffers.
+void zephr_init_offscreen(const char* font_path, Size size);
 void zephr_deinit(void);
+// Ends an offscreen frame, starts copying it back and clears the next one.
+// Returns the RGBA pixels, bottom row first, of the frame ended
+// ZEPHR_READBACK_FRAMES - 1 frames earlier, or NULL while the first frames are
+// still being copied. The pixels are valid until the next call.
+const u8 *zephr_read_frame(void);
+// Returns the frames still being copied one per call, NULL once all are.
+const u8 *zephr_flush_frame(void);
 bool zephr_should_quit(void);
 void zephr_swap_buffers(void);
 Size zephr_get_window_size(void);